@@ -2,5 +2,5 @@
 cd shaders
 call compile.bat
 cd ..
-clang  -Iinclude -Llib -I%VULKAN_SDK%/Include -L%VULKAN_SDK%/Lib vulkan.c -lglfw3 -lgdi32 -lvulkan-1 -luser32 -lshell32 -o Vulkan.exe
+clang -DSHADER_HOT_RELOAD -DSHADER_BUNDLE -Iinclude -Llib -I%VULKAN_SDK%/Include -L%VULKAN_SDK%/Lib vulkan.c -lglfw3 -lgdi32 -lvulkan-1 -luser32 -lshell32 -o Vulkan.exe
 vulkan
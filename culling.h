@@ -0,0 +1,316 @@
+#pragma once
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CULL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define CULL_NEON
+#include <arm_neon.h>
+#endif
+
+// CPU view culling of axis-aligned bounding boxes stored as a structure of arrays, so the SIMD
+// kernels test 4 (SSE, NEON) or 8 (AVX) boxes per instruction. A box is visible when it is
+// not entirely outside any of the planes. Visible indices are written out compacted without
+// branching on the result: every lane is stored and the output position only advances for
+// visible ones, so the output needs CULL_BATCH entries of slack.
+#define CULL_BATCH 8
+#define CULL_MAX_PLANES 6
+
+// Points p with dot(normal, p) + distance >= 0 are inside.
+struct CullPlane {
+    float normal[2];
+    float distance;
+};
+
+struct CullBounds {
+    float* centerX;
+    float* centerY;
+    // Half the size of the box along each axis.
+    float* extentX;
+    float* extentY;
+    uint32_t count;
+    // Allocations hold CULL_BATCH more, the kernels read whole batches past the last box.
+    uint32_t capacity;
+};
+
+enum CullKernel {
+    CULL_KERNEL_SCALAR = 0,
+    CULL_KERNEL_SSE,
+    CULL_KERNEL_AVX,
+    CULL_KERNEL_NEON,
+    CULL_KERNEL_COUNT
+};
+
+const char* cullKernelNames[CULL_KERNEL_COUNT] = {"scalar", "sse", "avx", "neon"};
+
+#if defined(CULL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CULL_TARGET_AVX __attribute__((target("avx")))
+#else
+#define CULL_TARGET_AVX
+#endif
+
+// Needs both the instructions and the OS saving the registers.
+bool cullAvxSupported() {
+#ifdef CULL_X86
+    uint32_t ecx;
+#if defined(_MSC_VER) && !defined(__clang__)
+    int registers[4];
+    __cpuid(registers, 1);
+    ecx = (uint32_t)registers[2];
+#else
+    uint32_t eax, ebx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+#endif
+    bool osxsave = (ecx >> 27) & 1;
+    bool avx = (ecx >> 28) & 1;
+    if(!osxsave || !avx) {
+        return false;
+    }
+#if defined(_MSC_VER) && !defined(__clang__)
+    uint64_t enabledState = _xgetbv(0);
+#else
+    uint32_t stateLow, stateHigh;
+    __asm__("xgetbv" : "=a"(stateLow), "=d"(stateHigh) : "c"(0));
+    uint64_t enabledState = ((uint64_t)stateHigh << 32) | stateLow;
+#endif
+    // XMM and YMM state.
+    return (enabledState & 6) == 6;
+#else
+    return false;
+#endif
+}
+
+bool cullKernelSupported(enum CullKernel kernel) {
+    switch(kernel) {
+    case CULL_KERNEL_SCALAR:
+        return true;
+#ifdef CULL_X86
+    case CULL_KERNEL_SSE:
+        return true;
+    case CULL_KERNEL_AVX:
+        return cullAvxSupported();
+#endif
+#ifdef CULL_NEON
+    case CULL_KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+enum CullKernel cullBestKernel() {
+    if(cullKernelSupported(CULL_KERNEL_AVX)) return CULL_KERNEL_AVX;
+    if(cullKernelSupported(CULL_KERNEL_SSE)) return CULL_KERNEL_SSE;
+    if(cullKernelSupported(CULL_KERNEL_NEON)) return CULL_KERNEL_NEON;
+    return CULL_KERNEL_SCALAR;
+}
+
+// Keeps the first count boxes.
+bool cullBoundsReserve(struct CullBounds* bounds, uint32_t capacity) {
+    if(capacity <= bounds->capacity) {
+        return true;
+    }
+    float** arrays[] = {&bounds->centerX, &bounds->centerY, &bounds->extentX, &bounds->extentY};
+    for(uint32_t i = 0; i < 4; i++) {
+        float* grown = realloc(*arrays[i], ((size_t)capacity + CULL_BATCH) * sizeof(float));
+        if(!grown) {
+            return false;
+        }
+        *arrays[i] = grown;
+    }
+    bounds->capacity = capacity;
+    return true;
+}
+
+void cullBoundsFree(struct CullBounds* bounds) {
+    free(bounds->centerX);
+    free(bounds->centerY);
+    free(bounds->extentX);
+    free(bounds->extentY);
+    memset(bounds, 0, sizeof(*bounds));
+}
+
+// Kernels: each culls boxes [first, first + count) and returns how many indices it wrote.
+
+uint32_t cullScalar(const struct CullBounds* bounds, uint32_t first, uint32_t count,
+                    const struct CullPlane* planes, uint32_t planeCount, uint32_t* visible) {
+    uint32_t visibleCount = 0;
+    for(uint32_t i = first; i < first + count; i++) {
+        bool inside = true;
+        for(uint32_t p = 0; p < planeCount; p++) {
+            const struct CullPlane* plane = &planes[p];
+            float distance = plane->normal[0] * bounds->centerX[i] +
+                             plane->normal[1] * bounds->centerY[i] + plane->distance +
+                             fabsf(plane->normal[0]) * bounds->extentX[i] +
+                             fabsf(plane->normal[1]) * bounds->extentY[i];
+            inside &= distance >= 0.0f;
+        }
+        visible[visibleCount] = i;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+#ifdef CULL_X86
+uint32_t cullSse(const struct CullBounds* bounds, uint32_t first, uint32_t count,
+                 const struct CullPlane* planes, uint32_t planeCount, uint32_t* visible) {
+    __m128 normalX[CULL_MAX_PLANES], normalY[CULL_MAX_PLANES], distance[CULL_MAX_PLANES];
+    __m128 absNormalX[CULL_MAX_PLANES], absNormalY[CULL_MAX_PLANES];
+    for(uint32_t p = 0; p < planeCount; p++) {
+        normalX[p] = _mm_set1_ps(planes[p].normal[0]);
+        normalY[p] = _mm_set1_ps(planes[p].normal[1]);
+        absNormalX[p] = _mm_set1_ps(fabsf(planes[p].normal[0]));
+        absNormalY[p] = _mm_set1_ps(fabsf(planes[p].normal[1]));
+        distance[p] = _mm_set1_ps(planes[p].distance);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    uint32_t visibleCount = 0;
+    for(uint32_t i = first; i < first + count; i += 4) {
+        __m128 centerX = _mm_loadu_ps(bounds->centerX + i);
+        __m128 centerY = _mm_loadu_ps(bounds->centerY + i);
+        __m128 extentX = _mm_loadu_ps(bounds->extentX + i);
+        __m128 extentY = _mm_loadu_ps(bounds->extentY + i);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(uint32_t p = 0; p < planeCount; p++) {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[p], centerX),
+                                             _mm_mul_ps(normalY[p], centerY)),
+                                  _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormalX[p], extentX),
+                                                        _mm_mul_ps(absNormalY[p], extentY)),
+                                             distance[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+        }
+        uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+        uint32_t remaining = first + count - i;
+        if(remaining < 4) {
+            mask &= (1u << remaining) - 1;
+        }
+        for(uint32_t lane = 0; lane < 4; lane++) {
+            visible[visibleCount] = i + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+    return visibleCount;
+}
+
+CULL_TARGET_AVX
+uint32_t cullAvx(const struct CullBounds* bounds, uint32_t first, uint32_t count,
+                 const struct CullPlane* planes, uint32_t planeCount, uint32_t* visible) {
+    __m256 normalX[CULL_MAX_PLANES], normalY[CULL_MAX_PLANES], distance[CULL_MAX_PLANES];
+    __m256 absNormalX[CULL_MAX_PLANES], absNormalY[CULL_MAX_PLANES];
+    for(uint32_t p = 0; p < planeCount; p++) {
+        normalX[p] = _mm256_set1_ps(planes[p].normal[0]);
+        normalY[p] = _mm256_set1_ps(planes[p].normal[1]);
+        absNormalX[p] = _mm256_set1_ps(fabsf(planes[p].normal[0]));
+        absNormalY[p] = _mm256_set1_ps(fabsf(planes[p].normal[1]));
+        distance[p] = _mm256_set1_ps(planes[p].distance);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+    uint32_t visibleCount = 0;
+    for(uint32_t i = first; i < first + count; i += 8) {
+        __m256 centerX = _mm256_loadu_ps(bounds->centerX + i);
+        __m256 centerY = _mm256_loadu_ps(bounds->centerY + i);
+        __m256 extentX = _mm256_loadu_ps(bounds->extentX + i);
+        __m256 extentY = _mm256_loadu_ps(bounds->extentY + i);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(uint32_t p = 0; p < planeCount; p++) {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normalX[p], centerX),
+                                                   _mm256_mul_ps(normalY[p], centerY)),
+                                     _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absNormalX[p], extentX),
+                                                                 _mm256_mul_ps(absNormalY[p], extentY)),
+                                                   distance[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+        }
+        uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+        uint32_t remaining = first + count - i;
+        if(remaining < 8) {
+            mask &= (1u << remaining) - 1;
+        }
+        for(uint32_t lane = 0; lane < 8; lane++) {
+            visible[visibleCount] = i + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+    return visibleCount;
+}
+#endif
+
+#ifdef CULL_NEON
+uint32_t cullNeon(const struct CullBounds* bounds, uint32_t first, uint32_t count,
+                  const struct CullPlane* planes, uint32_t planeCount, uint32_t* visible) {
+    float32x4_t normalX[CULL_MAX_PLANES], normalY[CULL_MAX_PLANES], distance[CULL_MAX_PLANES];
+    float32x4_t absNormalX[CULL_MAX_PLANES], absNormalY[CULL_MAX_PLANES];
+    for(uint32_t p = 0; p < planeCount; p++) {
+        normalX[p] = vdupq_n_f32(planes[p].normal[0]);
+        normalY[p] = vdupq_n_f32(planes[p].normal[1]);
+        absNormalX[p] = vdupq_n_f32(fabsf(planes[p].normal[0]));
+        absNormalY[p] = vdupq_n_f32(fabsf(planes[p].normal[1]));
+        distance[p] = vdupq_n_f32(planes[p].distance);
+    }
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    // Lane i keeps bit i of the visibility mask.
+    const uint32_t laneBitValues[4] = {1, 2, 4, 8};
+    const uint32x4_t laneBits = vld1q_u32(laneBitValues);
+    uint32_t visibleCount = 0;
+    for(uint32_t i = first; i < first + count; i += 4) {
+        float32x4_t centerX = vld1q_f32(bounds->centerX + i);
+        float32x4_t centerY = vld1q_f32(bounds->centerY + i);
+        float32x4_t extentX = vld1q_f32(bounds->extentX + i);
+        float32x4_t extentY = vld1q_f32(bounds->extentY + i);
+        uint32x4_t inside = vdupq_n_u32(UINT32_MAX);
+        for(uint32_t p = 0; p < planeCount; p++) {
+            float32x4_t d = vaddq_f32(vaddq_f32(vmulq_f32(normalX[p], centerX),
+                                                vmulq_f32(normalY[p], centerY)),
+                                      vaddq_f32(vaddq_f32(vmulq_f32(absNormalX[p], extentX),
+                                                          vmulq_f32(absNormalY[p], extentY)),
+                                                distance[p]));
+            inside = vandq_u32(inside, vcgeq_f32(d, zero));
+        }
+        uint32x4_t bits = vandq_u32(inside, laneBits);
+        uint32x2_t pairs = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+        uint32_t mask = vget_lane_u32(vpadd_u32(pairs, pairs), 0);
+        uint32_t remaining = first + count - i;
+        if(remaining < 4) {
+            mask &= (1u << remaining) - 1;
+        }
+        for(uint32_t lane = 0; lane < 4; lane++) {
+            visible[visibleCount] = i + lane;
+            visibleCount += (mask >> lane) & 1;
+        }
+    }
+    return visibleCount;
+}
+#endif
+
+// Culls boxes [first, first + count) of bounds against up to CULL_MAX_PLANES planes and
+// writes the indices of the visible ones to visible, which needs room for count +
+// CULL_BATCH. Returns how many are visible. Unsupported kernels fall back to scalar.
+uint32_t cullBoxes(enum CullKernel kernel, const struct CullBounds* bounds, uint32_t first,
+                   uint32_t count, const struct CullPlane* planes, uint32_t planeCount,
+                   uint32_t* visible) {
+    switch(kernel) {
+#ifdef CULL_X86
+    case CULL_KERNEL_SSE:
+        return cullSse(bounds, first, count, planes, planeCount, visible);
+    case CULL_KERNEL_AVX:
+        return cullAvx(bounds, first, count, planes, planeCount, visible);
+#endif
+#ifdef CULL_NEON
+    case CULL_KERNEL_NEON:
+        return cullNeon(bounds, first, count, planes, planeCount, visible);
+#endif
+    default:
+        return cullScalar(bounds, first, count, planes, planeCount, visible);
+    }
+}
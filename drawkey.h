@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// 64-bit draw keys. Fields are packed most significant first, so sorting the keys orders draws
+// by pass, then pipeline, then material and last depth. Draws whose keys share everything above
+// the depth share all their state, so state only has to change where that prefix does.
+#define DRAW_KEY_DEPTH_BITS 32
+#define DRAW_KEY_MATERIAL_BITS 20
+#define DRAW_KEY_PIPELINE_BITS 8
+#define DRAW_KEY_PASS_BITS 4
+#define DRAW_KEY_MATERIAL_SHIFT DRAW_KEY_DEPTH_BITS
+#define DRAW_KEY_PIPELINE_SHIFT (DRAW_KEY_MATERIAL_SHIFT + DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_PASS_SHIFT (DRAW_KEY_PIPELINE_SHIFT + DRAW_KEY_PIPELINE_BITS)
+#define DRAW_KEY_STATE_MASK (~(uint64_t)0 << DRAW_KEY_DEPTH_BITS)
+#define DRAW_KEY_MAX_MATERIALS (1u << DRAW_KEY_MATERIAL_BITS)
+#define DRAW_KEY_MAX_PIPELINES (1u << DRAW_KEY_PIPELINE_BITS)
+#define DRAW_KEY_MAX_PASSES (1u << DRAW_KEY_PASS_BITS)
+#define RADIX_SORT_BITS 8
+#define RADIX_SORT_BUCKETS (1 << RADIX_SORT_BITS)
+#define RADIX_SORT_PASSES (64 / RADIX_SORT_BITS)
+
+// Fields past their bit counts are cut off.
+uint64_t drawKeyMake(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t depth) {
+    return ((uint64_t)(pass & (DRAW_KEY_MAX_PASSES - 1)) << DRAW_KEY_PASS_SHIFT) |
+           ((uint64_t)(pipeline & (DRAW_KEY_MAX_PIPELINES - 1)) << DRAW_KEY_PIPELINE_SHIFT) |
+           ((uint64_t)(material & (DRAW_KEY_MAX_MATERIALS - 1)) << DRAW_KEY_MATERIAL_SHIFT) |
+           depth;
+}
+
+uint32_t drawKeyPipeline(uint64_t key) {
+    return (uint32_t)(key >> DRAW_KEY_PIPELINE_SHIFT) & (DRAW_KEY_MAX_PIPELINES - 1);
+}
+
+uint32_t drawKeyMaterial(uint64_t key) {
+    return (uint32_t)(key >> DRAW_KEY_MATERIAL_SHIFT) & (DRAW_KEY_MAX_MATERIALS - 1);
+}
+
+// Maps a float to bits that sort as unsigned integers in the same order as the floats:
+// positive floats get the sign bit set, negative ones are flipped entirely.
+uint32_t drawKeyDepth(float depth) {
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+// Stable LSD radix sort of keys, moving values along, one byte per pass. All byte histograms
+// come from a single read of the keys, and passes whose byte is the same in every key are
+// skipped, so keys that only use their low bits cost a pass or two. The scratch arrays hold
+// count entries each. The result ends up back in keys and values.
+void radixSortKeys(uint64_t* keys, uint32_t* values, uint32_t count, uint64_t* scratchKeys,
+                   uint32_t* scratchValues) {
+    uint32_t histograms[RADIX_SORT_PASSES][RADIX_SORT_BUCKETS] = {};
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t key = keys[i];
+        for(uint32_t pass = 0; pass < RADIX_SORT_PASSES; pass++) {
+            histograms[pass][(key >> (pass * RADIX_SORT_BITS)) & (RADIX_SORT_BUCKETS - 1)]++;
+        }
+    }
+    uint64_t* sourceKeys = keys;
+    uint32_t* sourceValues = values;
+    uint64_t* destinationKeys = scratchKeys;
+    uint32_t* destinationValues = scratchValues;
+    for(uint32_t pass = 0; pass < RADIX_SORT_PASSES; pass++) {
+        uint32_t* histogram = histograms[pass];
+        uint32_t shift = pass * RADIX_SORT_BITS;
+        if(count == 0 || histogram[(sourceKeys[0] >> shift) & (RADIX_SORT_BUCKETS - 1)] == count) {
+            continue;
+        }
+        uint32_t offset = 0;
+        for(uint32_t bucket = 0; bucket < RADIX_SORT_BUCKETS; bucket++) {
+            uint32_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+        for(uint32_t i = 0; i < count; i++) {
+            uint32_t position = histogram[(sourceKeys[i] >> shift) & (RADIX_SORT_BUCKETS - 1)]++;
+            destinationKeys[position] = sourceKeys[i];
+            destinationValues[position] = sourceValues[i];
+        }
+        uint64_t* swapKeys = sourceKeys;
+        sourceKeys = destinationKeys;
+        destinationKeys = swapKeys;
+        uint32_t* swapValues = sourceValues;
+        sourceValues = destinationValues;
+        destinationValues = swapValues;
+    }
+    if(sourceKeys != keys) {
+        memcpy(keys, sourceKeys, (size_t)count * sizeof(uint64_t));
+        memcpy(values, sourceValues, (size_t)count * sizeof(uint32_t));
+    }
+}
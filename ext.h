@@ -23,3 +23,14 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
         func(instance, debugMessenger, pAllocator);
     }
 }
+
+// VK_EXT_shader_module_identifier, leaves identifierSize at 0 when the function is missing.
+void GetShaderModuleIdentifierEXT(VkDevice device, VkShaderModule shaderModule,
+    VkShaderModuleIdentifierEXT* pIdentifier) {
+    PFN_vkGetShaderModuleIdentifierEXT func = (PFN_vkGetShaderModuleIdentifierEXT)
+        vkGetDeviceProcAddr(device, "vkGetShaderModuleIdentifierEXT");
+    pIdentifier->identifierSize = 0;
+    if(func != NULL) {
+        func(device, shaderModule, pIdentifier);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a, used to identify SPIR-V and other binary blobs by content.
+#define HASH64_SEED 0xcbf29ce484222325ULL
+
+uint64_t hashBytes64Seeded(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = seed;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t hashBytes64(const void* data, size_t size) {
+    return hashBytes64Seeded(data, size, HASH64_SEED);
+}
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 uint32_t clamp(uint32_t a, uint32_t min, uint32_t max) {
@@ -13,13 +14,20 @@ uint32_t clamp(uint32_t a, uint32_t min, uint32_t max) {
 
 #include <stdlib.h>
 
-char* readFile(const char* filename, uint32_t* size) {
+// Returns NULL instead of aborting when the file cannot be read.
+char* tryReadFile(const char* filename, uint32_t* size) {
     FILE* file;
+#ifdef _WIN32
     errno_t err = fopen_s(&file, filename, "rb");
     if (err != 0 || !file) {
-        perror("failed to open file");
-        exit(EXIT_FAILURE);
+        return NULL;
+    }
+#else
+    file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
     }
+#endif
 
     // Seek to the end of the file
     fseek(file, 0, SEEK_END);
@@ -33,12 +41,16 @@ char* readFile(const char* filename, uint32_t* size) {
     // Allocate a buffer to hold the contents of the file
     char* buffer = (char*)malloc(fileSize);
     if (!buffer) {
-        perror("failed to allocate buffer");
-        exit(EXIT_FAILURE);
+        fclose(file);
+        return NULL;
     }
 
     // Read the contents of the file into the buffer
-    fread(buffer, 1, fileSize, file);
+    if (fread(buffer, 1, fileSize, file) != (size_t)fileSize) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
 
     // Close the file
     fclose(file);
@@ -46,3 +58,30 @@ char* readFile(const char* filename, uint32_t* size) {
     return buffer;
 }
 
+char* readFile(const char* filename, uint32_t* size) {
+    char* buffer = tryReadFile(filename, size);
+    if (!buffer) {
+        perror("failed to read file");
+        exit(EXIT_FAILURE);
+    }
+    return buffer;
+}
+
+// Returns false instead of aborting when the file cannot be written.
+bool writeFile(const char* filename, const void* data, size_t size) {
+    FILE* file;
+#ifdef _WIN32
+    errno_t err = fopen_s(&file, filename, "wb");
+    if (err != 0 || !file) {
+        return false;
+    }
+#else
+    file = fopen(filename, "wb");
+    if (!file) {
+        return false;
+    }
+#endif
+    bool written = fwrite(data, 1, size, file) == size;
+    fclose(file);
+    return written;
+}
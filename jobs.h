@@ -0,0 +1,421 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Work-stealing jobs. A job runs function(context, index) for a range of indices. Every worker
+// has a deque of its own: it pushes and pops jobs at the bottom, idle workers steal from the
+// top of the others. Running a job hands the upper half of its range back to the deque until
+// a single index is left, so a large range spreads over the workers by being stolen half by
+// half, while a worker nobody steals from works through it in order. Callers pick what an
+// index covers; indices are not worth splitting below a few microseconds of work.
+//
+// Dependencies are counters: jobRun() adds the job's index count to its counter and every
+// finished index takes one off. jobRunAfter() holds a job back until another counter drops to
+// zero, and jobWait() returns once one does. The thread that created the system is worker 0
+// and has no thread of its own, it runs jobs while it waits, and so does any job that waits.
+// Idle workers spin for a while, then sleep until a job is pushed.
+//
+// The deques are short lists behind a spin lock rather than lock-free: the owner is nearly
+// always alone on its lock, and a full deque only means the pusher runs the job itself.
+#define JOB_MAX_WORKERS 64
+// A power of two.
+#define JOB_DEQUE_CAPACITY 1024
+#define JOB_MAX_WAITING 64
+#define JOB_SPIN_COUNT 64
+
+typedef void (*JobFunction)(void* context, uint32_t index);
+
+// Zero when nothing counted on it is left. Lives until everything counted on it is done.
+struct JobCounter {
+    atomic_uint pending;
+};
+
+struct Job {
+    JobFunction function;
+    void* context;
+    uint32_t first;
+    uint32_t end;
+    struct JobCounter* counter;
+};
+
+struct JobDeque {
+    atomic_flag lock;
+    uint32_t top;
+    uint32_t bottom;
+    struct Job jobs[JOB_DEQUE_CAPACITY];
+};
+
+struct JobWaiting {
+    struct JobCounter* dependency;
+    struct Job job;
+};
+
+struct JobSystem;
+
+struct JobWorkerStart {
+    struct JobSystem* jobs;
+    uint32_t index;
+};
+
+struct JobSystem {
+    uint32_t workerCount;
+    struct JobDeque* deques;
+    // Jobs in all deques, which sleeping workers wait for.
+    atomic_uint queued;
+    atomic_uint sleeping;
+    atomic_bool stop;
+    atomic_uint steals;
+    // Guarded by mutex, waitingCount is also read without it.
+    struct JobWaiting waiting[JOB_MAX_WAITING];
+    atomic_uint waitingCount;
+    struct JobWorkerStart starts[JOB_MAX_WORKERS];
+#ifdef _WIN32
+    SRWLOCK mutex;
+    CONDITION_VARIABLE wake;
+    HANDLE threads[JOB_MAX_WORKERS];
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    pthread_t threads[JOB_MAX_WORKERS];
+#endif
+};
+
+_Thread_local uint32_t jobWorkerIndex;
+
+// The calling thread's worker, 0 for threads the system did not start.
+uint32_t jobWorker() {
+    return jobWorkerIndex;
+}
+
+void jobYield() {
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void jobMutexLock(struct JobSystem* jobs) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&jobs->mutex);
+#else
+    pthread_mutex_lock(&jobs->mutex);
+#endif
+}
+
+void jobMutexUnlock(struct JobSystem* jobs) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&jobs->mutex);
+#else
+    pthread_mutex_unlock(&jobs->mutex);
+#endif
+}
+
+void jobDequeLock(struct JobDeque* deque) {
+    uint32_t spins = 0;
+    while(atomic_flag_test_and_set_explicit(&deque->lock, memory_order_acquire)) {
+        if(++spins == JOB_SPIN_COUNT) {
+            spins = 0;
+            jobYield();
+        }
+    }
+}
+
+void jobDequeUnlock(struct JobDeque* deque) {
+    atomic_flag_clear_explicit(&deque->lock, memory_order_release);
+}
+
+void jobExecute(struct JobSystem* jobs, struct Job job);
+
+// Onto the calling worker's deque. Returns false when it is full.
+bool jobPush(struct JobSystem* jobs, const struct Job* job) {
+    struct JobDeque* deque = &jobs->deques[jobWorkerIndex < jobs->workerCount ? jobWorkerIndex : 0];
+    jobDequeLock(deque);
+    if(deque->bottom - deque->top == JOB_DEQUE_CAPACITY) {
+        jobDequeUnlock(deque);
+        return false;
+    }
+    deque->jobs[deque->bottom & (JOB_DEQUE_CAPACITY - 1)] = *job;
+    deque->bottom++;
+    // Counted before it can be taken, so the count never drops below the jobs in the deques.
+    atomic_fetch_add(&jobs->queued, 1);
+    jobDequeUnlock(deque);
+    // A worker about to sleep counts itself before it checks queued, so one of the two sees
+    // the other.
+    if(atomic_load(&jobs->sleeping) > 0) {
+        jobMutexLock(jobs);
+#ifdef _WIN32
+        WakeConditionVariable(&jobs->wake);
+#else
+        pthread_cond_signal(&jobs->wake);
+#endif
+        jobMutexUnlock(jobs);
+    }
+    return true;
+}
+
+// The newest job of the calling worker, then the oldest of any other.
+bool jobTake(struct JobSystem* jobs, struct Job* job) {
+    uint32_t self = jobWorkerIndex < jobs->workerCount ? jobWorkerIndex : 0;
+    struct JobDeque* deque = &jobs->deques[self];
+    jobDequeLock(deque);
+    if(deque->bottom != deque->top) {
+        deque->bottom--;
+        *job = deque->jobs[deque->bottom & (JOB_DEQUE_CAPACITY - 1)];
+        jobDequeUnlock(deque);
+        atomic_fetch_sub(&jobs->queued, 1);
+        return true;
+    }
+    jobDequeUnlock(deque);
+    if(atomic_load(&jobs->queued) == 0) {
+        return false;
+    }
+    for(uint32_t i = 1; i < jobs->workerCount; i++) {
+        struct JobDeque* victim = &jobs->deques[(self + i) % jobs->workerCount];
+        // A busy deque is skipped rather than waited for, its owner is likely taking from it.
+        if(atomic_flag_test_and_set_explicit(&victim->lock, memory_order_acquire)) {
+            continue;
+        }
+        if(victim->bottom != victim->top) {
+            *job = victim->jobs[victim->top & (JOB_DEQUE_CAPACITY - 1)];
+            victim->top++;
+            jobDequeUnlock(victim);
+            atomic_fetch_sub(&jobs->queued, 1);
+            atomic_fetch_add(&jobs->steals, 1);
+            return true;
+        }
+        jobDequeUnlock(victim);
+    }
+    return false;
+}
+
+// Pushes the held back jobs whose dependency dropped to zero.
+void jobReleaseWaiting(struct JobSystem* jobs) {
+    struct Job ready[JOB_MAX_WAITING];
+    uint32_t readyCount = 0;
+    jobMutexLock(jobs);
+    uint32_t count = atomic_load(&jobs->waitingCount);
+    for(uint32_t i = 0; i < count; ) {
+        if(atomic_load(&jobs->waiting[i].dependency->pending) == 0) {
+            ready[readyCount++] = jobs->waiting[i].job;
+            jobs->waiting[i] = jobs->waiting[--count];
+        } else {
+            i++;
+        }
+    }
+    atomic_store(&jobs->waitingCount, count);
+    jobMutexUnlock(jobs);
+    for(uint32_t i = 0; i < readyCount; i++) {
+        if(!jobPush(jobs, &ready[i])) {
+            jobExecute(jobs, ready[i]);
+        }
+    }
+}
+
+void jobFinish(struct JobSystem* jobs, struct JobCounter* counter, uint32_t count) {
+    if(counter && atomic_fetch_sub(&counter->pending, count) == count &&
+       atomic_load(&jobs->waitingCount) > 0) {
+        jobReleaseWaiting(jobs);
+    }
+}
+
+void jobExecute(struct JobSystem* jobs, struct Job job) {
+    while(job.end - job.first > 1) {
+        struct Job upper = job;
+        upper.first = job.first + (job.end - job.first) / 2;
+        if(!jobPush(jobs, &upper)) {
+            break;
+        }
+        job.end = upper.first;
+    }
+    for(uint32_t i = job.first; i < job.end; i++) {
+        job.function(job.context, i);
+    }
+    jobFinish(jobs, job.counter, job.end - job.first);
+}
+
+// Runs one job if there is one.
+bool jobTryRun(struct JobSystem* jobs) {
+    struct Job job;
+    if(!jobTake(jobs, &job)) {
+        return false;
+    }
+    jobExecute(jobs, job);
+    return true;
+}
+
+// Runs function(context, i) for every i below count. counter may be NULL.
+void jobRun(struct JobSystem* jobs, JobFunction function, void* context, uint32_t count,
+            struct JobCounter* counter) {
+    if(count == 0) {
+        return;
+    }
+    if(counter) {
+        atomic_fetch_add(&counter->pending, count);
+    }
+    struct Job job = {function, context, 0, count, counter};
+    if(!jobPush(jobs, &job)) {
+        jobExecute(jobs, job);
+    }
+}
+
+// Like jobRun(), but not before dependency is zero. Held back jobs are found again through
+// dependency, so it has to live until the job was released: until a jobWait() on dependency
+// or on counter returned, both of which ensure that.
+void jobRunAfter(struct JobSystem* jobs, struct JobCounter* dependency, JobFunction function,
+                 void* context, uint32_t count, struct JobCounter* counter) {
+    if(count == 0) {
+        return;
+    }
+    if(counter) {
+        atomic_fetch_add(&counter->pending, count);
+    }
+    struct Job job = {function, context, 0, count, counter};
+    jobMutexLock(jobs);
+    uint32_t waitingCount = atomic_load(&jobs->waitingCount);
+    if(waitingCount == JOB_MAX_WAITING) {
+        fprintf(stderr, "More than %u jobs wait for a dependency, aborting.", JOB_MAX_WAITING);
+        exit(EXIT_FAILURE);
+    }
+    jobs->waiting[waitingCount].dependency = dependency;
+    jobs->waiting[waitingCount].job = job;
+    // Published before the dependency is checked, jobFinish() does it the other way round.
+    atomic_store(&jobs->waitingCount, waitingCount + 1);
+    bool ready = atomic_load(&dependency->pending) == 0;
+    jobMutexUnlock(jobs);
+    if(ready) {
+        jobReleaseWaiting(jobs);
+    }
+}
+
+// Runs jobs, any jobs, until counter is zero. The jobs held back on counter are released
+// before it returns, whoever took it to zero may not have got to them yet, so no held back job
+// refers to counter anymore and it may go out of scope.
+void jobWait(struct JobSystem* jobs, struct JobCounter* counter) {
+    uint32_t idle = 0;
+    while(atomic_load(&counter->pending) > 0) {
+        if(jobTryRun(jobs)) {
+            idle = 0;
+        } else if(++idle == JOB_SPIN_COUNT) {
+            idle = 0;
+            jobYield();
+        }
+    }
+    if(atomic_load(&jobs->waitingCount) > 0) {
+        jobReleaseWaiting(jobs);
+    }
+}
+
+void jobRunAndWait(struct JobSystem* jobs, JobFunction function, void* context, uint32_t count) {
+    struct JobCounter counter = {};
+    jobRun(jobs, function, context, count, &counter);
+    jobWait(jobs, &counter);
+}
+
+#ifdef _WIN32
+DWORD WINAPI jobWorkerMain(LPVOID parameter) {
+#else
+void* jobWorkerMain(void* parameter) {
+#endif
+    struct JobWorkerStart* start = parameter;
+    struct JobSystem* jobs = start->jobs;
+    jobWorkerIndex = start->index;
+    uint32_t idle = 0;
+    while(!atomic_load(&jobs->stop)) {
+        if(jobTryRun(jobs)) {
+            idle = 0;
+            continue;
+        }
+        if(++idle < JOB_SPIN_COUNT) {
+            jobYield();
+            continue;
+        }
+        idle = 0;
+        jobMutexLock(jobs);
+        atomic_fetch_add(&jobs->sleeping, 1);
+        while(atomic_load(&jobs->queued) == 0 && !atomic_load(&jobs->stop)) {
+#ifdef _WIN32
+            SleepConditionVariableSRW(&jobs->wake, &jobs->mutex, INFINITE, 0);
+#else
+            pthread_cond_wait(&jobs->wake, &jobs->mutex);
+#endif
+        }
+        atomic_fetch_sub(&jobs->sleeping, 1);
+        jobMutexUnlock(jobs);
+    }
+    return 0;
+}
+
+// workerCount includes the calling thread, which becomes worker 0.
+void jobSystemCreate(struct JobSystem* jobs, uint32_t workerCount) {
+    if(workerCount == 0) workerCount = 1;
+    if(workerCount > JOB_MAX_WORKERS) workerCount = JOB_MAX_WORKERS;
+    memset(jobs, 0, sizeof(*jobs));
+    jobs->workerCount = workerCount;
+    jobs->deques = calloc(workerCount, sizeof(struct JobDeque));
+    if(!jobs->deques) {
+        fprintf(stderr, "Failed to allocate %u job deques, aborting.", workerCount);
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t i = 0; i < workerCount; i++) {
+        atomic_flag_clear(&jobs->deques[i].lock);
+    }
+#ifdef _WIN32
+    InitializeSRWLock(&jobs->mutex);
+    InitializeConditionVariable(&jobs->wake);
+#else
+    pthread_mutex_init(&jobs->mutex, NULL);
+    pthread_cond_init(&jobs->wake, NULL);
+#endif
+    jobWorkerIndex = 0;
+    for(uint32_t i = 1; i < workerCount; i++) {
+        jobs->starts[i].jobs = jobs;
+        jobs->starts[i].index = i;
+#ifdef _WIN32
+        jobs->threads[i] = CreateThread(NULL, 0, jobWorkerMain, &jobs->starts[i], 0, NULL);
+        if(!jobs->threads[i]) {
+#else
+        if(pthread_create(&jobs->threads[i], NULL, jobWorkerMain, &jobs->starts[i]) != 0) {
+#endif
+            fprintf(stderr, "Failed to create job worker %u, aborting.", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Everything that was run has to be waited for first.
+void jobSystemDestroy(struct JobSystem* jobs) {
+    atomic_store(&jobs->stop, true);
+    jobMutexLock(jobs);
+#ifdef _WIN32
+    WakeAllConditionVariable(&jobs->wake);
+#else
+    pthread_cond_broadcast(&jobs->wake);
+#endif
+    jobMutexUnlock(jobs);
+    for(uint32_t i = 1; i < jobs->workerCount; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(jobs->threads[i], INFINITE);
+        CloseHandle(jobs->threads[i]);
+#else
+        pthread_join(jobs->threads[i], NULL);
+#endif
+    }
+#ifndef _WIN32
+    pthread_cond_destroy(&jobs->wake);
+    pthread_mutex_destroy(&jobs->mutex);
+#endif
+    free(jobs->deques);
+    memset(jobs, 0, sizeof(*jobs));
+}
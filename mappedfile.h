@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are only read from disk when touched.
+struct MappedFile {
+    const uint8_t* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+void mappedFileClose(struct MappedFile* file) {
+#ifdef _WIN32
+    if(file->data) UnmapViewOfFile(file->data);
+    if(file->mapping) CloseHandle(file->mapping);
+    if(file->file && file->file != INVALID_HANDLE_VALUE) CloseHandle(file->file);
+#else
+    if(file->data) munmap((void*)file->data, file->size);
+#endif
+    memset(file, 0, sizeof(*file));
+}
+
+// Fails for missing and empty files.
+bool mappedFileOpen(struct MappedFile* file, const char* path) {
+    memset(file, 0, sizeof(*file));
+#ifdef _WIN32
+    file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER fileSize;
+    if(file->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->file, &fileSize) ||
+       fileSize.QuadPart == 0) {
+        mappedFileClose(file);
+        return false;
+    }
+    file->size = (size_t)fileSize.QuadPart;
+    file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!file->mapping) {
+        mappedFileClose(file);
+        return false;
+    }
+    file->data = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!file->data) {
+        mappedFileClose(file);
+        return false;
+    }
+#else
+    int descriptor = open(path, O_RDONLY);
+    if(descriptor < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if(fstat(descriptor, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(descriptor);
+        return false;
+    }
+    file->size = (size_t)fileStat.st_size;
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // The mapping keeps the file referenced.
+    close(descriptor);
+    if(data == MAP_FAILED) {
+        file->size = 0;
+        return false;
+    }
+    file->data = data;
+#endif
+    return true;
+}
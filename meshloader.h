@@ -0,0 +1,1266 @@
+#pragma once
+#include <float.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "mappedfile.h"
+#include "vertexformat.h"
+
+// Mesh import for OBJ and glTF 2.0 (.gltf with external buffers, or .glb). Files are
+// memory-mapped and converted by several threads at once into unpacked vertices and the
+// 32-bit indices the geometry pool takes:
+//   OBJ: the file is cut into chunks at line breaks. A first pass counts the vertices and
+//        triangles of every chunk, which gives each chunk its place in the output, and a
+//        second pass parses the chunks straight into it.
+//   glTF: the JSON is parsed on the calling thread, then the accessors of every primitive are
+//        split into ranges that are converted in parallel. When a file has a single
+//        primitive with tightly packed 32-bit indices those are used in place, without a copy.
+// Only positions, vertex colors and glTF normals are read, OBJ normals belong to face corners
+// rather than vertices and are left at +z. glTF node transforms are ignored, the primitives
+// of all meshes are merged as they are.
+#define MESH_LOADER_MAX_THREADS 64
+// Smaller inputs are not worth another thread.
+#define MESH_LOADER_MIN_CHUNK_SIZE (256 * 1024)
+// Vertices or indices converted per glTF task.
+#define MESH_LOADER_GLTF_TASK_SIZE (64 * 1024)
+#define MESH_LOADER_MAX_BUFFERS 16
+#define MESH_LOADER_MAX_JSON_DEPTH 64
+
+struct LoadedMesh {
+    // Either owned or inside one of the mappings, valid until meshFree().
+    const struct MeshVertex* vertices;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+    struct MeshVertex* ownedVertices;
+    uint32_t* ownedIndices;
+    // The file itself and the buffers of a .gltf.
+    struct MappedFile files[MESH_LOADER_MAX_BUFFERS + 1];
+    uint32_t fileCount;
+};
+
+struct MeshLoadOptions {
+    // 0 for one per processor.
+    uint32_t threadCount;
+    // Centers positions and scales them into [-0.5, 0.5], the extent instances expect.
+    bool normalize;
+};
+
+// Threads:
+
+typedef void (*MeshTask)(void* context, uint32_t index);
+
+struct MeshTaskRange {
+    MeshTask task;
+    void* context;
+    uint32_t first;
+    uint32_t count;
+    uint32_t stride;
+};
+
+#ifdef _WIN32
+DWORD WINAPI meshTaskWorker(LPVOID parameter) {
+#else
+void* meshTaskWorker(void* parameter) {
+#endif
+    struct MeshTaskRange* range = parameter;
+    for(uint32_t i = range->first; i < range->count; i += range->stride) {
+        range->task(range->context, i);
+    }
+    return 0;
+}
+
+uint32_t meshProcessorCount() {
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwNumberOfProcessors > 0 ? (uint32_t)systemInfo.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+// Runs task(context, i) for every i below taskCount on up to threadCount threads, the calling
+// thread included, and returns once all of them are done.
+void meshRunParallel(MeshTask task, void* context, uint32_t taskCount, uint32_t threadCount) {
+    if(threadCount > taskCount) threadCount = taskCount;
+    if(threadCount > MESH_LOADER_MAX_THREADS) threadCount = MESH_LOADER_MAX_THREADS;
+    if(threadCount <= 1) {
+        for(uint32_t i = 0; i < taskCount; i++) {
+            task(context, i);
+        }
+        return;
+    }
+    struct MeshTaskRange ranges[MESH_LOADER_MAX_THREADS];
+#ifdef _WIN32
+    HANDLE threads[MESH_LOADER_MAX_THREADS];
+#else
+    pthread_t threads[MESH_LOADER_MAX_THREADS];
+#endif
+    for(uint32_t i = 0; i < threadCount; i++) {
+        ranges[i].task = task;
+        ranges[i].context = context;
+        ranges[i].first = i;
+        ranges[i].count = taskCount;
+        ranges[i].stride = threadCount;
+    }
+    for(uint32_t i = 1; i < threadCount; i++) {
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, meshTaskWorker, &ranges[i], 0, NULL);
+        if(!threads[i]) {
+#else
+        if(pthread_create(&threads[i], NULL, meshTaskWorker, &ranges[i]) != 0) {
+#endif
+            fprintf(stderr, "Failed to create mesh loader thread, aborting.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    meshTaskWorker(&ranges[0]);
+    for(uint32_t i = 1; i < threadCount; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+// Parsing:
+
+bool meshIsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* meshSkipSpaces(const char* cursor, const char* end) {
+    while(cursor < end && meshIsSpace(*cursor)) {
+        cursor++;
+    }
+    return cursor;
+}
+
+const char* meshSkipLine(const char* cursor, const char* end) {
+    const char* lineEnd = memchr(cursor, '\n', end - cursor);
+    return lineEnd ? lineEnd + 1 : end;
+}
+
+// Locale independent and much faster than strtod. Accepts what OBJ exporters write:
+// [+-]digits[.digits][(e|E)[+-]digits].
+bool meshParseFloat(const char** cursor, const char* end, float* value) {
+    static const double powersOf10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* c = *cursor;
+    bool negative = false;
+    if(c < end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        c++;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    for(; c < end && *c >= '0' && *c <= '9'; c++) {
+        // Digits past 19 cannot change a float.
+        if(mantissa < UINT64_MAX / 10 - 9) {
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+        } else {
+            exponent++;
+        }
+        anyDigits = true;
+    }
+    if(c < end && *c == '.') {
+        c++;
+        for(; c < end && *c >= '0' && *c <= '9'; c++) {
+            if(mantissa < UINT64_MAX / 10 - 9) {
+                mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+                exponent--;
+            }
+            anyDigits = true;
+        }
+    }
+    if(!anyDigits) {
+        return false;
+    }
+    if(c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        bool negativeExponent = false;
+        if(c < end && (*c == '-' || *c == '+')) {
+            negativeExponent = *c == '-';
+            c++;
+        }
+        if(c == end || *c < '0' || *c > '9') {
+            return false;
+        }
+        int explicitExponent = 0;
+        for(; c < end && *c >= '0' && *c <= '9'; c++) {
+            if(explicitExponent < 10000) {
+                explicitExponent = explicitExponent * 10 + (*c - '0');
+            }
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+    double result = (double)mantissa;
+    while(exponent > 22) {
+        result *= 1e22;
+        exponent -= 22;
+    }
+    while(exponent < -22) {
+        result /= 1e22;
+        exponent += 22;
+    }
+    result = exponent >= 0 ? result * powersOf10[exponent] : result / powersOf10[-exponent];
+    *value = (float)(negative ? -result : result);
+    *cursor = c;
+    return true;
+}
+
+bool meshParseInt(const char** cursor, const char* end, int64_t* value) {
+    const char* c = *cursor;
+    bool negative = false;
+    if(c < end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        c++;
+    }
+    if(c == end || *c < '0' || *c > '9') {
+        return false;
+    }
+    int64_t result = 0;
+    for(; c < end && *c >= '0' && *c <= '9'; c++) {
+        if(result < INT64_MAX / 10) {
+            result = result * 10 + (*c - '0');
+        }
+    }
+    *value = negative ? -result : result;
+    *cursor = c;
+    return true;
+}
+
+// OBJ:
+
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t firstVertex;
+    uint32_t firstIndex;
+    bool failed;
+};
+
+struct ObjLoad {
+    struct ObjChunk* chunks;
+    struct MeshVertex* vertices;
+    uint32_t* indices;
+    uint32_t vertexCount;
+};
+
+// Returns the kind of the line starting at cursor, 'v' or 'f' for the ones that are read,
+// and moves cursor past the keyword.
+char objLineKind(const char** cursor, const char* end) {
+    const char* c = meshSkipSpaces(*cursor, end);
+    if(end - c >= 2 && (c[0] == 'v' || c[0] == 'f') && meshIsSpace(c[1])) {
+        *cursor = c + 2;
+        return c[0];
+    }
+    *cursor = c;
+    return 0;
+}
+
+// Face corners are v, v/vt, v//vn or v/vt/vn, only v is used.
+uint32_t objCountFaceCorners(const char* cursor, const char* lineEnd) {
+    uint32_t corners = 0;
+    while(true) {
+        cursor = meshSkipSpaces(cursor, lineEnd);
+        if(cursor == lineEnd || *cursor == '\n' || *cursor == '#') {
+            return corners;
+        }
+        corners++;
+        while(cursor < lineEnd && !meshIsSpace(*cursor) && *cursor != '\n') {
+            cursor++;
+        }
+    }
+}
+
+void objCountTask(void* context, uint32_t index) {
+    struct ObjChunk* chunk = &((struct ObjLoad*)context)->chunks[index];
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    for(const char* line = chunk->begin; line < chunk->end; ) {
+        const char* lineEnd = meshSkipLine(line, chunk->end);
+        const char* cursor = line;
+        char kind = objLineKind(&cursor, lineEnd);
+        if(kind == 'v') {
+            vertexCount++;
+        } else if(kind == 'f') {
+            uint32_t corners = objCountFaceCorners(cursor, lineEnd);
+            if(corners >= 3) {
+                indexCount += 3 * (uint64_t)(corners - 2);
+            }
+        }
+        line = lineEnd;
+    }
+    chunk->failed = vertexCount > UINT32_MAX || indexCount > UINT32_MAX;
+    chunk->vertexCount = (uint32_t)vertexCount;
+    chunk->indexCount = (uint32_t)indexCount;
+}
+
+// Vertices are "v x y z [r g b]", of which x, y and the optional color are kept.
+bool objParseVertex(const char* cursor, const char* lineEnd, struct MeshVertex* vertex) {
+    float values[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    uint32_t valueCount = 0;
+    while(valueCount < 6) {
+        cursor = meshSkipSpaces(cursor, lineEnd);
+        if(cursor == lineEnd || *cursor == '\n' || *cursor == '#') {
+            break;
+        }
+        if(!meshParseFloat(&cursor, lineEnd, &values[valueCount++])) {
+            return false;
+        }
+    }
+    // A fourth value alone is the optional w.
+    if(valueCount < 3 || (valueCount > 3 && valueCount < 6)) {
+        values[3] = values[4] = values[5] = 1.0f;
+    }
+    vertex->position[0] = values[0];
+    vertex->position[1] = values[1];
+    vertex->color[0] = values[3];
+    vertex->color[1] = values[4];
+    vertex->color[2] = values[5];
+    vertex->normal[0] = 0.0f;
+    vertex->normal[1] = 0.0f;
+    vertex->normal[2] = 1.0f;
+    return valueCount >= 2;
+}
+
+// vertexNumber is the number of vertices defined before the line, relative indices count
+// back from it. Faces are triangulated as fans.
+bool objParseFace(const char* cursor, const char* lineEnd, uint32_t vertexNumber,
+                  uint32_t vertexCount, uint32_t* indices) {
+    uint32_t corner = 0;
+    uint32_t first = 0;
+    uint32_t previous = 0;
+    while(true) {
+        cursor = meshSkipSpaces(cursor, lineEnd);
+        if(cursor == lineEnd || *cursor == '\n' || *cursor == '#') {
+            return true;
+        }
+        int64_t number;
+        if(!meshParseInt(&cursor, lineEnd, &number) || number == 0) {
+            return false;
+        }
+        int64_t index = number > 0 ? number - 1 : (int64_t)vertexNumber + number;
+        if(index < 0 || index >= vertexCount) {
+            return false;
+        }
+        while(cursor < lineEnd && !meshIsSpace(*cursor) && *cursor != '\n') {
+            cursor++;
+        }
+        if(corner == 0) {
+            first = (uint32_t)index;
+        } else if(corner >= 2) {
+            *indices++ = first;
+            *indices++ = previous;
+            *indices++ = (uint32_t)index;
+        }
+        previous = (uint32_t)index;
+        corner++;
+    }
+}
+
+void objParseTask(void* context, uint32_t index) {
+    struct ObjLoad* load = context;
+    struct ObjChunk* chunk = &load->chunks[index];
+    struct MeshVertex* vertex = load->vertices + chunk->firstVertex;
+    uint32_t* indices = load->indices + chunk->firstIndex;
+    uint32_t vertexNumber = chunk->firstVertex;
+    for(const char* line = chunk->begin; line < chunk->end; ) {
+        const char* lineEnd = meshSkipLine(line, chunk->end);
+        const char* cursor = line;
+        char kind = objLineKind(&cursor, lineEnd);
+        if(kind == 'v') {
+            if(!objParseVertex(cursor, lineEnd, vertex++)) {
+                chunk->failed = true;
+                return;
+            }
+            vertexNumber++;
+        } else if(kind == 'f') {
+            uint32_t corners = objCountFaceCorners(cursor, lineEnd);
+            if(corners >= 3) {
+                if(!objParseFace(cursor, lineEnd, vertexNumber, load->vertexCount, indices)) {
+                    chunk->failed = true;
+                    return;
+                }
+                indices += 3 * (corners - 2);
+            }
+        }
+        line = lineEnd;
+    }
+}
+
+bool meshLoadObj(struct LoadedMesh* mesh, const struct MappedFile* file, uint32_t threadCount) {
+    const char* text = (const char*)file->data;
+    const char* textEnd = text + file->size;
+    uint32_t chunkCount = (uint32_t)(file->size / MESH_LOADER_MIN_CHUNK_SIZE);
+    // A few chunks per thread even out lines that are slower to parse.
+    if(chunkCount > threadCount * 4) chunkCount = threadCount * 4;
+    if(chunkCount == 0) chunkCount = 1;
+    struct ObjLoad load = {};
+    load.chunks = calloc(chunkCount, sizeof(struct ObjChunk));
+    if(!load.chunks) {
+        return false;
+    }
+    // Every chunk but the first starts after a line break.
+    const char* begin = text;
+    for(uint32_t i = 0; i < chunkCount; i++) {
+        const char* end = i + 1 == chunkCount ? textEnd : text + file->size / chunkCount * (i + 1);
+        if(end < begin) end = begin;
+        end = meshSkipLine(end == text ? end : end - 1, textEnd);
+        load.chunks[i].begin = begin;
+        load.chunks[i].end = end;
+        begin = end;
+    }
+    meshRunParallel(objCountTask, &load, chunkCount, threadCount);
+
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    bool failed = false;
+    for(uint32_t i = 0; i < chunkCount; i++) {
+        load.chunks[i].firstVertex = (uint32_t)vertexCount;
+        load.chunks[i].firstIndex = (uint32_t)indexCount;
+        vertexCount += load.chunks[i].vertexCount;
+        indexCount += load.chunks[i].indexCount;
+        failed |= load.chunks[i].failed;
+    }
+    if(failed || vertexCount == 0 || indexCount == 0 || vertexCount > UINT32_MAX ||
+       indexCount > UINT32_MAX) {
+        free(load.chunks);
+        return false;
+    }
+    load.vertexCount = (uint32_t)vertexCount;
+    load.vertices = malloc(vertexCount * sizeof(struct MeshVertex));
+    load.indices = malloc(indexCount * sizeof(uint32_t));
+    if(!load.vertices || !load.indices) {
+        free(load.vertices);
+        free(load.indices);
+        free(load.chunks);
+        return false;
+    }
+    meshRunParallel(objParseTask, &load, chunkCount, threadCount);
+    for(uint32_t i = 0; i < chunkCount; i++) {
+        failed |= load.chunks[i].failed;
+    }
+    free(load.chunks);
+    mesh->ownedVertices = load.vertices;
+    mesh->ownedIndices = load.indices;
+    mesh->vertices = load.vertices;
+    mesh->vertexCount = (uint32_t)vertexCount;
+    mesh->indices = load.indices;
+    mesh->indexCount = (uint32_t)indexCount;
+    return !failed;
+}
+
+// JSON, just enough for glTF. Values are tokens in document order, each knows where its
+// subtree ends so siblings can be skipped over.
+
+enum JsonType {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    // Numbers, true, false and null.
+    JSON_PRIMITIVE
+};
+
+struct JsonToken {
+    enum JsonType type;
+    // Strings exclude the quotes.
+    uint32_t start;
+    uint32_t end;
+    // Members of an object count their key and value as two tokens.
+    uint32_t childCount;
+    // Index of the first token after the subtree.
+    uint32_t next;
+};
+
+struct Json {
+    const char* text;
+    size_t size;
+    struct JsonToken* tokens;
+    uint32_t tokenCount;
+    uint32_t tokenCapacity;
+};
+
+bool jsonParseValue(struct Json* json, size_t* position, uint32_t depth);
+
+bool jsonPushToken(struct Json* json, enum JsonType type, size_t start, uint32_t* index) {
+    if(json->tokenCount == json->tokenCapacity) {
+        uint32_t capacity = json->tokenCapacity ? json->tokenCapacity * 2 : 1024;
+        struct JsonToken* grown = realloc(json->tokens, capacity * sizeof(struct JsonToken));
+        if(!grown) {
+            return false;
+        }
+        json->tokens = grown;
+        json->tokenCapacity = capacity;
+    }
+    *index = json->tokenCount++;
+    struct JsonToken* token = &json->tokens[*index];
+    token->type = type;
+    token->start = (uint32_t)start;
+    token->end = (uint32_t)start;
+    token->childCount = 0;
+    token->next = 0;
+    return true;
+}
+
+void jsonSkipSpaces(const struct Json* json, size_t* position) {
+    while(*position < json->size && (json->text[*position] == ' ' || json->text[*position] == '\t' ||
+          json->text[*position] == '\n' || json->text[*position] == '\r')) {
+        (*position)++;
+    }
+}
+
+bool jsonParseString(struct Json* json, size_t* position) {
+    uint32_t index;
+    if(!jsonPushToken(json, JSON_STRING, *position + 1, &index)) {
+        return false;
+    }
+    for(size_t i = *position + 1; i < json->size; i++) {
+        if(json->text[i] == '\\') {
+            i++;
+        } else if(json->text[i] == '"') {
+            json->tokens[index].end = (uint32_t)i;
+            json->tokens[index].next = json->tokenCount;
+            *position = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Objects and arrays.
+bool jsonParseContainer(struct Json* json, size_t* position, uint32_t depth) {
+    bool object = json->text[*position] == '{';
+    char close = object ? '}' : ']';
+    uint32_t index;
+    if(depth >= MESH_LOADER_MAX_JSON_DEPTH ||
+       !jsonPushToken(json, object ? JSON_OBJECT : JSON_ARRAY, *position, &index)) {
+        return false;
+    }
+    (*position)++;
+    jsonSkipSpaces(json, position);
+    uint32_t childCount = 0;
+    if(*position < json->size && json->text[*position] == close) {
+        (*position)++;
+    } else {
+        while(true) {
+            if(object) {
+                jsonSkipSpaces(json, position);
+                if(*position >= json->size || json->text[*position] != '"' ||
+                   !jsonParseString(json, position)) {
+                    return false;
+                }
+                jsonSkipSpaces(json, position);
+                if(*position >= json->size || json->text[*position] != ':') {
+                    return false;
+                }
+                (*position)++;
+                childCount++;
+            }
+            if(!jsonParseValue(json, position, depth + 1)) {
+                return false;
+            }
+            childCount++;
+            jsonSkipSpaces(json, position);
+            if(*position >= json->size) {
+                return false;
+            }
+            char c = json->text[(*position)++];
+            if(c == close) {
+                break;
+            }
+            if(c != ',') {
+                return false;
+            }
+        }
+    }
+    json->tokens[index].end = (uint32_t)*position;
+    json->tokens[index].childCount = childCount;
+    json->tokens[index].next = json->tokenCount;
+    return true;
+}
+
+bool jsonParseValue(struct Json* json, size_t* position, uint32_t depth) {
+    jsonSkipSpaces(json, position);
+    if(*position >= json->size) {
+        return false;
+    }
+    char c = json->text[*position];
+    if(c == '{' || c == '[') {
+        return jsonParseContainer(json, position, depth);
+    }
+    if(c == '"') {
+        return jsonParseString(json, position);
+    }
+    uint32_t index;
+    if(!jsonPushToken(json, JSON_PRIMITIVE, *position, &index)) {
+        return false;
+    }
+    size_t end = *position;
+    while(end < json->size && strchr(",]} \t\r\n", json->text[end]) == NULL) {
+        end++;
+    }
+    if(end == *position) {
+        return false;
+    }
+    json->tokens[index].end = (uint32_t)end;
+    json->tokens[index].next = json->tokenCount;
+    *position = end;
+    return true;
+}
+
+bool jsonParse(struct Json* json, const char* text, size_t size) {
+    memset(json, 0, sizeof(*json));
+    json->text = text;
+    json->size = size;
+    size_t position = 0;
+    // Offsets are 32-bit.
+    if(size >= UINT32_MAX || !jsonParseValue(json, &position, 0)) {
+        free(json->tokens);
+        memset(json, 0, sizeof(*json));
+        return false;
+    }
+    return true;
+}
+
+void jsonFree(struct Json* json) {
+    free(json->tokens);
+    memset(json, 0, sizeof(*json));
+}
+
+bool jsonStringEquals(const struct Json* json, uint32_t token, const char* string) {
+    if(token == UINT32_MAX) {
+        return false;
+    }
+    const struct JsonToken* t = &json->tokens[token];
+    size_t length = strlen(string);
+    return t->type == JSON_STRING && t->end - t->start == length &&
+           memcmp(json->text + t->start, string, length) == 0;
+}
+
+// Returns the value of key in object, or UINT32_MAX when there is none.
+uint32_t jsonFind(const struct Json* json, uint32_t object, const char* key) {
+    if(object == UINT32_MAX || json->tokens[object].type != JSON_OBJECT) {
+        return UINT32_MAX;
+    }
+    uint32_t token = object + 1;
+    for(uint32_t i = 0; i < json->tokens[object].childCount; i += 2) {
+        uint32_t value = json->tokens[token].next;
+        if(jsonStringEquals(json, token, key)) {
+            return value;
+        }
+        token = json->tokens[value].next;
+    }
+    return UINT32_MAX;
+}
+
+// Returns item index of array, or UINT32_MAX when there is none.
+uint32_t jsonItem(const struct Json* json, uint32_t array, uint32_t index) {
+    if(array == UINT32_MAX || json->tokens[array].type != JSON_ARRAY ||
+       index >= json->tokens[array].childCount) {
+        return UINT32_MAX;
+    }
+    uint32_t token = array + 1;
+    for(uint32_t i = 0; i < index; i++) {
+        token = json->tokens[token].next;
+    }
+    return token;
+}
+
+uint32_t jsonCount(const struct Json* json, uint32_t array) {
+    if(array == UINT32_MAX || json->tokens[array].type != JSON_ARRAY) {
+        return 0;
+    }
+    return json->tokens[array].childCount;
+}
+
+// Non-negative integers only, fallback when missing or anything else.
+uint64_t jsonUint(const struct Json* json, uint32_t token, uint64_t fallback) {
+    if(token == UINT32_MAX || json->tokens[token].type != JSON_PRIMITIVE) {
+        return fallback;
+    }
+    const char* cursor = json->text + json->tokens[token].start;
+    const char* end = json->text + json->tokens[token].end;
+    int64_t value;
+    if(!meshParseInt(&cursor, end, &value) || cursor != end || value < 0) {
+        return fallback;
+    }
+    return (uint64_t)value;
+}
+
+bool jsonBool(const struct Json* json, uint32_t token) {
+    return token != UINT32_MAX && json->tokens[token].type == JSON_PRIMITIVE &&
+           json->tokens[token].end - json->tokens[token].start == 4 &&
+           memcmp(json->text + json->tokens[token].start, "true", 4) == 0;
+}
+
+// glTF:
+
+#define GLTF_GLB_MAGIC 0x46546c67 // "glTF"
+#define GLTF_GLB_CHUNK_JSON 0x4e4f534a
+#define GLTF_GLB_CHUNK_BIN 0x004e4942
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+// Resolved accessor: element i starts at data + i * stride.
+struct GltfAccessor {
+    const uint8_t* data;
+    uint32_t count;
+    uint32_t stride;
+    uint32_t componentType;
+    uint32_t componentCount;
+    bool normalized;
+};
+
+struct GltfPrimitive {
+    struct GltfAccessor positions;
+    // componentCount is 0 without colors or normals.
+    struct GltfAccessor colors;
+    struct GltfAccessor normals;
+    // count is 0 without indices, the vertices are then drawn in order.
+    struct GltfAccessor indices;
+    uint32_t firstVertex;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+struct GltfTask {
+    uint32_t primitive;
+    bool vertices;
+    uint32_t first;
+    uint32_t count;
+    // Set by index tasks that find an index past the primitive's vertices.
+    bool failed;
+};
+
+struct GltfLoad {
+    struct GltfPrimitive* primitives;
+    struct GltfTask* tasks;
+    struct MeshVertex* vertices;
+    // NULL when the indices are used in place, index tasks then only check them.
+    uint32_t* indices;
+};
+
+uint32_t gltfComponentSize(uint32_t componentType) {
+    switch(componentType) {
+    case GLTF_UNSIGNED_BYTE: return 1;
+    case GLTF_UNSIGNED_SHORT: return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+uint32_t gltfComponentCount(const struct Json* json, uint32_t type) {
+    static const char* types[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+    for(uint32_t i = 0; i < 4; i++) {
+        if(jsonStringEquals(json, type, types[i])) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Checks the accessor lies inside its buffer view and that inside its buffer, sparse
+// accessors are not supported.
+bool gltfResolveAccessor(const struct Json* json, uint32_t root, uint32_t index,
+                         const struct MappedFile* buffers, const size_t* bufferOffsets,
+                         uint32_t bufferCount, struct GltfAccessor* accessor) {
+    uint32_t token = jsonItem(json, jsonFind(json, root, "accessors"), index);
+    uint64_t viewIndex = jsonUint(json, jsonFind(json, token, "bufferView"), UINT32_MAX);
+    uint32_t view = jsonItem(json, jsonFind(json, root, "bufferViews"), (uint32_t)viewIndex);
+    if(token == UINT32_MAX || view == UINT32_MAX || jsonFind(json, token, "sparse") != UINT32_MAX) {
+        return false;
+    }
+    accessor->componentType = (uint32_t)jsonUint(json, jsonFind(json, token, "componentType"), 0);
+    accessor->componentCount = gltfComponentCount(json, jsonFind(json, token, "type"));
+    accessor->normalized = jsonBool(json, jsonFind(json, token, "normalized"));
+    uint64_t count = jsonUint(json, jsonFind(json, token, "count"), UINT64_MAX);
+    uint64_t elementSize = (uint64_t)gltfComponentSize(accessor->componentType) *
+                           accessor->componentCount;
+    uint64_t buffer = jsonUint(json, jsonFind(json, view, "buffer"), UINT64_MAX);
+    uint64_t viewOffset = jsonUint(json, jsonFind(json, view, "byteOffset"), 0);
+    uint64_t viewLength = jsonUint(json, jsonFind(json, view, "byteLength"), UINT64_MAX);
+    uint64_t stride = jsonUint(json, jsonFind(json, view, "byteStride"), elementSize);
+    uint64_t offset = jsonUint(json, jsonFind(json, token, "byteOffset"), 0);
+    if(elementSize == 0 || count == 0 || count > UINT32_MAX || buffer >= bufferCount ||
+       stride < elementSize || stride > 255 ||
+       viewLength > buffers[buffer].size - bufferOffsets[buffer] ||
+       viewOffset > buffers[buffer].size - bufferOffsets[buffer] - viewLength ||
+       offset > viewLength || (count - 1) * stride + elementSize > viewLength - offset) {
+        return false;
+    }
+    accessor->data = buffers[buffer].data + bufferOffsets[buffer] + viewOffset + offset;
+    accessor->count = (uint32_t)count;
+    accessor->stride = (uint32_t)stride;
+    return true;
+}
+
+// Normalized integers map to [0, 1].
+float gltfReadComponent(const struct GltfAccessor* accessor, const uint8_t* element,
+                        uint32_t component) {
+    switch(accessor->componentType) {
+    case GLTF_FLOAT: {
+        float value;
+        memcpy(&value, element + component * 4, 4);
+        return value;
+    }
+    case GLTF_UNSIGNED_BYTE: {
+        uint8_t value = element[component];
+        return accessor->normalized ? value / 255.0f : value;
+    }
+    case GLTF_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, element + component * 2, 2);
+        return accessor->normalized ? value / 65535.0f : value;
+    }
+    default:
+        return 0.0f;
+    }
+}
+
+uint32_t gltfReadIndex(const struct GltfAccessor* accessor, uint32_t i) {
+    const uint8_t* element = accessor->data + (size_t)i * accessor->stride;
+    switch(accessor->componentType) {
+    case GLTF_UNSIGNED_BYTE:
+        return element[0];
+    case GLTF_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, element, 2);
+        return value;
+    }
+    default: {
+        uint32_t value;
+        memcpy(&value, element, 4);
+        return value;
+    }
+    }
+}
+
+void gltfConvertTask(void* context, uint32_t index) {
+    struct GltfLoad* load = context;
+    struct GltfTask* task = &load->tasks[index];
+    const struct GltfPrimitive* primitive = &load->primitives[task->primitive];
+    if(task->vertices) {
+        const struct GltfAccessor* positions = &primitive->positions;
+        const struct GltfAccessor* colors = &primitive->colors;
+        const struct GltfAccessor* normals = &primitive->normals;
+        struct MeshVertex* vertex = load->vertices + primitive->firstVertex + task->first;
+        for(uint32_t i = task->first; i < task->first + task->count; i++, vertex++) {
+            const uint8_t* position = positions->data + (size_t)i * positions->stride;
+            vertex->position[0] = gltfReadComponent(positions, position, 0);
+            vertex->position[1] = gltfReadComponent(positions, position, 1);
+            if(colors->componentCount) {
+                const uint8_t* color = colors->data + (size_t)i * colors->stride;
+                vertex->color[0] = gltfReadComponent(colors, color, 0);
+                vertex->color[1] = gltfReadComponent(colors, color, 1);
+                vertex->color[2] = gltfReadComponent(colors, color, 2);
+            } else {
+                vertex->color[0] = vertex->color[1] = vertex->color[2] = 1.0f;
+            }
+            if(normals->componentCount) {
+                const uint8_t* normal = normals->data + (size_t)i * normals->stride;
+                vertex->normal[0] = gltfReadComponent(normals, normal, 0);
+                vertex->normal[1] = gltfReadComponent(normals, normal, 1);
+                vertex->normal[2] = gltfReadComponent(normals, normal, 2);
+            } else {
+                vertex->normal[0] = vertex->normal[1] = 0.0f;
+                vertex->normal[2] = 1.0f;
+            }
+        }
+        return;
+    }
+    uint32_t* indices = load->indices ? load->indices + primitive->firstIndex + task->first : NULL;
+    uint32_t vertexCount = primitive->positions.count;
+    for(uint32_t i = task->first; i < task->first + task->count; i++) {
+        uint32_t vertex = primitive->indices.count ? gltfReadIndex(&primitive->indices, i) : i;
+        if(vertex >= vertexCount) {
+            task->failed = true;
+            return;
+        }
+        if(indices) {
+            *indices++ = primitive->firstVertex + vertex;
+        }
+    }
+}
+
+// Maps the buffers: the BIN chunk of a .glb, or files next to a .gltf. Returns how many.
+uint32_t gltfMapBuffers(struct LoadedMesh* mesh, const struct Json* json, uint32_t root,
+                        const char* path, const struct MappedFile* glb, size_t binOffset,
+                        size_t binSize, size_t* bufferOffsets, struct MappedFile* buffers) {
+    uint32_t bufferArray = jsonFind(json, root, "buffers");
+    uint32_t bufferCount = jsonCount(json, bufferArray);
+    if(bufferCount > MESH_LOADER_MAX_BUFFERS) {
+        fprintf(stderr, "%s has more than %u buffers.\n", path, MESH_LOADER_MAX_BUFFERS);
+        return 0;
+    }
+    const char* lastBSlash = strrchr(path, '\\');
+    const char* lastFSlash = strrchr(path, '/');
+    const char* lastSlash = lastBSlash > lastFSlash ? lastBSlash : lastFSlash;
+    size_t directoryLength = lastSlash ? (size_t)(lastSlash - path + 1) : 0;
+    for(uint32_t i = 0; i < bufferCount; i++) {
+        uint32_t uri = jsonFind(json, jsonItem(json, bufferArray, i), "uri");
+        if(uri == UINT32_MAX) {
+            // The first buffer of a .glb without uri is the BIN chunk.
+            if(i != 0 || !glb || binSize == 0) {
+                fprintf(stderr, "Buffer %u of %s has no data.\n", i, path);
+                return 0;
+            }
+            buffers[i] = *glb;
+            buffers[i].size = binOffset + binSize;
+            bufferOffsets[i] = binOffset;
+            continue;
+        }
+        const struct JsonToken* token = &json->tokens[uri];
+        size_t uriLength = token->end - token->start;
+        if(token->type != JSON_STRING || (uriLength >= 5 &&
+           memcmp(json->text + token->start, "data:", 5) == 0)) {
+            fprintf(stderr, "Buffer %u of %s is embedded, only external buffers are supported.\n",
+                    i, path);
+            return 0;
+        }
+        char* bufferPath = malloc(directoryLength + uriLength + 1);
+        if(!bufferPath) {
+            return 0;
+        }
+        memcpy(bufferPath, path, directoryLength);
+        memcpy(bufferPath + directoryLength, json->text + token->start, uriLength);
+        bufferPath[directoryLength + uriLength] = '\0';
+        bool mapped = mappedFileOpen(&mesh->files[mesh->fileCount], bufferPath);
+        if(!mapped) {
+            fprintf(stderr, "Failed to map %s.\n", bufferPath);
+        }
+        free(bufferPath);
+        if(!mapped) {
+            return 0;
+        }
+        buffers[i] = mesh->files[mesh->fileCount++];
+        bufferOffsets[i] = 0;
+    }
+    return bufferCount;
+}
+
+bool meshLoadGltf(struct LoadedMesh* mesh, const char* path, const struct MappedFile* file,
+                  uint32_t threadCount) {
+    const char* text = (const char*)file->data;
+    size_t textSize = file->size;
+    const struct MappedFile* glb = NULL;
+    size_t binOffset = 0;
+    size_t binSize = 0;
+    uint32_t magic = 0;
+    if(file->size >= 4) memcpy(&magic, file->data, 4);
+    if(magic == GLTF_GLB_MAGIC) {
+        // Header of magic, version and length, then a JSON chunk and an optional BIN chunk,
+        // each with length and type first.
+        uint32_t header[5];
+        if(file->size < sizeof(header)) {
+            return false;
+        }
+        memcpy(header, file->data, sizeof(header));
+        if(header[1] != 2 || header[4] != GLTF_GLB_CHUNK_JSON || header[3] > file->size - 20) {
+            return false;
+        }
+        text = (const char*)file->data + 20;
+        textSize = header[3];
+        size_t binChunk = 20 + ((size_t)header[3] + 3) / 4 * 4;
+        uint32_t binHeader[2];
+        if(binChunk + sizeof(binHeader) <= file->size) {
+            memcpy(binHeader, file->data + binChunk, sizeof(binHeader));
+            if(binHeader[1] == GLTF_GLB_CHUNK_BIN && binHeader[0] <= file->size - binChunk - 8) {
+                binOffset = binChunk + 8;
+                binSize = binHeader[0];
+            }
+        }
+        glb = file;
+    }
+
+    struct Json json;
+    if(!jsonParse(&json, text, textSize)) {
+        fprintf(stderr, "%s is not valid JSON.\n", path);
+        return false;
+    }
+    uint32_t root = 0;
+    struct MappedFile buffers[MESH_LOADER_MAX_BUFFERS];
+    size_t bufferOffsets[MESH_LOADER_MAX_BUFFERS];
+    uint32_t bufferCount = gltfMapBuffers(mesh, &json, root, path, glb, binOffset, binSize,
+                                          bufferOffsets, buffers);
+
+    uint32_t meshArray = jsonFind(&json, root, "meshes");
+    uint32_t primitiveCount = 0;
+    for(uint32_t i = 0; i < jsonCount(&json, meshArray); i++) {
+        primitiveCount += jsonCount(&json, jsonFind(&json, jsonItem(&json, meshArray, i), "primitives"));
+    }
+    struct GltfLoad load = {};
+    load.primitives = calloc(primitiveCount ? primitiveCount : 1, sizeof(struct GltfPrimitive));
+    if(bufferCount == 0 || !load.primitives) {
+        free(load.primitives);
+        jsonFree(&json);
+        return false;
+    }
+
+    uint64_t vertexCount = 0;
+    uint64_t indexCount = 0;
+    uint64_t taskCount = 0;
+    uint32_t loaded = 0;
+    bool failed = false;
+    for(uint32_t i = 0; i < jsonCount(&json, meshArray) && !failed; i++) {
+        uint32_t primitiveArray = jsonFind(&json, jsonItem(&json, meshArray, i), "primitives");
+        for(uint32_t j = 0; j < jsonCount(&json, primitiveArray) && !failed; j++) {
+            uint32_t token = jsonItem(&json, primitiveArray, j);
+            if(jsonUint(&json, jsonFind(&json, token, "mode"), GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+                continue;
+            }
+            struct GltfPrimitive* primitive = &load.primitives[loaded];
+            uint32_t attributes = jsonFind(&json, token, "attributes");
+            uint64_t position = jsonUint(&json, jsonFind(&json, attributes, "POSITION"), UINT32_MAX);
+            uint64_t color = jsonUint(&json, jsonFind(&json, attributes, "COLOR_0"), UINT32_MAX);
+            uint64_t normal = jsonUint(&json, jsonFind(&json, attributes, "NORMAL"), UINT32_MAX);
+            uint64_t indices = jsonUint(&json, jsonFind(&json, token, "indices"), UINT32_MAX);
+            failed = !gltfResolveAccessor(&json, root, (uint32_t)position, buffers, bufferOffsets,
+                                          bufferCount, &primitive->positions) ||
+                     primitive->positions.componentType != GLTF_FLOAT ||
+                     primitive->positions.componentCount != 3;
+            if(!failed && color != UINT32_MAX) {
+                failed = !gltfResolveAccessor(&json, root, (uint32_t)color, buffers, bufferOffsets,
+                                              bufferCount, &primitive->colors) ||
+                         primitive->colors.componentCount < 3 ||
+                         primitive->colors.count != primitive->positions.count ||
+                         (primitive->colors.componentType != GLTF_FLOAT &&
+                          !primitive->colors.normalized);
+            }
+            if(!failed && normal != UINT32_MAX) {
+                failed = !gltfResolveAccessor(&json, root, (uint32_t)normal, buffers, bufferOffsets,
+                                              bufferCount, &primitive->normals) ||
+                         primitive->normals.componentType != GLTF_FLOAT ||
+                         primitive->normals.componentCount != 3 ||
+                         primitive->normals.count != primitive->positions.count;
+            }
+            if(!failed && indices != UINT32_MAX) {
+                failed = !gltfResolveAccessor(&json, root, (uint32_t)indices, buffers, bufferOffsets,
+                                              bufferCount, &primitive->indices) ||
+                         primitive->indices.componentCount != 1 ||
+                         primitive->indices.componentType == GLTF_FLOAT;
+            }
+            if(failed) {
+                fprintf(stderr, "Primitive %u of mesh %u in %s has unsupported accessors.\n", j, i,
+                        path);
+                break;
+            }
+            primitive->indexCount = primitive->indices.count ? primitive->indices.count
+                                                             : primitive->positions.count;
+            primitive->firstVertex = (uint32_t)vertexCount;
+            primitive->firstIndex = (uint32_t)indexCount;
+            vertexCount += primitive->positions.count;
+            indexCount += primitive->indexCount;
+            taskCount += (primitive->positions.count + MESH_LOADER_GLTF_TASK_SIZE - 1) /
+                         MESH_LOADER_GLTF_TASK_SIZE;
+            taskCount += (primitive->indexCount + MESH_LOADER_GLTF_TASK_SIZE - 1) /
+                         MESH_LOADER_GLTF_TASK_SIZE;
+            failed = vertexCount > UINT32_MAX || indexCount > UINT32_MAX;
+            loaded++;
+        }
+    }
+    jsonFree(&json);
+    if(failed || loaded == 0) {
+        free(load.primitives);
+        return false;
+    }
+
+    // Tightly packed 32-bit indices of a single primitive already are what the pool takes.
+    const struct GltfPrimitive* first = &load.primitives[0];
+    bool indicesInPlace = loaded == 1 && first->indices.count &&
+                          first->indices.componentType == GLTF_UNSIGNED_INT &&
+                          first->indices.stride == sizeof(uint32_t) &&
+                          (uintptr_t)first->indices.data % sizeof(uint32_t) == 0;
+    load.tasks = calloc(taskCount, sizeof(struct GltfTask));
+    load.vertices = malloc(vertexCount * sizeof(struct MeshVertex));
+    load.indices = indicesInPlace ? NULL : malloc(indexCount * sizeof(uint32_t));
+    if(!load.tasks || !load.vertices || (!indicesInPlace && !load.indices)) {
+        free(load.tasks);
+        free(load.vertices);
+        free(load.indices);
+        free(load.primitives);
+        return false;
+    }
+    uint32_t task = 0;
+    for(uint32_t i = 0; i < loaded; i++) {
+        const struct GltfPrimitive* primitive = &load.primitives[i];
+        for(uint32_t kind = 0; kind < 2; kind++) {
+            bool vertices = kind == 0;
+            uint32_t count = vertices ? primitive->positions.count : primitive->indexCount;
+            for(uint32_t start = 0; start < count; start += MESH_LOADER_GLTF_TASK_SIZE) {
+                load.tasks[task].primitive = i;
+                load.tasks[task].vertices = vertices;
+                load.tasks[task].first = start;
+                load.tasks[task].count = count - start < MESH_LOADER_GLTF_TASK_SIZE ?
+                                         count - start : MESH_LOADER_GLTF_TASK_SIZE;
+                task++;
+            }
+        }
+    }
+    meshRunParallel(gltfConvertTask, &load, task, threadCount);
+    for(uint32_t i = 0; i < task; i++) {
+        failed |= load.tasks[i].failed;
+    }
+    mesh->ownedVertices = load.vertices;
+    mesh->ownedIndices = load.indices;
+    mesh->vertices = load.vertices;
+    mesh->vertexCount = (uint32_t)vertexCount;
+    mesh->indices = indicesInPlace ? (const uint32_t*)first->indices.data : load.indices;
+    free(load.tasks);
+    free(load.primitives);
+    mesh->indexCount = (uint32_t)indexCount;
+    return !failed;
+}
+
+// Normalizing:
+
+struct MeshBoundsTask {
+    struct MeshVertex* vertices;
+    uint32_t vertexCount;
+    uint32_t taskSize;
+    float (*bounds)[4];
+    float center[2];
+    float scale;
+};
+
+void meshBoundsTask(void* context, uint32_t index) {
+    struct MeshBoundsTask* task = context;
+    uint32_t first = index * task->taskSize;
+    uint32_t last = first + task->taskSize < task->vertexCount ? first + task->taskSize
+                                                               : task->vertexCount;
+    float* bounds = task->bounds[index];
+    bounds[0] = bounds[1] = FLT_MAX;
+    bounds[2] = bounds[3] = -FLT_MAX;
+    for(uint32_t i = first; i < last; i++) {
+        const float* position = task->vertices[i].position;
+        if(position[0] < bounds[0]) bounds[0] = position[0];
+        if(position[1] < bounds[1]) bounds[1] = position[1];
+        if(position[0] > bounds[2]) bounds[2] = position[0];
+        if(position[1] > bounds[3]) bounds[3] = position[1];
+    }
+}
+
+void meshScaleTask(void* context, uint32_t index) {
+    struct MeshBoundsTask* task = context;
+    uint32_t first = index * task->taskSize;
+    uint32_t last = first + task->taskSize < task->vertexCount ? first + task->taskSize
+                                                               : task->vertexCount;
+    for(uint32_t i = first; i < last; i++) {
+        float* position = task->vertices[i].position;
+        position[0] = (position[0] - task->center[0]) * task->scale;
+        position[1] = (position[1] - task->center[1]) * task->scale;
+    }
+}
+
+bool meshNormalize(struct MeshVertex* vertices, uint32_t vertexCount, uint32_t threadCount) {
+    struct MeshBoundsTask task = {};
+    task.vertices = vertices;
+    task.vertexCount = vertexCount;
+    task.taskSize = MESH_LOADER_GLTF_TASK_SIZE;
+    uint32_t taskCount = (vertexCount + task.taskSize - 1) / task.taskSize;
+    task.bounds = malloc(taskCount * sizeof(*task.bounds));
+    if(!task.bounds) {
+        return false;
+    }
+    meshRunParallel(meshBoundsTask, &task, taskCount, threadCount);
+    float bounds[4] = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t i = 0; i < taskCount; i++) {
+        if(task.bounds[i][0] < bounds[0]) bounds[0] = task.bounds[i][0];
+        if(task.bounds[i][1] < bounds[1]) bounds[1] = task.bounds[i][1];
+        if(task.bounds[i][2] > bounds[2]) bounds[2] = task.bounds[i][2];
+        if(task.bounds[i][3] > bounds[3]) bounds[3] = task.bounds[i][3];
+    }
+    free(task.bounds);
+    float extent = bounds[2] - bounds[0] > bounds[3] - bounds[1] ? bounds[2] - bounds[0]
+                                                                  : bounds[3] - bounds[1];
+    task.center[0] = (bounds[0] + bounds[2]) * 0.5f;
+    task.center[1] = (bounds[1] + bounds[3]) * 0.5f;
+    task.scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+    meshRunParallel(meshScaleTask, &task, taskCount, threadCount);
+    return true;
+}
+
+// Loading:
+
+void meshFree(struct LoadedMesh* mesh) {
+    free(mesh->ownedVertices);
+    free(mesh->ownedIndices);
+    for(uint32_t i = 0; i < mesh->fileCount; i++) {
+        mappedFileClose(&mesh->files[i]);
+    }
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+bool meshHasExtension(const char* path, const char* extension) {
+    size_t pathLength = strlen(path);
+    size_t extensionLength = strlen(extension);
+    if(pathLength < extensionLength) {
+        return false;
+    }
+    const char* suffix = path + pathLength - extensionLength;
+    for(size_t i = 0; i < extensionLength; i++) {
+        char c = suffix[i];
+        if(c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if(c != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The format follows the extension, .obj, .gltf or .glb. Returns false with a message when the
+// file cannot be read or holds no triangles.
+bool meshLoad(struct LoadedMesh* mesh, const char* path, const struct MeshLoadOptions* options) {
+    memset(mesh, 0, sizeof(*mesh));
+    uint32_t threadCount = options->threadCount ? options->threadCount : meshProcessorCount();
+    bool obj = meshHasExtension(path, ".obj");
+    if(!obj && !meshHasExtension(path, ".gltf") && !meshHasExtension(path, ".glb")) {
+        fprintf(stderr, "%s is neither .obj, .gltf nor .glb.\n", path);
+        return false;
+    }
+    if(!mappedFileOpen(&mesh->files[0], path)) {
+        fprintf(stderr, "Failed to map %s.\n", path);
+        return false;
+    }
+    mesh->fileCount = 1;
+    bool loaded = obj ? meshLoadObj(mesh, &mesh->files[0], threadCount)
+                      : meshLoadGltf(mesh, path, &mesh->files[0], threadCount);
+    if(loaded && options->normalize) {
+        loaded = meshNormalize(mesh->ownedVertices, mesh->vertexCount, threadCount);
+    }
+    if(!loaded) {
+        fprintf(stderr, "Failed to load %s.\n", path);
+        meshFree(mesh);
+        return false;
+    }
+    // The OBJ text is no longer needed, release its pages early.
+    if(obj) {
+        mappedFileClose(&mesh->files[0]);
+        mesh->fileCount = 0;
+    }
+    return true;
+}
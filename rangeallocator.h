@@ -0,0 +1,112 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// First-fit allocator for ranges of a pool, e.g. the vertices or indices of a shared buffer,
+// whose capacity only grows. Free ranges are kept sorted by offset and merged with their
+// neighbours when returned, so space freed by any mix of sizes can be refilled by later
+// allocations.
+// Up to RANGE_ALLOCATOR_MAX_FREE_RANGES - 1 allocations may be live at once, which is what
+// guarantees rangeFree() always has room to record the freed range.
+#define RANGE_ALLOCATOR_MAX_FREE_RANGES 4096
+#define RANGE_ALLOCATOR_FAILED UINT32_MAX
+
+struct FreeRange {
+    uint32_t offset;
+    uint32_t count;
+};
+
+struct RangeAllocator {
+    uint32_t capacity;
+    // Units not allocated, possibly split over several ranges.
+    uint32_t freeTotal;
+    uint32_t freeCount;
+    struct FreeRange freeRanges[RANGE_ALLOCATOR_MAX_FREE_RANGES];
+};
+
+void rangeAllocatorInit(struct RangeAllocator* allocator, uint32_t capacity) {
+    allocator->capacity = capacity;
+    allocator->freeTotal = capacity;
+    allocator->freeCount = capacity > 0 ? 1 : 0;
+    allocator->freeRanges[0].offset = 0;
+    allocator->freeRanges[0].count = capacity;
+}
+
+// Returns the offset of count units, or RANGE_ALLOCATOR_FAILED when count is 0 or no free
+// range is large enough.
+uint32_t rangeAllocate(struct RangeAllocator* allocator, uint32_t count) {
+    if(count == 0) {
+        return RANGE_ALLOCATOR_FAILED;
+    }
+    for(uint32_t i = 0; i < allocator->freeCount; i++) {
+        struct FreeRange* range = &allocator->freeRanges[i];
+        if(range->count < count) {
+            continue;
+        }
+        uint32_t offset = range->offset;
+        range->offset += count;
+        range->count -= count;
+        if(range->count == 0) {
+            memmove(range, range + 1, (allocator->freeCount - i - 1) * sizeof(struct FreeRange));
+            allocator->freeCount--;
+        }
+        allocator->freeTotal -= count;
+        return offset;
+    }
+    return RANGE_ALLOCATOR_FAILED;
+}
+
+// Raises the capacity, the units past the old one are free. Whatever owns the units must
+// have grown to match.
+void rangeAllocatorGrow(struct RangeAllocator* allocator, uint32_t capacity) {
+    uint32_t added = capacity - allocator->capacity;
+    struct FreeRange* last = allocator->freeCount > 0 ? &allocator->freeRanges[allocator->freeCount - 1] : NULL;
+    if(last && last->offset + last->count == allocator->capacity) {
+        last->count += added;
+    } else {
+        // Every free range but a last one like the above ends at an allocation, so there is
+        // room for one more.
+        allocator->freeRanges[allocator->freeCount].offset = allocator->capacity;
+        allocator->freeRanges[allocator->freeCount].count = added;
+        allocator->freeCount++;
+    }
+    allocator->capacity = capacity;
+    allocator->freeTotal += added;
+}
+
+// offset and count must be exactly what an earlier rangeAllocate() handed out.
+void rangeFree(struct RangeAllocator* allocator, uint32_t offset, uint32_t count) {
+    // First free range that starts after offset.
+    uint32_t low = 0;
+    uint32_t high = allocator->freeCount;
+    while(low < high) {
+        uint32_t middle = (low + high) / 2;
+        if(allocator->freeRanges[middle].offset < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    struct FreeRange* ranges = allocator->freeRanges;
+    bool mergePrevious = low > 0 && ranges[low - 1].offset + ranges[low - 1].count == offset;
+    bool mergeNext = low < allocator->freeCount && offset + count == ranges[low].offset;
+    if(mergePrevious && mergeNext) {
+        ranges[low - 1].count += count + ranges[low].count;
+        memmove(&ranges[low], &ranges[low + 1],
+                (allocator->freeCount - low - 1) * sizeof(struct FreeRange));
+        allocator->freeCount--;
+    } else if(mergePrevious) {
+        ranges[low - 1].count += count;
+    } else if(mergeNext) {
+        ranges[low].offset = offset;
+        ranges[low].count += count;
+    } else {
+        memmove(&ranges[low + 1], &ranges[low],
+                (allocator->freeCount - low) * sizeof(struct FreeRange));
+        ranges[low].offset = offset;
+        ranges[low].count = count;
+        allocator->freeCount++;
+    }
+    allocator->freeTotal += count;
+}
@@ -0,0 +1,681 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+
+// Declarative render graph. Passes are added in execution order and declare how they use each
+// image and buffer: the stages, the accesses and for images the layout. renderGraphCompile()
+// then drops the passes nothing kept depends on, computes the barriers and layout transitions
+// in front of each remaining pass, and creates the transient resources, placing those whose
+// lifetimes do not overlap at the same memory. renderGraphExecute() records the barriers and
+// calls each pass's record function, which must not synchronise with other passes itself.
+//
+// Imported resources are owned elsewhere, their contents outlive the graph, so passes writing
+// them are always kept. Transient resources only live through a single execution. The graph
+// is executed over and over on a single queue, so the first use of a transient resource waits
+// for the last use of whatever occupied its memory before, in this execution or the last.
+//
+// Barriers are global memory barriers plus image barriers for the layout transitions. Buffers
+// are only ever tracked, never named, so imported buffers need no handle and may change
+// between executions. Imported images must be set with renderGraphSetImage() before each
+// execution that transitions them.
+#define RENDER_GRAPH_MAX_RESOURCES 32
+#define RENDER_GRAPH_MAX_PASSES 32
+#define RENDER_GRAPH_MAX_PASS_ACCESSES 16
+#define RENDER_GRAPH_MAX_HEAPS 4
+#define RENDER_GRAPH_MAX_TRANSITIONS (RENDER_GRAPH_MAX_PASSES * RENDER_GRAPH_MAX_PASS_ACCESSES + \
+                                      RENDER_GRAPH_MAX_RESOURCES)
+#define RENDER_GRAPH_WRITE_ACCESS (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | \
+                                   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+                                   VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | \
+                                   VK_ACCESS_MEMORY_WRITE_BIT)
+// Keeps a pass whose results leave the graph some other way than through its resources.
+#define RENDER_GRAPH_PASS_KEEP 0x1
+
+enum RenderGraphResourceType {
+    RENDER_GRAPH_IMAGE = 0,
+    RENDER_GRAPH_BUFFER
+};
+
+typedef void (*RenderGraphRecordFunction)(VkCommandBuffer commandBuffer, void* frameData);
+
+struct RenderGraphResource {
+    const char* name;
+    enum RenderGraphResourceType type;
+    bool transient;
+    // Images only.
+    VkFormat format;
+    VkExtent2D extent;
+    VkImageUsageFlags imageUsage;
+    VkImageAspectFlags aspect;
+    VkImage image;
+    VkImageView view;
+    // Buffers only.
+    VkDeviceSize size;
+    VkBufferUsageFlags bufferUsage;
+    VkBuffer buffer;
+    // State of imported resources before each execution, and the layout imported images are
+    // left in, VK_IMAGE_LAYOUT_UNDEFINED to leave them as their last pass did.
+    VkImageLayout initialLayout;
+    VkPipelineStageFlags initialStages;
+    VkAccessFlags initialAccess;
+    VkImageLayout finalLayout;
+    // Compiled. Passes are indices into the graph's passes, lastPass is one past the last.
+    bool used;
+    uint32_t firstPass;
+    uint32_t lastPass;
+    // Stages since the last write or transition, and the accesses it wrote.
+    VkPipelineStageFlags lastStages;
+    VkAccessFlags lastWriteAccess;
+    uint32_t heap;
+    VkDeviceSize offset;
+    VkDeviceSize memorySize;
+    VkDeviceSize memoryAlignment;
+    uint32_t memoryTypeBits;
+};
+
+struct RenderGraphAccess {
+    uint32_t resource;
+    VkPipelineStageFlags stages;
+    VkAccessFlags access;
+    VkImageLayout layout;
+};
+
+struct RenderGraphTransition {
+    uint32_t resource;
+    VkImageLayout oldLayout;
+    VkImageLayout newLayout;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+};
+
+// A single vkCmdPipelineBarrier(), skipped when it has nothing to wait for.
+struct RenderGraphBarrier {
+    VkPipelineStageFlags srcStages;
+    VkPipelineStageFlags dstStages;
+    VkAccessFlags srcAccess;
+    VkAccessFlags dstAccess;
+    uint32_t firstTransition;
+    uint32_t transitionCount;
+};
+
+struct RenderGraphPass {
+    const char* name;
+    RenderGraphRecordFunction record;
+    uint32_t flags;
+    uint32_t accessCount;
+    struct RenderGraphAccess accesses[RENDER_GRAPH_MAX_PASS_ACCESSES];
+    // Compiled.
+    bool culled;
+    struct RenderGraphBarrier barrier;
+};
+
+struct RenderGraphHeap {
+    uint32_t memoryType;
+    VkDeviceSize size;
+    VkDeviceMemory memory;
+};
+
+struct RenderGraph {
+    uint32_t resourceCount;
+    struct RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t passCount;
+    struct RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    // Compiled.
+    uint32_t heapCount;
+    struct RenderGraphHeap heaps[RENDER_GRAPH_MAX_HEAPS];
+    uint32_t transitionCount;
+    struct RenderGraphTransition transitions[RENDER_GRAPH_MAX_TRANSITIONS];
+    // After the last pass, for the final layouts of imported images.
+    struct RenderGraphBarrier finalBarrier;
+    // What compiling found, for reporting.
+    uint32_t culledPassCount;
+    uint32_t barrierCount;
+    VkDeviceSize transientMemory;
+    VkDeviceSize unaliasedTransientMemory;
+};
+
+uint32_t renderGraphAddResource(struct RenderGraph* graph, const char* name,
+                                enum RenderGraphResourceType type, bool transient) {
+    if(graph->resourceCount == RENDER_GRAPH_MAX_RESOURCES) {
+        fprintf(stderr, "Render graph has more than %u resources, aborting.", RENDER_GRAPH_MAX_RESOURCES);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t index = graph->resourceCount++;
+    struct RenderGraphResource* resource = &graph->resources[index];
+    memset(resource, 0, sizeof(*resource));
+    resource->name = name;
+    resource->type = type;
+    resource->transient = transient;
+    return index;
+}
+
+// initialStages and initialAccess are what the image has to wait for before each execution,
+// e.g. the stage a swapchain image's acquire semaphore is waited on, with no access.
+uint32_t renderGraphImportImage(struct RenderGraph* graph, const char* name, VkImageAspectFlags aspect,
+                                VkImageLayout initialLayout, VkPipelineStageFlags initialStages,
+                                VkAccessFlags initialAccess, VkImageLayout finalLayout) {
+    uint32_t index = renderGraphAddResource(graph, name, RENDER_GRAPH_IMAGE, false);
+    struct RenderGraphResource* resource = &graph->resources[index];
+    resource->aspect = aspect;
+    resource->initialLayout = initialLayout;
+    resource->initialStages = initialStages;
+    resource->initialAccess = initialAccess;
+    resource->finalLayout = finalLayout;
+    return index;
+}
+
+// A buffer last written by an earlier submission the host already waited for needs no initial
+// stages, one written earlier on the queue does.
+uint32_t renderGraphImportBuffer(struct RenderGraph* graph, const char* name,
+                                 VkPipelineStageFlags initialStages, VkAccessFlags initialAccess) {
+    uint32_t index = renderGraphAddResource(graph, name, RENDER_GRAPH_BUFFER, false);
+    graph->resources[index].initialStages = initialStages;
+    graph->resources[index].initialAccess = initialAccess;
+    return index;
+}
+
+// Single sample 2D image with a single level, and a view of aspect.
+uint32_t renderGraphCreateImage(struct RenderGraph* graph, const char* name, VkFormat format,
+                                VkExtent2D extent, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+    uint32_t index = renderGraphAddResource(graph, name, RENDER_GRAPH_IMAGE, true);
+    struct RenderGraphResource* resource = &graph->resources[index];
+    resource->format = format;
+    resource->extent = extent;
+    resource->imageUsage = usage;
+    resource->aspect = aspect;
+    return index;
+}
+
+uint32_t renderGraphCreateBuffer(struct RenderGraph* graph, const char* name, VkDeviceSize size,
+                                 VkBufferUsageFlags usage) {
+    uint32_t index = renderGraphAddResource(graph, name, RENDER_GRAPH_BUFFER, true);
+    graph->resources[index].size = size;
+    graph->resources[index].bufferUsage = usage;
+    return index;
+}
+
+uint32_t renderGraphAddPass(struct RenderGraph* graph, const char* name, RenderGraphRecordFunction record,
+                            uint32_t flags) {
+    if(graph->passCount == RENDER_GRAPH_MAX_PASSES) {
+        fprintf(stderr, "Render graph has more than %u passes, aborting.", RENDER_GRAPH_MAX_PASSES);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t index = graph->passCount++;
+    struct RenderGraphPass* pass = &graph->passes[index];
+    memset(pass, 0, sizeof(*pass));
+    pass->name = name;
+    pass->record = record;
+    pass->flags = flags;
+    return index;
+}
+
+// Declares that the pass uses resource in stages with access, in layout for images. Uses of the
+// same resource by the same pass are merged, they must agree on the layout.
+void renderGraphUse(struct RenderGraph* graph, uint32_t pass, uint32_t resource, VkPipelineStageFlags stages,
+                    VkAccessFlags access, VkImageLayout layout) {
+    struct RenderGraphPass* graphPass = &graph->passes[pass];
+    for(uint32_t i = 0; i < graphPass->accessCount; i++) {
+        struct RenderGraphAccess* existing = &graphPass->accesses[i];
+        if(existing->resource != resource) {
+            continue;
+        }
+        if(existing->layout != layout) {
+            fprintf(stderr, "Pass %s uses %s in two layouts, aborting.", graphPass->name,
+                    graph->resources[resource].name);
+            exit(EXIT_FAILURE);
+        }
+        existing->stages |= stages;
+        existing->access |= access;
+        return;
+    }
+    if(graphPass->accessCount == RENDER_GRAPH_MAX_PASS_ACCESSES) {
+        fprintf(stderr, "Pass %s uses more than %u resources, aborting.", graphPass->name,
+                RENDER_GRAPH_MAX_PASS_ACCESSES);
+        exit(EXIT_FAILURE);
+    }
+    struct RenderGraphAccess* added = &graphPass->accesses[graphPass->accessCount++];
+    added->resource = resource;
+    added->stages = stages;
+    added->access = access;
+    added->layout = graph->resources[resource].type == RENDER_GRAPH_IMAGE ? layout : VK_IMAGE_LAYOUT_UNDEFINED;
+}
+
+// Walks the passes backwards, keeping those with RENDER_GRAPH_PASS_KEEP, those writing imported
+// resources and those writing what a kept pass reads.
+void renderGraphCullPasses(struct RenderGraph* graph) {
+    bool needed[RENDER_GRAPH_MAX_RESOURCES] = {};
+    graph->culledPassCount = 0;
+    for(uint32_t i = graph->passCount; i-- > 0;) {
+        struct RenderGraphPass* pass = &graph->passes[i];
+        bool keep = pass->flags & RENDER_GRAPH_PASS_KEEP;
+        for(uint32_t j = 0; j < pass->accessCount && !keep; j++) {
+            const struct RenderGraphAccess* access = &pass->accesses[j];
+            keep = (access->access & RENDER_GRAPH_WRITE_ACCESS) &&
+                   (!graph->resources[access->resource].transient || needed[access->resource]);
+        }
+        pass->culled = !keep;
+        if(!keep) {
+            graph->culledPassCount++;
+            continue;
+        }
+        for(uint32_t j = 0; j < pass->accessCount; j++) {
+            const struct RenderGraphAccess* access = &pass->accesses[j];
+            if(access->access & ~RENDER_GRAPH_WRITE_ACCESS) {
+                needed[access->resource] = true;
+            }
+        }
+    }
+}
+
+// Lifetimes over the kept passes, and the state each resource is left in.
+void renderGraphFindLifetimes(struct RenderGraph* graph) {
+    VkImageLayout layouts[RENDER_GRAPH_MAX_RESOURCES];
+    for(uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource* resource = &graph->resources[i];
+        resource->used = false;
+        resource->lastStages = 0;
+        resource->lastWriteAccess = 0;
+        layouts[i] = resource->transient ? VK_IMAGE_LAYOUT_UNDEFINED : resource->initialLayout;
+    }
+    for(uint32_t i = 0; i < graph->passCount; i++) {
+        const struct RenderGraphPass* pass = &graph->passes[i];
+        if(pass->culled) {
+            continue;
+        }
+        for(uint32_t j = 0; j < pass->accessCount; j++) {
+            const struct RenderGraphAccess* access = &pass->accesses[j];
+            struct RenderGraphResource* resource = &graph->resources[access->resource];
+            if(!resource->used) {
+                resource->used = true;
+                resource->firstPass = i;
+            }
+            resource->lastPass = i + 1;
+            bool transition = resource->type == RENDER_GRAPH_IMAGE && layouts[access->resource] != access->layout;
+            if(transition || (access->access & RENDER_GRAPH_WRITE_ACCESS)) {
+                resource->lastStages = access->stages;
+                resource->lastWriteAccess = access->access & RENDER_GRAPH_WRITE_ACCESS;
+            } else {
+                resource->lastStages |= access->stages;
+            }
+            layouts[access->resource] = access->layout;
+        }
+    }
+}
+
+bool renderGraphMemoryOverlaps(const struct RenderGraphResource* a, const struct RenderGraphResource* b) {
+    return a->heap == b->heap && a->offset < b->offset + b->memorySize && b->offset < a->offset + a->memorySize;
+}
+
+bool renderGraphLifetimesOverlap(const struct RenderGraphResource* a, const struct RenderGraphResource* b) {
+    return a->firstPass < b->lastPass && b->firstPass < a->lastPass;
+}
+
+// Creates the used transient resources and places them in a heap per memory type, largest
+// first, each at the lowest offset clear of the resources already placed whose lifetimes
+// overlap its own.
+void renderGraphAllocate(struct RenderGraph* graph, VkDevice device, VkPhysicalDevice physicalDevice) {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    // Buffers and optimal images may end up next to each other in any order.
+    VkDeviceSize granularity = deviceProperties.limits.bufferImageGranularity;
+
+    uint32_t order[RENDER_GRAPH_MAX_RESOURCES];
+    uint32_t orderCount = 0;
+    for(uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource* resource = &graph->resources[i];
+        if(!resource->transient || !resource->used) {
+            continue;
+        }
+        VkMemoryRequirements requirements;
+        if(resource->type == RENDER_GRAPH_IMAGE) {
+            VkImageCreateInfo imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = resource->format;
+            imageInfo.extent.width = resource->extent.width;
+            imageInfo.extent.height = resource->extent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = resource->imageUsage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            if(vkCreateImage(device, &imageInfo, NULL, &resource->image) != VK_SUCCESS) {
+                fprintf(stderr, "vkCreateImage failed for %s, aborting.", resource->name);
+                exit(EXIT_FAILURE);
+            }
+            vkGetImageMemoryRequirements(device, resource->image, &requirements);
+        } else {
+            VkBufferCreateInfo bufferInfo = {};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = resource->size;
+            bufferInfo.usage = resource->bufferUsage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if(vkCreateBuffer(device, &bufferInfo, NULL, &resource->buffer) != VK_SUCCESS) {
+                fprintf(stderr, "vkCreateBuffer failed for %s, aborting.", resource->name);
+                exit(EXIT_FAILURE);
+            }
+            vkGetBufferMemoryRequirements(device, resource->buffer, &requirements);
+        }
+        resource->memoryAlignment = requirements.alignment > granularity ? requirements.alignment : granularity;
+        resource->memorySize = (requirements.size + granularity - 1) / granularity * granularity;
+        resource->memoryTypeBits = requirements.memoryTypeBits;
+        graph->unaliasedTransientMemory += resource->memorySize;
+        uint32_t position = orderCount++;
+        while(position > 0 && graph->resources[order[position - 1]].memorySize < resource->memorySize) {
+            order[position] = order[position - 1];
+            position--;
+        }
+        order[position] = i;
+    }
+
+    for(uint32_t i = 0; i < orderCount; i++) {
+        struct RenderGraphResource* resource = &graph->resources[order[i]];
+        uint32_t memoryType = UINT32_MAX;
+        for(uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++) {
+            if((resource->memoryTypeBits & (1u << j)) && (memoryProperties.memoryTypes[j].propertyFlags &
+                                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+                memoryType = j;
+                break;
+            }
+        }
+        if(memoryType == UINT32_MAX) {
+            fprintf(stderr, "No device local memory type for %s, aborting.", resource->name);
+            exit(EXIT_FAILURE);
+        }
+        uint32_t heap = 0;
+        while(heap < graph->heapCount && graph->heaps[heap].memoryType != memoryType) {
+            heap++;
+        }
+        if(heap == graph->heapCount) {
+            if(graph->heapCount == RENDER_GRAPH_MAX_HEAPS) {
+                fprintf(stderr, "Render graph needs more than %u memory types, aborting.", RENDER_GRAPH_MAX_HEAPS);
+                exit(EXIT_FAILURE);
+            }
+            graph->heaps[graph->heapCount++].memoryType = memoryType;
+        }
+        resource->heap = heap;
+        // Moves past every conflicting resource in the way until none is.
+        resource->offset = 0;
+        bool moved = true;
+        while(moved) {
+            moved = false;
+            for(uint32_t j = 0; j < i; j++) {
+                const struct RenderGraphResource* placed = &graph->resources[order[j]];
+                if(renderGraphLifetimesOverlap(resource, placed) && renderGraphMemoryOverlaps(resource, placed)) {
+                    VkDeviceSize end = placed->offset + placed->memorySize;
+                    resource->offset = (end + resource->memoryAlignment - 1) / resource->memoryAlignment *
+                                       resource->memoryAlignment;
+                    moved = true;
+                }
+            }
+        }
+        if(resource->offset + resource->memorySize > graph->heaps[heap].size) {
+            graph->heaps[heap].size = resource->offset + resource->memorySize;
+        }
+    }
+
+    for(uint32_t i = 0; i < graph->heapCount; i++) {
+        struct RenderGraphHeap* heap = &graph->heaps[i];
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = heap->size;
+        allocInfo.memoryTypeIndex = heap->memoryType;
+        if(vkAllocateMemory(device, &allocInfo, NULL, &heap->memory) != VK_SUCCESS) {
+            fprintf(stderr, "vkAllocateMemory failed for the render graph, aborting.");
+            exit(EXIT_FAILURE);
+        }
+        graph->transientMemory += heap->size;
+    }
+    for(uint32_t i = 0; i < orderCount; i++) {
+        struct RenderGraphResource* resource = &graph->resources[order[i]];
+        VkDeviceMemory memory = graph->heaps[resource->heap].memory;
+        if(resource->type == RENDER_GRAPH_BUFFER) {
+            vkBindBufferMemory(device, resource->buffer, memory, resource->offset);
+            continue;
+        }
+        vkBindImageMemory(device, resource->image, memory, resource->offset);
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = resource->image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = resource->format;
+        viewInfo.subresourceRange.aspectMask = resource->aspect;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+        if(vkCreateImageView(device, &viewInfo, NULL, &resource->view) != VK_SUCCESS) {
+            fprintf(stderr, "vkCreateImageView failed for %s, aborting.", resource->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Tracked per resource while computing the barriers.
+struct RenderGraphState {
+    VkImageLayout layout;
+    // The last write or transition, and the reads since.
+    VkPipelineStageFlags writeStages;
+    VkAccessFlags writeAccess;
+    VkPipelineStageFlags readStages;
+    // What the last write has been made visible to.
+    VkPipelineStageFlags visibleStages;
+    VkAccessFlags visibleAccess;
+};
+
+void renderGraphAddTransition(struct RenderGraph* graph, struct RenderGraphBarrier* barrier, uint32_t resource,
+                              VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess,
+                              VkAccessFlags dstAccess) {
+    if(barrier->transitionCount == 0) {
+        barrier->firstTransition = graph->transitionCount;
+    }
+    struct RenderGraphTransition* transition = &graph->transitions[graph->transitionCount++];
+    transition->resource = resource;
+    transition->oldLayout = oldLayout;
+    transition->newLayout = newLayout;
+    transition->srcAccess = srcAccess;
+    transition->dstAccess = dstAccess;
+    barrier->transitionCount++;
+}
+
+// Only hazards get a barrier: reading what an earlier pass wrote unless it was already made
+// visible to the reading stages, writing over earlier reads or writes, and changing layouts.
+// Reads after reads in the same layout need nothing.
+void renderGraphComputeBarriers(struct RenderGraph* graph) {
+    struct RenderGraphState states[RENDER_GRAPH_MAX_RESOURCES] = {};
+    for(uint32_t i = 0; i < graph->resourceCount; i++) {
+        const struct RenderGraphResource* resource = &graph->resources[i];
+        struct RenderGraphState* state = &states[i];
+        if(!resource->transient) {
+            state->layout = resource->initialLayout;
+            state->writeStages = resource->initialStages;
+            state->writeAccess = resource->initialAccess;
+            continue;
+        }
+        if(!resource->used) {
+            continue;
+        }
+        // Waits for the earlier occupants of its memory in this execution, or without any, for
+        // all of them in the previous execution, itself included.
+        bool earlier = false;
+        for(uint32_t round = 0; round < 2 && !earlier; round++) {
+            for(uint32_t j = 0; j < graph->resourceCount; j++) {
+                const struct RenderGraphResource* other = &graph->resources[j];
+                if(!other->transient || !other->used || !renderGraphMemoryOverlaps(resource, other) ||
+                   (round == 0 && other->lastPass > resource->firstPass)) {
+                    continue;
+                }
+                state->writeStages |= other->lastStages;
+                state->writeAccess |= other->lastWriteAccess;
+                earlier = round == 0;
+            }
+        }
+    }
+
+    graph->transitionCount = 0;
+    graph->barrierCount = 0;
+    for(uint32_t i = 0; i < graph->passCount; i++) {
+        struct RenderGraphPass* pass = &graph->passes[i];
+        struct RenderGraphBarrier* barrier = &pass->barrier;
+        memset(barrier, 0, sizeof(*barrier));
+        if(pass->culled) {
+            continue;
+        }
+        for(uint32_t j = 0; j < pass->accessCount; j++) {
+            const struct RenderGraphAccess* access = &pass->accesses[j];
+            struct RenderGraphState* state = &states[access->resource];
+            bool write = access->access & RENDER_GRAPH_WRITE_ACCESS;
+            bool transition = graph->resources[access->resource].type == RENDER_GRAPH_IMAGE &&
+                              state->layout != access->layout;
+            if(transition) {
+                barrier->srcStages |= state->writeStages | state->readStages;
+                barrier->dstStages |= access->stages;
+                renderGraphAddTransition(graph, barrier, access->resource, state->layout, access->layout,
+                                         state->writeAccess, access->access);
+                // Later passes in other stages wait for the transition through these.
+                state->layout = access->layout;
+                state->writeStages = access->stages;
+                state->writeAccess = access->access & RENDER_GRAPH_WRITE_ACCESS;
+                state->readStages = 0;
+                state->visibleStages = write ? 0 : access->stages;
+                state->visibleAccess = write ? 0 : access->access;
+            } else if(write) {
+                if(state->writeStages | state->readStages) {
+                    barrier->srcStages |= state->writeStages | state->readStages;
+                    barrier->srcAccess |= state->writeAccess;
+                    barrier->dstStages |= access->stages;
+                    barrier->dstAccess |= access->access;
+                }
+                state->writeStages = access->stages;
+                state->writeAccess = access->access & RENDER_GRAPH_WRITE_ACCESS;
+                state->readStages = 0;
+                state->visibleStages = 0;
+                state->visibleAccess = 0;
+            } else {
+                if(state->writeStages && ((access->stages & ~state->visibleStages) ||
+                                          (access->access & ~state->visibleAccess))) {
+                    barrier->srcStages |= state->writeStages;
+                    barrier->srcAccess |= state->writeAccess;
+                    barrier->dstStages |= access->stages;
+                    barrier->dstAccess |= access->access;
+                    state->visibleStages |= access->stages;
+                    state->visibleAccess |= access->access;
+                }
+                state->readStages |= access->stages;
+            }
+        }
+        if(barrier->dstStages) {
+            graph->barrierCount++;
+        }
+    }
+
+    struct RenderGraphBarrier* finalBarrier = &graph->finalBarrier;
+    memset(finalBarrier, 0, sizeof(*finalBarrier));
+    for(uint32_t i = 0; i < graph->resourceCount; i++) {
+        const struct RenderGraphResource* resource = &graph->resources[i];
+        const struct RenderGraphState* state = &states[i];
+        if(resource->transient || resource->type != RENDER_GRAPH_IMAGE ||
+           resource->finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource->finalLayout == state->layout) {
+            continue;
+        }
+        finalBarrier->srcStages |= state->writeStages | state->readStages;
+        finalBarrier->dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        renderGraphAddTransition(graph, finalBarrier, i, state->layout, resource->finalLayout,
+                                 state->writeAccess, 0);
+    }
+    if(finalBarrier->dstStages) {
+        graph->barrierCount++;
+    }
+}
+
+// Compiles once for many executions, after all resources and passes are declared.
+void renderGraphCompile(struct RenderGraph* graph, VkDevice device, VkPhysicalDevice physicalDevice) {
+    renderGraphCullPasses(graph);
+    renderGraphFindLifetimes(graph);
+    renderGraphAllocate(graph, device, physicalDevice);
+    renderGraphComputeBarriers(graph);
+}
+
+void renderGraphSetImage(struct RenderGraph* graph, uint32_t resource, VkImage image) {
+    graph->resources[resource].image = image;
+}
+
+bool renderGraphFormatHasStencil(VkFormat format) {
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+           format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+void renderGraphRecordBarrier(const struct RenderGraph* graph, VkCommandBuffer commandBuffer,
+                              const struct RenderGraphBarrier* barrier) {
+    if(barrier->dstStages == 0) {
+        return;
+    }
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = barrier->srcAccess;
+    memoryBarrier.dstAccessMask = barrier->dstAccess;
+    VkImageMemoryBarrier imageBarriers[RENDER_GRAPH_MAX_PASS_ACCESSES + RENDER_GRAPH_MAX_RESOURCES];
+    for(uint32_t i = 0; i < barrier->transitionCount; i++) {
+        const struct RenderGraphTransition* transition = &graph->transitions[barrier->firstTransition + i];
+        const struct RenderGraphResource* resource = &graph->resources[transition->resource];
+        VkImageMemoryBarrier* imageBarrier = &imageBarriers[i];
+        memset(imageBarrier, 0, sizeof(*imageBarrier));
+        imageBarrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier->srcAccessMask = transition->srcAccess;
+        imageBarrier->dstAccessMask = transition->dstAccess;
+        imageBarrier->oldLayout = transition->oldLayout;
+        imageBarrier->newLayout = transition->newLayout;
+        imageBarrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier->image = resource->image;
+        imageBarrier->subresourceRange.aspectMask = resource->aspect;
+        if(renderGraphFormatHasStencil(resource->format)) {
+            // Depth and stencil change layout together.
+            imageBarrier->subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        imageBarrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        imageBarrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    }
+    // A transition out of nothing, e.g. a transient image's first, waits for no stage.
+    VkPipelineStageFlags srcStages = barrier->srcStages ? barrier->srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    bool memory = barrier->srcAccess | barrier->dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, barrier->dstStages, 0, memory ? 1 : 0, &memoryBarrier,
+                         0, NULL, barrier->transitionCount, imageBarriers);
+}
+
+// frameData is handed to every pass's record function.
+void renderGraphExecute(const struct RenderGraph* graph, VkCommandBuffer commandBuffer, void* frameData) {
+    for(uint32_t i = 0; i < graph->passCount; i++) {
+        const struct RenderGraphPass* pass = &graph->passes[i];
+        if(pass->culled) {
+            continue;
+        }
+        renderGraphRecordBarrier(graph, commandBuffer, &pass->barrier);
+        pass->record(commandBuffer, frameData);
+    }
+    renderGraphRecordBarrier(graph, commandBuffer, &graph->finalBarrier);
+}
+
+// Destroys the transient resources and forgets every declaration, ready to be declared again.
+void renderGraphDestroy(struct RenderGraph* graph, VkDevice device) {
+    for(uint32_t i = 0; i < graph->resourceCount; i++) {
+        struct RenderGraphResource* resource = &graph->resources[i];
+        if(!resource->transient) {
+            continue;
+        }
+        vkDestroyImageView(device, resource->view, NULL);
+        vkDestroyImage(device, resource->image, NULL);
+        vkDestroyBuffer(device, resource->buffer, NULL);
+    }
+    for(uint32_t i = 0; i < graph->heapCount; i++) {
+        vkFreeMemory(device, graph->heaps[i].memory, NULL);
+    }
+    memset(graph, 0, sizeof(*graph));
+}
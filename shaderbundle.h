@@ -0,0 +1,151 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "hash.h"
+#include "mappedfile.h"
+#include "spirvcompress.h"
+
+// Shader bundle: many named SPIR-V modules in one file, written by spvToHeaders --bundle.
+// Layout, all offsets from the start of the file:
+//   struct ShaderBundleHeader
+//   struct ShaderBundleSlot[slotCount]   open addressing on the name hash, linear probing
+//   NUL-terminated names
+//   SPIR-V blobs, each aligned to SHADER_BUNDLE_ALIGNMENT
+// The file is memory-mapped and raw module words are handed to vkCreateShaderModule in
+// place, so only the pages of shaders that are actually used are ever read. Blobs may also
+// be stored compressed (see spirvcompress.h), shaderBundleLoad() decodes those.
+#define SHADER_BUNDLE_MAGIC 0x4c444e42 // "BNDL"
+#define SHADER_BUNDLE_VERSION 2
+#define SHADER_BUNDLE_ALIGNMENT 16
+
+struct ShaderBundleHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Hash of the inputs and settings the bundle was built from, see spvToHeaders.
+    uint64_t contentHash;
+    uint32_t entryCount;
+    // Power of two, at least twice entryCount.
+    uint32_t slotCount;
+};
+
+struct ShaderBundleSlot {
+    // 0 marks an empty slot, see shaderBundleNameHash().
+    uint64_t nameHash;
+    uint32_t nameOffset;
+    uint32_t codeOffset;
+    // Size of the SPIR-V in bytes.
+    uint32_t codeSize;
+    // Bytes in the file: equal to codeSize when stored raw, smaller when compressed.
+    uint32_t storedSize;
+};
+
+struct ShaderBundle {
+    struct MappedFile file;
+    // Aliases of file.data and file.size.
+    const uint8_t* data;
+    size_t size;
+    const struct ShaderBundleHeader* header;
+    const struct ShaderBundleSlot* slots;
+};
+
+uint64_t shaderBundleNameHash(const char* name) {
+    uint64_t hash = hashBytes64(name, strlen(name));
+    return hash ? hash : 1;
+}
+
+// Only the header and index are checked here, the code pages stay untouched until used.
+bool shaderBundleValidate(const struct ShaderBundle* bundle) {
+    if(bundle->size < sizeof(struct ShaderBundleHeader)) {
+        return false;
+    }
+    const struct ShaderBundleHeader* header = bundle->header;
+    if(header->magic != SHADER_BUNDLE_MAGIC || header->version != SHADER_BUNDLE_VERSION ||
+       header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0 ||
+       header->slotCount > (bundle->size - sizeof(struct ShaderBundleHeader)) /
+                           sizeof(struct ShaderBundleSlot)) {
+        return false;
+    }
+    for(uint32_t i = 0; i < header->slotCount; i++) {
+        const struct ShaderBundleSlot* slot = &bundle->slots[i];
+        if(slot->nameHash == 0) {
+            continue;
+        }
+        if(slot->nameOffset >= bundle->size ||
+           !memchr(bundle->data + slot->nameOffset, '\0', bundle->size - slot->nameOffset) ||
+           slot->codeOffset % 4 != 0 || slot->codeSize % 4 != 0 || slot->storedSize > slot->codeSize ||
+           slot->codeOffset > bundle->size || slot->storedSize > bundle->size - slot->codeOffset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void shaderBundleClose(struct ShaderBundle* bundle) {
+    mappedFileClose(&bundle->file);
+    memset(bundle, 0, sizeof(*bundle));
+}
+
+bool shaderBundleOpen(struct ShaderBundle* bundle, const char* path) {
+    memset(bundle, 0, sizeof(*bundle));
+    if(!mappedFileOpen(&bundle->file, path)) {
+        return false;
+    }
+    bundle->data = bundle->file.data;
+    bundle->size = bundle->file.size;
+    bundle->header = (const struct ShaderBundleHeader*)bundle->data;
+    bundle->slots = (const struct ShaderBundleSlot*)(bundle->data + sizeof(struct ShaderBundleHeader));
+    if(!shaderBundleValidate(bundle)) {
+        shaderBundleClose(bundle);
+        return false;
+    }
+    return true;
+}
+
+const struct ShaderBundleSlot* shaderBundleFindSlot(const struct ShaderBundle* bundle,
+                                                   const char* name) {
+    uint64_t nameHash = shaderBundleNameHash(name);
+    uint32_t mask = bundle->header->slotCount - 1;
+    for(uint32_t probe = 0; probe <= mask; probe++) {
+        const struct ShaderBundleSlot* slot = &bundle->slots[(nameHash + probe) & mask];
+        if(slot->nameHash == 0) {
+            return NULL;
+        }
+        if(slot->nameHash == nameHash &&
+           strcmp((const char*)bundle->data + slot->nameOffset, name) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+// Returns the module words inside the mapping, valid until shaderBundleClose(), or NULL when
+// the bundle has no raw shader with that name. size is in bytes.
+const uint32_t* shaderBundleFind(const struct ShaderBundle* bundle, const char* name,
+                                 uint32_t* size) {
+    const struct ShaderBundleSlot* slot = shaderBundleFindSlot(bundle, name);
+    if(!slot || slot->storedSize != slot->codeSize) {
+        return NULL;
+    }
+    *size = slot->codeSize;
+    return (const uint32_t*)(bundle->data + slot->codeOffset);
+}
+
+// Like shaderBundleFind() but also accepts compressed entries, which are decoded into arena
+// and stay valid until the next decode into it. Returns NULL when the name is missing or the
+// entry does not decode.
+const uint32_t* shaderBundleLoad(const struct ShaderBundle* bundle, const char* name,
+                                 struct SpirvDecodeArena* arena, uint32_t* size) {
+    const struct ShaderBundleSlot* slot = shaderBundleFindSlot(bundle, name);
+    if(!slot) {
+        return NULL;
+    }
+    *size = slot->codeSize;
+    if(slot->storedSize == slot->codeSize) {
+        return (const uint32_t*)(bundle->data + slot->codeOffset);
+    }
+    return spirvDecompress(arena, bundle->data + slot->codeOffset, slot->storedSize,
+                           slot->codeSize);
+}
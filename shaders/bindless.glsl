@@ -0,0 +1,16 @@
+// Global bindless descriptor table, see createBindlessDescriptors() in vulkan.c.
+// Include with #extension GL_GOOGLE_include_directive : require.
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Declares a typed view of the storage buffer array, e.g.
+// BINDLESS_BUFFER(readonly, Instance, instanceBuffers) then instanceBuffers[handle].items[i].
+#define BINDLESS_BUFFER(access, Type, name) \
+    layout(set = 0, binding = 0) access buffer name##Block { Type items[]; } name[]
+
+layout(set = 0, binding = 1) uniform sampler2D bindlessTextures[];
+
+// Must match struct PushConstants in vulkan.c.
+layout(push_constant) uniform PushConstants {
+    uint resourceHandles[8];
+    uint parameters[8];
+} pushConstants;
@@ -1,8 +1,15 @@
+REM The .spv files and generated headers are not tracked, list new ones in .gitignore.
 %VULKAN_SDK%\bin\glslc.exe shader.vert -o vert.spv
 %VULKAN_SDK%\bin\glslc.exe shader.frag -o frag.spv
+%VULKAN_SDK%\bin\glslc.exe cull.comp -o cull.spv
+%VULKAN_SDK%\bin\glslc.exe hiz.comp -o hiz.spv
+REM Subgroup operations need SPIR-V 1.3.
+%VULKAN_SDK%\bin\glslc.exe --target-env=vulkan1.1 scan.comp -o scan.spv
+%VULKAN_SDK%\bin\glslc.exe histogram.comp -o histogram.spv
+%VULKAN_SDK%\bin\glslc.exe --target-env=vulkan1.1 onesweep.comp -o onesweep.spv
+%VULKAN_SDK%\bin\glslc.exe --target-env=vulkan1.1 reduce.comp -o reduce.spv
 cd spvToHeader/
 call build.bat
-call spvToHeaders.exe ../vert.spv ../frag.spv
+REM Extra arguments (buildRelease.bat passes --strip --compress) go straight to spvToHeaders.
+call spvToHeaders.exe --bundle ../../shaders.bundle %* -o ../.. ../vert.spv ../frag.spv ../cull.spv ../hiz.spv ../scan.spv ../histogram.spv ../onesweep.spv ../reduce.spv
 cd ..
-MOVE vert.h ..
-MOVE frag.h ..
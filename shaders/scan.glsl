@@ -0,0 +1,40 @@
+// Workgroup-wide scan built from subgroup scans, shared by the compute primitives.
+// Include with #extension GL_GOOGLE_include_directive : require after defining
+// SCAN_WORKGROUP_SIZE as local_size_x, with GL_KHR_shader_subgroup_arithmetic enabled.
+
+// One sum per subgroup, enough for subgroups of a single invocation.
+shared uint scanSubgroupSums[SCAN_WORKGROUP_SIZE];
+shared uint scanTotal;
+
+// Exclusive prefix sum of value over the invocations of the workgroup in invocation order, and
+// in total the sum of all of them. Every invocation has to call it, it synchronises the
+// workgroup. The first subgroup scans the sums of the subgroups, gl_SubgroupSize of them at a
+// time, as there may be more subgroups than it has invocations.
+uint workgroupExclusiveAdd(uint value, out uint total) {
+    uint inclusive = subgroupInclusiveAdd(value);
+    if (gl_SubgroupInvocationID == gl_SubgroupSize - 1) {
+        scanSubgroupSums[gl_SubgroupID] = inclusive;
+    }
+    barrier();
+    if (gl_SubgroupID == 0) {
+        uint carry = 0;
+        for (uint first = 0; first < gl_NumSubgroups; first += gl_SubgroupSize) {
+            uint index = first + gl_SubgroupInvocationID;
+            uint sum = index < gl_NumSubgroups ? scanSubgroupSums[index] : 0u;
+            uint sumInclusive = subgroupInclusiveAdd(sum);
+            if (index < gl_NumSubgroups) {
+                scanSubgroupSums[index] = carry + sumInclusive - sum;
+            }
+            carry += subgroupAdd(sum);
+        }
+        if (gl_SubgroupInvocationID == 0) {
+            scanTotal = carry;
+        }
+    }
+    barrier();
+    total = scanTotal;
+    uint exclusive = scanSubgroupSums[gl_SubgroupID] + inclusive - value;
+    // The next call overwrites the sums.
+    barrier();
+    return exclusive;
+}
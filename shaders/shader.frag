@@ -1,9 +1,21 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+#include "bindless.glsl"
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    // The material's tint, see struct Material in vulkan.c.
+    vec3 tint = uintBitsToFloat(uvec3(pushConstants.parameters[0], pushConstants.parameters[1],
+                                      pushConstants.parameters[2]));
+    vec3 color = fragColor * tint;
+    // Invalid without a texture or until it is uploaded. The same for the whole draw.
+    uint textureHandle = pushConstants.resourceHandles[0];
+    if (textureHandle != 0xffffffffu) {
+        color *= texture(bindlessTextures[textureHandle], fragTexCoord).rgb;
+    }
+    outColor = vec4(color, 1.0);
 }
@@ -1,11 +1,39 @@
 #version 450
 
+// Per-vertex inputs, stored in any of the vertex formats in vertexformat.h.
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
+// Octahedral, see vertexOctahedralEncode().
+layout(location = 2) in vec2 inNormal;
+
+// Per-instance inputs, see struct MeshInstance in vulkan.c.
+layout(location = 3) in vec2 instanceOffset;
+layout(location = 4) in vec2 instanceScale;
+layout(location = 5) in vec3 instanceColor;
+// 0 is nearest, see DEPTH_SORT_FRONT_TO_BACK in vulkan.c.
+layout(location = 6) in float instanceDepth;
 
 layout(location = 0) out vec3 fragColor;
+// The quad spans the texture once, top left at the origin. Other meshes get the same planar
+// projection over their extent.
+layout(location = 1) out vec2 fragTexCoord;
+
+// Lights meshes from the viewer, normals facing it keep their full color.
+const vec3 lightDirection = vec3(0.0, 0.0, 1.0);
+const float ambient = 0.25;
+
+vec3 octDecode(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
 
 void main() {
-    gl_Position = vec4(inPosition, 0.0, 0.6);
-    fragColor = inColor;
+    // z is divided by w like x and y.
+    gl_Position = vec4(inPosition * instanceScale + instanceOffset, instanceDepth * 0.6, 0.6);
+    float diffuse = max(dot(octDecode(inNormal), lightDirection), 0.0);
+    fragColor = inColor * instanceColor * (ambient + (1.0 - ambient) * diffuse);
+    fragTexCoord = inPosition + 0.5;
 }
@@ -0,0 +1,738 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimal SPIR-V definitions and interface reflection for spvToHeaders.
+#define SPIRV_MAGIC 0x07230203
+#define SPIRV_HEADER_WORDS 5
+#define SPIRV_NONE UINT32_MAX
+
+enum SpirvOp {
+    OpName = 5,
+    OpMemberName = 6,
+    OpExtension = 10,
+    OpExtInstImport = 11,
+    OpExtInst = 12,
+    OpEntryPoint = 15,
+    OpExecutionMode = 16,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpFunction = 54,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpDecorateId = 332,
+};
+
+enum SpirvDecoration {
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationArrayStride = 6,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+enum SpirvStorageClass {
+    StorageClassUniformConstant = 0,
+    StorageClassInput = 1,
+    StorageClassUniform = 2,
+    StorageClassPushConstant = 9,
+    StorageClassStorageBuffer = 12,
+};
+
+enum SpirvExecutionModel {
+    ExecutionModelVertex = 0,
+    ExecutionModelFragment = 4,
+    ExecutionModelGLCompute = 5,
+};
+
+enum SpirvExecutionMode {
+    ExecutionModeLocalSize = 17,
+};
+
+#define SPIRV_MAX_ATTRIBUTES 32
+#define SPIRV_MAX_BINDINGS 64
+
+struct SpirvAttribute {
+    uint32_t location;
+    const char* format;
+    uint32_t size;
+};
+
+struct SpirvBinding {
+    uint32_t set;
+    uint32_t binding;
+    const char* type;
+    // 0 for runtime sized (bindless) arrays.
+    uint32_t count;
+};
+
+struct SpirvReflection {
+    uint32_t executionModel;
+    uint32_t attributeCount;
+    struct SpirvAttribute attributes[SPIRV_MAX_ATTRIBUTES];
+    uint32_t bindingCount;
+    struct SpirvBinding bindings[SPIRV_MAX_BINDINGS];
+    uint32_t pushConstantSize;
+    // Workgroup size of compute shaders, 0 otherwise.
+    uint32_t localSize[3];
+};
+
+struct SpirvModule {
+    const uint32_t* words;
+    uint32_t wordCount;
+    uint32_t idBound;
+    // Instruction defining each id, NULL when the id is not a type, constant or variable.
+    const uint32_t** definitions;
+    uint32_t* locations;
+    uint32_t* bindings;
+    uint32_t* descriptorSets;
+    uint32_t* arrayStrides;
+    bool* isBuiltIn;
+    bool* isBlock;
+    bool* isBufferBlock;
+};
+
+#define SPIRV_FOR_EACH_INSTRUCTION(module, instruction) \
+    for (const uint32_t* instruction = (module)->words + SPIRV_HEADER_WORDS; \
+         instruction < (module)->words + (module)->wordCount && (*instruction >> 16) != 0; \
+         instruction += *instruction >> 16)
+
+bool spirvValidate(const uint32_t* words, uint32_t wordCount) {
+    if (wordCount < SPIRV_HEADER_WORDS || words[0] != SPIRV_MAGIC) {
+        return false;
+    }
+    uint32_t offset = SPIRV_HEADER_WORDS;
+    while (offset < wordCount) {
+        uint32_t length = words[offset] >> 16;
+        if (length == 0 || offset + length > wordCount) {
+            return false;
+        }
+        offset += length;
+    }
+    return true;
+}
+
+void spirvLoad(struct SpirvModule* module, const uint32_t* words, uint32_t wordCount) {
+    memset(module, 0, sizeof(*module));
+    module->words = words;
+    module->wordCount = wordCount;
+    module->idBound = words[3];
+    uint32_t bound = module->idBound;
+    module->definitions = calloc(bound, sizeof(uint32_t*));
+    module->locations = malloc(bound * sizeof(uint32_t));
+    module->bindings = malloc(bound * sizeof(uint32_t));
+    module->descriptorSets = malloc(bound * sizeof(uint32_t));
+    module->arrayStrides = calloc(bound, sizeof(uint32_t));
+    module->isBuiltIn = calloc(bound, sizeof(bool));
+    module->isBlock = calloc(bound, sizeof(bool));
+    module->isBufferBlock = calloc(bound, sizeof(bool));
+    for (uint32_t i = 0; i < bound; i++) {
+        module->locations[i] = SPIRV_NONE;
+        module->bindings[i] = SPIRV_NONE;
+        module->descriptorSets[i] = SPIRV_NONE;
+    }
+
+    SPIRV_FOR_EACH_INSTRUCTION(module, instruction) {
+        uint32_t opcode = instruction[0] & 0xffff;
+        switch (opcode) {
+            case OpDecorate: {
+                uint32_t target = instruction[1];
+                uint32_t decoration = instruction[2];
+                if (target >= bound) break;
+                if (decoration == DecorationLocation) module->locations[target] = instruction[3];
+                if (decoration == DecorationBinding) module->bindings[target] = instruction[3];
+                if (decoration == DecorationDescriptorSet) module->descriptorSets[target] = instruction[3];
+                if (decoration == DecorationArrayStride) module->arrayStrides[target] = instruction[3];
+                if (decoration == DecorationBuiltIn) module->isBuiltIn[target] = true;
+                if (decoration == DecorationBlock) module->isBlock[target] = true;
+                if (decoration == DecorationBufferBlock) module->isBufferBlock[target] = true;
+                break;
+            }
+            case OpTypeInt: case OpTypeFloat: case OpTypeVector: case OpTypeMatrix:
+            case OpTypeImage: case OpTypeSampler: case OpTypeSampledImage: case OpTypeArray:
+            case OpTypeRuntimeArray: case OpTypeStruct: case OpTypePointer:
+                if (instruction[1] < bound) module->definitions[instruction[1]] = instruction;
+                break;
+            case OpConstant: case OpVariable:
+                // Result id follows the result type.
+                if (instruction[2] < bound) module->definitions[instruction[2]] = instruction;
+                break;
+        }
+    }
+}
+
+void spirvFree(struct SpirvModule* module) {
+    free(module->definitions);
+    free(module->locations);
+    free(module->bindings);
+    free(module->descriptorSets);
+    free(module->arrayStrides);
+    free(module->isBuiltIn);
+    free(module->isBlock);
+    free(module->isBufferBlock);
+}
+
+uint32_t spirvOpcode(const uint32_t* instruction) {
+    return instruction ? instruction[0] & 0xffff : 0;
+}
+
+const uint32_t* spirvDefinition(const struct SpirvModule* module, uint32_t id) {
+    return id < module->idBound ? module->definitions[id] : NULL;
+}
+
+uint32_t spirvMemberDecoration(const struct SpirvModule* module, uint32_t structId,
+                               uint32_t member, uint32_t decoration) {
+    SPIRV_FOR_EACH_INSTRUCTION(module, instruction) {
+        if (spirvOpcode(instruction) == OpMemberDecorate && instruction[1] == structId &&
+            instruction[2] == member && instruction[3] == decoration) {
+            return (instruction[0] >> 16) > 4 ? instruction[4] : 0;
+        }
+    }
+    return SPIRV_NONE;
+}
+
+// Size in bytes of a type as laid out in a buffer or push constant block.
+uint32_t spirvTypeSize(const struct SpirvModule* module, uint32_t typeId) {
+    const uint32_t* type = spirvDefinition(module, typeId);
+    switch (spirvOpcode(type)) {
+        case OpTypeInt:
+        case OpTypeFloat:
+            return type[2] / 8;
+        case OpTypeVector:
+            return spirvTypeSize(module, type[2]) * type[3];
+        case OpTypeMatrix:
+            return spirvTypeSize(module, type[2]) * type[3];
+        case OpTypeArray: {
+            const uint32_t* length = spirvDefinition(module, type[3]);
+            uint32_t count = spirvOpcode(length) == OpConstant ? length[3] : 1;
+            uint32_t stride = module->arrayStrides[typeId];
+            if (stride == 0) stride = spirvTypeSize(module, type[2]);
+            return stride * count;
+        }
+        case OpTypeStruct: {
+            uint32_t memberCount = (type[0] >> 16) - 2;
+            uint32_t size = 0;
+            for (uint32_t i = 0; i < memberCount; i++) {
+                uint32_t offset = spirvMemberDecoration(module, typeId, i, DecorationOffset);
+                if (offset == SPIRV_NONE) offset = size;
+                uint32_t memberSize = spirvTypeSize(module, type[2 + i]);
+                const uint32_t* memberType = spirvDefinition(module, type[2 + i]);
+                uint32_t matrixStride = spirvMemberDecoration(module, typeId, i, DecorationMatrixStride);
+                if (spirvOpcode(memberType) == OpTypeMatrix && matrixStride != SPIRV_NONE) {
+                    memberSize = matrixStride * memberType[3];
+                }
+                if (offset + memberSize > size) size = offset + memberSize;
+            }
+            return size;
+        }
+    }
+    return 0;
+}
+
+// VkFormat name for a vertex input of the given scalar or vector type.
+const char* spirvVertexFormat(const struct SpirvModule* module, uint32_t typeId) {
+    static const char* floatFormats[] = {"VK_FORMAT_R32_SFLOAT", "VK_FORMAT_R32G32_SFLOAT",
+        "VK_FORMAT_R32G32B32_SFLOAT", "VK_FORMAT_R32G32B32A32_SFLOAT"};
+    static const char* intFormats[] = {"VK_FORMAT_R32_SINT", "VK_FORMAT_R32G32_SINT",
+        "VK_FORMAT_R32G32B32_SINT", "VK_FORMAT_R32G32B32A32_SINT"};
+    static const char* uintFormats[] = {"VK_FORMAT_R32_UINT", "VK_FORMAT_R32G32_UINT",
+        "VK_FORMAT_R32G32B32_UINT", "VK_FORMAT_R32G32B32A32_UINT"};
+    const uint32_t* type = spirvDefinition(module, typeId);
+    uint32_t componentCount = 1;
+    if (spirvOpcode(type) == OpTypeVector) {
+        componentCount = type[3];
+        type = spirvDefinition(module, type[2]);
+    }
+    if (componentCount < 1 || componentCount > 4) return NULL;
+    if (spirvOpcode(type) == OpTypeFloat && type[2] == 32) return floatFormats[componentCount - 1];
+    if (spirvOpcode(type) == OpTypeInt && type[2] == 32) {
+        return type[3] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+    }
+    return NULL;
+}
+
+const char* spirvDescriptorType(const struct SpirvModule* module, uint32_t storageClass,
+                                uint32_t typeId) {
+    const uint32_t* type = spirvDefinition(module, typeId);
+    switch (spirvOpcode(type)) {
+        case OpTypeSampledImage: return "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER";
+        case OpTypeSampler: return "VK_DESCRIPTOR_TYPE_SAMPLER";
+        case OpTypeImage: 
+            return type[7] == 2 ? "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE" : "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE";
+        case OpTypeStruct:
+            if (storageClass == StorageClassStorageBuffer || module->isBufferBlock[typeId]) {
+                return "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER";
+            }
+            return "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER";
+    }
+    return NULL;
+}
+
+int compareAttributes(const void* a, const void* b) {
+    const struct SpirvAttribute* attributeA = a;
+    const struct SpirvAttribute* attributeB = b;
+    return (attributeA->location > attributeB->location) - (attributeA->location < attributeB->location);
+}
+
+int compareBindings(const void* a, const void* b) {
+    const struct SpirvBinding* bindingA = a;
+    const struct SpirvBinding* bindingB = b;
+    if (bindingA->set != bindingB->set) return bindingA->set < bindingB->set ? -1 : 1;
+    return (bindingA->binding > bindingB->binding) - (bindingA->binding < bindingB->binding);
+}
+
+// Collects vertex inputs (vertex shaders only), descriptor bindings, the push constant
+// block size and the workgroup size (compute shaders only). Returns false for constructs the
+// generated tables cannot describe.
+bool spirvReflect(const struct SpirvModule* module, struct SpirvReflection* reflection) {
+    memset(reflection, 0, sizeof(*reflection));
+    reflection->executionModel = SPIRV_NONE;
+    SPIRV_FOR_EACH_INSTRUCTION(module, instruction) {
+        if (spirvOpcode(instruction) == OpEntryPoint) {
+            reflection->executionModel = instruction[1];
+            break;
+        }
+    }
+    SPIRV_FOR_EACH_INSTRUCTION(module, instruction) {
+        if (spirvOpcode(instruction) == OpExecutionMode && (*instruction >> 16) >= 6 &&
+            instruction[2] == ExecutionModeLocalSize &&
+            reflection->executionModel == ExecutionModelGLCompute) {
+            reflection->localSize[0] = instruction[3];
+            reflection->localSize[1] = instruction[4];
+            reflection->localSize[2] = instruction[5];
+        }
+    }
+
+    SPIRV_FOR_EACH_INSTRUCTION(module, instruction) {
+        if (spirvOpcode(instruction) != OpVariable) continue;
+        uint32_t variable = instruction[2];
+        uint32_t storageClass = instruction[3];
+        const uint32_t* pointer = spirvDefinition(module, instruction[1]);
+        if (spirvOpcode(pointer) != OpTypePointer) continue;
+        uint32_t typeId = pointer[3];
+
+        if (storageClass == StorageClassInput) {
+            if (reflection->executionModel != ExecutionModelVertex) continue;
+            if (module->isBuiltIn[variable] || module->locations[variable] == SPIRV_NONE) continue;
+            // Matrices take one location per column.
+            const uint32_t* type = spirvDefinition(module, typeId);
+            uint32_t columns = 1;
+            uint32_t columnType = typeId;
+            if (spirvOpcode(type) == OpTypeMatrix) {
+                columns = type[3];
+                columnType = type[2];
+            }
+            const char* format = spirvVertexFormat(module, columnType);
+            if (!format) {
+                fprintf(stderr, "Unsupported vertex input type at location %u.\n", 
+                        module->locations[variable]);
+                return false;
+            }
+            for (uint32_t column = 0; column < columns; column++) {
+                if (reflection->attributeCount == SPIRV_MAX_ATTRIBUTES) return false;
+                struct SpirvAttribute* attribute = &reflection->attributes[reflection->attributeCount++];
+                attribute->location = module->locations[variable] + column;
+                attribute->format = format;
+                attribute->size = spirvTypeSize(module, columnType);
+            }
+        } else if (storageClass == StorageClassPushConstant) {
+            uint32_t size = spirvTypeSize(module, typeId);
+            if (size > reflection->pushConstantSize) reflection->pushConstantSize = size;
+        } else if (storageClass == StorageClassUniform || storageClass == StorageClassUniformConstant ||
+                   storageClass == StorageClassStorageBuffer) {
+            if (module->bindings[variable] == SPIRV_NONE) continue;
+            uint32_t count = 1;
+            const uint32_t* type = spirvDefinition(module, typeId);
+            if (spirvOpcode(type) == OpTypeArray) {
+                const uint32_t* length = spirvDefinition(module, type[3]);
+                count = spirvOpcode(length) == OpConstant ? length[3] : 1;
+                typeId = type[2];
+            } else if (spirvOpcode(type) == OpTypeRuntimeArray) {
+                count = 0;
+                typeId = type[2];
+            }
+            const char* descriptorType = spirvDescriptorType(module, storageClass, typeId);
+            if (!descriptorType) continue;
+            if (reflection->bindingCount == SPIRV_MAX_BINDINGS) return false;
+            struct SpirvBinding* binding = &reflection->bindings[reflection->bindingCount++];
+            binding->set = module->descriptorSets[variable] == SPIRV_NONE ? 0 : module->descriptorSets[variable];
+            binding->binding = module->bindings[variable];
+            binding->type = descriptorType;
+            binding->count = count;
+        }
+    }
+    qsort(reflection->attributes, reflection->attributeCount, sizeof(struct SpirvAttribute),
+          compareAttributes);
+    qsort(reflection->bindings, reflection->bindingCount, sizeof(struct SpirvBinding),
+          compareBindings);
+    // Several typed views of one binding (as bindless.glsl declares) are one descriptor.
+    uint32_t uniqueCount = 0;
+    for (uint32_t i = 0; i < reflection->bindingCount; i++) {
+        if (uniqueCount > 0 && compareBindings(&reflection->bindings[uniqueCount - 1],
+                                               &reflection->bindings[i]) == 0) {
+            continue;
+        }
+        reflection->bindings[uniqueCount++] = reflection->bindings[i];
+    }
+    reflection->bindingCount = uniqueCount;
+    return true;
+}
+
+// Operand layouts used to find id operands. One character per operand:
+//   T result type id, R result id, I id, L literal word, S string literal,
+//   i optional id, s optional string, l optional literal,
+//   M optional memory operands, G optional image operands,
+//   + repeat the following operand kind until the end of the instruction,
+//   P remaining operands are (literal, id) pairs, Q remaining are (id, literal) pairs.
+const char* spirvOperandLayout(uint32_t opcode) {
+    switch (opcode) {
+        case 0: return "";                          // OpNop
+        case 1: return "TR";                        // OpUndef
+        case 2: return "S";                         // OpSourceContinued
+        case 3: return "LLis";                      // OpSource
+        case 4: return "S";                         // OpSourceExtension
+        case 5: return "IS";                        // OpName
+        case 6: return "ILS";                       // OpMemberName
+        case 7: return "RS";                        // OpString
+        case 8: return "ILL";                       // OpLine
+        case 10: return "S";                        // OpExtension
+        case 11: return "RS";                       // OpExtInstImport
+        case 12: return "TRIL+I";                   // OpExtInst
+        case 14: return "LL";                       // OpMemoryModel
+        case 15: return "LIS+I";                    // OpEntryPoint
+        case 16: return "IL+L";                     // OpExecutionMode
+        case 17: return "L";                        // OpCapability
+        case 19: case 20: case 26: return "R";      // OpTypeVoid, Bool, Sampler
+        case 21: return "RLL";                      // OpTypeInt
+        case 22: return "RL";                       // OpTypeFloat
+        case 23: case 24: return "RIL";             // OpTypeVector, Matrix
+        case 25: return "RILLLLLLl";                // OpTypeImage
+        case 27: case 29: return "RI";              // OpTypeSampledImage, RuntimeArray
+        case 28: return "RII";                      // OpTypeArray
+        case 30: return "R+I";                      // OpTypeStruct
+        case 32: return "RLI";                      // OpTypePointer
+        case 33: return "RI+I";                     // OpTypeFunction
+        case 39: return "IL";                       // OpTypeForwardPointer
+        case 41: case 42: case 46: case 48: case 49: return "TR";
+        case 43: case 50: return "TR+L";            // OpConstant, OpSpecConstant
+        case 44: case 51: return "TR+I";            // OpConstantComposite, OpSpecConstantComposite
+        case 45: return "TRLLL";                    // OpConstantSampler
+        case 52: return "TRL+I";                    // OpSpecConstantOp
+        case 54: return "TRLI";                     // OpFunction
+        case 55: return "TR";                       // OpFunctionParameter
+        case 56: return "";                         // OpFunctionEnd
+        case 57: return "TRI+I";                    // OpFunctionCall
+        case 59: return "TRLi";                     // OpVariable
+        case 60: return "TRIII";                    // OpImageTexelPointer
+        case 61: return "TRIM";                     // OpLoad
+        case 62: return "IIM";                      // OpStore
+        case 63: return "IIMM";                     // OpCopyMemory
+        case 64: return "IIIM";                     // OpCopyMemorySized
+        case 65: case 66: return "TRI+I";           // OpAccessChain, OpInBoundsAccessChain
+        case 67: case 70: return "TRII+I";          // OpPtrAccessChain, OpInBoundsPtrAccessChain
+        case 68: return "TRIL";                     // OpArrayLength
+        case 71: return "IL+L";                     // OpDecorate
+        case 72: return "ILL+L";                    // OpMemberDecorate
+        case 73: return "R";                        // OpDecorationGroup
+        case 74: return "I+I";                      // OpGroupDecorate
+        case 75: return "IQ";                       // OpGroupMemberDecorate
+        case 77: return "TRII";                     // OpVectorExtractDynamic
+        case 78: return "TRIII";                    // OpVectorInsertDynamic
+        case 79: return "TRII+L";                   // OpVectorShuffle
+        case 80: return "TR+I";                     // OpCompositeConstruct
+        case 81: return "TRI+L";                    // OpCompositeExtract
+        case 82: return "TRII+L";                   // OpCompositeInsert
+        case 83: case 84: return "TRI";             // OpCopyObject, OpTranspose
+        case 86: return "TRII";                     // OpSampledImage
+        case 87: case 91: case 95: case 98: return "TRIIG";
+        case 88: case 92: return "TRIIG";
+        case 89: case 90: case 93: case 94: case 96: case 97: return "TRIIIG";
+        case 99: return "IIIG";                     // OpImageWrite
+        case 100: case 104: case 106: case 107: return "TRI";
+        case 103: case 105: return "TRII";
+        case 218: case 219: case 252: case 253: case 255: case 4416: return "";
+        case 224: return "III";                     // OpControlBarrier
+        case 225: return "II";                      // OpMemoryBarrier
+        case 228: return "IIII";                    // OpAtomicStore
+        case 245: return "TR+I";                    // OpPhi
+        case 246: return "IIL+L";                   // OpLoopMerge
+        case 247: return "IL";                      // OpSelectionMerge
+        case 248: return "R";                       // OpLabel
+        case 249: return "I";                       // OpBranch
+        case 250: return "III+L";                   // OpBranchConditional
+        case 251: return "IIP";                     // OpSwitch
+        case 254: return "I";                       // OpReturnValue
+        case 317: return "";                        // OpNoLine
+        case 330: return "S";                       // OpModuleProcessed
+        case 331: return "IL+I";                    // OpExecutionModeId
+        case 332: return "IL+I";                    // OpDecorateId
+        case 333: return "TRI";                     // OpGroupNonUniformElect
+        case 342: return "TRILI";                   // OpGroupNonUniformBallotBitCount
+        case 5381: return "TR";                     // OpIsHelperInvocationEXT
+        case 5380: return "";                       // OpDemoteToHelperInvocation
+    }
+    // Value instructions whose operands are all ids: conversions, arithmetic, relational and
+    // logical, bit, derivative and atomic instructions, and most group operations.
+    if ((opcode >= 109 && opcode <= 152) || (opcode >= 154 && opcode <= 205) ||
+        (opcode >= 207 && opcode <= 215) || (opcode >= 227 && opcode <= 242) ||
+        (opcode >= 334 && opcode <= 341) || (opcode >= 343 && opcode <= 348) ||
+        (opcode >= 365 && opcode <= 366) || (opcode >= 400 && opcode <= 403)) {
+        return "TR+I";
+    }
+    // Group arithmetic: scope, group operation, value and an optional cluster size.
+    if (opcode >= 349 && opcode <= 364) {
+        return "TRIL+I";
+    }
+    return NULL;
+}
+
+uint32_t spirvStringWords(const uint32_t* words, uint32_t available) {
+    const char* text = (const char*)words;
+    size_t maxLength = (size_t)available * 4;
+    size_t length = strnlen(text, maxLength);
+    return (uint32_t)(length / 4 + 1);
+}
+
+// Writes the word offsets of every id operand (including the result id) into idOffsets and
+// returns how many there are, or -1 when the layout of the instruction is unknown. The result
+// id offset, if any, is stored in resultOffset.
+int spirvIdOperands(const uint32_t* instruction, uint32_t* idOffsets, uint32_t* resultOffset) {
+    uint32_t opcode = instruction[0] & 0xffff;
+    uint32_t length = instruction[0] >> 16;
+    const char* layout = spirvOperandLayout(opcode);
+    *resultOffset = 0;
+    if (!layout) {
+        return -1;
+    }
+    int count = 0;
+    uint32_t offset = 1;
+    for (const char* kind = layout; *kind && offset < length; kind++) {
+        bool repeat = *kind == '+';
+        if (repeat) {
+            kind++;
+        }
+        char current = *kind;
+        do {
+            switch (current) {
+                case 'T': case 'I': case 'i':
+                    idOffsets[count++] = offset++;
+                    break;
+                case 'R':
+                    *resultOffset = offset;
+                    idOffsets[count++] = offset++;
+                    break;
+                case 'L': case 'l':
+                    offset++;
+                    break;
+                case 'S': case 's':
+                    offset += spirvStringWords(instruction + offset, length - offset);
+                    break;
+                case 'M': {
+                    // Volatile, Aligned (followed by a literal) and Nontemporal only.
+                    uint32_t mask = instruction[offset++];
+                    if (mask & ~0x7u) return -1;
+                    if (mask & 0x2u) offset++;
+                    break;
+                }
+                case 'G':
+                    // Image operand mask followed by id operands.
+                    offset++;
+                    while (offset < length) idOffsets[count++] = offset++;
+                    break;
+                case 'P':
+                    while (offset + 1 < length) {
+                        offset++;
+                        idOffsets[count++] = offset++;
+                    }
+                    break;
+                case 'Q':
+                    while (offset + 1 < length) {
+                        idOffsets[count++] = offset++;
+                        offset++;
+                    }
+                    break;
+            }
+        } while (repeat && offset < length);
+    }
+    if (offset != length) {
+        return -1;
+    }
+    return count;
+}
+
+struct SpirvStripResult {
+    uint32_t originalWords;
+    uint32_t strippedWords;
+    bool compacted;
+};
+
+bool spirvIsDebugInstruction(uint32_t opcode) {
+    return opcode == 2 || opcode == 3 || opcode == 4 || opcode == 5 || opcode == 6 ||
+           opcode == 7 || opcode == 8 || opcode == 317 || opcode == 330;
+}
+
+bool spirvIsRemovableGlobal(uint32_t opcode) {
+    return (opcode >= 19 && opcode <= 33) || (opcode >= 41 && opcode <= 46) ||
+           (opcode >= 48 && opcode <= 52) || opcode == OpVariable || opcode == 1;
+}
+
+// Release-mode size optimisation: removes debug and non-semantic instructions, drops
+// module-level types, constants and variables nothing refers to, and renumbers ids densely.
+// Writes the new module to output (at least wordCount words) and returns its word count.
+uint32_t spirvStrip(const uint32_t* words, uint32_t wordCount, uint32_t* output,
+                    struct SpirvStripResult* result) {
+    uint32_t bound = words[3];
+    bool* removed = calloc(wordCount, sizeof(bool));
+    bool* nonSemanticSet = calloc(bound, sizeof(bool));
+    uint32_t* references = calloc(bound, sizeof(uint32_t));
+    uint32_t* idOffsets = malloc(sizeof(uint32_t) * wordCount);
+    bool layoutsKnown = true;
+
+    // Debug instructions and NonSemantic extended instruction sets carry no semantics.
+    uint32_t offset = SPIRV_HEADER_WORDS;
+    while (offset < wordCount) {
+        const uint32_t* instruction = words + offset;
+        uint32_t opcode = instruction[0] & 0xffff;
+        uint32_t length = instruction[0] >> 16;
+        if (spirvIsDebugInstruction(opcode)) {
+            removed[offset] = true;
+        } else if (opcode == OpExtInstImport && strncmp((const char*)(instruction + 2), "NonSemantic.", 12) == 0) {
+            nonSemanticSet[instruction[1]] = true;
+            removed[offset] = true;
+        } else if (opcode == OpExtInst && instruction[3] < bound && nonSemanticSet[instruction[3]]) {
+            removed[offset] = true;
+        } else if (opcode == OpExtension && strcmp((const char*)(instruction + 1),
+                                          "SPV_KHR_non_semantic_info") == 0) {
+            removed[offset] = true;
+        }
+        offset += length;
+    }
+
+    // Repeatedly drop unreferenced globals: removing one may orphan the types it used.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        memset(references, 0, sizeof(uint32_t) * bound);
+        for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+            const uint32_t* instruction = words + offset;
+            uint32_t opcode = instruction[0] & 0xffff;
+            uint32_t length = instruction[0] >> 16;
+            if (removed[offset]) continue;
+            uint32_t resultOffset;
+            int idCount = spirvIdOperands(instruction, idOffsets, &resultOffset);
+            if (idCount < 0) {
+                // Unknown layout: count every word that could be an id, which can only
+                // keep more alive than necessary.
+                layoutsKnown = false;
+                for (uint32_t i = 1; i < length; i++) {
+                    if (instruction[i] < bound) references[instruction[i]]++;
+                }
+                continue;
+            }
+            bool isDecoration = opcode == OpDecorate || opcode == OpMemberDecorate || opcode == OpDecorateId;
+            for (int i = 0; i < idCount; i++) {
+                if (idOffsets[i] == resultOffset) continue;
+                if (isDecoration && idOffsets[i] == 1) continue;
+                references[instruction[idOffsets[i]]]++;
+            }
+        }
+        for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+            const uint32_t* instruction = words + offset;
+            uint32_t opcode = instruction[0] & 0xffff;
+            if (removed[offset]) continue;
+            if (opcode == OpFunction) break;
+            if (!spirvIsRemovableGlobal(opcode)) continue;
+            uint32_t resultOffset;
+            if (spirvIdOperands(instruction, idOffsets, &resultOffset) < 0 || resultOffset == 0) continue;
+            if (references[instruction[resultOffset]] == 0) {
+                removed[offset] = true;
+                changed = true;
+            }
+        }
+        // Decorations of removed ids go too. Any word of an instruction of unknown layout may
+        // be the id it defines, so decorations of those ids stay.
+        bool* defined = calloc(bound, sizeof(bool));
+        for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+            uint32_t length = words[offset] >> 16;
+            uint32_t resultOffset;
+            if (removed[offset]) continue;
+            int idCount = spirvIdOperands(words + offset, idOffsets, &resultOffset);
+            if (idCount < 0) {
+                for (uint32_t i = 1; i < length; i++) {
+                    if (words[offset + i] < bound) defined[words[offset + i]] = true;
+                }
+            } else if (resultOffset != 0) {
+                defined[words[offset + resultOffset]] = true;
+            }
+        }
+        for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+            uint32_t opcode = words[offset] & 0xffff;
+            if (removed[offset]) continue;
+            if ((opcode == OpDecorate || opcode == OpMemberDecorate || opcode == OpDecorateId) &&
+                !defined[words[offset + 1]]) {
+                removed[offset] = true;
+            }
+        }
+        free(defined);
+    }
+
+    // Copy what is left, renumbering ids in order of definition when every layout is known.
+    uint32_t* remap = calloc(bound, sizeof(uint32_t));
+    uint32_t nextId = 1;
+    if (layoutsKnown) {
+        for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+            uint32_t resultOffset;
+            if (removed[offset]) continue;
+            spirvIdOperands(words + offset, idOffsets, &resultOffset);
+            if (resultOffset != 0 && remap[words[offset + resultOffset]] == 0) {
+                remap[words[offset + resultOffset]] = nextId++;
+            }
+        }
+    }
+    memcpy(output, words, SPIRV_HEADER_WORDS * sizeof(uint32_t));
+    uint32_t outputCount = SPIRV_HEADER_WORDS;
+    for (offset = SPIRV_HEADER_WORDS; offset < wordCount; offset += words[offset] >> 16) {
+        uint32_t length = words[offset] >> 16;
+        if (removed[offset]) continue;
+        uint32_t* copy = output + outputCount;
+        memcpy(copy, words + offset, length * sizeof(uint32_t));
+        outputCount += length;
+        if (!layoutsKnown) continue;
+        uint32_t resultOffset;
+        int idCount = spirvIdOperands(copy, idOffsets, &resultOffset);
+        for (int i = 0; i < idCount; i++) {
+            copy[idOffsets[i]] = remap[copy[idOffsets[i]]];
+        }
+    }
+    if (layoutsKnown) {
+        output[3] = nextId;
+    }
+
+    result->originalWords = wordCount;
+    result->strippedWords = outputCount;
+    result->compacted = layoutsKnown;
+    free(remap);
+    free(idOffsets);
+    free(references);
+    free(nonSemanticSet);
+    free(removed);
+    return outputCount;
+}
@@ -5,6 +5,193 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "../../hash.h"
+#include "../../shaderbundle.h"
+#include "../../spirvcompress.h"
+#include "spirv.h"
+
+// Output is assembled in memory and written with a single fwrite per file.
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define WORDS_PER_LINE 8
+#define MAX_THREADS 64
+// Bump when the generated output changes so stale outputs are regenerated.
+#define GENERATOR_VERSION 8
+// Decodes averaged for the --compress timing report.
+#define DECODE_BENCHMARK_RUNS 100
+#define HASH_LINE_PREFIX "// spvToHeaders hash "
+
+enum EmitMode {
+    EMIT_HEADER, // C array in a header, works with any compiler.
+    EMIT_INCBIN, // Assembly file that .incbin's the SPIR-V plus a header declaring it.
+    EMIT_BUNDLE  // SPIR-V goes into a shader bundle, the header only has reflection.
+};
+
+struct ShaderJob {
+    const char* shaderName;
+    enum EmitMode mode;
+    const char* outputDirectory;
+    // Release mode: embed the module without debug info, dead globals or id gaps.
+    bool strip;
+    // Bundle mode only: store the module compressed when that is smaller.
+    bool compress;
+    // Bundle mode only: set when the bundle is rebuilt, so current modules are processed too.
+    bool needsStored;
+    // Filled in by generateHeader().
+    bool generated;
+    int fileSize;
+    int embeddedSize;
+    double milliseconds;
+    // Bundle mode only: the bytes as they go into the bundle, their name and content hash.
+    char* name;
+    uint8_t* stored;
+    int storedSize;
+    double decodeMilliseconds;
+    uint64_t hash;
+};
+
+double currentMilliseconds() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#endif
+}
+
+struct OutputBuffer {
+    char* data;
+    size_t size;
+    size_t capacity;
+};
+
+void outputReserve(struct OutputBuffer* output, size_t extra) {
+    if (output->size + extra <= output->capacity) {
+        return;
+    }
+    size_t capacity = output->capacity ? output->capacity : OUTPUT_BUFFER_SIZE;
+    while (capacity < output->size + extra) {
+        capacity *= 2;
+    }
+    output->data = realloc(output->data, capacity);
+    if (!output->data) {
+        fprintf(stderr, "Failed to allocate output buffer, aborting.\n");
+        exit(EXIT_FAILURE);
+    }
+    output->capacity = capacity;
+}
+
+void outputAppend(struct OutputBuffer* output, const char* text) {
+    size_t length = strlen(text);
+    outputReserve(output, length);
+    memcpy(output->data + output->size, text, length);
+    output->size += length;
+}
+
+void outputPrintf(struct OutputBuffer* output, const char* format, const char* a, const char* b) {
+    char line[1024];
+    snprintf(line, sizeof(line), format, a, b);
+    outputAppend(output, line);
+}
+
+// Constant tables describing the shader interface, so pipeline creation needs no
+// hand-written vertex layouts and no runtime allocation.
+void appendReflection(struct OutputBuffer* output, const char* listName,
+                      const struct SpirvReflection* reflection) {
+    char line[512];
+    outputAppend(output, "#include <vulkan/vulkan.h>\n");
+    outputAppend(output, "#ifndef SHADER_REFLECTION_TYPES\n");
+    outputAppend(output, "#define SHADER_REFLECTION_TYPES\n");
+    outputAppend(output, "struct ShaderInputAttribute {\n");
+    outputAppend(output, "    uint32_t location;\n");
+    outputAppend(output, "    VkFormat format;\n");
+    outputAppend(output, "    uint32_t size;\n");
+    outputAppend(output, "};\n");
+    outputAppend(output, "struct ShaderDescriptorBinding {\n");
+    outputAppend(output, "    uint32_t set;\n");
+    outputAppend(output, "    uint32_t binding;\n");
+    outputAppend(output, "    VkDescriptorType descriptorType;\n");
+    outputAppend(output, "    uint32_t descriptorCount; // 0 for runtime sized arrays\n");
+    outputAppend(output, "};\n");
+    outputAppend(output, "#endif\n");
+
+    snprintf(line, sizeof(line), "#define %sInputAttributeCount %u\n", listName,
+             reflection->attributeCount);
+    outputAppend(output, line);
+    snprintf(line, sizeof(line), "const struct ShaderInputAttribute %sInputAttributes[] = {\n", listName);
+    outputAppend(output, line);
+    for (uint32_t i = 0; i < reflection->attributeCount; i++) {
+        const struct SpirvAttribute* attribute = &reflection->attributes[i];
+        snprintf(line, sizeof(line), "    {%u, %s, %u},\n", attribute->location, attribute->format,
+                 attribute->size);
+        outputAppend(output, line);
+    }
+    if (reflection->attributeCount == 0) {
+        outputAppend(output, "    {0, VK_FORMAT_UNDEFINED, 0},\n");
+    }
+    outputAppend(output, "};\n");
+
+    uint32_t packedSize = 0;
+    for (uint32_t i = 0; i < reflection->attributeCount; i++) {
+        packedSize += reflection->attributes[i].size;
+    }
+    snprintf(line, sizeof(line), "#define %sInputPackedSize %u\n", listName, packedSize);
+    outputAppend(output, line);
+
+    snprintf(line, sizeof(line), "#define %sDescriptorBindingCount %u\n", listName,
+             reflection->bindingCount);
+    outputAppend(output, line);
+    snprintf(line, sizeof(line), "const struct ShaderDescriptorBinding %sDescriptorBindings[] = {\n",
+             listName);
+    outputAppend(output, line);
+    for (uint32_t i = 0; i < reflection->bindingCount; i++) {
+        const struct SpirvBinding* binding = &reflection->bindings[i];
+        snprintf(line, sizeof(line), "    {%u, %u, %s, %u},\n", binding->set, binding->binding,
+                 binding->type, binding->count);
+        outputAppend(output, line);
+    }
+    if (reflection->bindingCount == 0) {
+        outputAppend(output, "    {0, 0, VK_DESCRIPTOR_TYPE_SAMPLER, 0},\n");
+    }
+    outputAppend(output, "};\n");
+
+    snprintf(line, sizeof(line), "#define %sPushConstantSize %u\n", listName,
+             reflection->pushConstantSize);
+    outputAppend(output, line);
+
+    if (reflection->executionModel == ExecutionModelGLCompute) {
+        static const char axes[] = "XYZ";
+        for (uint32_t i = 0; i < 3; i++) {
+            snprintf(line, sizeof(line), "#define %sLocalSize%c %u\n", listName, axes[i],
+                     reflection->localSize[i]);
+            outputAppend(output, line);
+        }
+    }
+}
+
+void writeOutput(const char* path, const struct OutputBuffer* output) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to create file %s, aborting.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (fwrite(output->data, 1, output->size, file) != output->size) {
+        fprintf(stderr, "Failed to write file %s, aborting.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+}
 
 char* extract_filename_prefix(const char* path) {
     // Find the last occurrence of '/'
@@ -42,8 +229,104 @@ char* extract_filename_prefix(const char* path) {
     return prefix;
 }
 
-void generateHeader(const char* shaderName) {
-    printf("Generating for %s...\n", shaderName);
+// Outputs go to outputDirectory when given. Otherwise relative inputs ("../vert.spv") get
+// their outputs next to them, anything else in the working directory. The extension
+// includes the dot.
+char* outputPath(const char* shaderName, const char* outputDirectory, const char* listName,
+                 const char* extension) {
+    size_t directoryLength = 0;
+    if (outputDirectory) {
+        directoryLength = strlen(outputDirectory) + 1;
+        char* path = malloc(directoryLength + strlen(listName) + strlen(extension) + 1);
+        strcpy(path, outputDirectory);
+        strcat(path, "/");
+        strcat(path, listName);
+        strcat(path, extension);
+        return path;
+    }
+    if (shaderName[1] == '.') {
+        const char* lastBSlash = strrchr(shaderName, '\\');
+        const char* lastFSlash = strrchr(shaderName, '/');
+        const char* lastSlash = !lastBSlash ? lastFSlash : lastBSlash;
+        directoryLength = lastSlash - shaderName + 1;
+    }
+    char* path = malloc(directoryLength + strlen(listName) + strlen(extension) + 1);
+    memcpy(path, shaderName, directoryLength);
+    strcpy(path + directoryLength, listName);
+    strcat(path, extension);
+    return path;
+}
+
+// Absolute path with forward slashes, so the assembler finds the SPIR-V regardless of
+// where the generated file is assembled from.
+char* absolutePath(const char* path) {
+#ifdef _WIN32
+    char* resolved = _fullpath(NULL, path, 0);
+#else
+    char* resolved = realpath(path, NULL);
+#endif
+    if (!resolved) {
+        fprintf(stderr, "Failed to resolve path %s, aborting.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    for (char* c = resolved; *c; c++) {
+        if (*c == '\\') *c = '/';
+    }
+    return resolved;
+}
+
+void appendWords(struct OutputBuffer* output, const uint32_t* words, uint32_t wordCount) {
+    static const char hexDigits[] = "0123456789abcdef";
+    // "0x%08x, " is 12 characters, plus indentation and newline per line.
+    outputReserve(output, (size_t)wordCount * 12 + (wordCount / WORDS_PER_LINE + 1) * 5);
+    char* cursor = output->data + output->size;
+    for (uint32_t i = 0; i < wordCount; i++) {
+        if (i % WORDS_PER_LINE == 0) {
+            memcpy(cursor, "    ", 4);
+            cursor += 4;
+        }
+        uint32_t word = words[i];
+        *cursor++ = '0';
+        *cursor++ = 'x';
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            *cursor++ = hexDigits[(word >> shift) & 0xf];
+        }
+        *cursor++ = ',';
+        if (i % WORDS_PER_LINE == WORDS_PER_LINE - 1 || i == wordCount - 1) {
+            *cursor++ = '\n';
+        } else {
+            *cursor++ = ' ';
+        }
+    }
+    output->size = cursor - output->data;
+}
+
+// True when path starts with the hash line written for this input, so regenerating would
+// produce identical files and only touch their timestamps.
+bool isUpToDate(const char* path, const char* hashLine) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char line[64] = {};
+    size_t length = fread(line, 1, strlen(hashLine), file);
+    fclose(file);
+    return length == strlen(hashLine) && memcmp(line, hashLine, length) == 0;
+}
+
+bool fileExists(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+void generateHeader(struct ShaderJob* job) {
+    double startTime = currentMilliseconds();
+    const char* shaderName = job->shaderName;
+    enum EmitMode mode = job->mode;
     FILE* shader = fopen(shaderName, "rb");
     if (!shader) {
         fprintf(stderr, "Failed to open file %s, aborting.\n", shaderName);
@@ -65,59 +348,479 @@ void generateHeader(const char* shaderName) {
     }
     fread(buffer, 1, fileSize, shader);
     fclose(shader);
+    if (!spirvValidate(buffer, fileSize / 4)) {
+        fprintf(stderr, "%s is not valid SPIR-V, aborting.\n", shaderName);
+        exit(EXIT_FAILURE);
+    }
 
-    char* lastPrefix = extract_filename_prefix(shaderName);
+    char* listName = extract_filename_prefix(shaderName);
+    char* headerName = outputPath(shaderName, job->outputDirectory, listName, ".h");
+    char* assemblyName = outputPath(shaderName, job->outputDirectory, listName, ".S");
+    char* strippedName = outputPath(shaderName, job->outputDirectory, listName, ".min.spv");
+    job->fileSize = fileSize;
+    job->embeddedSize = fileSize;
 
-    if (shaderName[1] == '.') {
-        char* lastBSlash = strrchr(shaderName, '\\');
-        char* lastFSlash = strrchr(shaderName, '/');
-        char* lastSlash = !lastBSlash ? lastFSlash : lastBSlash;
-        int indexOfSlash = lastSlash - shaderName;
-        int lengthOfPostfix = strlen(lastPrefix);
-        char* newName = malloc(indexOfSlash + 1 + lengthOfPostfix + 3);
-        strncpy(newName, shaderName, indexOfSlash + 1);
-        strcpy(newName + indexOfSlash + 1, lastPrefix);
-        newName[indexOfSlash + lengthOfPostfix + 1] = '.';
-        newName[indexOfSlash + lengthOfPostfix + 2] = 'h';
-        newName[indexOfSlash + lengthOfPostfix + 3] = '\0';
-        free(lastPrefix);
-        lastPrefix = newName;
-    }
-    char* headerName = lastPrefix;
-    FILE* header = fopen(headerName, "w");
-    if (!header) {
-        fprintf(stderr, "Failed to create file %s, aborting.\n", headerName);
+    // The key covers everything the outputs depend on: content, mode, stripping and generator.
+    uint32_t settings[4] = {GENERATOR_VERSION, (uint32_t)mode, (uint32_t)job->strip,
+                            (uint32_t)job->compress};
+    uint64_t hash = hashBytes64Seeded(settings, sizeof(settings), hashBytes64(buffer, fileSize));
+    char hashLine[64];
+    snprintf(hashLine, sizeof(hashLine), HASH_LINE_PREFIX "%016llx\n", (unsigned long long)hash);
+    bool upToDate = isUpToDate(headerName, hashLine) &&
+                    (mode != EMIT_INCBIN || fileExists(assemblyName)) &&
+                    (mode != EMIT_INCBIN || !job->strip || fileExists(strippedName));
+    job->hash = hash;
+    // The bundle is checked against every job's hash first, and only when it has to be
+    // rebuilt are the current modules run again for their stored bytes.
+    if (upToDate && !job->needsStored) {
+        if (mode == EMIT_BUNDLE) {
+            job->name = listName;
+            listName = NULL;
+        }
+        job->generated = false;
+        job->embeddedSize = -1;
+        job->milliseconds += currentMilliseconds() - startTime;
+        free(strippedName);
+        free(assemblyName);
+        free(headerName);
+        free(listName);
+        free(buffer);
+        return;
+    }
+
+    // Reflection runs on the original module; stripping keeps every decoration it reads.
+    struct SpirvModule module;
+    struct SpirvReflection reflection;
+    spirvLoad(&module, buffer, fileSize / 4);
+    if (!spirvReflect(&module, &reflection)) {
+        fprintf(stderr, "Failed to reflect %s, aborting.\n", shaderName);
         exit(EXIT_FAILURE);
     }
-    char* lastBSlash = strrchr(headerName, '\\');
-    char* lastFSlash = strrchr(headerName, '/');
-    char* lastSlash = !lastBSlash ? lastFSlash : lastBSlash;
-    int indexOfSlash = lastSlash - headerName;
-    char* lastPeriod = strrchr(headerName, '.');
-    int length = lastPeriod - lastSlash - 1;
-    char* listName = malloc(length + 1);
-    strncpy(listName, &headerName[indexOfSlash + 1], length);
-    listName[length] = '\0';
-    fprintf(header, "#pragma once\n");
-    fprintf(header, "#include <stdint.h>\n");
-    fprintf(header, "const uint32_t %sShaderByteCode[] = {\n", listName);
-    for (int i = 0; i < fileSize / 4; i++) {
-        fprintf(header, "    0x%08x,\n", buffer[i]);
-    }
-    fprintf(header, "};");
-    fclose(header);
-    printf("Generated %s\n", headerName);
+    spirvFree(&module);
+
+    const uint32_t* embedded = buffer;
+    uint32_t embeddedWords = fileSize / 4;
+    uint32_t* stripped = NULL;
+    if (job->strip) {
+        struct SpirvStripResult stripResult;
+        stripped = malloc(fileSize);
+        if (!stripped) {
+            fprintf(stderr, "Failed to allocate buffer, aborting.\n");
+            exit(EXIT_FAILURE);
+        }
+        embeddedWords = spirvStrip(buffer, fileSize / 4, stripped, &stripResult);
+        if (!spirvValidate(stripped, embeddedWords)) {
+            fprintf(stderr, "Stripping %s produced invalid SPIR-V, aborting.\n", shaderName);
+            exit(EXIT_FAILURE);
+        }
+        if (!stripResult.compacted) {
+            fprintf(stderr, "%s uses instructions spvToHeaders cannot renumber, ids left as is.\n",
+                    shaderName);
+        }
+        embedded = stripped;
+        job->embeddedSize = embeddedWords * 4;
+    }
+    char wordCount[32];
+    snprintf(wordCount, sizeof(wordCount), "%u", embeddedWords);
+
+    struct OutputBuffer header = {};
+    outputAppend(&header, hashLine);
+    outputAppend(&header, "#pragma once\n");
+    outputAppend(&header, "#include <stdint.h>\n");
+    if (mode == EMIT_INCBIN) {
+        // The size is part of the declaration so sizeof() keeps working in vulkan.c.
+        outputPrintf(&header, "extern const uint32_t %sShaderByteCode[%s];\n", listName, wordCount);
+    } else if (mode == EMIT_BUNDLE) {
+        outputPrintf(&header, "// Byte code is in the shader bundle under the name \"%s\".\n",
+                     listName, NULL);
+        outputPrintf(&header, "#define %sShaderBundleName \"%s\"\n", listName, listName);
+    } else {
+        outputPrintf(&header, "const uint32_t %sShaderByteCode[%s] = {\n", listName, wordCount);
+        appendWords(&header, embedded, embeddedWords);
+        outputAppend(&header, "};\n");
+    }
+    appendReflection(&header, listName, &reflection);
+    if (mode == EMIT_INCBIN) {
+        // .incbin needs the stripped module on disk, next to the assembly.
+        if (stripped) {
+            struct OutputBuffer strippedOutput = {(char*)stripped, embeddedWords * 4, fileSize};
+            writeOutput(strippedName, &strippedOutput);
+        }
+        char* spirvPath = absolutePath(stripped ? strippedName : shaderName);
+        struct OutputBuffer assembly = {};
+        outputAppend(&assembly, "#if defined(__APPLE__)\n");
+        outputAppend(&assembly, "    .section __TEXT,__const\n");
+        outputAppend(&assembly, "#define SYMBOL(name) _##name\n");
+        outputAppend(&assembly, "#elif defined(_WIN32)\n");
+        outputAppend(&assembly, "    .section .rdata,\"dr\"\n");
+        outputAppend(&assembly, "#define SYMBOL(name) name\n");
+        outputAppend(&assembly, "#else\n");
+        outputAppend(&assembly, "    .section .rodata\n");
+        outputAppend(&assembly, "#define SYMBOL(name) name\n");
+        outputAppend(&assembly, "#endif\n");
+        outputAppend(&assembly, "    .balign 4\n");
+        outputPrintf(&assembly, "    .globl SYMBOL(%sShaderByteCode)\n", listName, NULL);
+        outputPrintf(&assembly, "SYMBOL(%sShaderByteCode):\n", listName, NULL);
+        outputPrintf(&assembly, "    .incbin \"%s\"\n", spirvPath, NULL);
+        outputAppend(&assembly, "#if defined(__ELF__)\n");
+        outputAppend(&assembly, "    .section .note.GNU-stack,\"\",@progbits\n");
+        outputAppend(&assembly, "#endif\n");
+        writeOutput(assemblyName, &assembly);
+        free(assembly.data);
+        free(spirvPath);
+    }
+    // Written last, so an interrupted run never leaves a header whose hash claims the
+    // assembly is current.
+    if (!upToDate) {
+        writeOutput(headerName, &header);
+    }
+    if (mode == EMIT_BUNDLE) {
+        free(job->name);
+        job->name = listName;
+        listName = NULL;
+        size_t compressedSize = 0;
+        uint8_t* compressed = job->compress ? spirvCompress(embedded, embeddedWords, &compressedSize) : NULL;
+        if (compressed && compressedSize < embeddedWords * 4 && upToDate) {
+            // Checked and timed when it was generated, the same input compresses the same way.
+            job->stored = compressed;
+            job->storedSize = (int)compressedSize;
+        } else if (compressed && compressedSize < embeddedWords * 4) {
+            // Check the decoder reproduces the module exactly, and time it.
+            struct SpirvDecodeArena arena = {};
+            const uint32_t* decoded = NULL;
+            double decodeStart = currentMilliseconds();
+            for (int i = 0; i < DECODE_BENCHMARK_RUNS; i++) {
+                decoded = spirvDecompress(&arena, compressed, compressedSize, embeddedWords * 4);
+            }
+            job->decodeMilliseconds = (currentMilliseconds() - decodeStart) / DECODE_BENCHMARK_RUNS;
+            if (!decoded || memcmp(decoded, embedded, embeddedWords * 4) != 0) {
+                fprintf(stderr, "Compressed %s does not decode to the original, aborting.\n",
+                        shaderName);
+                exit(EXIT_FAILURE);
+            }
+            spirvArenaFree(&arena);
+            job->stored = compressed;
+            job->storedSize = (int)compressedSize;
+        } else {
+            free(compressed);
+            job->stored = malloc(embeddedWords * 4);
+            memcpy(job->stored, embedded, embeddedWords * 4);
+            job->storedSize = embeddedWords * 4;
+        }
+    }
+
+    job->generated = !upToDate;
+    job->milliseconds += currentMilliseconds() - startTime;
+    free(stripped);
+    free(strippedName);
+    free(assemblyName);
+    free(header.data);
     free(headerName);
     free(listName);
     free(buffer);
 }
 
+struct WorkerRange {
+    struct ShaderJob* jobs;
+    int jobCount;
+    int first;
+    int stride;
+};
+
+#ifdef _WIN32
+DWORD WINAPI generateWorker(LPVOID parameter) {
+#else
+void* generateWorker(void* parameter) {
+#endif
+    struct WorkerRange* range = parameter;
+    for (int i = range->first; i < range->jobCount; i += range->stride) {
+        // Bundle jobs that already hold their stored bytes are done.
+        if (!range->jobs[i].stored) {
+            generateHeader(&range->jobs[i]);
+        }
+    }
+    return 0;
+}
+
+int processorCount() {
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+    return (int)systemInfo.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+// Inputs are independent, so they are spread over one thread per core.
+void generateAll(struct ShaderJob* jobs, int jobCount) {
+    int threadCount = processorCount();
+    if (threadCount > jobCount) threadCount = jobCount;
+    if (threadCount > MAX_THREADS) threadCount = MAX_THREADS;
+    struct WorkerRange ranges[MAX_THREADS];
+#ifdef _WIN32
+    HANDLE threads[MAX_THREADS];
+#else
+    pthread_t threads[MAX_THREADS];
+#endif
+    for (int i = 0; i < threadCount; i++) {
+        ranges[i].jobs = jobs;
+        ranges[i].jobCount = jobCount;
+        ranges[i].first = i;
+        ranges[i].stride = threadCount;
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, generateWorker, &ranges[i], 0, NULL);
+        if (!threads[i]) {
+#else
+        if (pthread_create(&threads[i], NULL, generateWorker, &ranges[i]) != 0) {
+#endif
+            fprintf(stderr, "Failed to create worker thread, aborting.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int i = 0; i < threadCount; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// True when the bundle at path was built from exactly these inputs.
+bool isBundleUpToDate(const char* path, uint64_t contentHash) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    struct ShaderBundleHeader header = {};
+    size_t length = fread(&header, 1, sizeof(header), file);
+    fclose(file);
+    return length == sizeof(header) && header.magic == SHADER_BUNDLE_MAGIC &&
+           header.version == SHADER_BUNDLE_VERSION && header.contentHash == contentHash;
+}
+
+// Covers every module and its name; the per-job hashes already include the settings.
+uint64_t bundleContentHash(const struct ShaderJob* jobs, int jobCount) {
+    uint64_t contentHash = HASH64_SEED;
+    for (int i = 0; i < jobCount; i++) {
+        contentHash = hashBytes64Seeded(&jobs[i].hash, sizeof(jobs[i].hash), contentHash);
+        contentHash = hashBytes64Seeded(jobs[i].name, strlen(jobs[i].name) + 1, contentHash);
+    }
+    return contentHash;
+}
+
+// Every job needs its stored bytes. Returns the bundle size in bytes.
+size_t writeBundle(const char* path, const struct ShaderJob* jobs, int jobCount, uint64_t contentHash) {
+
+    uint32_t slotCount = 1;
+    while (slotCount < (uint32_t)jobCount * 2) {
+        slotCount *= 2;
+    }
+    size_t namesOffset = sizeof(struct ShaderBundleHeader) + slotCount * sizeof(struct ShaderBundleSlot);
+    size_t codeOffset = namesOffset;
+    for (int i = 0; i < jobCount; i++) {
+        codeOffset += strlen(jobs[i].name) + 1;
+    }
+    codeOffset = alignUp(codeOffset, SHADER_BUNDLE_ALIGNMENT);
+    size_t size = codeOffset;
+    for (int i = 0; i < jobCount; i++) {
+        size = alignUp(size + jobs[i].storedSize, SHADER_BUNDLE_ALIGNMENT);
+    }
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "Shader bundle would exceed 4 GiB, aborting.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct OutputBuffer bundle = {};
+    outputReserve(&bundle, size);
+    memset(bundle.data, 0, size);
+    bundle.size = size;
+    struct ShaderBundleHeader* header = (struct ShaderBundleHeader*)bundle.data;
+    struct ShaderBundleSlot* slots = (struct ShaderBundleSlot*)(bundle.data + sizeof(*header));
+    header->magic = SHADER_BUNDLE_MAGIC;
+    header->version = SHADER_BUNDLE_VERSION;
+    header->contentHash = contentHash;
+    header->entryCount = jobCount;
+    header->slotCount = slotCount;
+    size_t nameCursor = namesOffset;
+    size_t codeCursor = codeOffset;
+    for (int i = 0; i < jobCount; i++) {
+        uint64_t nameHash = shaderBundleNameHash(jobs[i].name);
+        uint32_t index = (uint32_t)nameHash & (slotCount - 1);
+        while (slots[index].nameHash != 0) {
+            if (slots[index].nameHash == nameHash &&
+                strcmp(bundle.data + slots[index].nameOffset, jobs[i].name) == 0) {
+                fprintf(stderr, "Two inputs are named %s, aborting.\n", jobs[i].name);
+                exit(EXIT_FAILURE);
+            }
+            index = (index + 1) & (slotCount - 1);
+        }
+        slots[index].nameHash = nameHash;
+        slots[index].nameOffset = (uint32_t)nameCursor;
+        slots[index].codeOffset = (uint32_t)codeCursor;
+        slots[index].codeSize = (uint32_t)jobs[i].embeddedSize;
+        slots[index].storedSize = (uint32_t)jobs[i].storedSize;
+        strcpy(bundle.data + nameCursor, jobs[i].name);
+        nameCursor += strlen(jobs[i].name) + 1;
+        memcpy(bundle.data + codeCursor, jobs[i].stored, jobs[i].storedSize);
+        codeCursor = alignUp(codeCursor + jobs[i].storedSize, SHADER_BUNDLE_ALIGNMENT);
+    }
+    writeOutput(path, &bundle);
+    free(bundle.data);
+    return size;
+}
+
+// Decoding is worth it whenever the modules would be read slower than the break-even rate:
+// the bytes saved divided by the time spent decoding them. Only regenerated modules are
+// decoded and timed, the others show "-".
+void printCompressionReport(const struct ShaderJob* jobs, int jobCount) {
+    long long totalSize = 0;
+    long long totalStored = 0;
+    double totalMilliseconds = 0.0;
+    int timedCount = 0;
+    printf("%-40s %10s %10s %8s %12s %16s\n", "Compressed", "Bytes", "Stored", "Ratio",
+           "Decode us", "Break-even MB/s");
+    for (int i = 0; i < jobCount; i++) {
+        const struct ShaderJob* job = &jobs[i];
+        char decode[16] = "-";
+        char breakEven[16] = "-";
+        if (job->generated) {
+            double savedMegabytes = (job->embeddedSize - job->storedSize) / 1e6;
+            snprintf(decode, sizeof(decode), "%.2f", job->decodeMilliseconds * 1000.0);
+            snprintf(breakEven, sizeof(breakEven), "%.1f", job->decodeMilliseconds > 0.0 ?
+                     savedMegabytes / (job->decodeMilliseconds / 1000.0) : 0.0);
+            totalMilliseconds += job->decodeMilliseconds;
+            timedCount++;
+        }
+        printf("%-40s %10d %10d %7.2fx %12s %16s\n", job->shaderName, job->embeddedSize,
+               job->storedSize, (double)job->embeddedSize / job->storedSize, decode, breakEven);
+        totalSize += job->embeddedSize;
+        totalStored += job->storedSize;
+    }
+    printf("Compression stores %lld of %lld bytes (%.2fx), decoding the %d regenerated takes %.2f us.\n",
+           totalStored, totalSize, (double)totalSize / totalStored, timedCount, 
+           totalMilliseconds * 1000.0);
+}
+
 int main(int argc, char* argv[]) {
-    if(argc == 0) {
-        printf("Please input a spirv filename.\n");
+    if(argc < 2) {
+        printf("Usage: spvToHeaders [--incbin | --bundle file [--compress]] [--strip] [-o directory] shader.spv...\n");
+        printf("  --incbin  emit an assembly file that .incbin's the SPIR-V and a header\n");
+        printf("            declaring it, instead of a header with the words as a C array.\n");
+        printf("  --bundle  write every module into one indexed, memory-mappable bundle file and\n");
+        printf("            headers with only the reflection tables.\n");
+        printf("  --compress with --bundle, store modules delta and LZ compressed and report\n");
+        printf("            the decode time of regenerated modules against the bytes saved.\n");
+        printf("  --strip   release mode: drop debug info and unused globals and renumber ids.\n");
+        printf("            With --incbin the stripped module is written as <name>.min.spv.\n");
+        printf("  -o        directory to write the outputs to.\n");
+        printf("Outputs whose recorded content hash matches the input are left untouched.\n");
+        return 0;
     }
+    double startTime = currentMilliseconds();
+    enum EmitMode mode = EMIT_HEADER;
+    bool strip = false;
+    bool compress = false;
+    const char* outputDirectory = NULL;
+    const char* bundlePath = NULL;
+    struct ShaderJob* jobs = calloc(argc, sizeof(struct ShaderJob));
+    int jobCount = 0;
     for(int i = 1; i < argc; i++) {
-        generateHeader(argv[i]);
+        if(strcmp(argv[i], "--incbin") == 0) {
+            mode = EMIT_INCBIN;
+            continue;
+        }
+        if(strcmp(argv[i], "--bundle") == 0 && i + 1 < argc) {
+            mode = EMIT_BUNDLE;
+            bundlePath = argv[++i];
+            continue;
+        }
+        if(strcmp(argv[i], "--compress") == 0) {
+            compress = true;
+            continue;
+        }
+        if(strcmp(argv[i], "--strip") == 0) {
+            strip = true;
+            continue;
+        }
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outputDirectory = argv[++i];
+            continue;
+        }
+        jobs[jobCount].shaderName = argv[i];
+        jobCount++;
+    }
+    for(int i = 0; i < jobCount; i++) {
+        jobs[i].mode = mode;
+        jobs[i].outputDirectory = outputDirectory;
+        jobs[i].strip = strip;
+        jobs[i].compress = compress;
+    }
+    if (compress && mode != EMIT_BUNDLE) {
+        fprintf(stderr, "--compress needs --bundle, aborting.\n");
+        exit(EXIT_FAILURE);
+    }
+    generateAll(jobs, jobCount);
+    // A no-op build stops at the hashes: the bundle was built from the same inputs.
+    uint64_t bundleHash = 0;
+    bool bundleCurrent = false;
+    if (mode == EMIT_BUNDLE) {
+        bundleHash = bundleContentHash(jobs, jobCount);
+        bundleCurrent = isBundleUpToDate(bundlePath, bundleHash);
+        if (!bundleCurrent) {
+            for(int i = 0; i < jobCount; i++) {
+                jobs[i].needsStored = true;
+            }
+            generateAll(jobs, jobCount);
+        }
+    }
+
+    int generatedCount = 0;
+    long long totalBytes = 0;
+    long long totalEmbedded = 0;
+    printf("%-40s %-10s %10s %10s %8s %10s\n", "Shader", "Status", "Bytes", "Embedded", "Saved",
+           "ms");
+    for(int i = 0; i < jobCount; i++) {
+        // Unchanged outputs were not regenerated, so their embedded size is not known.
+        char embedded[16] = "-";
+        char saved[16] = "-";
+        if (jobs[i].embeddedSize >= 0) {
+            snprintf(embedded, sizeof(embedded), "%d", jobs[i].embeddedSize);
+            snprintf(saved, sizeof(saved), "%.1f%%",
+                     100.0 * (jobs[i].fileSize - jobs[i].embeddedSize) / jobs[i].fileSize);
+            totalBytes += jobs[i].fileSize;
+            totalEmbedded += jobs[i].embeddedSize;
+        }
+        printf("%-40s %-10s %10d %10s %8s %10.3f\n", jobs[i].shaderName,
+               jobs[i].generated ? "generated" : "unchanged", jobs[i].fileSize, embedded, saved,
+               jobs[i].milliseconds);
+        generatedCount += jobs[i].generated;
+    }
+    if (strip && totalBytes > 0) {
+        printf("Stripping saved %lld of %lld bytes.\n", totalBytes - totalEmbedded, totalBytes);
+    }
+    if (compress && !bundleCurrent) {
+        printCompressionReport(jobs, jobCount);
+    }
+    if (mode == EMIT_BUNDLE && bundleCurrent) {
+        printf("Bundle %s unchanged.\n", bundlePath);
+    } else if (mode == EMIT_BUNDLE) {
+        size_t bundleSize = writeBundle(bundlePath, jobs, jobCount, bundleHash);
+        printf("Bundle %s generated, %zu bytes.\n", bundlePath, bundleSize);
+    }
+    printf("%d of %d generated in %.3f ms.\n", generatedCount, jobCount,
+           currentMilliseconds() - startTime);
+    for(int i = 0; i < jobCount; i++) {
+        free(jobs[i].name);
+        free(jobs[i].stored);
     }
+    free(jobs);
     return 0;
 }
@@ -0,0 +1,139 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Watches a fixed set of shader files for changes. On Linux this uses inotify on the
+// containing directory, elsewhere it falls back to comparing modification times.
+#define SHADER_WATCH_MAX_FILES 32
+#define SHADER_WATCH_MAX_PATH 256
+
+struct ShaderWatcher {
+    uint32_t fileCount;
+    char paths[SHADER_WATCH_MAX_FILES][SHADER_WATCH_MAX_PATH];
+    time_t modifiedTimes[SHADER_WATCH_MAX_FILES];
+#ifdef __linux__
+    int inotifyFd;
+    int watchDescriptors[SHADER_WATCH_MAX_FILES];
+#endif
+};
+
+const char* shaderWatchBasename(const char* path) {
+    const char* lastBSlash = strrchr(path, '\\');
+    const char* lastFSlash = strrchr(path, '/');
+    const char* lastSlash = lastBSlash > lastFSlash ? lastBSlash : lastFSlash;
+    return lastSlash ? lastSlash + 1 : path;
+}
+
+time_t shaderWatchModifiedTime(const char* path) {
+    struct stat fileStat;
+    if(stat(path, &fileStat) != 0) {
+        return 0;
+    }
+    return fileStat.st_mtime;
+}
+
+void shaderWatcherInit(struct ShaderWatcher* watcher) {
+    memset(watcher, 0, sizeof(*watcher));
+#ifdef __linux__
+    watcher->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->inotifyFd < 0) {
+        perror("inotify_init1 failed, falling back to polling");
+    }
+#endif
+}
+
+// Returns the index used to identify the file in shaderWatcherPoll().
+uint32_t shaderWatcherAdd(struct ShaderWatcher* watcher, const char* path) {
+    if(watcher->fileCount == SHADER_WATCH_MAX_FILES) {
+        fprintf(stderr, "Too many watched shader files, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t index = watcher->fileCount++;
+    snprintf(watcher->paths[index], SHADER_WATCH_MAX_PATH, "%s", path);
+    watcher->modifiedTimes[index] = shaderWatchModifiedTime(path);
+#ifdef __linux__
+    watcher->watchDescriptors[index] = -1;
+    if(watcher->inotifyFd >= 0) {
+        char directory[SHADER_WATCH_MAX_PATH];
+        const char* name = shaderWatchBasename(path);
+        int directoryLength = (int)(name - path);
+        if(directoryLength == 0) {
+            snprintf(directory, sizeof(directory), ".");
+        } else {
+            snprintf(directory, sizeof(directory), "%.*s", directoryLength, path);
+        }
+        // Compilers often write to a temporary and rename it, so watch the directory
+        // and match names instead of watching the file itself.
+        watcher->watchDescriptors[index] = inotify_add_watch(watcher->inotifyFd, directory,
+                                                             IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(watcher->watchDescriptors[index] < 0) {
+            fprintf(stderr, "inotify_add_watch failed for %s, polling instead.\n", directory);
+        }
+    }
+#endif
+    return index;
+}
+
+// Fills changed with the indices of files modified since the last call and returns how
+// many there are. Never blocks.
+uint32_t shaderWatcherPoll(struct ShaderWatcher* watcher, uint32_t* changed) {
+    bool isChanged[SHADER_WATCH_MAX_FILES] = {};
+#ifdef __linux__
+    if(watcher->inotifyFd >= 0) {
+        char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        for(;;) {
+            ssize_t length = read(watcher->inotifyFd, events, sizeof(events));
+            if(length <= 0) {
+                break;
+            }
+            for(char* cursor = events; cursor < events + length; ) {
+                struct inotify_event* event = (struct inotify_event*)cursor;
+                for(uint32_t i = 0; i < watcher->fileCount; i++) {
+                    if(event->len > 0 && event->wd == watcher->watchDescriptors[i] &&
+                       strcmp(event->name, shaderWatchBasename(watcher->paths[i])) == 0) {
+                        isChanged[i] = true;
+                    }
+                }
+                cursor += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+#endif
+    for(uint32_t i = 0; i < watcher->fileCount; i++) {
+#ifdef __linux__
+        if(watcher->inotifyFd >= 0 && watcher->watchDescriptors[i] >= 0) {
+            continue;
+        }
+#endif
+        time_t modifiedTime = shaderWatchModifiedTime(watcher->paths[i]);
+        if(modifiedTime != 0 && modifiedTime != watcher->modifiedTimes[i]) {
+            watcher->modifiedTimes[i] = modifiedTime;
+            isChanged[i] = true;
+        }
+    }
+    uint32_t changedCount = 0;
+    for(uint32_t i = 0; i < watcher->fileCount; i++) {
+        if(isChanged[i]) {
+            changed[changedCount++] = i;
+        }
+    }
+    return changedCount;
+}
+
+void shaderWatcherDestroy(struct ShaderWatcher* watcher) {
+#ifdef __linux__
+    if(watcher->inotifyFd >= 0) {
+        close(watcher->inotifyFd);
+    }
+#endif
+    watcher->fileCount = 0;
+}
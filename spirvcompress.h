@@ -0,0 +1,313 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compressed SPIR-V, used for shader bundle entries (spvToHeaders --compress).
+// Two stages, both reversible without knowing the SPIR-V grammar:
+//  1. Transform: each instruction becomes varint(opcode), varint(word count), then every
+//     operand as a zigzag varint of its difference to the same operand of the previous
+//     instruction with the same opcode. Ids grow by small steps and types repeat, so most
+//     operands shrink to a single byte.
+//  2. LZ77 over the transformed bytes, with an LZ4 style sequence format: a token with the
+//     literal and match lengths, the literals, then a 16-bit match offset.
+// Stored layout: uint32_t transformed size, then the LZ stream.
+#define SPIRV_DELTA_OPCODES 256
+#define SPIRV_DELTA_OPERANDS 8
+#define SPIRV_LZ_HASH_BITS 14
+#define SPIRV_LZ_MIN_MATCH 4
+#define SPIRV_LZ_MAX_OFFSET 65535
+
+// Buffers reused between decodes, so decoding many modules allocates only a few times.
+struct SpirvDecodeArena {
+    uint8_t* bytes;
+    size_t byteCapacity;
+    uint32_t* words;
+    size_t wordCapacity;
+};
+
+bool spirvArenaReserve(struct SpirvDecodeArena* arena, size_t bytes, size_t words) {
+    if(bytes > arena->byteCapacity) {
+        uint8_t* grown = realloc(arena->bytes, bytes);
+        if(!grown) return false;
+        arena->bytes = grown;
+        arena->byteCapacity = bytes;
+    }
+    if(words > arena->wordCapacity) {
+        uint32_t* grown = realloc(arena->words, words * sizeof(uint32_t));
+        if(!grown) return false;
+        arena->words = grown;
+        arena->wordCapacity = words;
+    }
+    return true;
+}
+
+void spirvArenaFree(struct SpirvDecodeArena* arena) {
+    free(arena->bytes);
+    free(arena->words);
+    memset(arena, 0, sizeof(*arena));
+}
+
+uint8_t* spirvPutVarint(uint8_t* out, uint32_t value) {
+    while(value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+const uint8_t* spirvGetVarint(const uint8_t* in, const uint8_t* end, uint32_t* value) {
+    uint32_t result = 0;
+    for(uint32_t shift = 0; shift < 35 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) {
+            *value = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+uint32_t spirvZigzag(uint32_t delta) {
+    return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+uint32_t spirvUnzigzag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+// out needs room for wordCount * 5 + 10 bytes. Returns the transformed size, or 0 when the
+// words are not a sequence of well formed instructions.
+size_t spirvDeltaEncode(const uint32_t* words, uint32_t wordCount, uint8_t* out) {
+    static const uint32_t headerWords = 5;
+    uint32_t previous[SPIRV_DELTA_OPCODES][SPIRV_DELTA_OPERANDS] = {};
+    uint8_t* cursor = out;
+    if(wordCount < headerWords) {
+        return 0;
+    }
+    for(uint32_t i = 0; i < headerWords; i++) {
+        cursor = spirvPutVarint(cursor, words[i]);
+    }
+    for(uint32_t offset = headerWords; offset < wordCount; ) {
+        uint32_t opcode = words[offset] & 0xffff;
+        uint32_t length = words[offset] >> 16;
+        if(length == 0 || length > wordCount - offset) {
+            return 0;
+        }
+        cursor = spirvPutVarint(cursor, opcode);
+        cursor = spirvPutVarint(cursor, length);
+        uint32_t* last = previous[opcode % SPIRV_DELTA_OPCODES];
+        for(uint32_t i = 1; i < length; i++) {
+            uint32_t word = words[offset + i];
+            if(i < SPIRV_DELTA_OPERANDS) {
+                cursor = spirvPutVarint(cursor, spirvZigzag(word - last[i]));
+                last[i] = word;
+            } else {
+                cursor = spirvPutVarint(cursor, word);
+            }
+        }
+        offset += length;
+    }
+    return cursor - out;
+}
+
+bool spirvDeltaDecode(const uint8_t* in, size_t size, uint32_t* words, uint32_t wordCount) {
+    static const uint32_t headerWords = 5;
+    uint32_t previous[SPIRV_DELTA_OPCODES][SPIRV_DELTA_OPERANDS] = {};
+    const uint8_t* end = in + size;
+    if(wordCount < headerWords) {
+        return false;
+    }
+    for(uint32_t i = 0; i < headerWords; i++) {
+        if(!(in = spirvGetVarint(in, end, &words[i]))) return false;
+    }
+    uint32_t offset = headerWords;
+    while(offset < wordCount) {
+        uint32_t opcode, length;
+        if(!(in = spirvGetVarint(in, end, &opcode)) || !(in = spirvGetVarint(in, end, &length)) ||
+           opcode > 0xffff || length == 0 || length > wordCount - offset) {
+            return false;
+        }
+        words[offset] = opcode | (length << 16);
+        uint32_t* last = previous[opcode % SPIRV_DELTA_OPCODES];
+        for(uint32_t i = 1; i < length; i++) {
+            uint32_t value;
+            if(!(in = spirvGetVarint(in, end, &value))) return false;
+            if(i < SPIRV_DELTA_OPERANDS) {
+                value = last[i] + spirvUnzigzag(value);
+                last[i] = value;
+            }
+            words[offset + i] = value;
+        }
+        offset += length;
+    }
+    return in == end;
+}
+
+size_t spirvLzBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+uint8_t* spirvLzPutLength(uint8_t* out, size_t length) {
+    for(; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+uint8_t* spirvLzPutSequence(uint8_t* out, const uint8_t* literals, size_t literalCount,
+                            size_t matchLength) {
+    uint8_t* token = out++;
+    *token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+    if(literalCount >= 15) out = spirvLzPutLength(out, literalCount - 15);
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+    if(matchLength) {
+        size_t code = matchLength - SPIRV_LZ_MIN_MATCH;
+        *token |= (uint8_t)(code < 15 ? code : 15);
+        // Offset is written by the caller, before the extended match length.
+    }
+    return out;
+}
+
+uint32_t spirvLzRead32(const uint8_t* in) {
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// Greedy single-probe matcher: fast to compress and the format is trivial to decode.
+// out needs spirvLzBound(size) bytes. Returns the compressed size.
+size_t spirvLzCompress(const uint8_t* in, size_t size, uint8_t* out) {
+    // Positions are stored plus one so that zero means empty.
+    uint32_t* table = calloc((size_t)1 << SPIRV_LZ_HASH_BITS, sizeof(uint32_t));
+    if(!table) {
+        return 0;
+    }
+    uint8_t* cursor = out;
+    size_t anchor = 0;
+    size_t position = 0;
+    while(position + SPIRV_LZ_MIN_MATCH <= size) {
+        uint32_t sequence = spirvLzRead32(in + position);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - SPIRV_LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t)position + 1;
+        if(candidate == 0 || position - (candidate - 1) > SPIRV_LZ_MAX_OFFSET ||
+           spirvLzRead32(in + candidate - 1) != sequence) {
+            position++;
+            continue;
+        }
+        candidate--;
+        size_t matchLength = SPIRV_LZ_MIN_MATCH;
+        while(position + matchLength < size && in[candidate + matchLength] == in[position + matchLength]) {
+            matchLength++;
+        }
+        cursor = spirvLzPutSequence(cursor, in + anchor, position - anchor, matchLength);
+        size_t offset = position - candidate;
+        *cursor++ = (uint8_t)offset;
+        *cursor++ = (uint8_t)(offset >> 8);
+        if(matchLength - SPIRV_LZ_MIN_MATCH >= 15) {
+            cursor = spirvLzPutLength(cursor, matchLength - SPIRV_LZ_MIN_MATCH - 15);
+        }
+        position += matchLength;
+        anchor = position;
+    }
+    // The stream always ends with a literal-only sequence, possibly empty.
+    cursor = spirvLzPutSequence(cursor, in + anchor, size - anchor, 0);
+    free(table);
+    return cursor - out;
+}
+
+const uint8_t* spirvLzGetLength(const uint8_t* in, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if(in == end) return NULL;
+        byte = *in++;
+        *length += byte;
+    } while(byte == 255);
+    return in;
+}
+
+bool spirvLzDecompress(const uint8_t* in, size_t size, uint8_t* out, size_t outSize) {
+    const uint8_t* end = in + size;
+    uint8_t* cursor = out;
+    uint8_t* outEnd = out + outSize;
+    while(in < end) {
+        uint8_t token = *in++;
+        size_t literalCount = token >> 4;
+        if(literalCount == 15 && !(in = spirvLzGetLength(in, end, &literalCount))) return false;
+        if(literalCount > (size_t)(end - in) || literalCount > (size_t)(outEnd - cursor)) return false;
+        memcpy(cursor, in, literalCount);
+        cursor += literalCount;
+        in += literalCount;
+        if(in == end) {
+            break;
+        }
+        if(end - in < 2) return false;
+        size_t offset = in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        size_t matchLength = (token & 15) + SPIRV_LZ_MIN_MATCH;
+        if((token & 15) == 15 && !(in = spirvLzGetLength(in, end, &matchLength))) return false;
+        if(offset == 0 || offset > (size_t)(cursor - out) || matchLength > (size_t)(outEnd - cursor)) {
+            return false;
+        }
+        // Byte by byte: matches may overlap their own output.
+        const uint8_t* match = cursor - offset;
+        for(size_t i = 0; i < matchLength; i++) {
+            cursor[i] = match[i];
+        }
+        cursor += matchLength;
+    }
+    return cursor == outEnd;
+}
+
+// Returns a malloc'd buffer in the stored layout and its size, or NULL when the module cannot
+// be encoded.
+uint8_t* spirvCompress(const uint32_t* words, uint32_t wordCount, size_t* storedSize) {
+    uint8_t* transformed = malloc((size_t)wordCount * 5 + 10);
+    if(!transformed) {
+        return NULL;
+    }
+    size_t transformedSize = spirvDeltaEncode(words, wordCount, transformed);
+    if(transformedSize == 0 || transformedSize > UINT32_MAX) {
+        free(transformed);
+        return NULL;
+    }
+    uint8_t* stored = malloc(sizeof(uint32_t) + spirvLzBound(transformedSize));
+    if(!stored) {
+        free(transformed);
+        return NULL;
+    }
+    uint32_t header = (uint32_t)transformedSize;
+    memcpy(stored, &header, sizeof(header));
+    size_t compressedSize = spirvLzCompress(transformed, transformedSize, stored + sizeof(header));
+    free(transformed);
+    if(compressedSize == 0) {
+        free(stored);
+        return NULL;
+    }
+    *storedSize = sizeof(header) + compressedSize;
+    return stored;
+}
+
+// Decodes into the arena; the returned words stay valid until the next decode into it.
+const uint32_t* spirvDecompress(struct SpirvDecodeArena* arena, const uint8_t* stored,
+                                size_t storedSize, uint32_t codeSize) {
+    uint32_t transformedSize;
+    if(storedSize < sizeof(transformedSize) || codeSize % 4 != 0) {
+        return NULL;
+    }
+    memcpy(&transformedSize, stored, sizeof(transformedSize));
+    if(!spirvArenaReserve(arena, transformedSize, codeSize / 4) ||
+       !spirvLzDecompress(stored + sizeof(transformedSize), storedSize - sizeof(transformedSize),
+                          arena->bytes, transformedSize) ||
+       !spirvDeltaDecode(arena->bytes, transformedSize, arena->words, codeSize / 4)) {
+        return NULL;
+    }
+    return arena->words;
+}
@@ -0,0 +1,282 @@
+#pragma once
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+
+// Vertex formats: how each attribute of a vertex is stored on the GPU. Meshes are built and
+// loaded as unpacked MeshVertex arrays and packed into a format when they are uploaded. The
+// vertex input stage converts every encoding back to floats, so shaders read the same
+// inputs whatever the format. Normals are always stored as two octahedral components that
+// the vertex shader decodes.
+// Every VkFormat used here is one Vulkan requires vertex buffer support for.
+#define VERTEX_FORMAT_MAX_ATTRIBUTES 3
+// Normals encoded at once by vertexFormatPack().
+#define VERTEX_FORMAT_PACK_BLOCK 256
+
+// Unpacked vertex.
+struct MeshVertex {
+    float position[2];
+    float color[3];
+    float normal[3];
+};
+
+enum VertexSemantic {
+    VERTEX_SEMANTIC_POSITION = 0,
+    VERTEX_SEMANTIC_COLOR,
+    VERTEX_SEMANTIC_NORMAL
+};
+
+enum VertexEncoding {
+    VERTEX_ENCODING_FLOAT32 = 0,
+    VERTEX_ENCODING_FLOAT16,
+    // Values in [-1, 1].
+    VERTEX_ENCODING_SNORM16,
+    VERTEX_ENCODING_SNORM8,
+    // Values in [0, 1].
+    VERTEX_ENCODING_UNORM8
+};
+
+struct VertexAttributeFormat {
+    enum VertexSemantic semantic;
+    enum VertexEncoding encoding;
+    // Shader input location.
+    uint32_t location;
+};
+
+struct VertexFormat {
+    const char* name;
+    uint32_t attributeCount;
+    struct VertexAttributeFormat attributes[VERTEX_FORMAT_MAX_ATTRIBUTES];
+    uint32_t offsets[VERTEX_FORMAT_MAX_ATTRIBUTES];
+    uint32_t stride;
+};
+
+uint32_t vertexEncodingSize(enum VertexEncoding encoding) {
+    switch(encoding) {
+    case VERTEX_ENCODING_FLOAT32: return 4;
+    case VERTEX_ENCODING_FLOAT16:
+    case VERTEX_ENCODING_SNORM16: return 2;
+    default: return 1;
+    }
+}
+
+// Components the shader reads.
+uint32_t vertexSemanticComponents(enum VertexSemantic semantic) {
+    return semantic == VERTEX_SEMANTIC_COLOR ? 3 : 2;
+}
+
+// Three 8 and 16-bit components are padded to four, few devices fetch the packed formats.
+uint32_t vertexStoredComponents(enum VertexSemantic semantic, enum VertexEncoding encoding) {
+    uint32_t components = vertexSemanticComponents(semantic);
+    return components == 3 && encoding != VERTEX_ENCODING_FLOAT32 ? 4 : components;
+}
+
+VkFormat vertexAttributeVkFormat(const struct VertexAttributeFormat* attribute) {
+    uint32_t components = vertexStoredComponents(attribute->semantic, attribute->encoding);
+    switch(attribute->encoding) {
+    case VERTEX_ENCODING_FLOAT32:
+        return components == 2 ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R32G32B32_SFLOAT;
+    case VERTEX_ENCODING_FLOAT16:
+        return components == 2 ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+    case VERTEX_ENCODING_SNORM16:
+        return components == 2 ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R16G16B16A16_SNORM;
+    case VERTEX_ENCODING_SNORM8:
+        return components == 2 ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R8G8B8A8_SNORM;
+    case VERTEX_ENCODING_UNORM8:
+        return components == 2 ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+// Lays the attributes out in the given order, each at a multiple of 4 bytes. Returns false
+// for a semantic given twice or an encoding that cannot hold it: positions and normals need
+// signed values, colors unsigned ones.
+bool vertexFormatInit(struct VertexFormat* format, const char* name,
+                      const struct VertexAttributeFormat* attributes, uint32_t attributeCount) {
+    memset(format, 0, sizeof(*format));
+    if(attributeCount > VERTEX_FORMAT_MAX_ATTRIBUTES) {
+        return false;
+    }
+    format->name = name;
+    format->attributeCount = attributeCount;
+    uint32_t seen = 0;
+    for(uint32_t i = 0; i < attributeCount; i++) {
+        const struct VertexAttributeFormat* attribute = &attributes[i];
+        bool isSigned = attribute->encoding == VERTEX_ENCODING_SNORM16 ||
+                        attribute->encoding == VERTEX_ENCODING_SNORM8;
+        bool isUnsigned = attribute->encoding == VERTEX_ENCODING_UNORM8;
+        if((seen & (1u << attribute->semantic)) ||
+           (attribute->semantic == VERTEX_SEMANTIC_COLOR ? isSigned : isUnsigned)) {
+            return false;
+        }
+        seen |= 1u << attribute->semantic;
+        format->attributes[i] = *attribute;
+        format->offsets[i] = format->stride;
+        uint32_t size = vertexStoredComponents(attribute->semantic, attribute->encoding) *
+                        vertexEncodingSize(attribute->encoding);
+        format->stride += (size + 3) / 4 * 4;
+    }
+    return true;
+}
+
+// Returns the index of the attribute read at location, or UINT32_MAX when there is none.
+uint32_t vertexFormatFindLocation(const struct VertexFormat* format, uint32_t location) {
+    for(uint32_t i = 0; i < format->attributeCount; i++) {
+        if(format->attributes[i].location == location) {
+            return i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+// Packing:
+
+// Round to nearest even, overflow to infinity, keeps NaN and denormals.
+uint16_t vertexFloatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if(exponent == 0xff) {
+        return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    }
+    int32_t halfExponent = (int32_t)exponent - 127 + 15;
+    if(halfExponent >= 31) {
+        return (uint16_t)(sign | 0x7c00);
+    }
+    if(halfExponent <= 0) {
+        if(halfExponent < -10) {
+            return (uint16_t)sign;
+        }
+        // Denormal: shift the mantissa, implicit bit included, into place.
+        mantissa |= 0x800000;
+        uint32_t shift = (uint32_t)(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if(remainder > halfway || (remainder == halfway && (half & 1))) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+    uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1fff;
+    // A carry out of the mantissa correctly bumps the exponent.
+    if(remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return (uint16_t)(sign | half);
+}
+
+int16_t vertexFloatToSnorm16(float value) {
+    value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+int8_t vertexFloatToSnorm8(float value) {
+    value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+    return (int8_t)lrintf(value * 127.0f);
+}
+
+uint8_t vertexFloatToUnorm8(float value) {
+    value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+    return (uint8_t)lrintf(value * 255.0f);
+}
+
+// Octahedral mapping of a unit vector to [-1, 1]^2, the inverse of octDecode() in
+// shaders/shader.vert. Zero vectors map to +z.
+void vertexOctahedralEncode(const float* normal, float* encoded) {
+    float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if(length == 0.0f) {
+        encoded[0] = encoded[1] = 0.0f;
+        return;
+    }
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+    if(normal[2] < 0.0f) {
+        float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+    encoded[0] = x;
+    encoded[1] = y;
+}
+
+// Writes components floats of every vertex's source to destination, stride bytes apart.
+// One loop per encoding keeps the conversion out of the inner loop's branches.
+void vertexPackComponents(const struct MeshVertex* vertices, uint32_t vertexCount,
+                          size_t sourceOffset, uint32_t components, uint32_t storedComponents,
+                          enum VertexEncoding encoding, uint8_t* destination, uint32_t stride) {
+#define VERTEX_PACK_LOOP(type, convert, padding)                                          \
+    for(uint32_t i = 0; i < vertexCount; i++) {                                          \
+        const float* source = (const float*)((const uint8_t*)&vertices[i] + sourceOffset); \
+        type packed[4];                                                                   \
+        for(uint32_t c = 0; c < components; c++) {                                        \
+            packed[c] = convert(source[c]);                                               \
+        }                                                                                 \
+        for(uint32_t c = components; c < storedComponents; c++) {                         \
+            packed[c] = padding;                                                          \
+        }                                                                                 \
+        memcpy(destination + (size_t)i * stride, packed, storedComponents * sizeof(type)); \
+    }
+#define VERTEX_PACK_FLOAT32(value) (value)
+    switch(encoding) {
+    case VERTEX_ENCODING_FLOAT32:
+        VERTEX_PACK_LOOP(float, VERTEX_PACK_FLOAT32, 1.0f)
+        break;
+    case VERTEX_ENCODING_FLOAT16:
+        VERTEX_PACK_LOOP(uint16_t, vertexFloatToHalf, 0x3c00)
+        break;
+    case VERTEX_ENCODING_SNORM16:
+        VERTEX_PACK_LOOP(int16_t, vertexFloatToSnorm16, INT16_MAX)
+        break;
+    case VERTEX_ENCODING_SNORM8:
+        VERTEX_PACK_LOOP(int8_t, vertexFloatToSnorm8, INT8_MAX)
+        break;
+    case VERTEX_ENCODING_UNORM8:
+        VERTEX_PACK_LOOP(uint8_t, vertexFloatToUnorm8, UINT8_MAX)
+        break;
+    }
+#undef VERTEX_PACK_FLOAT32
+#undef VERTEX_PACK_LOOP
+}
+
+// Packs vertexCount vertices into destination, format->stride bytes each.
+void vertexFormatPack(const struct VertexFormat* format, const struct MeshVertex* vertices,
+                      uint32_t vertexCount, void* destination) {
+    // Normals are encoded into a scratch array first, in blocks to keep it small.
+    struct MeshVertex encoded[VERTEX_FORMAT_PACK_BLOCK];
+    for(uint32_t i = 0; i < format->attributeCount; i++) {
+        const struct VertexAttributeFormat* attribute = &format->attributes[i];
+        uint8_t* attributeDestination = (uint8_t*)destination + format->offsets[i];
+        uint32_t components = vertexSemanticComponents(attribute->semantic);
+        uint32_t storedComponents = vertexStoredComponents(attribute->semantic, attribute->encoding);
+        if(attribute->semantic == VERTEX_SEMANTIC_POSITION) {
+            vertexPackComponents(vertices, vertexCount, offsetof(struct MeshVertex, position),
+                                 components, storedComponents, attribute->encoding,
+                                 attributeDestination, format->stride);
+        } else if(attribute->semantic == VERTEX_SEMANTIC_COLOR) {
+            vertexPackComponents(vertices, vertexCount, offsetof(struct MeshVertex, color),
+                                 components, storedComponents, attribute->encoding,
+                                 attributeDestination, format->stride);
+        } else {
+            for(uint32_t first = 0; first < vertexCount; first += VERTEX_FORMAT_PACK_BLOCK) {
+                uint32_t count = vertexCount - first < VERTEX_FORMAT_PACK_BLOCK ? 
+                                 vertexCount - first : VERTEX_FORMAT_PACK_BLOCK;
+                for(uint32_t j = 0; j < count; j++) {
+                    vertexOctahedralEncode(vertices[first + j].normal, encoded[j].normal);
+                }
+                vertexPackComponents(encoded, count, offsetof(struct MeshVertex, normal),
+                                     components, storedComponents, attribute->encoding,
+                                     attributeDestination + (size_t)first * format->stride,
+                                     format->stride);
+            }
+        }
+    }
+}
@@ -12,14 +12,35 @@
 #include <string.h>
 #include "ext.h"
 #include "helper.h"
+#include "shaderwatch.h"
+#include "shaderbundle.h"
+#include "hash.h"
+#include "rangeallocator.h"
+#include "vertexformat.h"
+#include "meshloader.h"
+#include "jobs.h"
+#include "culling.h"
+#include "drawkey.h"
+#include "rendergraph.h"
 #include "vert.h"
 #include "frag.h"
+#include "cull.h"
+#include "hiz.h"
+#include "scan.h"
+#include "histogram.h"
+#include "onesweep.h"
+#include "reduce.h"
 
 struct QueueFamilyIndices {
     bool hasGraphics;
     uint32_t graphics;
     bool hasPresent;
     uint32_t present;
+    // A queue that runs beside the graphics queue: preferably from a family without graphics,
+    // otherwise the second queue of the graphics family.
+    bool hasCompute;
+    uint32_t compute;
+    uint32_t computeQueue;
 };
 
 struct SwapchainSupportDetails {
@@ -39,6 +60,9 @@ void freeSwapchainSupportDetailsStruct(struct SwapchainSupportDetails* details)
 
 #define MAX_FRAMES_IN_FLIGHT 2
 uint32_t currentFrame = 0;
+// Number of frames submitted so far. Work released during frame N is safe to destroy once
+// frame N's fence has been waited on, see frameRetired().
+uint64_t frameNumber = 0;
 VkQueue presentQueue;
 VkQueue graphicsQueue;
 VkSwapchainKHR swapchain;
@@ -56,44 +80,879 @@ VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
 VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
 VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
 VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
-VkBuffer vertexBuffer;
-VkDeviceMemory vertexBufferMemory;
-VkBuffer indexBuffer;
-VkDeviceMemory indexBufferMemory;
-
-const float vertexData[] = {
-    // first triangle
-    -0.5f, -0.5f,    1.0f, 0.0f, 0.0f,
-    0.5f, -0.5f,     0.0f, 1.0f, 0.0f,
-    0.5f, 0.5f,    0.0f, 0.0f, 1.0f,
-    -0.5f, 0.5f, .0f, .0f, .0f,
+
+// Bindless resources: one global, update-after-bind descriptor set shared by every pipeline.
+// Resources are addressed from shaders by the integer handle returned when they are added.
+#define BINDLESS_STORAGE_BUFFER_BINDING 0
+#define BINDLESS_SAMPLED_IMAGE_BINDING 1
+#define BINDLESS_BINDING_COUNT 2
+#define BINDLESS_MAX_STORAGE_BUFFERS 8192
+#define BINDLESS_MAX_SAMPLED_IMAGES 8192
+#define BINDLESS_INVALID_HANDLE UINT32_MAX
+
+struct BindlessSlots {
+    uint32_t capacity;
+    uint32_t next;
+    uint32_t* freeHandles;
+    uint32_t freeCount;
+    // Handles released while frames may still reference them, recycled once that frame retires.
+    uint32_t* retiredHandles;
+    uint64_t* retiredFrames;
+    uint32_t retiredCount;
+};
+
+// Must match the push_constant block in shaders/bindless.glsl.
+struct PushConstants {
+    uint32_t resourceHandles[8];
+    // Plain values for the shader, e.g. element counts.
+    uint32_t parameters[8];
+};
+
+VkDescriptorSetLayout bindlessSetLayout;
+VkDescriptorPool bindlessDescriptorPool;
+VkDescriptorSet bindlessDescriptorSet;
+struct BindlessSlots bindlessSlots[BINDLESS_BINDING_COUNT];
+
+// Shader module cache: modules are shared by SPIR-V content hash and stay alive while any
+// pipeline owner holds a reference, see acquireShaderModule(). With
+// VK_EXT_shader_module_identifier the identifiers of modules created on earlier runs are
+// kept in SHADER_IDENTIFIER_CACHE_PATH, so a pipeline found in the pipeline cache can be
+// created without creating its modules at all.
+#define SHADER_MODULE_CACHE_SIZE 256
+#define SHADER_MODULE_INVALID UINT32_MAX
+#define PIPELINE_CACHE_PATH "pipeline.cache"
+#define SHADER_IDENTIFIER_CACHE_PATH "shaderidentifiers.cache"
+#define SHADER_IDENTIFIER_CACHE_MAGIC 0x44494853 // "SHID"
+
+struct CachedShaderModule {
+    // 0 marks an empty slot. Slots are never emptied, released entries keep their identifier.
+    uint64_t hash;
+    uint32_t refCount;
+    VkShaderModule module;
+    // Copy of the SPIR-V, only held while an identifier stands in for the module.
+    uint32_t* code;
+    uint32_t codeSize;
+    uint32_t identifierSize;
+    uint8_t identifier[VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT];
+};
+
+struct ShaderIdentifierRecord {
+    uint64_t hash;
+    uint32_t identifierSize;
+    uint8_t identifier[VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT];
+};
+
+struct CachedShaderModule shaderModuleCache[SHADER_MODULE_CACHE_SIZE];
+bool shaderModuleIdentifierEnabled = false;
+uint8_t shaderModuleIdentifierAlgorithm[VK_UUID_SIZE];
+VkPipelineCache pipelineCache;
+
+// Module cache entries used by graphicsPipeline.
+#define GRAPHICS_SHADER_VERT 0
+#define GRAPHICS_SHADER_FRAG 1
+#define GRAPHICS_SHADER_COUNT 2
+uint32_t graphicsShaders[GRAPHICS_SHADER_COUNT];
+
+#ifdef SHADER_HOT_RELOAD
+// Development mode: the SPIR-V next to the shader sources is watched and the pipeline is
+// rebuilt when it changes. Paths are relative to the working directory of the executable.
+#define MAX_RETIRED_PIPELINES 16
+
+struct HotShader {
+    const char* path;
+    uint32_t watchIndex;
+};
+
+// Indexed like graphicsShaders.
+struct HotShader hotShaders[GRAPHICS_SHADER_COUNT] = {
+    {"shaders/vert.spv", 0},
+    {"shaders/frag.spv", 0},
+};
+struct ShaderWatcher shaderWatcher;
+// Replaced pipelines may still be in use by frames in flight, destroyed once those retire.
+VkPipeline retiredPipelines[MAX_RETIRED_PIPELINES];
+uint64_t retiredPipelineFrames[MAX_RETIRED_PIPELINES];
+uint32_t retiredPipelineCount;
+#endif
+
+#ifdef SHADER_BUNDLE
+// Written by spvToHeaders --bundle, see shaders/compile.bat. The file stays mapped while the
+// program runs and raw shader modules are created straight from the mapping. Compressed ones
+// (release builds) are decoded into the arena first, which is reused for every module.
+#define SHADER_BUNDLE_PATH "shaders.bundle"
+struct ShaderBundle shaderBundle;
+struct SpirvDecodeArena shaderDecodeArena;
+#endif
+
+const struct MeshVertex quadVertices[] = {
+    {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+    {{-0.5f, 0.5f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
 };
 
-const uint16_t indexData[] = {
+const uint32_t indexData[] = {
     0, 1, 2, 2, 3, 0       
 };
 
-VkVertexInputBindingDescription getVertexDataBindingDescription() {
-    VkVertexInputBindingDescription bindingDescription;
-    bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(float) * 5;
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-    return bindingDescription;
+// Per-instance data, must match the instance inputs of shaders/shader.vert.
+struct MeshInstance {
+    float offset[2];
+    float scale[2];
+    float color[3];
+    // In [0, 1], 0 is nearest.
+    float depth;
+};
+
+// Geometry pool: every mesh lives in one shared vertex buffer and one shared index buffer,
+// so all of them are drawn without rebinding, from a single indirect draw. Space is
+// sub-allocated with rangeallocator.h. A removed mesh keeps its space until no frame in
+// flight can still draw it, after which new meshes refill it. A mesh that does not fit grows
+// the buffers, each at most to GEOMETRY_POOL_MAX_BUFFER_SIZE.
+#define GEOMETRY_POOL_VERTEX_CAPACITY (1 << 20)
+#define GEOMETRY_POOL_INDEX_CAPACITY (1 << 22)
+#define GEOMETRY_POOL_MAX_BUFFER_SIZE (1ull << 30)
+#define GEOMETRY_POOL_MAX_MESHES (RANGE_ALLOCATOR_MAX_FREE_RANGES - 1)
+#define MESH_INVALID UINT32_MAX
+// Loads per thread count in --benchmark-mesh-load, the fastest one is reported.
+#define MESH_LOAD_BENCHMARK_RUNS 3
+
+enum PoolMeshState {
+    POOL_MESH_FREE = 0,
+    POOL_MESH_LIVE,
+    // Removed, waiting for the frames that may draw it to retire.
+    POOL_MESH_RETIRED
+};
+
+struct PoolMesh {
+    enum PoolMeshState state;
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+struct GeometryPool {
+    VkBuffer vertexBuffer;
+    VkDeviceMemory vertexMemory;
+    VkBuffer indexBuffer;
+    VkDeviceMemory indexMemory;
+    struct RangeAllocator vertices;
+    struct RangeAllocator indices;
+    struct PoolMesh meshes[GEOMETRY_POOL_MAX_MESHES];
+    uint32_t retiredMeshes[GEOMETRY_POOL_MAX_MESHES];
+    uint64_t retiredFrames[GEOMETRY_POOL_MAX_MESHES];
+    uint32_t retiredCount;
+};
+
+struct GeometryPool geometryPool;
+uint32_t quadMesh;
+
+// What to draw: instances [firstInstance, firstInstance + instanceCount) of meshInstances,
+// each as mesh with material. The application sets both lists, with setMeshInstances() and
+// setMeshDraws().
+struct MeshDraw {
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    uint32_t material;
+};
+
+struct MeshInstance* meshInstances;
+uint32_t meshInstanceCount;
+uint32_t meshInstanceCapacity;
+uint64_t meshInstanceVersion;
+struct MeshDraw* meshDraws;
+uint32_t meshDrawCount;
+uint32_t meshDrawCapacity;
+// The draws in the order they are submitted and their keys, see sortMeshDraws().
+uint32_t* drawOrder;
+uint64_t* drawKeys;
+// Also bumped when a mesh is removed, so draws of it are dropped.
+uint64_t meshDrawVersion;
+
+// Persistently mapped, host-visible buffer that grows by doubling.
+struct MappedBuffer {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    void* mapped;
+    VkDeviceSize capacity;
+    // Bindless handle, for storage buffers only.
+    uint32_t handle;
+};
+
+// Textures: sampled TEXTURE_FORMAT images with a full mip chain in device-local memory, one
+// allocation each, addressed by their slot. textureCreate() creates the image and queues a copy
+// of the pixels. After each frame's fence, uploadFrameTextures() moves queued pixels into the
+// frame's staging buffer, up to TEXTURE_UPLOAD_FRAME_BUDGET bytes or TEXTURE_MAX_FRAME_UPLOADS
+// textures, and the frame's command buffer starts with their copies, the mips blitted down one
+// level at a time, and the transitions, batched over the textures. Nothing waits for the GPU. A
+// texture is only sampled once its upload has been recorded. Removed textures are destroyed
+// once no frame in flight can still sample them.
+#define MAX_TEXTURES 4096
+#define TEXTURE_INVALID UINT32_MAX
+#define TEXTURE_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+#define TEXTURE_TEXEL_SIZE 4
+#define TEXTURE_UPLOAD_FRAME_BUDGET (16u << 20)
+#define TEXTURE_MAX_FRAME_UPLOADS 64
+// textureCreate() fails beyond it.
+#define TEXTURE_MEMORY_BUDGET ((VkDeviceSize)512 << 20)
+#define TEXTURE_BENCHMARK_SIZE 256
+#define TEXTURE_BENCHMARK_MATERIALS 64
+#define TEXTURE_BENCHMARK_STREAMED_PER_FRAME 4
+
+enum TextureState {
+    TEXTURE_FREE = 0,
+    // Waiting in textureUploadQueue, pixels holds a copy of the texels.
+    TEXTURE_QUEUED,
+    TEXTURE_LIVE,
+    // Removed, waiting for the frames that may sample it to retire.
+    TEXTURE_RETIRED
+};
+
+struct Texture {
+    enum TextureState state;
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkDeviceSize memorySize;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint32_t handle;
+    uint8_t* pixels;
+    uint64_t retiredFrame;
+};
+
+struct TextureUpload {
+    uint32_t texture;
+    VkDeviceSize stagingOffset;
+};
+
+struct Texture textures[MAX_TEXTURES];
+uint32_t retiredTextures[MAX_TEXTURES];
+uint32_t retiredTextureCount;
+uint32_t textureUploadQueue[MAX_TEXTURES];
+uint32_t textureUploadQueueCount;
+struct MappedBuffer textureStaging[MAX_FRAMES_IN_FLIGHT];
+struct TextureUpload frameTextureUploads[MAX_FRAMES_IN_FLIGHT][TEXTURE_MAX_FRAME_UPLOADS];
+uint32_t frameTextureUploadCounts[MAX_FRAMES_IN_FLIGHT];
+VkSampler textureSampler;
+// Without linear blits, textures keep only their first level.
+bool textureMipsSupported = false;
+// Device memory of all textures that are not destroyed yet, and texels staged so far.
+VkDeviceSize textureMemoryBytes;
+uint32_t textureCount;
+uint64_t textureUploadBytes;
+
+// Materials: one of drawPipelines and the push constants its shaders read, for shader.frag a
+// tint in parameters [MATERIAL_PARAMETER_TINT, MATERIAL_PARAMETER_TINT + 3) as float bits and
+// the bindless handle of its texture in resourceHandles[MATERIAL_HANDLE_TEXTURE], invalid while
+// the texture is not uploaded. Draws of invalid materials use MATERIAL_DEFAULT, plain white.
+#define MAX_MATERIALS 4096
+#define MATERIAL_DEFAULT 0
+#define MATERIAL_PARAMETER_TINT 0
+#define MATERIAL_HANDLE_TEXTURE 0
+#define DRAW_PASS_OPAQUE 0
+#define DRAW_PIPELINE_OPAQUE 0
+#define DRAW_PIPELINE_COUNT 1
+
+struct Material {
+    uint32_t pipeline;
+    // TEXTURE_INVALID for none.
+    uint32_t texture;
+    struct PushConstants constants;
+};
+
+struct Material materials[MAX_MATERIALS];
+uint32_t materialCount;
+// Pointers, shader hot reload replaces the pipelines.
+VkPipeline* const drawPipelines[DRAW_PIPELINE_COUNT] = {&graphicsPipeline};
+
+// Draws are submitted in the order of their drawkey.h keys: by pass, pipeline and material,
+// then by depth in depthSortOrder. Consecutive draws whose keys share everything but the
+// depth form a group, which is drawn after binding its pipeline and pushing its material only
+// where they differ from the previous group's. The counters add up, since the last reset, the
+// binds issued and those a bind per draw would have issued on top.
+#define DRAW_KEY_BENCHMARK_DRAWS 4096
+
+struct DrawGroup {
+    uint64_t stateKey;
+    uint32_t material;
+    uint32_t firstDraw;
+    uint32_t drawCount;
+    // GPU culling only: the group's range of the culled draws, one per instance of its draws.
+    uint32_t firstCulled;
+    uint32_t culledCount;
+};
+
+// What a command buffer last bound, UINT32_MAX for nothing. Binds are counted here first and
+// moved to the totals below with addBindCounts(), so threads recording at once count apart.
+struct DrawState {
+    uint32_t pipeline;
+    uint32_t material;
+    uint64_t pipelineBinds;
+    uint64_t pipelineBindsAvoided;
+    uint64_t materialBinds;
+    uint64_t materialBindsAvoided;
+};
+
+uint64_t pipelineBinds;
+uint64_t pipelineBindsAvoided;
+uint64_t materialBinds;
+uint64_t materialBindsAvoided;
+
+// Each frame in flight reads its own copy of the instances and the draws, turned into
+// VkDrawIndexedIndirectCommands, so both can change every frame without waiting on the GPU.
+// They are rewritten only when the application changed them.
+struct FrameDraws {
+    struct MappedBuffer instances;
+    uint32_t instanceCount;
+    uint64_t instanceVersion;
+    struct MappedBuffer draws;
+    uint32_t drawCount;
+    uint64_t drawVersion;
+    // Sum of the instance counts of the draws.
+    uint32_t totalDrawInstances;
+    // GPU culling only: for each draw, the sum of the instance counts of the draws before it.
+    struct MappedBuffer drawStarts;
+    struct DrawGroup* groups;
+    uint32_t groupCount;
+    uint32_t groupCapacity;
+    // GPU culling only: one draw per visible instance, written by the cull shader, and
+    // their count per group, at the index of the group's first draw.
+    VkBuffer culledBuffer;
+    VkDeviceMemory culledMemory;
+    uint32_t culledHandle;
+    uint32_t culledCapacity;
+    VkBuffer countBuffer;
+    VkDeviceMemory countMemory;
+    uint32_t countHandle;
+    uint32_t countCapacity;
+    // Occlusion culling only: whether each instance was visible when the frame was last
+    // drawn, zeroed by the graph's visibility clear pass when the buffer is new.
+    VkBuffer visibilityBuffer;
+    VkDeviceMemory visibilityMemory;
+    uint32_t visibilityHandle;
+    uint32_t visibilityCapacity;
+    bool visibilityCleared;
+};
+
+struct FrameDraws frameDraws[MAX_FRAMES_IN_FLIGHT];
+// multiDrawIndirect and drawIndirectFirstInstance, otherwise draws are issued one by one.
+bool multiDrawIndirectEnabled = false;
+
+// GPU culling: a compute pass culls the instances of every draw against the view and writes
+// one indirect draw per visible instance, drawn with vkCmdDrawIndexedIndirectCount. The CPU
+// records the same few commands whatever the instance count. Needs drawIndirectCount on top
+// of multiDrawIndirectEnabled, without it the instances are culled on the CPU.
+#define CULL_HANDLE_INSTANCES 0
+#define CULL_HANDLE_CULLED_DRAWS 1
+#define CULL_HANDLE_DRAW_COUNT 2
+#define CULL_HANDLE_DRAWS 3
+#define CULL_HANDLE_DRAW_STARTS 6
+#define CULL_PARAMETER_DRAW_COUNT 0
+#define CULL_PARAMETER_CULLED_CAPACITY 1
+#define CULL_PARAMETER_FIRST_CULLED 2
+#define CULL_PARAMETER_FIRST_DRAW 3
+bool gpuCullingEnabled = false;
+uint32_t maxIndirectDrawCount;
+VkPipeline cullPipeline;
+uint32_t cullShader;
+
+// Occlusion culling, on top of GPU culling when the depth buffer can be sampled, unless
+// --no-occlusion-culling is given. The cull pass runs in two phases around a split render
+// pass. The early phase draws the instances that were visible last time and are in view,
+// hiz.comp then reduces the depth they leave into a pyramid of farthest depths, and the late
+// phase tests every instance in view against it, draws those the early phase left out and
+// records which are visible for the next time. An instance that comes into sight is drawn in
+// the frame it does, never a frame late. The late phase of each draw group appends to a
+// second range of the culled draws, after the early ones, with counts after the early ones.
+#define CULL_HANDLE_VISIBILITY 4
+#define CULL_HANDLE_PYRAMID 5
+#define CULL_PARAMETER_COUNT_SLOT 4
+#define CULL_PARAMETER_PHASE 5
+#define CULL_PARAMETER_DEPTH_SIZE 6
+#define CULL_PARAMETER_PYRAMID_LEVELS 7
+#define HIZ_HANDLE_DEPTH 0
+#define HIZ_HANDLE_PYRAMID 1
+#define HIZ_PARAMETER_SOURCE_OFFSET 0
+#define HIZ_PARAMETER_DESTINATION_OFFSET 1
+#define HIZ_PARAMETER_SOURCE_SIZE 2
+#define HIZ_PARAMETER_DESTINATION_SIZE 3
+// Source offset of level 0, which reads the depth buffer.
+#define HIZ_SOURCE_DEPTH UINT32_MAX
+// Enough for level 0 of 32768 texels, half the largest extent whose size fits the 16 bits
+// the shaders unpack.
+#define HIZ_MAX_LEVELS 16
+
+enum CullPhase {
+    // View culling only, without occlusion culling.
+    CULL_PHASE_VIEW = 0,
+    CULL_PHASE_EARLY,
+    CULL_PHASE_LATE
+};
+
+bool occlusionCullingRequested = true;
+bool occlusionCullingEnabled = false;
+// Draws the late phase over what the first one, renderPass, left.
+VkRenderPass lateRenderPass;
+VkPipeline hizPipeline;
+uint32_t hizShader;
+VkSampler depthSampler;
+uint32_t depthHandle;
+// A transient resource of the render graph, the levels packed one after the other.
+VkBuffer pyramidBuffer;
+uint32_t pyramidHandle;
+uint32_t pyramidLevelCount;
+uint32_t pyramidWidths[HIZ_MAX_LEVELS];
+uint32_t pyramidHeights[HIZ_MAX_LEVELS];
+uint32_t pyramidOffsets[HIZ_MAX_LEVELS];
+
+// Async compute, unless --no-async-compute is given: the device gets a compute queue beside
+// the graphics queue when findQueueFamilies() finds one. With view culling only, the draw count
+// clear and the cull pass are submitted to it on their own and the frame's graphics submission
+// waits for them at the indirect draws, so a frame's cull overlaps the previous frame's
+// drawing. Occlusion culling stays on the graphics queue, its phases wait on the frame's own
+// draws. Buffers are shared by both families when they differ.
+#define ASYNC_COMPUTE_BENCHMARK_INSTANCES 1000000
+#define ASYNC_COMPUTE_BENCHMARK_DRAWS 64
+bool asyncComputeRequested = true;
+bool asyncComputeEnabled = false;
+bool asyncCullingEnabled = false;
+uint32_t computeQueueFamily;
+VkQueue computeQueue;
+VkCommandPool computeCommandPool;
+VkCommandBuffer computeCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+VkSemaphore computeFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
+uint32_t bufferQueueFamilies[2];
+uint32_t bufferQueueFamilyCount = 1;
+
+// Compute primitives over storage buffers of uints: an exclusive prefix sum (scan.comp), a
+// stable radix sort of keys with values (histogram.comp and onesweep.comp) and their sum,
+// minimum and maximum (reduce.comp), recorded by recordPrefixSum(), recordRadixSort() and
+// recordReduce(). Building blocks for stream compaction, sorting transparent draws or particles
+// and statistics, without a round trip to the CPU. They need subgroup arithmetic in compute
+// shaders. The scan and the sort pass counts between workgroups with decoupled look-back.
+#define SCAN_HANDLE_INPUT 0
+#define SCAN_HANDLE_OUTPUT 1
+#define SCAN_HANDLE_STATE 2
+#define SCAN_PARAMETER_COUNT 0
+#define SCAN_ITEMS_PER_INVOCATION 4
+#define SORT_HANDLE_KEYS 0
+#define SORT_HANDLE_VALUES 1
+#define SORT_HANDLE_SORTED_KEYS 2
+#define SORT_HANDLE_SORTED_VALUES 3
+#define SORT_HANDLE_STATE 4
+#define SORT_PARAMETER_COUNT 0
+#define SORT_PARAMETER_PASS 1
+#define SORT_ITEMS_PER_INVOCATION 4
+#define SORT_DIGITS 256
+#define SORT_PASSES 4
+// The state of a sort: a tile counter per pass, the digit counts of every pass, then the
+// look-back descriptors of every digit of every tile of every pass.
+#define SORT_STATE_HISTOGRAM SORT_PASSES
+#define SORT_STATE_LOOKBACK (SORT_STATE_HISTOGRAM + SORT_PASSES * SORT_DIGITS)
+#define REDUCE_HANDLE_INPUT 0
+#define REDUCE_HANDLE_RESULTS 1
+#define REDUCE_PARAMETER_COUNT 0
+#define REDUCE_RESULT_SUM 0
+#define REDUCE_RESULT_MIN 1
+#define REDUCE_RESULT_MAX 2
+#define REDUCE_RESULT_COUNT 3
+#define REDUCE_ITEMS_PER_INVOCATION 16
+#define REDUCE_MAX_WORKGROUPS 1024
+// 65535 workgroups, the smallest maxComputeWorkGroupCount, of 1024 elements each. The look-back
+// descriptors count up to 2^30.
+#define PRIMITIVE_MAX_ELEMENTS (65535u * 1024u)
+#define PRIMITIVE_BENCHMARK_RUNS 10
+#define PRIMITIVE_BENCHMARK_MAX_ELEMENTS 1000000
+#define PRIMITIVE_SCAN 0
+#define PRIMITIVE_SORT 1
+#define PRIMITIVE_REDUCE 2
+#define PRIMITIVE_COUNT 3
+
+// A device local storage buffer and its bindless handle.
+struct StorageBuffer {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t handle;
+};
+
+// The buffers of --benchmark-compute-primitives and its self-test, and the hashed uints both
+// run the primitives on, with room for PRIMITIVE_BENCHMARK_MAX_ELEMENTS of everything. The
+// uploaded input stays in initialKeys and initialValues and is copied to input and output
+// before every run, since the sort works in place.
+struct PrimitiveBenchmark {
+    struct StorageBuffer initialKeys;
+    struct StorageBuffer initialValues;
+    struct StorageBuffer input;
+    struct StorageBuffer output;
+    struct StorageBuffer scratchKeys;
+    struct StorageBuffer scratchValues;
+    struct StorageBuffer state;
+    struct StorageBuffer results;
+    struct MappedBuffer staging;
+    uint32_t* data;
+    uint32_t* indices;
+    uint32_t* result;
+    uint32_t* resultValues;
+    uint64_t* sortKeys;
+    uint64_t* sortScratchKeys;
+    uint32_t* sortValues;
+    uint32_t* sortScratchValues;
+};
+
+const char* primitiveNames[PRIMITIVE_COUNT] = {"scan", "sort", "reduce"};
+
+bool computePrimitivesEnabled = false;
+VkPipeline scanPipeline;
+VkPipeline sortHistogramPipeline;
+VkPipeline sortPassPipeline;
+VkPipeline reducePipeline;
+uint32_t scanShader;
+uint32_t histogramShader;
+uint32_t onesweepShader;
+uint32_t reduceShader;
+
+// GPU time of culling and drawing the quads, measured with two timestamps per frame in flight while
+// frameTimingEnabled is set. Samples are added up in gpuDrawMilliseconds.
+#define INSTANCE_BENCHMARK_WARMUP_FRAMES 16
+#define INSTANCE_BENCHMARK_FRAMES 128
+#define INSTANCE_BENCHMARK_MAX_INSTANCES 1000000
+// shader.vert writes w = 0.6, so x and y in [-QUAD_VIEW_EXTENT, QUAD_VIEW_EXTENT] are on screen.
+#define QUAD_VIEW_EXTENT 0.6f
+VkQueryPool timestampQueryPool;
+bool timestampsSupported = false;
+double timestampPeriod;
+uint64_t timestampMask;
+bool frameTimingEnabled = false;
+bool frameTimestampsWritten[MAX_FRAMES_IN_FLIGHT];
+double gpuDrawMilliseconds;
+uint32_t gpuDrawSamples;
+
+// CPU culling, when GPU culling is unavailable or --cpu-culling asks for it: instanceBounds
+// mirrors the bounds of meshInstances as a structure of arrays, which the fastest kernel of
+// culling.h tests against viewPlanes. Only the visible instances are copied to the frame,
+// packed per draw, so the commands recordCommandBuffer() draws cover no culled instance.
+#define CULL_BENCHMARK_RUNS 10
+#define CULL_BENCHMARK_MAX_OBJECTS 1000000
+bool cpuCullingRequested = false;
+bool cpuCullingEnabled = false;
+enum CullKernel cpuCullKernel = CULL_KERNEL_SCALAR;
+struct CullBounds instanceBounds;
+uint32_t* visibleInstances;
+uint32_t visibleInstanceCapacity;
+const struct CullPlane viewPlanes[] = {
+    {{1.0f, 0.0f}, QUAD_VIEW_EXTENT},
+    {{-1.0f, 0.0f}, QUAD_VIEW_EXTENT},
+    {{0.0f, 1.0f}, QUAD_VIEW_EXTENT},
+    {{0.0f, -1.0f}, QUAD_VIEW_EXTENT}
+};
+const uint32_t viewPlaneCount = 4;
+
+// Sprite batcher: immediate-mode 2D quads, pushed with pushQuad() until the next drawFrame(),
+// which draws them over the meshes. Vertices are packed straight into the current frame's part
+// of a persistently mapped ring, in vertexFormat, and every batch is one indexed draw over
+// indexMesh, whose indices repeat the quad pattern for SPRITE_MAX_QUADS quads. Changing the
+// scissor starts a new batch. Nothing is allocated after createSpriteBatcher(): quads past
+// SPRITE_MAX_QUADS, and past SPRITE_MAX_BATCHES scissor changes, in a frame are dropped.
+#define SPRITE_MAX_QUADS 65536
+#define SPRITE_MAX_BATCHES 256
+// The ring starts with the single instance every sprite is drawn with, which leaves the
+// vertices as they are. Frame regions follow it.
+#define SPRITE_RING_FRAMES_OFFSET 256
+#define SPRITE_BENCHMARK_WARMUP_FRAMES 16
+#define SPRITE_BENCHMARK_FRAMES 128
+#define SPRITE_BENCHMARK_MAX_SPRITES 50000
+
+struct SpriteBatch {
+    uint32_t firstQuad;
+    uint32_t quadCount;
+    // Whole framebuffer when not scissored.
+    bool scissored;
+    VkRect2D scissor;
+};
+
+struct SpriteBatcher {
+    struct MappedBuffer ring;
+    uint32_t indexMesh;
+    // Set by the first push of a frame, once the frame's region is no longer read.
+    bool begun;
+    uint8_t* vertices;
+    uint32_t quadCount;
+    uint32_t droppedQuads;
+    struct SpriteBatch batches[SPRITE_MAX_BATCHES];
+    uint32_t batchCount;
+    // State of the next quad.
+    bool scissored;
+    VkRect2D scissor;
+};
+
+struct SpriteBatcher spriteBatcher;
+
+// Depth buffer, unless --no-depth is given or the device offers no depth format. It is a
+// transient resource of the render graph, shared by the frames in flight, which the graph's
+// barriers order. Opaque instances are drawn in depthSortOrder, front to back by
+// default, so early depth testing rejects the hidden fragments of those drawn later.
+enum DepthSortOrder {
+    DEPTH_SORT_NONE = 0,
+    DEPTH_SORT_FRONT_TO_BACK,
+    DEPTH_SORT_BACK_TO_FRONT,
+    DEPTH_SORT_ORDER_COUNT
+};
+const char* depthSortOrderNames[DEPTH_SORT_ORDER_COUNT] = {"unsorted", "front-to-back", "back-to-front"};
+bool depthRequested = true;
+bool depthEnabled = false;
+VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+VkImage depthImage;
+VkImageView depthImageView;
+enum DepthSortOrder depthSortOrder = DEPTH_SORT_FRONT_TO_BACK;
+
+// The frame as a rendergraph.h graph, declared and compiled with the swapchain. Its passes are
+// the draw count clear and the cull pass with GPU culling, and the draws. Occlusion culling
+// adds the depth pyramid, the late cull pass and the late draws. The graph owns the depth
+// buffer and the depth pyramid, the draw counts, culled draws and visibility are imported
+// from the frame's draws.
+#define GRAPH_RESOURCE_NONE UINT32_MAX
+
+// Handed to the passes by recordCommandBuffer().
+struct FrameContext {
+    struct FrameDraws* draws;
+    VkFramebuffer framebuffer;
+    struct DrawState state;
+    // The pipeline statistics query is active, secondary command buffers have to inherit it.
+    bool statisticsActive;
+};
+
+struct RenderGraph renderGraph;
+uint32_t graphSwapchainImage;
+
+// Parallel recording. A scene pass with at least PARALLEL_RECORD_MIN_COMMANDS draw commands is
+// split into recordThreadCount ranges of its draws, each recorded by a job into a secondary
+// command buffer the primary executes in order, the last range with the sprites. Every range
+// records from a pool of its own per frame in flight, reset once the frame's fence was waited
+// for, so no two threads ever share a pool. recordThreadCount is one per job worker unless
+// --record-threads is given, 1 records everything on the main thread. recordMilliseconds adds
+// up the CPU time of recordCommandBuffer().
+#define RECORD_MAX_THREADS 16
+#define PARALLEL_RECORD_MIN_COMMANDS 1024
+// The early, or only, scene pass and the late one.
+#define SCENE_PASS_COUNT 2
+#define RECORD_BENCHMARK_DRAWS 65536
+#define RECORD_BENCHMARK_MATERIALS 2048
+
+// A secondary command buffer's share of a scene pass, the draws from firstDraw to endDraw.
+struct RecordRange {
+    VkCommandBuffer commandBuffer;
+    const struct FrameContext* context;
+    VkRenderPass scenePass;
+    enum CullPhase phase;
+    uint32_t firstDraw;
+    uint32_t endDraw;
+    bool sprites;
+    struct DrawState state;
+};
+
+uint32_t recordThreadCount = 0;
+bool inheritedQueriesEnabled = false;
+VkCommandPool recordPools[MAX_FRAMES_IN_FLIGHT][RECORD_MAX_THREADS];
+VkCommandBuffer recordBuffers[MAX_FRAMES_IN_FLIGHT][RECORD_MAX_THREADS][SCENE_PASS_COUNT];
+double recordMilliseconds;
+
+// Jobs, see jobs.h. One worker per processor unless --threads is given, the main thread
+// included. Initialization builds the pipelines and creates the query pools in jobs while the
+// main thread creates the rest. Per frame, CPU culling and packing run as jobs in pieces of
+// about PACK_JOB_INSTANCES instances: the pieces are culled and depth sorted, appended to the
+// frame's commands in order by a single job that depends on them, and then copied to the
+// frame's instances, merging those of a depth sorted draw, while the command buffer is
+// recorded. drawFrame() waits for packCopies before it submits.
+#define PACK_JOB_INSTANCES 16384
+#define JOB_BENCHMARK_RUNS 10
+#define JOB_BENCHMARK_EMPTY_JOBS 100000
+#define INSTANCE_BOUNDS_JOB_SIZE 65536
+#define INIT_DEVICE_TASK_GRAPHICS_PIPELINE 0
+#define INIT_DEVICE_TASK_CULL_PIPELINE 1
+#define INIT_DEVICE_TASK_DEPTH_PYRAMID_PIPELINE 2
+#define INIT_DEVICE_TASK_QUERIES 3
+#define INIT_DEVICE_TASK_COMPUTE_PRIMITIVES 4
+#define INIT_DEVICE_TASK_COUNT 5
+
+// A part of a sorted draw's instances. The pieces of a depth sorted draw are sorted on their
+// own, and each copies as many instances as it has from its place in the merge of all of them.
+struct PackPiece {
+    uint32_t sortedDraw;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    // Where the piece's visible instances go in visibleInstances, with CULL_BATCH of slack.
+    uint32_t firstVisible;
+    uint32_t visibleCount;
+    // Where they go in the frame's instances.
+    uint32_t firstPacked;
+    // The pieces of its draw.
+    uint32_t firstDrawPiece;
+    uint32_t endDrawPiece;
+};
+
+struct PackContext {
+    struct FrameDraws* draws;
+    uint32_t sortedCount;
+    bool depthSorted;
+    struct PackPiece* pieces;
+    uint32_t pieceCount;
+    uint32_t pieceCapacity;
+    // The pieces of job i end at jobEnds[i].
+    uint32_t* jobEnds;
+    uint32_t jobCount;
+};
+
+// Radix sort scratch, the draw sort uses worker 0's.
+struct SortScratch {
+    uint64_t* keys;
+    uint64_t* scratchKeys;
+    uint32_t* scratchValues;
+    uint32_t capacity;
+};
+
+struct JobSystem jobSystem;
+uint32_t jobThreadCount = 0;
+struct PackContext packContext;
+struct JobCounter packCopies;
+struct SortScratch sortScratch[JOB_MAX_WORKERS];
+double uploadMilliseconds;
+
+// Overdraw: fragment shader invocations per framebuffer pixel, from a pipeline statistics
+// query per frame in flight, written alongside the timestamps. Samples are added up in
+// fragmentInvocations.
+#define OVERDRAW_BENCHMARK_QUADS 256
+VkQueryPool statisticsQueryPool;
+bool statisticsSupported = false;
+bool frameStatisticsWritten[MAX_FRAMES_IN_FLIGHT];
+double fragmentInvocations;
+uint32_t fragmentInvocationSamples;
+
+// The vertex layout comes from the tables spvToHeaders reflects out of vert.spv: locations
+// below VERTEX_INSTANCE_FIRST_LOCATION are read from the per-vertex binding, laid out by
+// vertexFormat, and the rest are packed in location order into the per-instance one.
+#define VERTEX_BINDING 0
+#define INSTANCE_BINDING 1
+#define VERTEX_BINDING_COUNT 2
+#define VERTEX_INSTANCE_FIRST_LOCATION 3
+#define VERTEX_LOCATION_POSITION 0
+#define VERTEX_LOCATION_COLOR 1
+#define VERTEX_LOCATION_NORMAL 2
+// Per-vertex inputs of shader.vert as floats: vec2 position, vec3 color, vec2 normal.
+#define VERTEX_SHADER_INPUT_SIZE (7 * sizeof(float))
+
+// Selected with --vertex-format. float is the unpacked 28 bytes per vertex, half 16 and
+// packed 12.
+#define VERTEX_FORMAT_PRESET_COUNT 3
+const char* vertexFormatPresetNames[VERTEX_FORMAT_PRESET_COUNT] = {"float", "half", "packed"};
+const struct VertexAttributeFormat vertexFormatPresets[VERTEX_FORMAT_PRESET_COUNT][VERTEX_FORMAT_MAX_ATTRIBUTES] = {
+    {
+        {VERTEX_SEMANTIC_POSITION, VERTEX_ENCODING_FLOAT32, VERTEX_LOCATION_POSITION},
+        {VERTEX_SEMANTIC_COLOR, VERTEX_ENCODING_FLOAT32, VERTEX_LOCATION_COLOR},
+        {VERTEX_SEMANTIC_NORMAL, VERTEX_ENCODING_FLOAT32, VERTEX_LOCATION_NORMAL},
+    },
+    {
+        {VERTEX_SEMANTIC_POSITION, VERTEX_ENCODING_FLOAT16, VERTEX_LOCATION_POSITION},
+        {VERTEX_SEMANTIC_COLOR, VERTEX_ENCODING_FLOAT16, VERTEX_LOCATION_COLOR},
+        {VERTEX_SEMANTIC_NORMAL, VERTEX_ENCODING_FLOAT16, VERTEX_LOCATION_NORMAL},
+    },
+    // Positions are within [-0.5, 0.5], see the mesh normalization in loadMeshFile().
+    {
+        {VERTEX_SEMANTIC_POSITION, VERTEX_ENCODING_SNORM16, VERTEX_LOCATION_POSITION},
+        {VERTEX_SEMANTIC_COLOR, VERTEX_ENCODING_UNORM8, VERTEX_LOCATION_COLOR},
+        {VERTEX_SEMANTIC_NORMAL, VERTEX_ENCODING_SNORM16, VERTEX_LOCATION_NORMAL},
+    },
+};
+struct VertexFormat vertexFormat;
+
+void selectVertexFormat(const char* name) {
+    for(uint32_t i = 0; i < VERTEX_FORMAT_PRESET_COUNT; i++) {
+        if(strcmp(name, vertexFormatPresetNames[i]) == 0) {
+            if(!vertexFormatInit(&vertexFormat, vertexFormatPresetNames[i], vertexFormatPresets[i],
+                                 VERTEX_FORMAT_MAX_ATTRIBUTES)) {
+                fprintf(stderr, "Vertex format %s is invalid, aborting.", name);
+                exit(EXIT_FAILURE);
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "Unknown vertex format %s, aborting.", name);
+    exit(EXIT_FAILURE);
+}
+
+uint32_t getVertexAttributeBinding(uint32_t location) {
+    return location < VERTEX_INSTANCE_FIRST_LOCATION ? VERTEX_BINDING : INSTANCE_BINDING;
+}
+
+void getVertexBindingDescriptions(VkVertexInputBindingDescription* bindingDescriptions) {
+    for(uint32_t i = 0; i < VERTEX_BINDING_COUNT; i++) {
+        bindingDescriptions[i].binding = i;
+        bindingDescriptions[i].stride = 0;
+    }
+    bindingDescriptions[VERTEX_BINDING].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    bindingDescriptions[VERTEX_BINDING].stride = vertexFormat.stride;
+    bindingDescriptions[INSTANCE_BINDING].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    for(uint32_t i = 0; i < vertInputAttributeCount; i++) {
+        if(getVertexAttributeBinding(vertInputAttributes[i].location) == INSTANCE_BINDING) {
+            bindingDescriptions[INSTANCE_BINDING].stride += vertInputAttributes[i].size;
+        }
+    }
+}
+
+void getVertexAttributeDescriptions(VkVertexInputAttributeDescription* attributeDescriptions) {
+    uint32_t instanceOffset = 0;
+    for(uint32_t i = 0; i < vertInputAttributeCount; i++) {
+        uint32_t location = vertInputAttributes[i].location;
+        uint32_t binding = getVertexAttributeBinding(location);
+        attributeDescriptions[i].binding = binding;
+        attributeDescriptions[i].location = location;
+        if(binding == INSTANCE_BINDING) {
+            attributeDescriptions[i].format = vertInputAttributes[i].format;
+            attributeDescriptions[i].offset = instanceOffset;
+            instanceOffset += vertInputAttributes[i].size;
+            continue;
+        }
+        uint32_t attribute = vertexFormatFindLocation(&vertexFormat, location);
+        if(attribute == UINT32_MAX) {
+            fprintf(stderr, "Vertex format %s has no attribute for location %u, aborting.",
+                    vertexFormat.name, location);
+            exit(EXIT_FAILURE);
+        }
+        attributeDescriptions[i].format = vertexAttributeVkFormat(&vertexFormat.attributes[attribute]);
+        attributeDescriptions[i].offset = vertexFormat.offsets[attribute];
+    }
 }
 
-VkVertexInputAttributeDescription* getVertexAttributeDescriptions() {
-    VkVertexInputAttributeDescription* attributeDescriptions = 
-             malloc(sizeof(VkVertexInputAttributeDescription) * 2);
-    attributeDescriptions[0].binding = 0;
-    attributeDescriptions[0].location = 0;
-    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescriptions[0].offset = 0;
+_Static_assert(vertInputPackedSize == VERTEX_SHADER_INPUT_SIZE + sizeof(struct MeshInstance), 
+               "struct MeshInstance does not match the vertex layout of shader.vert");
+_Static_assert(vertPushConstantSize <= sizeof(struct PushConstants) &&
+               fragPushConstantSize <= sizeof(struct PushConstants) &&
+               cullPushConstantSize <= sizeof(struct PushConstants) &&
+               hizPushConstantSize <= sizeof(struct PushConstants) &&
+               scanPushConstantSize <= sizeof(struct PushConstants) &&
+               histogramPushConstantSize <= sizeof(struct PushConstants) &&
+               onesweepPushConstantSize <= sizeof(struct PushConstants) &&
+               reducePushConstantSize <= sizeof(struct PushConstants),
+               "shader push constants are larger than struct PushConstants");
 
-    attributeDescriptions[1].binding = 0;
-    attributeDescriptions[1].location = 1;
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescriptions[1].offset = sizeof(float) * 2;
-    return attributeDescriptions; 
+// Every descriptor a shader declares has to live in the bindless set.
+bool shaderBindingsMatchBindlessLayout(const struct ShaderDescriptorBinding* bindings, 
+                                       uint32_t bindingCount) {
+    for(uint32_t i = 0; i < bindingCount; i++) {
+        VkDescriptorType expected = bindings[i].binding == BINDLESS_SAMPLED_IMAGE_BINDING ?
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        if(bindings[i].set != 0 || bindings[i].binding >= BINDLESS_BINDING_COUNT || 
+           bindings[i].descriptorType != expected) {
+            fprintf(stderr, "Shader binding set=%u binding=%u is not in the bindless layout.\n",
+                    bindings[i].set, bindings[i].binding);
+            return false;
+        }
+    }
+    return true;
 }
 
 // Functions:
@@ -125,19 +984,189 @@ void recreateSwapchain();
 void createSwapchain();
 void createImageViews();
 void createRenderPass();
+VkRenderPass buildRenderPass(enum CullPhase phase);
 void createGraphicsPipeline();
 void cleanupSwapchain();
+VkResult buildGraphicsPipeline(uint32_t vertShader, uint32_t fragShader, VkPipeline* pipeline);
 VkShaderModule createShaderModule(char* code, uint32_t size);
+bool deviceExtensionAvailable(VkPhysicalDevice device, const char* name);
+bool checkShaderModuleIdentifierSupport(VkPhysicalDevice device);
+void loadShaderModuleCache();
+void saveShaderModuleCache();
+void cleanupShaderModuleCache();
+uint32_t shaderModuleCacheSlot(uint64_t hash);
+void shaderModuleCacheCreate(struct CachedShaderModule* entry, const uint32_t* code, uint32_t size);
+uint32_t acquireShaderModule(const uint32_t* code, uint32_t size);
+void releaseShaderModule(uint32_t shader);
+VkShaderModule shaderModuleCacheModule(uint32_t shader);
+#ifdef SHADER_BUNDLE
+void openShaderBundle();
+uint32_t acquireBundledShaderModule(const char* name);
+#endif
+#ifdef SHADER_HOT_RELOAD
+void initShaderHotReload();
+void reloadChangedShaders();
+void destroyRetiredPipelines(bool all);
+void cleanupShaderHotReload();
+#endif
 void createFramebuffers();
 void createCommandPool();
+bool frameRetired(uint64_t frame);
+bool checkDescriptorIndexingSupport(VkPhysicalDevice device);
+bool checkGpuCullingSupport(VkPhysicalDevice device);
+void createBindlessDescriptors();
+void cleanupBindlessDescriptors();
+uint32_t bindlessAllocateHandle(uint32_t binding);
+void bindlessReleaseHandle(uint32_t binding, uint32_t handle);
+void bindlessRecycleHandles();
+uint32_t bindlessAddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+uint32_t bindlessAddSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout layout);
 void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, 
                   VkBuffer* buffer, VkDeviceMemory* deviceMemory);
-void createVertexBuffer();
-void createIndexBuffer();
+VkCommandBuffer beginSingleTimeCommands();
+void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+void createGeometryPool();
+uint32_t geometryPoolAddMesh(const struct MeshVertex* vertices, uint32_t vertexCount, 
+                             const uint32_t* indices, uint32_t indexCount);
+bool geometryPoolGrow(struct RangeAllocator* allocator, VkDeviceSize stride, VkBufferUsageFlags usage,
+                      VkBuffer* buffer, VkDeviceMemory* memory, uint32_t count);
+void geometryPoolRemoveMesh(uint32_t mesh);
+void geometryPoolRecycle();
+void cleanupGeometryPool();
+void createTextures();
+uint32_t textureCreate(const uint8_t* pixels, uint32_t width, uint32_t height);
+void textureDestroy(uint32_t texture);
+void uploadFrameTextures(uint32_t frame);
+void recordTextureUploads(VkCommandBuffer commandBuffer, uint32_t frame);
+VkImageMemoryBarrier textureBarrier(VkImage image, uint32_t baseLevel, uint32_t levelCount, 
+                                    VkImageLayout oldLayout, VkImageLayout newLayout, 
+                                    VkAccessFlags srcAccess, VkAccessFlags dstAccess);
+void textureRecycle();
+void cleanupTextures();
+void runTextureBenchmark();
+uint32_t loadMeshFile(const char* path);
+void runMeshLoadBenchmark(const char* path);
 void createCommandBuffers();
 uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 void createSyncObjects();
+void setMeshInstances(const struct MeshInstance* instances, uint32_t count);
+void setMeshDraws(const struct MeshDraw* draws, uint32_t count);
+void mappedBufferReserve(struct MappedBuffer* mappedBuffer, VkDeviceSize size, 
+                         VkBufferUsageFlags usage);
+void mappedBufferDestroy(struct MappedBuffer* mappedBuffer);
+void uploadFrameDraws(uint32_t frame);
+uint32_t meshDrawInstanceCount(const struct MeshDraw* meshDraw);
+void updateInstanceBounds();
+void packFrameDraws(struct FrameDraws* draws, uint32_t sortedCount);
+void reservePackPieces(uint32_t count);
+void packCullTask(void* context, uint32_t index);
+void packAppendTask(void* context, uint32_t index);
+void packCopyTask(void* context, uint32_t index);
+uint64_t packMergeKey(uint32_t instance);
+uint32_t packPieceCountBelow(const struct PackPiece* piece, uint64_t key);
+void packMergeHeapDown(uint64_t* keys, uint32_t* pieces, uint32_t count, uint32_t index);
+void packMergeCopy(const struct PackContext* pack, const struct PackPiece* piece, 
+                   struct MeshInstance* instances, struct SortScratch* scratch);
+void reserveSortScratch(struct SortScratch* scratch, uint32_t count);
+void instanceBoundsTask(void* context, uint32_t index);
+void createPipelineLayout();
+void acquirePipelineShaders();
+void initDeviceTask(void* context, uint32_t index);
+void runJobBenchmark();
+void jobBenchmarkCullTask(void* context, uint32_t index);
+void jobBenchmarkEmptyTask(void* context, uint32_t index);
+uint32_t sortMeshDraws();
+void appendFrameDraw(struct FrameDraws* draws, VkDrawIndexedIndirectCommand* commands, uint64_t key,
+                     uint32_t mesh, uint32_t instanceCount, uint32_t firstInstance);
+void createMaterials();
+uint32_t createMaterial(uint32_t pipeline, const float tint[3], uint32_t texture);
+void setMaterialTexture(uint32_t material, uint32_t texture);
+void updateMaterialTextures();
+void bindDrawState(VkCommandBuffer commandBuffer, struct DrawState* state, uint32_t material,
+                   uint32_t drawCount);
+void addBindCounts(struct DrawState* state);
+void runDrawKeyBenchmark();
+void setDepthSortOrder(enum DepthSortOrder order);
+void chooseDepthFormat();
+void createRenderGraph();
+void useSceneAttachments(uint32_t pass, uint32_t color, uint32_t depth, uint32_t drawCounts,
+                         uint32_t culledDraws, bool load);
+void cleanupRenderGraph();
+void beginScenePass(VkCommandBuffer commandBuffer, struct FrameContext* context, VkRenderPass scenePass,
+                    bool clear, VkSubpassContents contents);
+void bindSceneState(VkCommandBuffer commandBuffer, const struct FrameDraws* draws);
+void recordScenePass(VkCommandBuffer commandBuffer, struct FrameContext* context, enum CullPhase phase);
+bool drawRecordedPerDraw(const struct DrawGroup* group);
+uint32_t drawCommandCount(const struct FrameDraws* draws);
+void splitDrawRanges(const struct FrameDraws* draws, uint32_t rangeCount, uint32_t* ends);
+void recordRangeTask(void* context, uint32_t index);
+void createRecordPools();
+void cleanupRecordPools();
+void runRecordingBenchmark();
+void recordDrawCountClear(VkCommandBuffer commandBuffer, void* frameData);
+void recordVisibilityClear(VkCommandBuffer commandBuffer, void* frameData);
+void recordEarlyCull(VkCommandBuffer commandBuffer, void* frameData);
+void recordEarlyDraws(VkCommandBuffer commandBuffer, void* frameData);
+void recordLateCull(VkCommandBuffer commandBuffer, void* frameData);
+void recordLateDraws(VkCommandBuffer commandBuffer, void* frameData);
+void runCullingBenchmark();
+void createSpriteBatcher();
+void beginSprites();
+void setSpriteScissor(const VkRect2D* scissor);
+void pushQuad(const float rect[4], const float color[3]);
+void recordSpriteBatches(VkCommandBuffer commandBuffer, struct DrawState* state);
+void cleanupSpriteBatcher();
+void runSpriteBenchmark();
+void reserveCulledDraws(struct FrameDraws* draws, uint32_t capacity, uint32_t drawCount);
+void cleanupFrameDraws();
+void createComputePipeline(uint32_t shader, VkPipeline* pipeline);
+void bindComputePipeline(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+void recordDispatch(VkCommandBuffer commandBuffer, const struct PushConstants* pushConstants, 
+                    uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+void createComputeCommands();
+void cleanupComputeCommands();
+void recordAsyncCull(VkCommandBuffer commandBuffer);
+void runAsyncComputeBenchmark();
+bool checkComputePrimitivesSupport(VkPhysicalDevice device);
+void createComputePrimitivePipelines();
+void cleanupComputePrimitives();
+void storageBufferCreate(struct StorageBuffer* storageBuffer, VkDeviceSize size);
+void storageBufferDestroy(struct StorageBuffer* storageBuffer);
+void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+                         VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+VkDeviceSize prefixSumStateSize(uint32_t count);
+VkDeviceSize radixSortStateSize(uint32_t count);
+void recordPrefixSum(VkCommandBuffer commandBuffer, const struct StorageBuffer* input, 
+                     const struct StorageBuffer* output, const struct StorageBuffer* state, uint32_t count);
+void recordRadixSort(VkCommandBuffer commandBuffer, const struct StorageBuffer* keys, 
+                     const struct StorageBuffer* values, const struct StorageBuffer* scratchKeys,
+                     const struct StorageBuffer* scratchValues, const struct StorageBuffer* state, uint32_t count);
+void recordReduce(VkCommandBuffer commandBuffer, const struct StorageBuffer* input, 
+                  const struct StorageBuffer* results, uint32_t count);
+void runComputePrimitiveBenchmark();
+void primitiveBenchmarkUpload(const struct StorageBuffer* storageBuffer, struct MappedBuffer* staging,
+                              const uint32_t* data, uint32_t count);
+void primitiveBenchmarkDownload(const struct StorageBuffer* storageBuffer, struct MappedBuffer* staging,
+                                uint32_t* data, uint32_t count);
+void primitiveBenchmarkUploadInput(struct PrimitiveBenchmark* benchmark, uint32_t primitive, uint32_t count);
+void recordPrimitiveInput(VkCommandBuffer commandBuffer, struct PrimitiveBenchmark* benchmark, uint32_t primitive,
+                          uint32_t count);
+void recordPrimitive(VkCommandBuffer commandBuffer, struct PrimitiveBenchmark* benchmark, uint32_t primitive,
+                     uint32_t count);
+bool primitiveAgrees(struct PrimitiveBenchmark* benchmark, uint32_t primitive, uint32_t count);
+void testComputePrimitives(struct PrimitiveBenchmark* benchmark);
+void createCullPipeline();
+void recordCullPass(VkCommandBuffer commandBuffer, struct FrameDraws* draws, enum CullPhase phase);
+void recordDrawGroups(VkCommandBuffer commandBuffer, const struct FrameDraws* draws, 
+                      struct DrawState* state, enum CullPhase phase, uint32_t firstDraw, uint32_t endDraw);
+void createDepthPyramidPipeline();
+void recordDepthPyramid(VkCommandBuffer commandBuffer, void* frameData);
+void createTimestampQueries();
+void createStatisticsQueries();
+void readFrameQueries(uint32_t frame);
+void runInstanceBenchmark();
+void runOverdrawBenchmark();
 void mainLoop();
 void drawFrame();
 void cleanup();
@@ -152,6 +1181,12 @@ const char* requiredDeviceExtensions[] = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME   
 };
 const uint32_t requiredDeviceExtensionCount = 1;
+// Enabled only when all of them and their features are supported.
+const char* shaderModuleIdentifierExtensions[] = {
+    VK_EXT_SHADER_MODULE_IDENTIFIER_EXTENSION_NAME,
+    VK_EXT_PIPELINE_CREATION_CACHE_CONTROL_EXTENSION_NAME
+};
+const uint32_t shaderModuleIdentifierExtensionCount = 2;
 
 VkInstance instance;
 VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
@@ -179,11 +1214,119 @@ VkSurfaceKHR surface;
 VkDebugUtilsMessengerEXT debugMessenger;
 
 // Main:
-int main() {
+int main(int argc, char* argv[]) {
+    bool benchmarkInstances = false;
+    bool benchmarkCulling = false;
+    bool benchmarkSprites = false;
+    bool benchmarkOverdraw = false;
+    bool benchmarkDrawKeys = false;
+    bool benchmarkRecording = false;
+    bool benchmarkJobs = false;
+    bool benchmarkAsyncCompute = false;
+    bool benchmarkComputePrimitives = false;
+    bool benchmarkTextures = false;
+    const char* meshPath = NULL;
+    const char* benchmarkLoadPath = NULL;
+    const char* vertexFormatName = "packed";
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--benchmark-instances") == 0) {
+            benchmarkInstances = true;
+        } else if(strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            meshPath = argv[++i];
+        } else if(strcmp(argv[i], "--benchmark-mesh-load") == 0 && i + 1 < argc) {
+            benchmarkLoadPath = argv[++i];
+        } else if(strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+            vertexFormatName = argv[++i];
+        } else if(strcmp(argv[i], "--cpu-culling") == 0) {
+            cpuCullingRequested = true;
+        } else if(strcmp(argv[i], "--benchmark-culling") == 0) {
+            benchmarkCulling = true;
+        } else if(strcmp(argv[i], "--benchmark-sprites") == 0) {
+            benchmarkSprites = true;
+        } else if(strcmp(argv[i], "--no-depth") == 0) {
+            depthRequested = false;
+        } else if(strcmp(argv[i], "--benchmark-overdraw") == 0) {
+            benchmarkOverdraw = true;
+        } else if(strcmp(argv[i], "--benchmark-draw-keys") == 0) {
+            benchmarkDrawKeys = true;
+        } else if(strcmp(argv[i], "--no-occlusion-culling") == 0) {
+            occlusionCullingRequested = false;
+        } else if(strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            recordThreadCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if(recordThreadCount == 0) {
+                recordThreadCount = 1;
+            }
+        } else if(strcmp(argv[i], "--benchmark-recording") == 0) {
+            benchmarkRecording = true;
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            jobThreadCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "--benchmark-jobs") == 0) {
+            benchmarkJobs = true;
+        } else if(strcmp(argv[i], "--no-async-compute") == 0) {
+            asyncComputeRequested = false;
+        } else if(strcmp(argv[i], "--benchmark-async-compute") == 0) {
+            benchmarkAsyncCompute = true;
+            occlusionCullingRequested = false;
+        } else if(strcmp(argv[i], "--benchmark-compute-primitives") == 0) {
+            benchmarkComputePrimitives = true;
+        } else if(strcmp(argv[i], "--benchmark-textures") == 0) {
+            benchmarkTextures = true;
+        } else {
+            fprintf(stderr, "Unknown argument %s.\n", argv[i]);
+            fprintf(stderr, "Usage: %s [--benchmark-instances] [--mesh <file>] "
+                    "[--benchmark-mesh-load <file>] [--vertex-format float|half|packed] "
+                    "[--cpu-culling] [--benchmark-culling] [--benchmark-sprites] [--no-depth] "
+                    "[--benchmark-overdraw] [--benchmark-draw-keys] [--no-occlusion-culling] "
+                    "[--record-threads <count>] [--benchmark-recording] [--threads <count>] "
+                    "[--benchmark-jobs] [--no-async-compute] [--benchmark-async-compute] "
+                    "[--benchmark-compute-primitives] [--benchmark-textures]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    jobSystemCreate(&jobSystem, jobThreadCount ? jobThreadCount : meshProcessorCount());
+    // Loading, culling and jobs need no window or device.
+    if(benchmarkLoadPath || benchmarkCulling || benchmarkJobs) {
+        glfwInit();
+        if(benchmarkLoadPath) runMeshLoadBenchmark(benchmarkLoadPath);
+        if(benchmarkCulling) runCullingBenchmark();
+        if(benchmarkJobs) runJobBenchmark();
+        glfwTerminate();
+        jobSystemDestroy(&jobSystem);
+        return 0;
+    }
+    selectVertexFormat(vertexFormatName);
     initWindow();
     initVulkan();
-    mainLoop();
+    if(benchmarkInstances) {
+        runInstanceBenchmark();
+    } else if(benchmarkSprites) {
+        runSpriteBenchmark();
+    } else if(benchmarkOverdraw) {
+        runOverdrawBenchmark();
+    } else if(benchmarkDrawKeys) {
+        runDrawKeyBenchmark();
+    } else if(benchmarkRecording) {
+        runRecordingBenchmark();
+    } else if(benchmarkAsyncCompute) {
+        runAsyncComputeBenchmark();
+    } else if(benchmarkComputePrimitives) {
+        runComputePrimitiveBenchmark();
+    } else if(benchmarkTextures) {
+        runTextureBenchmark();
+    } else {
+        uint32_t mesh = meshPath ? loadMeshFile(meshPath) : quadMesh;
+        if(mesh == MESH_INVALID) {
+            fprintf(stderr, "Drawing the quad instead.\n");
+            mesh = quadMesh;
+        }
+        const struct MeshInstance quad = {{0.0f, 0.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, 0.0f};
+        const struct MeshDraw draw = {mesh, 0, 1, MATERIAL_DEFAULT};
+        setMeshInstances(&quad, 1);
+        setMeshDraws(&draw, 1);
+        mainLoop();
+    }
     cleanup();
+    jobSystemDestroy(&jobSystem);
 }
 void initWindow() {
     if(!glfwInit()) {
@@ -209,14 +1352,34 @@ void initVulkan() {
     createLogicalDevice();
     createSwapchain();
     createImageViews();
+    chooseDepthFormat();
     createRenderPass();
-    createGraphicsPipeline();
-    createFramebuffers();
+    createBindlessDescriptors();
+    loadShaderModuleCache();
+#ifdef SHADER_BUNDLE
+    openShaderBundle();
+#endif
+    createPipelineLayout();
+    acquirePipelineShaders();
+    // The pipelines compile and the query pools are created in jobs meanwhile, the render
+    // graph needs the depth pyramid's sampler.
+    struct JobCounter deviceJobs = {};
+    jobRun(&jobSystem, initDeviceTask, NULL, INIT_DEVICE_TASK_COUNT, &deviceJobs);
+    createMaterials();
     createCommandPool();
-    createVertexBuffer();
-    createIndexBuffer();
+    createRecordPools();
+    createGeometryPool();
+    createSpriteBatcher();
+    createTextures();
     createCommandBuffers();
     createSyncObjects();
+    createComputeCommands();
+    jobWait(&jobSystem, &deviceJobs);
+    createRenderGraph();
+    createFramebuffers();
+#ifdef SHADER_HOT_RELOAD
+    initShaderHotReload();
+#endif
 }
 
 
@@ -228,7 +1391,7 @@ void createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_2;
     
     //Find out what extensions the hardware supports:
     uint32_t availableExtensionCount = 0;
@@ -437,6 +1600,10 @@ void pickPhysicalDevice() {
             printf("%s does not have required device extensions.\n\n", deviceProperties.deviceName);
             continue;
         }
+        if(!checkDescriptorIndexingSupport(availableDevice)) {
+            printf("%s does not support bindless descriptor indexing.\n\n", deviceProperties.deviceName);
+            continue;
+        }
         struct SwapchainSupportDetails swapchainSupportDetails;
         querySwapchainSupport(availableDevice, &swapchainSupportDetails);
         bool swapchainHasSupport = (swapchainSupportDetails.formatCount > 0) && 
@@ -464,11 +1631,16 @@ void findQueueFamilies(VkPhysicalDevice device, struct QueueFamilyIndices* famil
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
     VkQueueFamilyProperties queueFamilyProperties[queueFamilyCount];
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilyProperties);
+    memset(familyIndices, 0, sizeof(*familyIndices));
     for(int i = 0; i < queueFamilyCount; i++) {
         VkQueueFamilyProperties queueFamProps = queueFamilyProperties[i];
         if(queueFamProps.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
             familyIndices->hasGraphics = true;
             familyIndices->graphics = i;
+        } else if(queueFamProps.queueFlags & VK_QUEUE_COMPUTE_BIT && !familyIndices->hasCompute) {
+            familyIndices->hasCompute = true;
+            familyIndices->compute = i;
+            familyIndices->computeQueue = 0;
         }
         VkBool32 presentSupport = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
@@ -477,6 +1649,46 @@ void findQueueFamilies(VkPhysicalDevice device, struct QueueFamilyIndices* famil
             familyIndices->present = i;
         }
     }
+    // Graphics families always support compute.
+    if(!familyIndices->hasCompute && familyIndices->hasGraphics &&
+       queueFamilyProperties[familyIndices->graphics].queueCount > 1) {
+        familyIndices->hasCompute = true;
+        familyIndices->compute = familyIndices->graphics;
+        familyIndices->computeQueue = 1;
+    }
+}
+
+bool checkDescriptorIndexingSupport(VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+    if(deviceProperties.apiVersion < VK_API_VERSION_1_2) {
+        return false;
+    }
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    return features12.descriptorIndexing &&
+           features12.runtimeDescriptorArray &&
+           features12.descriptorBindingPartiallyBound &&
+           features12.descriptorBindingUpdateUnusedWhilePending &&
+           features12.descriptorBindingStorageBufferUpdateAfterBind &&
+           features12.descriptorBindingSampledImageUpdateAfterBind &&
+           features12.shaderStorageBufferArrayNonUniformIndexing &&
+           features12.shaderSampledImageArrayNonUniformIndexing;
+}
+
+bool checkGpuCullingSupport(VkPhysicalDevice device) {
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    return features12.drawIndirectCount && features.features.multiDrawIndirect &&
+           features.features.drawIndirectFirstInstance;
 }
 
 bool checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -583,43 +1795,116 @@ VkExtent2D chooseSwapExtent(const struct SwapchainSupportDetails*
 void createLogicalDevice() {
     struct QueueFamilyIndices queueFamIndices;
     findQueueFamilies(physicalDevice, &queueFamIndices);
+    asyncComputeEnabled = asyncComputeRequested && queueFamIndices.hasCompute;
+    // One create info per distinct family, with enough queues for the highest index taken
+    // from it.
+    const uint32_t queueFamilies[] = {
+        queueFamIndices.graphics, queueFamIndices.present, queueFamIndices.compute
+    };
+    const uint32_t queueCounts[] = {1, 1, asyncComputeEnabled ? queueFamIndices.computeQueue + 1 : 0};
+    const float queuePriorities[] = {1.0f, 1.0f};
+    VkDeviceQueueCreateInfo queueCreateInfos[3] = {};
     uint32_t requiredFamilyCount = 0;
-    if(queueFamIndices.present == queueFamIndices.graphics) {
-        requiredFamilyCount = 1;
-    }else {
-        requiredFamilyCount = 2;
-    }
-     
-    VkDeviceQueueCreateInfo queueCreateInfos[requiredFamilyCount];
-    for(int i = 0; i < requiredFamilyCount; i++) {
-        queueCreateInfos[i].flags = 0;
-        queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfos[i].queueCount = 1;
-        float queuePriority = 1.0f;
-        queueCreateInfos[i].pQueuePriorities = &queuePriority;
-        queueCreateInfos[i].pNext = NULL;
-        switch(i) {
-            case(0):
-                queueCreateInfos[i].queueFamilyIndex = queueFamIndices.graphics;
-                break;
-            case(1):
-                queueCreateInfos[i].queueFamilyIndex = queueFamIndices.present;
-                break;
+    for(uint32_t i = 0; i < 3; i++) {
+        if(queueCounts[i] == 0) {
+            continue;
+        }
+        uint32_t family = 0;
+        while(family < requiredFamilyCount && queueCreateInfos[family].queueFamilyIndex != queueFamilies[i]) {
+            family++;
+        }
+        if(family == requiredFamilyCount) {
+            queueCreateInfos[family].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            queueCreateInfos[family].queueFamilyIndex = queueFamilies[i];
+            queueCreateInfos[family].pQueuePriorities = queuePriorities;
+            requiredFamilyCount++;
+        }
+        if(queueCounts[i] > queueCreateInfos[family].queueCount) {
+            queueCreateInfos[family].queueCount = queueCounts[i];
         }
     }
     
-    VkPhysicalDeviceFeatures deviceFeatures = {};
+    VkPhysicalDeviceVulkan12Features features12 = {};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.descriptorIndexing = VK_TRUE;
+    features12.runtimeDescriptorArray = VK_TRUE;
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+    shaderModuleIdentifierEnabled = checkShaderModuleIdentifierSupport(physicalDevice);
+    VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT identifierFeatures = {};
+    identifierFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+    identifierFeatures.shaderModuleIdentifier = VK_TRUE;
+    VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT cacheControlFeatures = {};
+    cacheControlFeatures.sType = 
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES_EXT;
+    cacheControlFeatures.pipelineCreationCacheControl = VK_TRUE;
+    cacheControlFeatures.pNext = &identifierFeatures;
+    const char* enabledExtensions[requiredDeviceExtensionCount + shaderModuleIdentifierExtensionCount];
+    uint32_t enabledExtensionCount = 0;
+    for(uint32_t i = 0; i < requiredDeviceExtensionCount; i++) {
+        enabledExtensions[enabledExtensionCount++] = requiredDeviceExtensions[i];
+    }
+    if(shaderModuleIdentifierEnabled) {
+        features12.pNext = &cacheControlFeatures;
+        for(uint32_t i = 0; i < shaderModuleIdentifierExtensionCount; i++) {
+            enabledExtensions[enabledExtensionCount++] = shaderModuleIdentifierExtensions[i];
+        }
+        printf("Shader module identifiers enabled.\n");
+    }
+
+    VkPhysicalDeviceFeatures2 deviceFeatures = {};
+    deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    deviceFeatures.pNext = &features12;
+
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    multiDrawIndirectEnabled = supportedFeatures.multiDrawIndirect && 
+                               supportedFeatures.drawIndirectFirstInstance;
+    if(multiDrawIndirectEnabled) {
+        deviceFeatures.features.multiDrawIndirect = VK_TRUE;
+        deviceFeatures.features.drawIndirectFirstInstance = VK_TRUE;
+    }
+    statisticsSupported = supportedFeatures.pipelineStatisticsQuery;
+    if(statisticsSupported) {
+        deviceFeatures.features.pipelineStatisticsQuery = VK_TRUE;
+    }
+    // Without it, scene passes are recorded inline while the statistics query is active.
+    inheritedQueriesEnabled = supportedFeatures.inheritedQueries;
+    if(inheritedQueriesEnabled) {
+        deviceFeatures.features.inheritedQueries = VK_TRUE;
+    }
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    maxIndirectDrawCount = deviceProperties.limits.maxDrawIndirectCount;
+    gpuCullingEnabled = !cpuCullingRequested && multiDrawIndirectEnabled && 
+                        checkGpuCullingSupport(physicalDevice);
+    if(gpuCullingEnabled) {
+        features12.drawIndirectCount = VK_TRUE;
+        printf("GPU culling enabled.\n");
+    }
+    computePrimitivesEnabled = checkComputePrimitivesSupport(physicalDevice);
+    cpuCullingEnabled = !gpuCullingEnabled;
+    if(cpuCullingEnabled) {
+        cpuCullKernel = cullBestKernel();
+        printf("CPU culling enabled, %s kernel.\n", cullKernelNames[cpuCullKernel]);
+    }
 
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    createInfo.pNext = &deviceFeatures;
     createInfo.pQueueCreateInfos = queueCreateInfos;
     createInfo.queueCreateInfoCount = requiredFamilyCount;
-    createInfo.pEnabledFeatures = &deviceFeatures;
+    createInfo.pEnabledFeatures = NULL;
     createInfo.enabledLayerCount = requiredValidationLayersCount;
     createInfo.ppEnabledLayerNames = requiredValidationLayers;
     
-    createInfo.enabledExtensionCount = requiredDeviceExtensionCount;
-    createInfo.ppEnabledExtensionNames = requiredDeviceExtensions;
+    createInfo.enabledExtensionCount = enabledExtensionCount;
+    createInfo.ppEnabledExtensionNames = enabledExtensions;
 
     if(vkCreateDevice(physicalDevice, &createInfo, NULL, &device) != VK_SUCCESS) {
         fprintf(stderr, "Failed to create logical device, aborting.");
@@ -628,6 +1913,17 @@ void createLogicalDevice() {
 
     vkGetDeviceQueue(device, queueFamIndices.graphics, 0, &graphicsQueue);
     vkGetDeviceQueue(device, queueFamIndices.present, 0, &presentQueue);
+    if(asyncComputeEnabled) {
+        computeQueueFamily = queueFamIndices.compute;
+        vkGetDeviceQueue(device, computeQueueFamily, queueFamIndices.computeQueue, &computeQueue);
+        if(computeQueueFamily != queueFamIndices.graphics) {
+            bufferQueueFamilies[0] = queueFamIndices.graphics;
+            bufferQueueFamilies[1] = computeQueueFamily;
+            bufferQueueFamilyCount = 2;
+        }
+        printf("Async compute on queue %u of family %u.\n", queueFamIndices.computeQueue, 
+               computeQueueFamily);
+    }
 
 }
 void createSwapchain() {
@@ -708,15 +2004,28 @@ void createImageViews() {
     }
 }
 void createRenderPass() {
+    if(occlusionCullingEnabled) {
+        renderPass = buildRenderPass(CULL_PHASE_EARLY);
+        lateRenderPass = buildRenderPass(CULL_PHASE_LATE);
+    } else {
+        renderPass = buildRenderPass(CULL_PHASE_VIEW);
+    }
+}
+
+// The whole frame for CULL_PHASE_VIEW. With occlusion culling the early part clears and keeps
+// both attachments for hiz.comp and the late part, which loads them. The parts are compatible,
+// so they share the framebuffers. Attachments stay in their attachment layouts and there are
+// no external dependencies, the render graph's barriers around the passes do both.
+VkRenderPass buildRenderPass(enum CullPhase phase) {
     VkAttachmentDescription colorAttachment={};
     colorAttachment.format = swapchainImageFormat;
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.loadOp = phase == CULL_PHASE_LATE ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef={};
     colorAttachmentRef.attachment = 0;
@@ -726,45 +2035,180 @@ void createRenderPass() {
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
-     VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+    // Only needed while drawing, the previous frame's contents are cleared.
+    VkAttachmentDescription attachments[2] = {colorAttachment};
+    VkAttachmentReference depthAttachmentRef = {};
+    if(depthEnabled) {
+        VkAttachmentDescription* depthAttachment = &attachments[1];
+        depthAttachment->format = depthFormat;
+        depthAttachment->samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment->loadOp = phase == CULL_PHASE_LATE ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment->storeOp = phase == CULL_PHASE_EARLY ? VK_ATTACHMENT_STORE_OP_STORE : 
+                                                               VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment->stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        depthAttachment->stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment->initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment->finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachmentRef.attachment = 1;
+        depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    }
 
     VkRenderPassCreateInfo renderPassInfo={};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = depthEnabled ? 2 : 1;
+    renderPassInfo.pAttachments = attachments;
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-            renderPassInfo.dependencyCount = 1; //CHANGEW TO !
-    renderPassInfo.pDependencies = &dependency;
 
-    if (vkCreateRenderPass(device, &renderPassInfo, NULL, &renderPass) != VK_SUCCESS) {
+    VkRenderPass builtRenderPass;
+    if (vkCreateRenderPass(device, &renderPassInfo, NULL, &builtRenderPass) != VK_SUCCESS) {
         fprintf(stderr, "vkCreateRenderPass failed, aborting.");
-        EXIT_FAILURE; 
+        exit(EXIT_FAILURE);
+    }
+    return builtRenderPass;
+}
+// The shader module cache and the bundle's decode arena are not shared between threads, so
+// all modules are acquired up front. Building the pipelines afterwards only touches the
+// entries of their own modules.
+void acquirePipelineShaders() {
+    if(!shaderBindingsMatchBindlessLayout(vertDescriptorBindings, vertDescriptorBindingCount) ||
+       !shaderBindingsMatchBindlessLayout(fragDescriptorBindings, fragDescriptorBindingCount)) {
+        fprintf(stderr, "Shader interface does not match the pipeline layout, aborting.");
+        exit(EXIT_FAILURE);
+    }
+#ifdef SHADER_BUNDLE
+    graphicsShaders[GRAPHICS_SHADER_VERT] = acquireBundledShaderModule(vertShaderBundleName);
+    graphicsShaders[GRAPHICS_SHADER_FRAG] = acquireBundledShaderModule(fragShaderBundleName);
+#else
+    graphicsShaders[GRAPHICS_SHADER_VERT] = acquireShaderModule(vertShaderByteCode, sizeof(vertShaderByteCode));
+    graphicsShaders[GRAPHICS_SHADER_FRAG] = acquireShaderModule(fragShaderByteCode, sizeof(fragShaderByteCode));
+#endif
+    if(gpuCullingEnabled) {
+        if(!shaderBindingsMatchBindlessLayout(cullDescriptorBindings, cullDescriptorBindingCount)) {
+            fprintf(stderr, "Cull shader interface does not match the pipeline layout, aborting.");
+            exit(EXIT_FAILURE);
+        }
+#ifdef SHADER_BUNDLE
+        cullShader = acquireBundledShaderModule(cullShaderBundleName);
+#else
+        cullShader = acquireShaderModule(cullShaderByteCode, sizeof(cullShaderByteCode));
+#endif
+    }
+    if(occlusionCullingEnabled) {
+        if(!shaderBindingsMatchBindlessLayout(hizDescriptorBindings, hizDescriptorBindingCount)) {
+            fprintf(stderr, "Depth pyramid shader interface does not match the pipeline layout, aborting.");
+            exit(EXIT_FAILURE);
+        }
+#ifdef SHADER_BUNDLE
+        hizShader = acquireBundledShaderModule(hizShaderBundleName);
+#else
+        hizShader = acquireShaderModule(hizShaderByteCode, sizeof(hizShaderByteCode));
+#endif
+    }
+    if(computePrimitivesEnabled) {
+        if(!shaderBindingsMatchBindlessLayout(scanDescriptorBindings, scanDescriptorBindingCount) ||
+           !shaderBindingsMatchBindlessLayout(histogramDescriptorBindings, histogramDescriptorBindingCount) ||
+           !shaderBindingsMatchBindlessLayout(onesweepDescriptorBindings, onesweepDescriptorBindingCount) ||
+           !shaderBindingsMatchBindlessLayout(reduceDescriptorBindings, reduceDescriptorBindingCount)) {
+            fprintf(stderr, "Compute primitive shader interface does not match the pipeline layout, aborting.");
+            exit(EXIT_FAILURE);
+        }
+#ifdef SHADER_BUNDLE
+        scanShader = acquireBundledShaderModule(scanShaderBundleName);
+        histogramShader = acquireBundledShaderModule(histogramShaderBundleName);
+        onesweepShader = acquireBundledShaderModule(onesweepShaderBundleName);
+        reduceShader = acquireBundledShaderModule(reduceShaderBundleName);
+#else
+        scanShader = acquireShaderModule(scanShaderByteCode, sizeof(scanShaderByteCode));
+        histogramShader = acquireShaderModule(histogramShaderByteCode, sizeof(histogramShaderByteCode));
+        onesweepShader = acquireShaderModule(onesweepShaderByteCode, sizeof(onesweepShaderByteCode));
+        reduceShader = acquireShaderModule(reduceShaderByteCode, sizeof(reduceShaderByteCode));
+#endif
+    }
+}
+
+// Everything initVulkan() runs as jobs, none of it depends on the rest.
+void initDeviceTask(void* context, uint32_t index) {
+    switch(index) {
+    case INIT_DEVICE_TASK_GRAPHICS_PIPELINE:
+        createGraphicsPipeline();
+        break;
+    case INIT_DEVICE_TASK_CULL_PIPELINE:
+        createCullPipeline();
+        break;
+    case INIT_DEVICE_TASK_DEPTH_PYRAMID_PIPELINE:
+        createDepthPyramidPipeline();
+        break;
+    case INIT_DEVICE_TASK_QUERIES:
+        createTimestampQueries();
+        createStatisticsQueries();
+        break;
+    case INIT_DEVICE_TASK_COMPUTE_PRIMITIVES:
+        createComputePrimitivePipelines();
+        break;
     }
+}
+
+// Shared by the graphics and compute pipelines.
+void createPipelineLayout() {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo={};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_ALL;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(struct PushConstants);
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &bindlessSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS) {
+        fprintf(stderr,"vkCreatePipelineLayout failed, aborting.");
+        EXIT_FAILURE;
+    }
 }
+
 void createGraphicsPipeline() { 
-    VkShaderModule vertShaderModule = createShaderModule((char*)vertShaderByteCode, sizeof(vertShaderByteCode));
-    VkShaderModule fragShaderModule = createShaderModule((char*)fragShaderByteCode, sizeof(fragShaderByteCode));
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+    // The modules stay referenced while graphicsPipeline uses them, so a rebuild only has to
+    // create the stage that changed.
+    if(buildGraphicsPipeline(graphicsShaders[GRAPHICS_SHADER_VERT], 
+                             graphicsShaders[GRAPHICS_SHADER_FRAG], &graphicsPipeline) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateGraphicsPipelines failed, aborting.");
+        EXIT_FAILURE;
+    }
+}
+// vertShader and fragShader are shader module cache entries, see acquireShaderModule().
+VkResult buildGraphicsPipeline(uint32_t vertShader, uint32_t fragShader, VkPipeline* pipeline) {
+    uint32_t shaders[] = {vertShader, fragShader};
+    VkShaderStageFlagBits stages[] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+    VkPipelineShaderStageModuleIdentifierCreateInfoEXT identifierInfos[2] = {};
+    // Warm start: when no stage has a module yet but all have identifiers from an earlier
+    // run, try the pipeline cache before paying for module creation.
+    bool useIdentifiers = shaderModuleIdentifierEnabled;
+    for(uint32_t i = 0; i < 2; i++) {
+        struct CachedShaderModule* entry = &shaderModuleCache[shaders[i]];
+        if(entry->module != VK_NULL_HANDLE || entry->identifierSize == 0) {
+            useIdentifiers = false;
+        }
+    }
+    for(uint32_t i = 0; i < 2; i++) {
+        shaderStages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[i].stage = stages[i];
+        shaderStages[i].pName = "main";
+        if(useIdentifiers) {
+            identifierInfos[i].sType = 
+                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_MODULE_IDENTIFIER_CREATE_INFO_EXT;
+            identifierInfos[i].identifierSize = shaderModuleCache[shaders[i]].identifierSize;
+            identifierInfos[i].pIdentifier = shaderModuleCache[shaders[i]].identifier;
+            shaderStages[i].pNext = &identifierInfos[i];
+            shaderStages[i].module = VK_NULL_HANDLE;
+        } else {
+            shaderStages[i].module = shaderModuleCacheModule(shaders[i]);
+        }
+    }
    
     uint32_t dynamicStateCount = 2; 
     VkDynamicState dynamicStates[] = {
@@ -776,13 +2220,15 @@ void createGraphicsPipeline() {
     dynamicState.dynamicStateCount = dynamicStateCount;
     dynamicState.pDynamicStates = (VkDynamicState*)&dynamicStates;
     
-    VkVertexInputBindingDescription description = getVertexDataBindingDescription();
-    VkVertexInputAttributeDescription* attribs = getVertexAttributeDescriptions();
+    VkVertexInputBindingDescription bindingDescriptions[VERTEX_BINDING_COUNT];
+    getVertexBindingDescriptions(bindingDescriptions);
+    VkVertexInputAttributeDescription attribs[vertInputAttributeCount];
+    getVertexAttributeDescriptions(attribs);
     VkPipelineVertexInputStateCreateInfo vertexInputInfo ={};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &description;
-    vertexInputInfo.vertexAttributeDescriptionCount = 2;
+    vertexInputInfo.vertexBindingDescriptionCount = VERTEX_BINDING_COUNT;
+    vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions;
+    vertexInputInfo.vertexAttributeDescriptionCount = vertInputAttributeCount;
     vertexInputInfo.pVertexAttributeDescriptions = attribs;
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -848,17 +2294,15 @@ void createGraphicsPipeline() {
     colorBlending.blendConstants[2] = 0.0f; // Optional
     colorBlending.blendConstants[3] = 0.0f; // Optional
     
-    VkPipelineLayoutCreateInfo pipelineLayoutInfo={};
-    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 0; // Optional
-    pipelineLayoutInfo.pSetLayouts = NULL; // Optional
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = NULL; // Optional
+    // Equal depths pass, so sprites drawn last at depth 0 stay on top.
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
 
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS) {
-        fprintf(stderr,"vkCreatePipelineLayout failed, aborting.");
-        EXIT_FAILURE;
-    }
     VkGraphicsPipelineCreateInfo pipelineInfo= {};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineInfo.stageCount = 2;
@@ -868,7 +2312,7 @@ void createGraphicsPipeline() {
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = NULL;
+    pipelineInfo.pDepthStencilState = depthEnabled ? &depthStencil : NULL;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicState;
     pipelineInfo.layout = pipelineLayout;
@@ -876,17 +2320,110 @@ void createGraphicsPipeline() {
     pipelineInfo.subpass = 0;
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
     pipelineInfo.basePipelineIndex = -1;
+    pipelineInfo.flags = useIdentifiers ? VK_PIPELINE_CREATE_FAIL_ON_PIPELINE_COMPILE_REQUIRED_BIT_EXT : 0;
 
-    if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &graphicsPipeline)
-       != VK_SUCCESS) {
-        fprintf(stderr, "vkCreateGraphicsPipelines failed, aborting.");
-        EXIT_FAILURE;
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, 
+                                                pipeline);
+    if(result == VK_PIPELINE_COMPILE_REQUIRED_EXT) {
+        // Not in the pipeline cache after all, compile it from the modules.
+        for(uint32_t i = 0; i < 2; i++) {
+            shaderStages[i].pNext = NULL;
+            shaderStages[i].module = shaderModuleCacheModule(shaders[i]);
+        }
+        pipelineInfo.flags = 0;
+        result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, pipeline);
+    }
+    return result;
+}
+#ifdef SHADER_HOT_RELOAD
+void initShaderHotReload() {
+    shaderWatcherInit(&shaderWatcher);
+    for(uint32_t i = 0; i < GRAPHICS_SHADER_COUNT; i++) {
+        hotShaders[i].watchIndex = shaderWatcherAdd(&shaderWatcher, hotShaders[i].path);
+    }
+    printf("Shader hot reload enabled.\n");
+}
+void reloadChangedShaders() {
+    uint32_t changed[SHADER_WATCH_MAX_FILES];
+    uint32_t changedCount = shaderWatcherPoll(&shaderWatcher, changed);
+    if(changedCount == 0) {
+        return;
+    }
+    double startTime = glfwGetTime();
+    uint32_t newShaders[GRAPHICS_SHADER_COUNT];
+    bool isReloaded[GRAPHICS_SHADER_COUNT] = {};
+    bool anyReloaded = false;
+    for(uint32_t i = 0; i < GRAPHICS_SHADER_COUNT; i++) {
+        newShaders[i] = graphicsShaders[i];
+        bool isChanged = false;
+        for(uint32_t j = 0; j < changedCount; j++) {
+            isChanged |= changed[j] == hotShaders[i].watchIndex;
+        }
+        if(!isChanged) continue;
+
+        uint32_t size;
+        char* code = tryReadFile(hotShaders[i].path, &size);
+        if(code == NULL || size < 4 || size % 4 != 0 || *(uint32_t*)code != 0x07230203) {
+            fprintf(stderr, "%s is not valid SPIR-V, keeping the current module.\n",
+                    hotShaders[i].path);
+            free(code);
+            continue;
+        }
+        // Saving a file without changing it hands back the cached module.
+        newShaders[i] = acquireShaderModule((uint32_t*)code, size);
+        free(code);
+        isReloaded[i] = true;
+        anyReloaded = true;
+    }
+    if(!anyReloaded) {
+        return;
     }
 
-    vkDestroyShaderModule(device, vertShaderModule, NULL);
-    vkDestroyShaderModule(device, fragShaderModule, NULL);
-    free(attribs);
+    VkPipeline newPipeline;
+    if(buildGraphicsPipeline(newShaders[GRAPHICS_SHADER_VERT], newShaders[GRAPHICS_SHADER_FRAG], 
+                             &newPipeline) != VK_SUCCESS) {
+        fprintf(stderr, "Rebuilding the graphics pipeline failed, keeping the current one.\n");
+        for(uint32_t i = 0; i < GRAPHICS_SHADER_COUNT; i++) {
+            if(isReloaded[i]) {
+                releaseShaderModule(newShaders[i]);
+            }
+        }
+        return;
+    }
+    for(uint32_t i = 0; i < GRAPHICS_SHADER_COUNT; i++) {
+        if(isReloaded[i]) {
+            releaseShaderModule(graphicsShaders[i]);
+            graphicsShaders[i] = newShaders[i];
+        }
+    }
+    if(retiredPipelineCount == MAX_RETIRED_PIPELINES) {
+        vkDeviceWaitIdle(device);
+        destroyRetiredPipelines(true);
+    }
+    retiredPipelines[retiredPipelineCount] = graphicsPipeline;
+    retiredPipelineFrames[retiredPipelineCount] = frameNumber;
+    retiredPipelineCount++;
+    graphicsPipeline = newPipeline;
+    printf("Reloaded shaders in %.2f ms.\n", (glfwGetTime() - startTime) * 1000.0);
+}
+void destroyRetiredPipelines(bool all) {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < retiredPipelineCount; i++) {
+        if(all || frameRetired(retiredPipelineFrames[i])) {
+            vkDestroyPipeline(device, retiredPipelines[i], NULL);
+        } else {
+            retiredPipelines[kept] = retiredPipelines[i];
+            retiredPipelineFrames[kept] = retiredPipelineFrames[i];
+            kept++;
+        }
+    }
+    retiredPipelineCount = kept;
+}
+void cleanupShaderHotReload() {
+    destroyRetiredPipelines(true);
+    shaderWatcherDestroy(&shaderWatcher);
 }
+#endif
 VkShaderModule createShaderModule(char* code, uint32_t size) {
     VkShaderModuleCreateInfo createInfo= {};
     createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -900,22 +2437,259 @@ VkShaderModule createShaderModule(char* code, uint32_t size) {
     return shaderModule;
    
 }
-void createFramebuffers() {
-    swapchainFramebuffers = malloc(sizeof(VkFramebuffer) * swapchainImageCount);
-    for(int i = 0; i < swapchainImageCount; i++) {
-        VkImageView attachments = swapchainImageViews[i];
-        VkFramebufferCreateInfo framebufferInfo = {};
-
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = &attachments;
-        framebufferInfo.width = swapchainExtent.width;
-        framebufferInfo.height = swapchainExtent.height;
-        framebufferInfo.layers = 1;
-
-        if(vkCreateFramebuffer(device, &framebufferInfo, NULL, &swapchainFramebuffers[i]) != VK_SUCCESS)
-        {
+bool deviceExtensionAvailable(VkPhysicalDevice device, const char* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
+    VkExtensionProperties extensionProperties[extensionCount];
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, extensionProperties);
+    for(uint32_t i = 0; i < extensionCount; i++) {
+        if(strcmp(extensionProperties[i].extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+// Optional, so unlike checkDescriptorIndexingSupport() this never rules a device out. Also
+// records the identifier algorithm, identifiers saved under another one are useless.
+bool checkShaderModuleIdentifierSupport(VkPhysicalDevice device) {
+    for(uint32_t i = 0; i < shaderModuleIdentifierExtensionCount; i++) {
+        if(!deviceExtensionAvailable(device, shaderModuleIdentifierExtensions[i])) {
+            return false;
+        }
+    }
+    VkPhysicalDeviceShaderModuleIdentifierFeaturesEXT identifierFeatures = {};
+    identifierFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_FEATURES_EXT;
+    VkPhysicalDevicePipelineCreationCacheControlFeaturesEXT cacheControlFeatures = {};
+    cacheControlFeatures.sType = 
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_CREATION_CACHE_CONTROL_FEATURES_EXT;
+    cacheControlFeatures.pNext = &identifierFeatures;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &cacheControlFeatures;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    if(!identifierFeatures.shaderModuleIdentifier || 
+       !cacheControlFeatures.pipelineCreationCacheControl) {
+        return false;
+    }
+    VkPhysicalDeviceShaderModuleIdentifierPropertiesEXT identifierProperties = {};
+    identifierProperties.sType = 
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_MODULE_IDENTIFIER_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &identifierProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties);
+    memcpy(shaderModuleIdentifierAlgorithm, 
+           identifierProperties.shaderModuleIdentifierAlgorithmUUID, VK_UUID_SIZE);
+    return true;
+}
+// The pipeline cache is always persisted. Identifiers are only loaded when the device uses the
+// same identifier algorithm as the run that saved them.
+void loadShaderModuleCache() {
+    uint32_t size = 0;
+    char* data = tryReadFile(PIPELINE_CACHE_PATH, &size);
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data ? size : 0;
+    cacheInfo.pInitialData = data;
+    if(vkCreatePipelineCache(device, &cacheInfo, NULL, &pipelineCache) != VK_SUCCESS) {
+        // Data from another driver or a truncated file, start with an empty cache.
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = NULL;
+        if(vkCreatePipelineCache(device, &cacheInfo, NULL, &pipelineCache) != VK_SUCCESS) {
+            fprintf(stderr, "vkCreatePipelineCache failed, aborting.");
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(data);
+    if(!shaderModuleIdentifierEnabled) {
+        return;
+    }
+
+    // Layout: magic, record count, identifier algorithm UUID, records.
+    const uint32_t headerSize = 2 * sizeof(uint32_t) + VK_UUID_SIZE;
+    data = tryReadFile(SHADER_IDENTIFIER_CACHE_PATH, &size);
+    uint32_t header[2];
+    if(data && size >= headerSize) {
+        memcpy(header, data, sizeof(header));
+        if(header[0] == SHADER_IDENTIFIER_CACHE_MAGIC &&
+           memcmp(data + sizeof(header), shaderModuleIdentifierAlgorithm, VK_UUID_SIZE) == 0 &&
+           header[1] <= (size - headerSize) / sizeof(struct ShaderIdentifierRecord)) {
+            for(uint32_t i = 0; i < header[1]; i++) {
+                struct ShaderIdentifierRecord record;
+                memcpy(&record, data + headerSize + i * sizeof(record), sizeof(record));
+                if(record.hash == 0 || record.identifierSize == 0 || 
+                   record.identifierSize > VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT) {
+                    continue;
+                }
+                struct CachedShaderModule* entry = &shaderModuleCache[shaderModuleCacheSlot(record.hash)];
+                entry->identifierSize = record.identifierSize;
+                memcpy(entry->identifier, record.identifier, record.identifierSize);
+            }
+        }
+    }
+    free(data);
+}
+void saveShaderModuleCache() {
+    size_t size = 0;
+    if(vkGetPipelineCacheData(device, pipelineCache, &size, NULL) == VK_SUCCESS && size > 0) {
+        void* data = malloc(size);
+        if(data && vkGetPipelineCacheData(device, pipelineCache, &size, data) == VK_SUCCESS &&
+           !writeFile(PIPELINE_CACHE_PATH, data, size)) {
+            fprintf(stderr, "Failed to write %s.\n", PIPELINE_CACHE_PATH);
+        }
+        free(data);
+    }
+    if(!shaderModuleIdentifierEnabled) {
+        return;
+    }
+
+    const uint32_t headerSize = 2 * sizeof(uint32_t) + VK_UUID_SIZE;
+    char* data = calloc(1, headerSize + sizeof(struct ShaderIdentifierRecord) * SHADER_MODULE_CACHE_SIZE);
+    uint32_t recordCount = 0;
+    for(uint32_t i = 0; i < SHADER_MODULE_CACHE_SIZE; i++) {
+        const struct CachedShaderModule* entry = &shaderModuleCache[i];
+        if(entry->hash == 0 || entry->identifierSize == 0) {
+            continue;
+        }
+        struct ShaderIdentifierRecord record = {};
+        record.hash = entry->hash;
+        record.identifierSize = entry->identifierSize;
+        memcpy(record.identifier, entry->identifier, entry->identifierSize);
+        memcpy(data + headerSize + recordCount * sizeof(record), &record, sizeof(record));
+        recordCount++;
+    }
+    uint32_t header[2] = {SHADER_IDENTIFIER_CACHE_MAGIC, recordCount};
+    memcpy(data, header, sizeof(header));
+    memcpy(data + sizeof(header), shaderModuleIdentifierAlgorithm, VK_UUID_SIZE);
+    if(!writeFile(SHADER_IDENTIFIER_CACHE_PATH, data, 
+                  headerSize + recordCount * sizeof(struct ShaderIdentifierRecord))) {
+        fprintf(stderr, "Failed to write %s.\n", SHADER_IDENTIFIER_CACHE_PATH);
+    }
+    free(data);
+}
+void cleanupShaderModuleCache() {
+    for(uint32_t i = 0; i < SHADER_MODULE_CACHE_SIZE; i++) {
+        vkDestroyShaderModule(device, shaderModuleCache[i].module, NULL);
+        free(shaderModuleCache[i].code);
+    }
+    memset(shaderModuleCache, 0, sizeof(shaderModuleCache));
+    vkDestroyPipelineCache(device, pipelineCache, NULL);
+}
+// Finds the entry for hash, claiming an empty slot for it when there is none.
+uint32_t shaderModuleCacheSlot(uint64_t hash) {
+    hash = hash ? hash : 1;
+    for(uint32_t probe = 0; probe < SHADER_MODULE_CACHE_SIZE; probe++) {
+        uint32_t slot = (uint32_t)(hash + probe) & (SHADER_MODULE_CACHE_SIZE - 1);
+        if(shaderModuleCache[slot].hash == hash) {
+            return slot;
+        }
+        if(shaderModuleCache[slot].hash == 0) {
+            shaderModuleCache[slot].hash = hash;
+            return slot;
+        }
+    }
+    fprintf(stderr, "Shader module cache is full, aborting.");
+    exit(EXIT_FAILURE);
+}
+void shaderModuleCacheCreate(struct CachedShaderModule* entry, const uint32_t* code, uint32_t size) {
+    entry->module = createShaderModule((char*)code, size);
+    if(shaderModuleIdentifierEnabled) {
+        VkShaderModuleIdentifierEXT identifier = {};
+        identifier.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_IDENTIFIER_EXT;
+        GetShaderModuleIdentifierEXT(device, entry->module, &identifier);
+        if(identifier.identifierSize <= VK_MAX_SHADER_MODULE_IDENTIFIER_SIZE_EXT) {
+            entry->identifierSize = identifier.identifierSize;
+            memcpy(entry->identifier, identifier.identifier, identifier.identifierSize);
+        }
+    }
+}
+// Returns the cache entry for the SPIR-V and holds a reference on it until
+// releaseShaderModule(). Identical code shares one entry and one module. When an identifier
+// from an earlier run is known the module is not created yet, only the code is kept in case
+// the pipeline cache misses, see shaderModuleCacheModule().
+uint32_t acquireShaderModule(const uint32_t* code, uint32_t size) {
+    uint32_t shader = shaderModuleCacheSlot(hashBytes64(code, size));
+    struct CachedShaderModule* entry = &shaderModuleCache[shader];
+    entry->refCount++;
+    if(entry->module != VK_NULL_HANDLE || entry->code != NULL) {
+        return shader;
+    }
+    if(shaderModuleIdentifierEnabled && entry->identifierSize > 0) {
+        entry->code = malloc(size);
+        if(!entry->code) {
+            fprintf(stderr, "Failed to allocate shader code, aborting.");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(entry->code, code, size);
+        entry->codeSize = size;
+        return shader;
+    }
+    shaderModuleCacheCreate(entry, code, size);
+    return shader;
+}
+// Destroys the module once nothing references it. The entry keeps its identifier, so it is
+// still saved and a later acquire of the same code can skip module creation again.
+void releaseShaderModule(uint32_t shader) {
+    struct CachedShaderModule* entry = &shaderModuleCache[shader];
+    if(entry->refCount == 0 || --entry->refCount > 0) {
+        return;
+    }
+    vkDestroyShaderModule(device, entry->module, NULL);
+    entry->module = VK_NULL_HANDLE;
+    free(entry->code);
+    entry->code = NULL;
+}
+// Creates the module of an entry that so far only had an identifier.
+VkShaderModule shaderModuleCacheModule(uint32_t shader) {
+    struct CachedShaderModule* entry = &shaderModuleCache[shader];
+    if(entry->module == VK_NULL_HANDLE) {
+        if(!entry->code) {
+            fprintf(stderr, "Shader module cache entry has no code, aborting.");
+            exit(EXIT_FAILURE);
+        }
+        shaderModuleCacheCreate(entry, entry->code, entry->codeSize);
+        free(entry->code);
+        entry->code = NULL;
+    }
+    return entry->module;
+}
+#ifdef SHADER_BUNDLE
+void openShaderBundle() {
+    if(!shaderBundleOpen(&shaderBundle, SHADER_BUNDLE_PATH)) {
+        fprintf(stderr, "Failed to open shader bundle %s, aborting.", SHADER_BUNDLE_PATH);
+        exit(EXIT_FAILURE);
+    }
+}
+// Raw words are passed to the driver in place, nothing is copied out of the mapping.
+// The cache copies the code or creates the module right away, so the arena is free for the
+// next module afterwards.
+uint32_t acquireBundledShaderModule(const char* name) {
+    uint32_t size;
+    const uint32_t* code = shaderBundleLoad(&shaderBundle, name, &shaderDecodeArena, &size);
+    if(!code) {
+        fprintf(stderr, "Shader %s is missing from or corrupt in %s, aborting.", name,
+                SHADER_BUNDLE_PATH);
+        exit(EXIT_FAILURE);
+    }
+    return acquireShaderModule(code, size);
+}
+#endif
+void createFramebuffers() {
+    swapchainFramebuffers = malloc(sizeof(VkFramebuffer) * swapchainImageCount);
+    for(int i = 0; i < swapchainImageCount; i++) {
+        VkImageView attachments[] = {swapchainImageViews[i], depthImageView};
+        VkFramebufferCreateInfo framebufferInfo = {};
+
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = depthEnabled ? 2 : 1;
+        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.width = swapchainExtent.width;
+        framebufferInfo.height = swapchainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if(vkCreateFramebuffer(device, &framebufferInfo, NULL, &swapchainFramebuffers[i]) != VK_SUCCESS)
+        {
             fprintf(stderr, "vkCreateFramebuffer failed, aborting.");
             EXIT_FAILURE;
         }
@@ -935,204 +2709,3622 @@ void createCommandPool() {
         EXIT_FAILURE;
     }
 }
-void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, 
-                  VkBuffer* buffer, VkDeviceMemory* deviceMemory) {
-    VkBufferCreateInfo bufferInfo = {};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+bool frameRetired(uint64_t frame) {
+    // drawFrame() waits on the fence of frame (frameNumber - MAX_FRAMES_IN_FLIGHT) before
+    // recording, so everything submitted up to that frame has finished executing.
+    return frame + MAX_FRAMES_IN_FLIGHT <= frameNumber;
+}
+void createBindlessDescriptors() {
+    VkPhysicalDeviceVulkan12Properties properties12 = {};
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+    // The bindings are visible to every stage, so each has to fit the per-stage limits as well
+    // as the set's. A combined image sampler counts as a sampler too, and against the
+    // per-stage resources only as a sampled image.
+    uint32_t storageBuffers = properties12.maxDescriptorSetUpdateAfterBindStorageBuffers;
+    if(properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers < storageBuffers) {
+        storageBuffers = properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers;
+    }
+    uint32_t sampledImages = properties12.maxDescriptorSetUpdateAfterBindSampledImages;
+    const uint32_t imageLimits[] = {
+        properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+        properties12.maxDescriptorSetUpdateAfterBindSamplers,
+        properties12.maxPerStageDescriptorUpdateAfterBindSamplers
+    };
+    for(uint32_t i = 0; i < sizeof(imageLimits) / sizeof(imageLimits[0]); i++) {
+        if(imageLimits[i] < sampledImages) {
+            sampledImages = imageLimits[i];
+        }
+    }
+    uint32_t capacities[BINDLESS_BINDING_COUNT];
+    capacities[BINDLESS_STORAGE_BUFFER_BINDING] = clamp(BINDLESS_MAX_STORAGE_BUFFERS, 1, storageBuffers);
+    capacities[BINDLESS_SAMPLED_IMAGE_BINDING] = clamp(BINDLESS_MAX_SAMPLED_IMAGES, 1, sampledImages);
+    // Both bindings share the per-stage resources, split evenly when they do not fit together.
+    uint32_t resources = properties12.maxPerStageUpdateAfterBindResources;
+    if((uint64_t)capacities[BINDLESS_STORAGE_BUFFER_BINDING] + capacities[BINDLESS_SAMPLED_IMAGE_BINDING] > resources) {
+        capacities[BINDLESS_SAMPLED_IMAGE_BINDING] = 
+            clamp(capacities[BINDLESS_SAMPLED_IMAGE_BINDING], 1, resources / 2);
+        capacities[BINDLESS_STORAGE_BUFFER_BINDING] = 
+            clamp(capacities[BINDLESS_STORAGE_BUFFER_BINDING], 1, 
+                  resources - capacities[BINDLESS_SAMPLED_IMAGE_BINDING]);
+    }
+
+    VkDescriptorType types[BINDLESS_BINDING_COUNT];
+    types[BINDLESS_STORAGE_BUFFER_BINDING] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    types[BINDLESS_SAMPLED_IMAGE_BINDING] = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT];
+    VkDescriptorBindingFlags bindingFlags[BINDLESS_BINDING_COUNT];
+    VkDescriptorPoolSize poolSizes[BINDLESS_BINDING_COUNT];
+    for(uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = capacities[i];
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+        bindings[i].pImmutableSamplers = NULL;
+        bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                          VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                          VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        poolSizes[i].type = types[i];
+        poolSizes[i].descriptorCount = capacities[i];
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = BINDLESS_BINDING_COUNT;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &bindingFlagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = BINDLESS_BINDING_COUNT;
+    layoutInfo.pBindings = bindings;
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &bindlessSetLayout) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateDescriptorSetLayout failed, aborting.");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = BINDLESS_BINDING_COUNT;
+    poolInfo.pPoolSizes = poolSizes;
+    if(vkCreateDescriptorPool(device, &poolInfo, NULL, &bindlessDescriptorPool) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateDescriptorPool failed, aborting.");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = bindlessDescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &bindlessSetLayout;
+    if(vkAllocateDescriptorSets(device, &allocInfo, &bindlessDescriptorSet) != VK_SUCCESS) {
+        fprintf(stderr, "vkAllocateDescriptorSets failed, aborting.");
+        exit(EXIT_FAILURE);
+    }
+
+    for(uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        struct BindlessSlots* slots = &bindlessSlots[i];
+        slots->capacity = capacities[i];
+        slots->next = 0;
+        slots->freeCount = 0;
+        slots->freeHandles = malloc(sizeof(uint32_t) * capacities[i]);
+        slots->retiredHandles = malloc(sizeof(uint32_t) * capacities[i]);
+        slots->retiredFrames = malloc(sizeof(uint64_t) * capacities[i]);
+        slots->retiredCount = 0;
+    }
+}
+void cleanupBindlessDescriptors() {
+    for(uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        free(bindlessSlots[i].freeHandles);
+        free(bindlessSlots[i].retiredHandles);
+        free(bindlessSlots[i].retiredFrames);
+    }
+    vkDestroyDescriptorPool(device, bindlessDescriptorPool, NULL);
+    vkDestroyDescriptorSetLayout(device, bindlessSetLayout, NULL);
+}
+uint32_t bindlessAllocateHandle(uint32_t binding) {
+    struct BindlessSlots* slots = &bindlessSlots[binding];
+    if(slots->freeCount > 0) {
+        slots->freeCount--;
+        return slots->freeHandles[slots->freeCount];
+    }
+    if(slots->next == slots->capacity) {
+        fprintf(stderr, "Bindless binding %u is full, aborting.", binding);
+        exit(EXIT_FAILURE);
+    }
+    return slots->next++;
+}
+void bindlessReleaseHandle(uint32_t binding, uint32_t handle) {
+    // The descriptor may still be read by frames in flight, so the slot only becomes
+    // reusable once the current frame has retired.
+    struct BindlessSlots* slots = &bindlessSlots[binding];
+    slots->retiredHandles[slots->retiredCount] = handle;
+    slots->retiredFrames[slots->retiredCount] = frameNumber;
+    slots->retiredCount++;
+}
+void bindlessRecycleHandles() {
+    for(uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        struct BindlessSlots* slots = &bindlessSlots[i];
+        uint32_t kept = 0;
+        for(uint32_t j = 0; j < slots->retiredCount; j++) {
+            if(frameRetired(slots->retiredFrames[j])) {
+                slots->freeHandles[slots->freeCount++] = slots->retiredHandles[j];
+            } else {
+                slots->retiredHandles[kept] = slots->retiredHandles[j];
+                slots->retiredFrames[kept] = slots->retiredFrames[j];
+                kept++;
+            }
+        }
+        slots->retiredCount = kept;
+    }
+}
+uint32_t bindlessAddStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    uint32_t handle = bindlessAllocateHandle(BINDLESS_STORAGE_BUFFER_BINDING);
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = buffer;
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = bindlessDescriptorSet;
+    write.dstBinding = BINDLESS_STORAGE_BUFFER_BINDING;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    return handle;
+}
+uint32_t bindlessAddSampledImage(VkImageView imageView, VkSampler sampler, VkImageLayout layout) {
+    uint32_t handle = bindlessAllocateHandle(BINDLESS_SAMPLED_IMAGE_BINDING);
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = imageView;
+    imageInfo.imageLayout = layout;
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = bindlessDescriptorSet;
+    write.dstBinding = BINDLESS_SAMPLED_IMAGE_BINDING;
+    write.dstArrayElement = handle;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    return handle;
+}
+void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, 
+                  VkBuffer* buffer, VkDeviceMemory* deviceMemory) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(bufferQueueFamilyCount > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = bufferQueueFamilyCount;
+        bufferInfo.pQueueFamilyIndices = bufferQueueFamilies;
+    }
+
+    if(vkCreateBuffer(device, &bufferInfo, NULL, buffer) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to create vertex buffer, aborting.");
+        exit(EXIT_FAILURE);
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+    if(vkAllocateMemory(device, &allocInfo, NULL, deviceMemory) != VK_SUCCESS) {
+        fprintf(stderr, "Failed to allocate vertex buffer memory, aborting.");
+        exit(EXIT_FAILURE);
+    }
+
+    vkBindBufferMemory(device, *buffer, *deviceMemory, 0);
+
+}
+void copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, 
+                VkDeviceSize dstOffset, VkDeviceSize size) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    endSingleTimeCommands(commandBuffer);
+}
+
+// A command buffer of commandPool for the graphics queue, endSingleTimeCommands() submits it
+// and waits for it.
+VkCommandBuffer beginSingleTimeCommands() {
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = commandPool;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    return commandBuffer;
+}
+
+void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo  = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vkQueueSubmit(graphicsQueue, 1, &submitInfo, NULL);
+    vkQueueWaitIdle(graphicsQueue);
+    
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+}
+void createGeometryPool() {
+    rangeAllocatorInit(&geometryPool.vertices, GEOMETRY_POOL_VERTEX_CAPACITY);
+    rangeAllocatorInit(&geometryPool.indices, GEOMETRY_POOL_INDEX_CAPACITY);
+    // Transfer sources too, for when they grow.
+    createBuffer((VkDeviceSize)GEOMETRY_POOL_VERTEX_CAPACITY * vertexFormat.stride,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+                 VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &geometryPool.vertexBuffer, 
+                 &geometryPool.vertexMemory);
+    createBuffer((VkDeviceSize)GEOMETRY_POOL_INDEX_CAPACITY * sizeof(uint32_t),
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &geometryPool.indexBuffer, 
+                 &geometryPool.indexMemory);
+    quadMesh = geometryPoolAddMesh(quadVertices, sizeof(quadVertices) / sizeof(struct MeshVertex), 
+                                   indexData, sizeof(indexData) / sizeof(uint32_t));
+    if(quadMesh == MESH_INVALID) {
+        fprintf(stderr, "Failed to add the quad to the geometry pool, aborting.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Replaces the buffer with one that has room for count more units than the allocator's
+// capacity, doubling it where that stays within GEOMETRY_POOL_MAX_BUFFER_SIZE, and copies
+// the meshes over at the same offsets. copyBuffer() waits for the graphics queue, so no frame
+// in flight still reads the old buffer when it is destroyed. false when even count more
+// units would pass the limit.
+bool geometryPoolGrow(struct RangeAllocator* allocator, VkDeviceSize stride, VkBufferUsageFlags usage,
+                      VkBuffer* buffer, VkDeviceMemory* memory, uint32_t count) {
+    uint64_t maxCapacity = GEOMETRY_POOL_MAX_BUFFER_SIZE / stride;
+    uint64_t required = (uint64_t)allocator->capacity + count;
+    if(required > maxCapacity) {
+        return false;
+    }
+    uint64_t capacity = (uint64_t)allocator->capacity * 2;
+    while(capacity < required) {
+        capacity *= 2;
+    }
+    if(capacity > maxCapacity) {
+        capacity = maxCapacity;
+    }
+    VkBuffer grownBuffer;
+    VkDeviceMemory grownMemory;
+    createBuffer(capacity * stride, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &grownBuffer, &grownMemory);
+    copyBuffer(*buffer, 0, grownBuffer, 0, (VkDeviceSize)allocator->capacity * stride);
+    vkDestroyBuffer(device, *buffer, NULL);
+    vkFreeMemory(device, *memory, NULL);
+    *buffer = grownBuffer;
+    *memory = grownMemory;
+    rangeAllocatorGrow(allocator, (uint32_t)capacity);
+    return true;
+}
+
+// vertices are packed into vertexFormat, indices are relative to the first vertex. Returns
+// MESH_INVALID when the pool has no room left and cannot grow.
+uint32_t geometryPoolAddMesh(const struct MeshVertex* vertices, uint32_t vertexCount, 
+                             const uint32_t* indices, uint32_t indexCount) {
+    uint32_t mesh = 0;
+    while(mesh < GEOMETRY_POOL_MAX_MESHES && geometryPool.meshes[mesh].state != POOL_MESH_FREE) {
+        mesh++;
+    }
+    if(mesh == GEOMETRY_POOL_MAX_MESHES) {
+        fprintf(stderr, "Geometry pool is out of mesh slots.\n");
+        return MESH_INVALID;
+    }
+    uint32_t vertexOffset = rangeAllocate(&geometryPool.vertices, vertexCount);
+    if(vertexOffset == RANGE_ALLOCATOR_FAILED && vertexCount > 0 &&
+       geometryPoolGrow(&geometryPool.vertices, vertexFormat.stride, 
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                        &geometryPool.vertexBuffer, &geometryPool.vertexMemory, vertexCount)) {
+        vertexOffset = rangeAllocate(&geometryPool.vertices, vertexCount);
+    }
+    if(vertexOffset == RANGE_ALLOCATOR_FAILED) {
+        fprintf(stderr, "Geometry pool has no room for %u vertices, it holds at most %llu.\n", vertexCount,
+                (unsigned long long)(GEOMETRY_POOL_MAX_BUFFER_SIZE / vertexFormat.stride));
+        return MESH_INVALID;
+    }
+    uint32_t firstIndex = rangeAllocate(&geometryPool.indices, indexCount);
+    if(firstIndex == RANGE_ALLOCATOR_FAILED && indexCount > 0 &&
+       geometryPoolGrow(&geometryPool.indices, sizeof(uint32_t), 
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+                        VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                        &geometryPool.indexBuffer, &geometryPool.indexMemory, indexCount)) {
+        firstIndex = rangeAllocate(&geometryPool.indices, indexCount);
+    }
+    if(firstIndex == RANGE_ALLOCATOR_FAILED) {
+        rangeFree(&geometryPool.vertices, vertexOffset, vertexCount);
+        fprintf(stderr, "Geometry pool has no room for %u indices, it holds at most %llu.\n", indexCount,
+                (unsigned long long)(GEOMETRY_POOL_MAX_BUFFER_SIZE / sizeof(uint32_t)));
+        return MESH_INVALID;
+    }
+
+    VkDeviceSize vertexSize = (VkDeviceSize)vertexCount * vertexFormat.stride;
+    VkDeviceSize indexSize = (VkDeviceSize)indexCount * sizeof(uint32_t);
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(vertexSize + indexSize, 
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, vertexSize + indexSize, 0, &data);
+    vertexFormatPack(&vertexFormat, vertices, vertexCount, data);
+    memcpy((char*)data + vertexSize, indices, indexSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+    // Frames in flight only read other meshes' ranges, so no synchronisation is needed.
+    copyBuffer(stagingBuffer, 0, geometryPool.vertexBuffer, 
+               (VkDeviceSize)vertexOffset * vertexFormat.stride, vertexSize);
+    copyBuffer(stagingBuffer, vertexSize, geometryPool.indexBuffer, 
+               (VkDeviceSize)firstIndex * sizeof(uint32_t), indexSize);
+    vkDestroyBuffer(device, stagingBuffer, NULL);
+    vkFreeMemory(device, stagingBufferMemory, NULL);
+
+    struct PoolMesh* poolMesh = &geometryPool.meshes[mesh];
+    poolMesh->state = POOL_MESH_LIVE;
+    poolMesh->vertexOffset = vertexOffset;
+    poolMesh->vertexCount = vertexCount;
+    poolMesh->firstIndex = firstIndex;
+    poolMesh->indexCount = indexCount;
+    return mesh;
+}
+
+// Draws of the mesh are dropped right away, its space is reused once the current frame has
+// retired, see geometryPoolRecycle().
+void geometryPoolRemoveMesh(uint32_t mesh) {
+    if(mesh >= GEOMETRY_POOL_MAX_MESHES || geometryPool.meshes[mesh].state != POOL_MESH_LIVE) {
+        return;
+    }
+    geometryPool.meshes[mesh].state = POOL_MESH_RETIRED;
+    geometryPool.retiredMeshes[geometryPool.retiredCount] = mesh;
+    geometryPool.retiredFrames[geometryPool.retiredCount] = frameNumber;
+    geometryPool.retiredCount++;
+    meshDrawVersion++;
+}
+
+void geometryPoolRecycle() {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < geometryPool.retiredCount; i++) {
+        uint32_t mesh = geometryPool.retiredMeshes[i];
+        if(frameRetired(geometryPool.retiredFrames[i])) {
+            struct PoolMesh* poolMesh = &geometryPool.meshes[mesh];
+            rangeFree(&geometryPool.vertices, poolMesh->vertexOffset, poolMesh->vertexCount);
+            rangeFree(&geometryPool.indices, poolMesh->firstIndex, poolMesh->indexCount);
+            poolMesh->state = POOL_MESH_FREE;
+        } else {
+            geometryPool.retiredMeshes[kept] = mesh;
+            geometryPool.retiredFrames[kept] = geometryPool.retiredFrames[i];
+            kept++;
+        }
+    }
+    geometryPool.retiredCount = kept;
+}
+
+// Normalized into the extent instances expect, so any file draws like the quad. MESH_INVALID
+// when the file cannot be loaded or the mesh does not fit the geometry pool.
+uint32_t loadMeshFile(const char* path) {
+    struct MeshLoadOptions options = {};
+    options.normalize = true;
+    struct LoadedMesh loadedMesh;
+    double start = glfwGetTime();
+    if(!meshLoad(&loadedMesh, path, &options)) {
+        fprintf(stderr, "Failed to load mesh %s.\n", path);
+        return MESH_INVALID;
+    }
+    double loadMilliseconds = (glfwGetTime() - start) * 1000.0;
+    uint32_t mesh = geometryPoolAddMesh(loadedMesh.vertices, loadedMesh.vertexCount,
+                                        loadedMesh.indices, loadedMesh.indexCount);
+    printf("Loaded %s: %u vertices, %u indices in %.1f ms on %u threads.\n", path,
+           loadedMesh.vertexCount, loadedMesh.indexCount, loadMilliseconds, meshProcessorCount());
+    printf("Vertices take %.1f MB as %s, %.1f MB as float.\n", 
+           (double)loadedMesh.vertexCount * vertexFormat.stride / 1e6, vertexFormat.name,
+           (double)loadedMesh.vertexCount * VERTEX_SHADER_INPUT_SIZE / 1e6);
+    meshFree(&loadedMesh);
+    if(mesh == MESH_INVALID) {
+        fprintf(stderr, "Mesh %s does not fit the geometry pool.\n", path);
+    }
+    return mesh;
+}
+
+// Loads the file with 1, 2, 4, ... threads up to one per processor, best of a few runs each.
+void runMeshLoadBenchmark(const char* path) {
+    // Only the file itself is counted, not external glTF buffers.
+    struct MappedFile file;
+    if(!mappedFileOpen(&file, path)) {
+        fprintf(stderr, "Failed to map %s, aborting.", path);
+        exit(EXIT_FAILURE);
+    }
+    size_t fileSize = file.size;
+    mappedFileClose(&file);
+    uint32_t processorCount = meshProcessorCount();
+    double singleMilliseconds = 0.0;
+    printf("%8s %12s %12s %10s\n", "Threads", "Load ms", "MB/s", "Speedup");
+    for(uint32_t threadCount = 1; ; threadCount *= 2) {
+        if(threadCount > processorCount) {
+            threadCount = processorCount;
+        }
+        struct MeshLoadOptions options = {};
+        options.threadCount = threadCount;
+        double bestMilliseconds = 0.0;
+        for(uint32_t run = 0; run < MESH_LOAD_BENCHMARK_RUNS; run++) {
+            struct LoadedMesh loadedMesh;
+            double start = glfwGetTime();
+            if(!meshLoad(&loadedMesh, path, &options)) {
+                fprintf(stderr, "Failed to load mesh %s, aborting.", path);
+                exit(EXIT_FAILURE);
+            }
+            double milliseconds = (glfwGetTime() - start) * 1000.0;
+            if(run == 0 || milliseconds < bestMilliseconds) {
+                bestMilliseconds = milliseconds;
+            }
+            meshFree(&loadedMesh);
+        }
+        if(threadCount == 1) {
+            singleMilliseconds = bestMilliseconds;
+        }
+        printf("%8u %12.1f %12.1f %10.2f\n", threadCount, bestMilliseconds,
+               bestMilliseconds > 0 ? fileSize / 1000.0 / bestMilliseconds : 0.0,
+               bestMilliseconds > 0 ? singleMilliseconds / bestMilliseconds : 0.0);
+        if(threadCount == processorCount) {
+            break;
+        }
+    }
+}
+
+void cleanupGeometryPool() {
+    vkDestroyBuffer(device, geometryPool.vertexBuffer, NULL);
+    vkFreeMemory(device, geometryPool.vertexMemory, NULL);
+    vkDestroyBuffer(device, geometryPool.indexBuffer, NULL);
+    vkFreeMemory(device, geometryPool.indexMemory, NULL);
+    memset(&geometryPool, 0, sizeof(geometryPool));
+}
+
+void createTextures() {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, TEXTURE_FORMAT, &formatProperties);
+    VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    textureMipsSupported = (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if(vkCreateSampler(device, &samplerInfo, NULL, &textureSampler) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateSampler failed for the textures, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        mappedBufferReserve(&textureStaging[frame], TEXTURE_UPLOAD_FRAME_BUDGET, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    }
+}
+
+// pixels are width * height TEXTURE_FORMAT texels, row by row from the top, and are copied
+// before it returns. Returns TEXTURE_INVALID when out of slots or TEXTURE_MEMORY_BUDGET.
+uint32_t textureCreate(const uint8_t* pixels, uint32_t width, uint32_t height) {
+    uint32_t texture = 0;
+    while(texture < MAX_TEXTURES && textures[texture].state != TEXTURE_FREE) {
+        texture++;
+    }
+    if(texture == MAX_TEXTURES) {
+        fprintf(stderr, "Out of texture slots.\n");
+        return TEXTURE_INVALID;
+    }
+    if(width == 0 || height == 0) {
+        fprintf(stderr, "Cannot create a texture of %ux%u texels.\n", width, height);
+        return TEXTURE_INVALID;
+    }
+    uint32_t mipLevels = 1;
+    if(textureMipsSupported) {
+        while((width >> mipLevels) > 0 || (height >> mipLevels) > 0) {
+            mipLevels++;
+        }
+    }
+    struct Texture* t = &textures[texture];
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = TEXTURE_FORMAT;
+    imageInfo.extent.width = width;
+    imageInfo.extent.height = height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // The levels are blitted from one another.
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | 
+                      VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(device, &imageInfo, NULL, &t->image) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateImage failed for a texture, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, t->image, &memRequirements);
+    if(textureMemoryBytes + memRequirements.size > TEXTURE_MEMORY_BUDGET) {
+        vkDestroyImage(device, t->image, NULL);
+        t->image = VK_NULL_HANDLE;
+        fprintf(stderr, "No texture memory left for %ux%u texels.\n", width, height);
+        return TEXTURE_INVALID;
+    }
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if(vkAllocateMemory(device, &allocInfo, NULL, &t->memory) != VK_SUCCESS) {
+        fprintf(stderr, "vkAllocateMemory failed for a texture, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    vkBindImageMemory(device, t->image, t->memory, 0);
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = t->image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = TEXTURE_FORMAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = mipLevels;
+    viewInfo.subresourceRange.layerCount = 1;
+    if(vkCreateImageView(device, &viewInfo, NULL, &t->view) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateImageView failed for a texture, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t)width * height * TEXTURE_TEXEL_SIZE;
+    t->pixels = malloc(size);
+    if(!t->pixels) {
+        fprintf(stderr, "Failed to allocate %ux%u texels, aborting.", width, height);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(t->pixels, pixels, size);
+    // Written now, only read by frames recorded after the upload.
+    t->handle = bindlessAddSampledImage(t->view, textureSampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    t->state = TEXTURE_QUEUED;
+    t->memorySize = memRequirements.size;
+    t->width = width;
+    t->height = height;
+    t->mipLevels = mipLevels;
+    textureUploadQueue[textureUploadQueueCount++] = texture;
+    textureMemoryBytes += t->memorySize;
+    textureCount++;
+    return texture;
+}
+
+// Materials with the texture stop sampling it right away and lose it, its image is destroyed
+// once the current frame has retired, see textureRecycle().
+void textureDestroy(uint32_t texture) {
+    if(texture >= MAX_TEXTURES || 
+       (textures[texture].state != TEXTURE_QUEUED && textures[texture].state != TEXTURE_LIVE)) {
+        return;
+    }
+    struct Texture* t = &textures[texture];
+    if(t->state == TEXTURE_QUEUED) {
+        uint32_t i = 0;
+        while(textureUploadQueue[i] != texture) {
+            i++;
+        }
+        memmove(&textureUploadQueue[i], &textureUploadQueue[i + 1], 
+                (textureUploadQueueCount - i - 1) * sizeof(uint32_t));
+        textureUploadQueueCount--;
+        free(t->pixels);
+        t->pixels = NULL;
+    }
+    bindlessReleaseHandle(BINDLESS_SAMPLED_IMAGE_BINDING, t->handle);
+    t->state = TEXTURE_RETIRED;
+    t->retiredFrame = frameNumber;
+    retiredTextures[retiredTextureCount++] = texture;
+    for(uint32_t material = 0; material < materialCount; material++) {
+        if(materials[material].texture == texture) {
+            setMaterialTexture(material, TEXTURE_INVALID);
+        }
+    }
+}
+
+// Called once the frame's fence has been waited on, so its staging buffer is no longer read.
+// Textures are taken in the order they were created. One larger than the budget goes alone,
+// the staging buffer grows for it.
+void uploadFrameTextures(uint32_t frame) {
+    struct MappedBuffer* staging = &textureStaging[frame];
+    struct TextureUpload* uploads = frameTextureUploads[frame];
+    VkDeviceSize used = 0;
+    uint32_t uploadCount = 0;
+    while(uploadCount < textureUploadQueueCount && uploadCount < TEXTURE_MAX_FRAME_UPLOADS) {
+        uint32_t texture = textureUploadQueue[uploadCount];
+        struct Texture* t = &textures[texture];
+        VkDeviceSize size = (VkDeviceSize)t->width * t->height * TEXTURE_TEXEL_SIZE;
+        if(used > 0 && used + size > TEXTURE_UPLOAD_FRAME_BUDGET) {
+            break;
+        }
+        // Only grows when nothing is staged yet, the budget fits the initial capacity.
+        mappedBufferReserve(staging, used + size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        memcpy((uint8_t*)staging->mapped + used, t->pixels, size);
+        free(t->pixels);
+        t->pixels = NULL;
+        // recordCommandBuffer() records the upload before anything that samples it.
+        t->state = TEXTURE_LIVE;
+        uploads[uploadCount].texture = texture;
+        uploads[uploadCount].stagingOffset = used;
+        uploadCount++;
+        used += size;
+    }
+    memmove(textureUploadQueue, &textureUploadQueue[uploadCount], 
+            (textureUploadQueueCount - uploadCount) * sizeof(uint32_t));
+    textureUploadQueueCount -= uploadCount;
+    frameTextureUploadCounts[frame] = uploadCount;
+    textureUploadBytes += used;
+    if(uploadCount > 0) {
+        updateMaterialTextures();
+    }
+}
+
+VkImageMemoryBarrier textureBarrier(VkImage image, uint32_t baseLevel, uint32_t levelCount, 
+                                    VkImageLayout oldLayout, VkImageLayout newLayout, 
+                                    VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseLevel;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+// The frame's uploads, on the graphics queue as blits need one. Each step is one barrier for
+// all textures: every level a transfer destination, the first levels copied, then level by
+// level the one above turned into a transfer source and blitted down, finally all levels
+// turned readable by fragment shaders.
+void recordTextureUploads(VkCommandBuffer commandBuffer, uint32_t frame) {
+    uint32_t uploadCount = frameTextureUploadCounts[frame];
+    if(uploadCount == 0) {
+        return;
+    }
+    const struct TextureUpload* uploads = frameTextureUploads[frame];
+    VkImageMemoryBarrier barriers[2 * TEXTURE_MAX_FRAME_UPLOADS];
+    uint32_t maxLevels = 0;
+    for(uint32_t i = 0; i < uploadCount; i++) {
+        const struct Texture* t = &textures[uploads[i].texture];
+        barriers[i] = textureBarrier(t->image, 0, t->mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, 
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+        maxLevels = t->mipLevels > maxLevels ? t->mipLevels : maxLevels;
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, NULL, 0, NULL, uploadCount, barriers);
+    for(uint32_t i = 0; i < uploadCount; i++) {
+        const struct Texture* t = &textures[uploads[i].texture];
+        VkBufferImageCopy region = {};
+        region.bufferOffset = uploads[i].stagingOffset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = t->width;
+        region.imageExtent.height = t->height;
+        region.imageExtent.depth = 1;
+        vkCmdCopyBufferToImage(commandBuffer, textureStaging[frame].buffer, t->image, 
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+    for(uint32_t level = 1; level < maxLevels; level++) {
+        uint32_t barrierCount = 0;
+        for(uint32_t i = 0; i < uploadCount; i++) {
+            const struct Texture* t = &textures[uploads[i].texture];
+            if(level < t->mipLevels) {
+                barriers[barrierCount++] = textureBarrier(t->image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 
+                                                          VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+            }
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, NULL, 0, NULL, barrierCount, barriers);
+        for(uint32_t i = 0; i < uploadCount; i++) {
+            const struct Texture* t = &textures[uploads[i].texture];
+            if(level >= t->mipLevels) {
+                continue;
+            }
+            VkImageBlit blit = {};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.layerCount = 1;
+            blit.srcOffsets[1].x = t->width >> (level - 1) ? (int32_t)(t->width >> (level - 1)) : 1;
+            blit.srcOffsets[1].y = t->height >> (level - 1) ? (int32_t)(t->height >> (level - 1)) : 1;
+            blit.srcOffsets[1].z = 1;
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.layerCount = 1;
+            blit.dstOffsets[1].x = t->width >> level ? (int32_t)(t->width >> level) : 1;
+            blit.dstOffsets[1].y = t->height >> level ? (int32_t)(t->height >> level) : 1;
+            blit.dstOffsets[1].z = 1;
+            vkCmdBlitImage(commandBuffer, t->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, t->image, 
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        }
+    }
+    // All but the last level were blitted from, the last one only written.
+    uint32_t barrierCount = 0;
+    for(uint32_t i = 0; i < uploadCount; i++) {
+        const struct Texture* t = &textures[uploads[i].texture];
+        if(t->mipLevels > 1) {
+            barriers[barrierCount++] = textureBarrier(t->image, 0, t->mipLevels - 1, 
+                                                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, 
+                                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                      VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+        barriers[barrierCount++] = textureBarrier(t->image, t->mipLevels - 1, 1, 
+                                                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+                                                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                         0, NULL, 0, NULL, barrierCount, barriers);
+}
+
+void textureRecycle() {
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < retiredTextureCount; i++) {
+        uint32_t texture = retiredTextures[i];
+        struct Texture* t = &textures[texture];
+        if(frameRetired(t->retiredFrame)) {
+            vkDestroyImageView(device, t->view, NULL);
+            vkDestroyImage(device, t->image, NULL);
+            vkFreeMemory(device, t->memory, NULL);
+            textureMemoryBytes -= t->memorySize;
+            textureCount--;
+            memset(t, 0, sizeof(*t));
+        } else {
+            retiredTextures[kept++] = texture;
+        }
+    }
+    retiredTextureCount = kept;
+}
+
+void cleanupTextures() {
+    for(uint32_t texture = 0; texture < MAX_TEXTURES; texture++) {
+        struct Texture* t = &textures[texture];
+        if(t->state != TEXTURE_FREE) {
+            vkDestroyImageView(device, t->view, NULL);
+            vkDestroyImage(device, t->image, NULL);
+            vkFreeMemory(device, t->memory, NULL);
+            free(t->pixels);
+            memset(t, 0, sizeof(*t));
+        }
+    }
+    textureUploadQueueCount = 0;
+    retiredTextureCount = 0;
+    textureMemoryBytes = 0;
+    textureCount = 0;
+    for(uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        mappedBufferDestroy(&textureStaging[frame]);
+        frameTextureUploadCounts[frame] = 0;
+    }
+    vkDestroySampler(device, textureSampler, NULL);
+}
+uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+    for(uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+        if(typeFilter & (1 << i) && 
+            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+    fprintf(stderr, "Failed to find suitable memory!");
+    return -1;
+}
+void createCommandBuffers() {
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    if(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers) != VK_SUCCESS) {
+        fprintf(stderr, "vkAllocateCommandBuffers failed, aborting");
+        EXIT_FAILURE; 
+    }
+}
+
+void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = 0;
+    beginInfo.pInheritanceInfo = NULL;
+
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "vkBeginComandBuffer failed, aborting");
+        EXIT_FAILURE;
+    }
+
+    bool writeTimestamps = frameTimingEnabled && timestampsSupported;
+    if(writeTimestamps) {
+        vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool,
+                            currentFrame * 2);
+    }
+    bool writeStatistics = frameTimingEnabled && statisticsSupported;
+    if(writeStatistics) {
+        vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, currentFrame, 1);
+        // Outside the render passes, so it spans all of them.
+        vkCmdBeginQuery(commandBuffer, statisticsQueryPool, currentFrame, 0);
+    }
+
+    // The frame's fence was waited for, so nothing recorded from these pools is still pending.
+    if(recordThreadCount > 1) {
+        for(uint32_t thread = 0; thread < recordThreadCount; thread++) {
+            vkResetCommandPool(device, recordPools[currentFrame][thread], 0);
+        }
+    }
+
+    // Before every pass, any of them may sample the textures.
+    recordTextureUploads(commandBuffer, currentFrame);
+
+    // The cull passes pushed constants of their own, so the first group always pushes its material.
+    struct FrameContext context = {};
+    context.draws = &frameDraws[currentFrame];
+    context.framebuffer = swapchainFramebuffers[imageIndex];
+    context.state.pipeline = UINT32_MAX;
+    context.state.material = UINT32_MAX;
+    context.statisticsActive = writeStatistics;
+    renderGraphSetImage(&renderGraph, graphSwapchainImage, swapchainImages[imageIndex]);
+    renderGraphExecute(&renderGraph, commandBuffer, &context);
+    addBindCounts(&context.state);
+
+    if(writeTimestamps) {
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool,
+                            currentFrame * 2 + 1);
+    }
+    frameTimestampsWritten[currentFrame] = writeTimestamps;
+    if(writeStatistics) {
+        vkCmdEndQuery(commandBuffer, statisticsQueryPool, currentFrame);
+    }
+    frameStatisticsWritten[currentFrame] = writeStatistics;
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "vkEndCommandBuffer() failed, aborting");
+        EXIT_FAILURE;
+    }
+}
+void createSyncObjects() {
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    for(int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+
+        if(vkCreateSemaphore(device, &semaphoreInfo, NULL, &imageAvailableSemaphores[i]) 
+            != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinishedSemaphores[i]) 
+            != VK_SUCCESS ||
+            vkCreateFence(device, &fenceInfo, NULL, &inFlightFences[i]) != VK_SUCCESS) {
+
+            fprintf(stderr, "vkCreateSempaphore or vkCreateFence failed, aborting.");
+            EXIT_FAILURE; 
+        }
+    }
+}
+
+// Each frame's compute command buffer is reset once its fence was waited for: the graphics
+// submission it signals waits for it, so it has finished too.
+void createComputeCommands() {
+    // Never together with occlusion culling: its late pass culls against the depth pyramid the
+    // same frame's early draws build on the graphics queue.
+    asyncCullingEnabled = asyncComputeEnabled && gpuCullingEnabled && !occlusionCullingEnabled;
+    if(!asyncComputeEnabled) {
+        return;
+    }
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = computeQueueFamily;
+    if(vkCreateCommandPool(device, &poolInfo, NULL, &computeCommandPool) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateCommandPool failed for the compute queue, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    if(vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers) != VK_SUCCESS) {
+        fprintf(stderr, "vkAllocateCommandBuffers failed for the compute queue, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if(vkCreateSemaphore(device, &semaphoreInfo, NULL, &computeFinishedSemaphores[i]) != VK_SUCCESS) {
+            fprintf(stderr, "vkCreateSemaphore failed for the compute queue, aborting.");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(asyncCullingEnabled) {
+        printf("Culling on the async compute queue.\n");
+    }
+}
+
+void cleanupComputeCommands() {
+    if(!asyncComputeEnabled) {
+        return;
+    }
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkDestroySemaphore(device, computeFinishedSemaphores[i], NULL);
+    }
+    vkDestroyCommandPool(device, computeCommandPool, NULL);
+}
+void setMeshInstances(const struct MeshInstance* instances, uint32_t count) {
+    if(count > meshInstanceCapacity) {
+        struct MeshInstance* grown = realloc(meshInstances, (size_t)count * sizeof(struct MeshInstance));
+        if(!grown) {
+            fprintf(stderr, "Failed to allocate %u mesh instances, aborting.", count);
+            exit(EXIT_FAILURE);
+        }
+        meshInstances = grown;
+        meshInstanceCapacity = count;
+    }
+    if(count > 0) {
+        memcpy(meshInstances, instances, (size_t)count * sizeof(struct MeshInstance));
+    }
+    meshInstanceCount = count;
+    meshInstanceVersion++;
+    if(cpuCullingEnabled) {
+        updateInstanceBounds();
+    }
+}
+
+// Draws of removed meshes and instances past meshInstanceCount are skipped when the frame's
+// commands are built.
+void setMeshDraws(const struct MeshDraw* draws, uint32_t count) {
+    if(count > meshDrawCapacity) {
+        struct MeshDraw* grown = realloc(meshDraws, (size_t)count * sizeof(struct MeshDraw));
+        uint32_t* grownOrder = realloc(drawOrder, (size_t)count * sizeof(uint32_t));
+        uint64_t* grownKeys = realloc(drawKeys, (size_t)count * sizeof(uint64_t));
+        if(grown) meshDraws = grown;
+        if(grownOrder) drawOrder = grownOrder;
+        if(grownKeys) drawKeys = grownKeys;
+        if(!grown || !grownOrder || !grownKeys) {
+            fprintf(stderr, "Failed to allocate %u mesh draws, aborting.", count);
+            exit(EXIT_FAILURE);
+        }
+        meshDrawCapacity = count;
+        reserveSortScratch(&sortScratch[0], count);
+    }
+    if(count > 0) {
+        memcpy(meshDraws, draws, (size_t)count * sizeof(struct MeshDraw));
+    }
+    meshDrawCount = count;
+    meshDrawVersion++;
+}
+
+// Only ever called for the frame whose fence was just waited on, so the old buffer can go
+// right away. Storage buffers get a new bindless handle.
+void mappedBufferReserve(struct MappedBuffer* mappedBuffer, VkDeviceSize size, 
+                         VkBufferUsageFlags usage) {
+    if(size <= mappedBuffer->capacity) {
+        return;
+    }
+    VkDeviceSize capacity = mappedBuffer->capacity ? mappedBuffer->capacity : 4096;
+    while(capacity < size) {
+        capacity *= 2;
+    }
+    mappedBufferDestroy(mappedBuffer);
+    createBuffer(capacity, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | 
+                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &mappedBuffer->buffer, &mappedBuffer->memory);
+    if(vkMapMemory(device, mappedBuffer->memory, 0, VK_WHOLE_SIZE, 0, &mappedBuffer->mapped) 
+       != VK_SUCCESS) {
+        fprintf(stderr, "vkMapMemory failed, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    mappedBuffer->capacity = capacity;
+    mappedBuffer->handle = BINDLESS_INVALID_HANDLE;
+    if(usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) {
+        mappedBuffer->handle = bindlessAddStorageBuffer(mappedBuffer->buffer, 0, VK_WHOLE_SIZE);
+    }
+}
+
+void mappedBufferDestroy(struct MappedBuffer* mappedBuffer) {
+    if(mappedBuffer->buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    if(mappedBuffer->handle != BINDLESS_INVALID_HANDLE) {
+        bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, mappedBuffer->handle);
+    }
+    vkDestroyBuffer(device, mappedBuffer->buffer, NULL);
+    vkFreeMemory(device, mappedBuffer->memory, NULL);
+    memset(mappedBuffer, 0, sizeof(*mappedBuffer));
+}
+
+// Called once the frame's fence has been waited on, so its buffers are no longer read.
+void uploadFrameDraws(uint32_t frame) {
+    struct FrameDraws* draws = &frameDraws[frame];
+    bool instancesChanged = draws->instanceVersion != meshInstanceVersion;
+    if(!instancesChanged && draws->drawVersion == meshDrawVersion) {
+        return;
+    }
+    if(meshDrawCount > draws->groupCapacity) {
+        struct DrawGroup* grown = realloc(draws->groups, (size_t)meshDrawCount * sizeof(struct DrawGroup));
+        if(!grown) {
+            fprintf(stderr, "Failed to allocate %u draw groups, aborting.", meshDrawCount);
+            exit(EXIT_FAILURE);
+        }
+        draws->groups = grown;
+        draws->groupCapacity = meshDrawCount;
+    }
+    uint32_t sortedCount = sortMeshDraws();
+    // Occlusion culling keeps the visibility of each instance of the frame, so no two draws
+    // may share one.
+    if(cpuCullingEnabled || occlusionCullingEnabled || (depthEnabled && depthSortOrder != DEPTH_SORT_NONE)) {
+        packFrameDraws(draws, sortedCount);
+        if(gpuCullingEnabled) {
+            reserveCulledDraws(draws, draws->totalDrawInstances, draws->drawCount);
+        }
+        return;
+    }
+    VkBufferUsageFlags storageUsage = gpuCullingEnabled ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0;
+    if(instancesChanged && meshInstanceCount > 0) {
+        mappedBufferReserve(&draws->instances, (VkDeviceSize)meshInstanceCount * sizeof(struct MeshInstance),
+                            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | storageUsage);
+        memcpy(draws->instances.mapped, meshInstances, 
+               (size_t)meshInstanceCount * sizeof(struct MeshInstance));
+    }
+    draws->instanceCount = meshInstanceCount;
+    draws->instanceVersion = meshInstanceVersion;
+
+    // The commands depend on the instance count too, so they are rebuilt either way.
+    draws->drawCount = 0;
+    draws->totalDrawInstances = 0;
+    draws->groupCount = 0;
+    draws->drawVersion = meshDrawVersion;
+    if(sortedCount == 0) {
+        return;
+    }
+    mappedBufferReserve(&draws->draws, (VkDeviceSize)sortedCount * sizeof(VkDrawIndexedIndirectCommand),
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | storageUsage);
+    if(gpuCullingEnabled) {
+        mappedBufferReserve(&draws->drawStarts, (VkDeviceSize)sortedCount * sizeof(uint32_t),
+                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+    VkDrawIndexedIndirectCommand* commands = draws->draws.mapped;
+    for(uint32_t i = 0; i < sortedCount; i++) {
+        const struct MeshDraw* meshDraw = &meshDraws[drawOrder[i]];
+        appendFrameDraw(draws, commands, drawKeys[i], meshDraw->mesh, meshDrawInstanceCount(meshDraw),
+                        meshDraw->firstInstance);
+    }
+    if(gpuCullingEnabled) {
+        reserveCulledDraws(draws, draws->totalDrawInstances, draws->drawCount);
+    }
+}
+
+// Instances of the draw that exist, none when its mesh was removed.
+uint32_t meshDrawInstanceCount(const struct MeshDraw* meshDraw) {
+    if(meshDraw->mesh >= GEOMETRY_POOL_MAX_MESHES || 
+       geometryPool.meshes[meshDraw->mesh].state != POOL_MESH_LIVE ||
+       meshDraw->firstInstance >= meshInstanceCount) {
+        return 0;
+    }
+    uint32_t instanceCount = meshInstanceCount - meshDraw->firstInstance;
+    return meshDraw->instanceCount < instanceCount ? meshDraw->instanceCount : instanceCount;
+}
+
+// Meshes are normalized into [-0.5, 0.5], so an instance covers offset +- scale / 2.
+void updateInstanceBounds() {
+    if(!cullBoundsReserve(&instanceBounds, meshInstanceCount)) {
+        fprintf(stderr, "Failed to allocate bounds of %u instances, aborting.", meshInstanceCount);
+        exit(EXIT_FAILURE);
+    }
+    jobRunAndWait(&jobSystem, instanceBoundsTask, NULL, 
+                  (meshInstanceCount + INSTANCE_BOUNDS_JOB_SIZE - 1) / INSTANCE_BOUNDS_JOB_SIZE);
+    instanceBounds.count = meshInstanceCount;
+}
+
+void instanceBoundsTask(void* context, uint32_t index) {
+    uint32_t first = index * INSTANCE_BOUNDS_JOB_SIZE;
+    uint32_t end = first + INSTANCE_BOUNDS_JOB_SIZE < meshInstanceCount ? 
+                   first + INSTANCE_BOUNDS_JOB_SIZE : meshInstanceCount;
+    for(uint32_t i = first; i < end; i++) {
+        const struct MeshInstance* instance = &meshInstances[i];
+        instanceBounds.centerX[i] = instance->offset[0];
+        instanceBounds.centerY[i] = instance->offset[1];
+        instanceBounds.extentX[i] = 0.5f * fabsf(instance->scale[0]);
+        instanceBounds.extentY[i] = 0.5f * fabsf(instance->scale[1]);
+    }
+}
+
+// uploadFrameDraws() for CPU culling and depth sorting: the instances of each draw follow those
+// of the previous draws in the frame's instance buffer, without the culled ones and in
+// depthSortOrder. Draws left without instances are dropped. GPU culling appends the draws of
+// each group in whatever order the invocations finish, which still roughly follows the sorted one.
+// The draws are cut into pieces for the pack jobs, the instances are copied to the frame once
+// this returns, see packCopies.
+void packFrameDraws(struct FrameDraws* draws, uint32_t sortedCount) {
+    draws->instanceCount = 0;
+    draws->instanceVersion = meshInstanceVersion;
+    draws->drawCount = 0;
+    draws->totalDrawInstances = 0;
+    draws->groupCount = 0;
+    draws->drawVersion = meshDrawVersion;
+    // Draws may share instances, so the worst case is the sum over the draws.
+    uint64_t maxVisible = 0;
+    for(uint32_t i = 0; i < sortedCount; i++) {
+        maxVisible += meshDrawInstanceCount(&meshDraws[drawOrder[i]]);
+    }
+    if(maxVisible == 0) {
+        return;
+    }
+    if(maxVisible > UINT32_MAX) {
+        fprintf(stderr, "Draws reference more than %u instances, aborting.", UINT32_MAX);
+        exit(EXIT_FAILURE);
+    }
+    struct PackContext* pack = &packContext;
+    pack->draws = draws;
+    pack->sortedCount = sortedCount;
+    pack->depthSorted = depthEnabled && depthSortOrder != DEPTH_SORT_NONE;
+    reservePackPieces(sortedCount + (uint32_t)(maxVisible / PACK_JOB_INSTANCES) + 1);
+    pack->pieceCount = 0;
+    pack->jobCount = 0;
+    uint64_t visibleSize = 0;
+    uint32_t jobInstances = 0;
+    for(uint32_t i = 0; i < sortedCount; i++) {
+        uint32_t instanceCount = meshDrawInstanceCount(&meshDraws[drawOrder[i]]);
+        for(uint32_t first = 0; first < instanceCount; ) {
+            uint32_t count = instanceCount - first;
+            if(count > PACK_JOB_INSTANCES) {
+                count = PACK_JOB_INSTANCES;
+            }
+            struct PackPiece* piece = &pack->pieces[pack->pieceCount++];
+            piece->sortedDraw = i;
+            piece->firstInstance = first;
+            piece->instanceCount = count;
+            piece->firstVisible = (uint32_t)visibleSize;
+            visibleSize += count + CULL_BATCH;
+            first += count;
+            jobInstances += count;
+            if(jobInstances >= PACK_JOB_INSTANCES) {
+                pack->jobEnds[pack->jobCount++] = pack->pieceCount;
+                jobInstances = 0;
+            }
+        }
+    }
+    if(jobInstances > 0) {
+        pack->jobEnds[pack->jobCount++] = pack->pieceCount;
+    }
+    if(visibleSize > UINT32_MAX) {
+        fprintf(stderr, "Draws reference more than %u instances, aborting.", UINT32_MAX);
+        exit(EXIT_FAILURE);
+    }
+    if(visibleSize > visibleInstanceCapacity) {
+        uint32_t* grown = realloc(visibleInstances, (size_t)visibleSize * sizeof(uint32_t));
+        if(!grown) {
+            fprintf(stderr, "Failed to allocate %llu visible instances, aborting.", 
+                    (unsigned long long)visibleSize);
+            exit(EXIT_FAILURE);
+        }
+        visibleInstances = grown;
+        visibleInstanceCapacity = (uint32_t)visibleSize;
+    }
+    VkBufferUsageFlags storageUsage = gpuCullingEnabled ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0;
+    mappedBufferReserve(&draws->instances, maxVisible * sizeof(struct MeshInstance),
+                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | storageUsage);
+    mappedBufferReserve(&draws->draws, (VkDeviceSize)sortedCount * sizeof(VkDrawIndexedIndirectCommand),
+                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | storageUsage);
+    if(gpuCullingEnabled) {
+        mappedBufferReserve(&draws->drawStarts, (VkDeviceSize)sortedCount * sizeof(uint32_t),
+                            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+    struct JobCounter culled = {};
+    struct JobCounter appended = {};
+    jobRun(&jobSystem, packCullTask, pack, pack->jobCount, &culled);
+    jobRunAfter(&jobSystem, &culled, packAppendTask, pack, 1, &appended);
+    jobWait(&jobSystem, &appended);
+    jobRun(&jobSystem, packCopyTask, pack, pack->jobCount, &packCopies);
+}
+
+// Room for count pieces and as many jobs.
+void reservePackPieces(uint32_t count) {
+    if(count <= packContext.pieceCapacity) {
+        return;
+    }
+    struct PackPiece* grownPieces = realloc(packContext.pieces, (size_t)count * sizeof(struct PackPiece));
+    uint32_t* grownEnds = realloc(packContext.jobEnds, (size_t)count * sizeof(uint32_t));
+    if(grownPieces) packContext.pieces = grownPieces;
+    if(grownEnds) packContext.jobEnds = grownEnds;
+    if(!grownPieces || !grownEnds) {
+        fprintf(stderr, "Failed to allocate %u pack pieces, aborting.", count);
+        exit(EXIT_FAILURE);
+    }
+    packContext.pieceCapacity = count;
+}
+
+// Culls the pieces of a job into their parts of visibleInstances, sorting those of depth
+// sorted draws with the worker's scratch.
+void packCullTask(void* context, uint32_t index) {
+    struct PackContext* pack = context;
+    uint32_t firstPiece = index == 0 ? 0 : pack->jobEnds[index - 1];
+    struct SortScratch* scratch = &sortScratch[jobWorker()];
+    for(uint32_t i = firstPiece; i < pack->jobEnds[index]; i++) {
+        struct PackPiece* piece = &pack->pieces[i];
+        const struct MeshDraw* meshDraw = &meshDraws[drawOrder[piece->sortedDraw]];
+        uint32_t firstInstance = meshDraw->firstInstance + piece->firstInstance;
+        uint32_t* visible = visibleInstances + piece->firstVisible;
+        uint32_t visibleCount = piece->instanceCount;
+        if(cpuCullingEnabled) {
+            visibleCount = cullBoxes(cpuCullKernel, &instanceBounds, firstInstance, piece->instanceCount,
+                                     viewPlanes, viewPlaneCount, visible);
+        } else {
+            for(uint32_t j = 0; j < piece->instanceCount; j++) {
+                visible[j] = firstInstance + j;
+            }
+        }
+        // The visible instances are in index order, which the stable sort keeps for equal depths.
+        if(pack->depthSorted && visibleCount > 0) {
+            reserveSortScratch(scratch, visibleCount);
+            for(uint32_t j = 0; j < visibleCount; j++) {
+                uint32_t depth = drawKeyDepth(meshInstances[visible[j]].depth);
+                scratch->keys[j] = depthSortOrder == DEPTH_SORT_BACK_TO_FRONT ? ~depth : depth;
+            }
+            radixSortKeys(scratch->keys, visible, visibleCount, scratch->scratchKeys, scratch->scratchValues);
+        }
+        piece->visibleCount = visibleCount;
+    }
+}
+
+// Appends the draws in sorted order, once all pieces are culled.
+void packAppendTask(void* context, uint32_t index) {
+    struct PackContext* pack = context;
+    struct FrameDraws* draws = pack->draws;
+    VkDrawIndexedIndirectCommand* commands = draws->draws.mapped;
+    uint32_t piece = 0;
+    while(piece < pack->pieceCount) {
+        uint32_t sortedDraw = pack->pieces[piece].sortedDraw;
+        uint32_t firstInstance = draws->instanceCount;
+        uint32_t firstDrawPiece = piece;
+        for(; piece < pack->pieceCount && pack->pieces[piece].sortedDraw == sortedDraw; piece++) {
+            pack->pieces[piece].firstPacked = draws->instanceCount;
+            draws->instanceCount += pack->pieces[piece].visibleCount;
+        }
+        for(uint32_t i = firstDrawPiece; i < piece; i++) {
+            pack->pieces[i].firstDrawPiece = firstDrawPiece;
+            pack->pieces[i].endDrawPiece = piece;
+        }
+        uint32_t visibleCount = draws->instanceCount - firstInstance;
+        if(visibleCount > 0) {
+            appendFrameDraw(draws, commands, drawKeys[sortedDraw], meshDraws[drawOrder[sortedDraw]].mesh,
+                            visibleCount, firstInstance);
+        }
+    }
+}
+
+void packCopyTask(void* context, uint32_t index) {
+    const struct PackContext* pack = context;
+    struct MeshInstance* instances = pack->draws->instances.mapped;
+    uint32_t firstPiece = index == 0 ? 0 : pack->jobEnds[index - 1];
+    for(uint32_t i = firstPiece; i < pack->jobEnds[index]; i++) {
+        const struct PackPiece* piece = &pack->pieces[i];
+        if(piece->visibleCount == 0) {
+            continue;
+        }
+        if(pack->depthSorted && piece->endDrawPiece - piece->firstDrawPiece > 1) {
+            packMergeCopy(pack, piece, instances, &sortScratch[jobWorker()]);
+            continue;
+        }
+        const uint32_t* visible = visibleInstances + piece->firstVisible;
+        for(uint32_t j = 0; j < piece->visibleCount; j++) {
+            instances[piece->firstPacked + j] = meshInstances[visible[j]];
+        }
+    }
+}
+
+// Orders the instances of a depth sorted draw by depth, then by index, which is the order the
+// stable sort leaves each piece in. No two instances of a draw have the same key.
+uint64_t packMergeKey(uint32_t instance) {
+    uint32_t depth = drawKeyDepth(meshInstances[instance].depth);
+    if(depthSortOrder == DEPTH_SORT_BACK_TO_FRONT) {
+        depth = ~depth;
+    }
+    return (uint64_t)depth << 32 | instance;
+}
+
+// The piece's visible instances whose keys are below key.
+uint32_t packPieceCountBelow(const struct PackPiece* piece, uint64_t key) {
+    const uint32_t* visible = visibleInstances + piece->firstVisible;
+    uint32_t low = 0;
+    uint32_t high = piece->visibleCount;
+    while(low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if(packMergeKey(visible[middle]) < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Moves the entry at index down the min-heap of the pieces' next keys.
+void packMergeHeapDown(uint64_t* keys, uint32_t* pieces, uint32_t count, uint32_t index) {
+    for(;;) {
+        uint32_t smallest = index;
+        uint32_t left = index * 2 + 1;
+        if(left < count && keys[left] < keys[smallest]) {
+            smallest = left;
+        }
+        if(left + 1 < count && keys[left + 1] < keys[smallest]) {
+            smallest = left + 1;
+        }
+        if(smallest == index) {
+            return;
+        }
+        uint64_t key = keys[index];
+        keys[index] = keys[smallest];
+        keys[smallest] = key;
+        uint32_t swapPiece = pieces[index];
+        pieces[index] = pieces[smallest];
+        pieces[smallest] = swapPiece;
+        index = smallest;
+    }
+}
+
+// Copies the piece's share of the merge of its draw's pieces, the instances from its place in
+// the draw on. Where the share starts in each piece comes from a binary search for the key at
+// that place, then the pieces are merged through a heap in the worker's sort scratch: the
+// keys in keys, the pieces in scratchValues and the position in each piece in scratchKeys.
+void packMergeCopy(const struct PackContext* pack, const struct PackPiece* piece, 
+                   struct MeshInstance* instances, struct SortScratch* scratch) {
+    const struct PackPiece* drawPieces = &pack->pieces[piece->firstDrawPiece];
+    uint32_t pieceCount = piece->endDrawPiece - piece->firstDrawPiece;
+    uint32_t rank = piece->firstPacked - drawPieces[0].firstPacked;
+    // The smallest key with more than rank keys at or below it, keys never reach UINT64_MAX.
+    uint64_t low = 0;
+    uint64_t high = UINT64_MAX - 1;
+    while(low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        uint64_t atOrBelow = 0;
+        for(uint32_t i = 0; i < pieceCount; i++) {
+            atOrBelow += packPieceCountBelow(&drawPieces[i], middle + 1);
+        }
+        if(atOrBelow > rank) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    reserveSortScratch(scratch, pieceCount);
+    uint64_t* heapKeys = scratch->keys;
+    uint32_t* heapPieces = scratch->scratchValues;
+    uint64_t* positions = scratch->scratchKeys;
+    uint32_t heapCount = 0;
+    for(uint32_t i = 0; i < pieceCount; i++) {
+        positions[i] = packPieceCountBelow(&drawPieces[i], low);
+        if(positions[i] < drawPieces[i].visibleCount) {
+            heapKeys[heapCount] = packMergeKey(visibleInstances[drawPieces[i].firstVisible + positions[i]]);
+            heapPieces[heapCount] = i;
+            heapCount++;
+        }
+    }
+    for(uint32_t i = heapCount / 2; i-- > 0; ) {
+        packMergeHeapDown(heapKeys, heapPieces, heapCount, i);
+    }
+    for(uint32_t j = 0; j < piece->visibleCount; j++) {
+        uint32_t next = heapPieces[0];
+        const uint32_t* visible = visibleInstances + drawPieces[next].firstVisible;
+        instances[piece->firstPacked + j] = meshInstances[visible[positions[next]]];
+        positions[next]++;
+        if(positions[next] < drawPieces[next].visibleCount) {
+            heapKeys[0] = packMergeKey(visible[positions[next]]);
+        } else {
+            heapCount--;
+            heapKeys[0] = heapKeys[heapCount];
+            heapPieces[0] = heapPieces[heapCount];
+        }
+        packMergeHeapDown(heapKeys, heapPieces, heapCount, 0);
+    }
+}
+
+// The scratch only grows, sorts of up to count keys need no allocation.
+void reserveSortScratch(struct SortScratch* scratch, uint32_t count) {
+    if(count <= scratch->capacity) {
+        return;
+    }
+    uint64_t* grownKeys = realloc(scratch->keys, (size_t)count * sizeof(uint64_t));
+    uint64_t* grownScratchKeys = realloc(scratch->scratchKeys, (size_t)count * sizeof(uint64_t));
+    uint32_t* grownScratchValues = realloc(scratch->scratchValues, (size_t)count * sizeof(uint32_t));
+    if(grownKeys) scratch->keys = grownKeys;
+    if(grownScratchKeys) scratch->scratchKeys = grownScratchKeys;
+    if(grownScratchValues) scratch->scratchValues = grownScratchValues;
+    if(!grownKeys || !grownScratchKeys || !grownScratchValues) {
+        fprintf(stderr, "Failed to allocate sort scratch for %u keys, aborting.", count);
+        exit(EXIT_FAILURE);
+    }
+    scratch->capacity = count;
+}
+
+// Fills drawOrder with the draws that have instances, sorted by key, and drawKeys with their
+// keys, and returns how many there are. With depth sorting the nearest instance of a draw
+// decides its depth front to back, the farthest back to front, otherwise the draws of a group
+// keep the order they were set in.
+uint32_t sortMeshDraws() {
+    bool depthSorted = depthEnabled && depthSortOrder != DEPTH_SORT_NONE;
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < meshDrawCount; i++) {
+        const struct MeshDraw* meshDraw = &meshDraws[i];
+        uint32_t instanceCount = meshDrawInstanceCount(meshDraw);
+        if(instanceCount == 0) {
+            continue;
+        }
+        uint32_t material = meshDraw->material < materialCount ? meshDraw->material : MATERIAL_DEFAULT;
+        uint32_t depth = 0;
+        if(depthSorted) {
+            const struct MeshInstance* instances = &meshInstances[meshDraw->firstInstance];
+            float nearest = instances[0].depth;
+            for(uint32_t j = 1; j < instanceCount; j++) {
+                bool before = depthSortOrder == DEPTH_SORT_BACK_TO_FRONT ? 
+                              instances[j].depth > nearest : instances[j].depth < nearest;
+                if(before) {
+                    nearest = instances[j].depth;
+                }
+            }
+            depth = drawKeyDepth(nearest);
+            if(depthSortOrder == DEPTH_SORT_BACK_TO_FRONT) {
+                depth = ~depth;
+            }
+        }
+        drawKeys[count] = drawKeyMake(DRAW_PASS_OPAQUE, materials[material].pipeline, material, depth);
+        drawOrder[count] = i;
+        count++;
+    }
+    radixSortKeys(drawKeys, drawOrder, count, sortScratch[0].scratchKeys, sortScratch[0].scratchValues);
+    return count;
+}
+
+// Appends the command to the last group when its key has the same state, to a new one
+// otherwise.
+void appendFrameDraw(struct FrameDraws* draws, VkDrawIndexedIndirectCommand* commands, uint64_t key,
+                     uint32_t mesh, uint32_t instanceCount, uint32_t firstInstance) {
+    uint64_t stateKey = key & DRAW_KEY_STATE_MASK;
+    struct DrawGroup* group = draws->groupCount > 0 ? &draws->groups[draws->groupCount - 1] : NULL;
+    if(!group || group->stateKey != stateKey) {
+        group = &draws->groups[draws->groupCount++];
+        group->stateKey = stateKey;
+        group->material = drawKeyMaterial(key);
+        group->firstDraw = draws->drawCount;
+        group->drawCount = 0;
+        group->firstCulled = draws->totalDrawInstances;
+        group->culledCount = 0;
+    }
+    const struct PoolMesh* poolMesh = &geometryPool.meshes[mesh];
+    if(gpuCullingEnabled) {
+        ((uint32_t*)draws->drawStarts.mapped)[draws->drawCount] = draws->totalDrawInstances;
+    }
+    VkDrawIndexedIndirectCommand* command = &commands[draws->drawCount++];
+    command->indexCount = poolMesh->indexCount;
+    command->instanceCount = instanceCount;
+    command->firstIndex = poolMesh->firstIndex;
+    command->vertexOffset = (int32_t)poolMesh->vertexOffset;
+    command->firstInstance = firstInstance;
+    group->drawCount++;
+    group->culledCount += instanceCount;
+    draws->totalDrawInstances += instanceCount;
+}
+
+// Every frame repacks its instances in the new order.
+void setDepthSortOrder(enum DepthSortOrder order) {
+    depthSortOrder = order;
+    meshDrawVersion++;
+}
+
+// The first depth-only format the device can render to, D32 is always the most precise.
+void chooseDepthFormat() {
+    if(!depthRequested) {
+        return;
+    }
+    const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D16_UNORM,
+        VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT
+    };
+    for(uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidates[i], &properties);
+        if(properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            depthFormat = candidates[i];
+            depthEnabled = true;
+            // hiz.comp samples a view of the depth aspect, which the framebuffer can only
+            // share without a stencil aspect.
+            occlusionCullingEnabled = occlusionCullingRequested && gpuCullingEnabled &&
+                (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+                depthFormat != VK_FORMAT_D32_SFLOAT_S8_UINT && depthFormat != VK_FORMAT_D24_UNORM_S8_UINT;
+            if(occlusionCullingEnabled) {
+                printf("Occlusion culling enabled.\n");
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "No depth format is supported, drawing without a depth buffer.\n");
+}
+
+// Declares the frame and compiles it, creating the depth buffer and the depth pyramid. Sized
+// to the swapchain, recreated along with it.
+void createRenderGraph() {
+    struct RenderGraph* graph = &renderGraph;
+    // The acquire semaphore is waited on at the color attachment output stage.
+    graphSwapchainImage = renderGraphImportImage(graph, "swapchain image", VK_IMAGE_ASPECT_COLOR_BIT,
+                                                 VK_IMAGE_LAYOUT_UNDEFINED, 
+                                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                                                 VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    uint32_t depth = GRAPH_RESOURCE_NONE;
+    if(depthEnabled) {
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        if(occlusionCullingEnabled) {
+            usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        }
+        depth = renderGraphCreateImage(graph, "depth buffer", depthFormat, swapchainExtent, usage,
+                                       VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+    uint32_t drawCounts = GRAPH_RESOURCE_NONE;
+    uint32_t culledDraws = GRAPH_RESOURCE_NONE;
+    uint32_t visibility = GRAPH_RESOURCE_NONE;
+    if(gpuCullingEnabled) {
+        // Each frame's own, drawFrame() waited for the submission that used them last. The
+        // visibility the late phase wrote back then is read, so it waits for that write.
+        drawCounts = renderGraphImportBuffer(graph, "draw counts", 0, 0);
+        culledDraws = renderGraphImportBuffer(graph, "culled draws", 0, 0);
+    }
+    // On the compute queue, the submission waits for what it wrote.
+    if(gpuCullingEnabled && !asyncCullingEnabled) {
+        uint32_t clear = renderGraphAddPass(graph, "clear draw counts", recordDrawCountClear, 0);
+        renderGraphUse(graph, clear, drawCounts, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, 
+                       VK_IMAGE_LAYOUT_UNDEFINED);
+        if(occlusionCullingEnabled) {
+            visibility = renderGraphImportBuffer(graph, "visibility", VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                                 VK_ACCESS_SHADER_WRITE_BIT);
+            uint32_t clearVisibility = renderGraphAddPass(graph, "clear visibility", recordVisibilityClear, 0);
+            renderGraphUse(graph, clearVisibility, visibility, VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                           VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        }
+        uint32_t cull = renderGraphAddPass(graph, occlusionCullingEnabled ? "early cull" : "cull", 
+                                           recordEarlyCull, 0);
+        renderGraphUse(graph, cull, drawCounts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        renderGraphUse(graph, cull, culledDraws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        if(occlusionCullingEnabled) {
+            renderGraphUse(graph, cull, visibility, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                           VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        }
+    }
+    uint32_t draw = renderGraphAddPass(graph, occlusionCullingEnabled ? "early draws" : "draws", 
+                                       recordEarlyDraws, 0);
+    useSceneAttachments(draw, graphSwapchainImage, depth, drawCounts, culledDraws, false);
+
+    uint32_t pyramid = GRAPH_RESOURCE_NONE;
+    if(occlusionCullingEnabled) {
+        // Level 0 halves the depth buffer, rounding up, and every level halves the one below
+        // down to a single texel.
+        uint32_t width = (swapchainExtent.width + 1) / 2;
+        uint32_t height = (swapchainExtent.height + 1) / 2;
+        uint32_t texelCount = 0;
+        pyramidLevelCount = 0;
+        while(pyramidLevelCount < HIZ_MAX_LEVELS) {
+            pyramidWidths[pyramidLevelCount] = width;
+            pyramidHeights[pyramidLevelCount] = height;
+            pyramidOffsets[pyramidLevelCount] = texelCount;
+            texelCount += width * height;
+            pyramidLevelCount++;
+            if(width == 1 && height == 1) {
+                break;
+            }
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+        pyramid = renderGraphCreateBuffer(graph, "depth pyramid", (VkDeviceSize)texelCount * sizeof(float),
+                                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        uint32_t hiz = renderGraphAddPass(graph, "depth pyramid", recordDepthPyramid, 0);
+        renderGraphUse(graph, hiz, depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                       VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        renderGraphUse(graph, hiz, pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        uint32_t lateCull = renderGraphAddPass(graph, "late cull", recordLateCull, 0);
+        renderGraphUse(graph, lateCull, drawCounts, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        renderGraphUse(graph, lateCull, culledDraws, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        renderGraphUse(graph, lateCull, visibility, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        renderGraphUse(graph, lateCull, pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                       VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        uint32_t lateDraw = renderGraphAddPass(graph, "late draws", recordLateDraws, 0);
+        useSceneAttachments(lateDraw, graphSwapchainImage, depth, drawCounts, culledDraws, true);
+    }
+
+    renderGraphCompile(graph, device, physicalDevice);
+    printf("Render graph: %u passes, %u culled, %u barriers, %.2f MiB transient memory, %.2f MiB "
+           "without aliasing.\n", graph->passCount, graph->culledPassCount, graph->barrierCount,
+           graph->transientMemory / (1024.0 * 1024.0), graph->unaliasedTransientMemory / (1024.0 * 1024.0));
+    if(depthEnabled) {
+        depthImage = graph->resources[depth].image;
+        depthImageView = graph->resources[depth].view;
+    }
+    if(occlusionCullingEnabled) {
+        depthHandle = bindlessAddSampledImage(depthImageView, depthSampler, 
+                                              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        pyramidBuffer = graph->resources[pyramid].buffer;
+        pyramidHandle = bindlessAddStorageBuffer(pyramidBuffer, 0, VK_WHOLE_SIZE);
+    }
+}
+
+// The color attachment and the depth test of a scene pass, and with GPU culling the indirect
+// reads of its culled draws. Loading keeps what an earlier pass drew.
+void useSceneAttachments(uint32_t pass, uint32_t color, uint32_t depth, uint32_t drawCounts,
+                         uint32_t culledDraws, bool load) {
+    VkAccessFlags colorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    if(load) {
+        colorAccess |= VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+    }
+    renderGraphUse(&renderGraph, pass, color, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, colorAccess,
+                   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    if(depth != GRAPH_RESOURCE_NONE) {
+        renderGraphUse(&renderGraph, pass, depth, 
+                       VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                       VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                       VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    }
+    if(drawCounts != GRAPH_RESOURCE_NONE) {
+        renderGraphUse(&renderGraph, pass, drawCounts, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 
+                       VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+        renderGraphUse(&renderGraph, pass, culledDraws, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 
+                       VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    }
+}
+
+void cleanupRenderGraph() {
+    if(occlusionCullingEnabled && pyramidBuffer != VK_NULL_HANDLE) {
+        bindlessReleaseHandle(BINDLESS_SAMPLED_IMAGE_BINDING, depthHandle);
+        bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, pyramidHandle);
+    }
+    renderGraphDestroy(&renderGraph, device);
+    pyramidBuffer = VK_NULL_HANDLE;
+    depthImageView = VK_NULL_HANDLE;
+    depthImage = VK_NULL_HANDLE;
+}
+
+// The culled draws stay on the GPU. The count buffer holds a count per draw, though only
+// those at the first draw of a group are used. Occlusion culling needs both for each phase,
+// and the visibility of the frame's instances.
+void reserveCulledDraws(struct FrameDraws* draws, uint32_t capacity, uint32_t drawCount) {
+    if(occlusionCullingEnabled) {
+        capacity *= 2;
+        drawCount *= 2;
+        if(draws->instanceCount > draws->visibilityCapacity) {
+            if(draws->visibilityBuffer != VK_NULL_HANDLE) {
+                bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, draws->visibilityHandle);
+                vkDestroyBuffer(device, draws->visibilityBuffer, NULL);
+                vkFreeMemory(device, draws->visibilityMemory, NULL);
+            }
+            uint32_t visibilityCapacity = draws->visibilityCapacity ? draws->visibilityCapacity : 64;
+            while(visibilityCapacity < draws->instanceCount) {
+                visibilityCapacity *= 2;
+            }
+            createBuffer((VkDeviceSize)visibilityCapacity * sizeof(uint32_t), 
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &draws->visibilityBuffer, 
+                         &draws->visibilityMemory);
+            draws->visibilityHandle = bindlessAddStorageBuffer(draws->visibilityBuffer, 0, VK_WHOLE_SIZE);
+            draws->visibilityCapacity = visibilityCapacity;
+            draws->visibilityCleared = false;
+        }
+    }
+    if(drawCount > draws->countCapacity) {
+        if(draws->countBuffer != VK_NULL_HANDLE) {
+            bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, draws->countHandle);
+            vkDestroyBuffer(device, draws->countBuffer, NULL);
+            vkFreeMemory(device, draws->countMemory, NULL);
+        }
+        uint32_t countCapacity = draws->countCapacity ? draws->countCapacity : 64;
+        while(countCapacity < drawCount) {
+            countCapacity *= 2;
+        }
+        createBuffer((VkDeviceSize)countCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | 
+                     VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &draws->countBuffer, &draws->countMemory);
+        draws->countHandle = bindlessAddStorageBuffer(draws->countBuffer, 0, VK_WHOLE_SIZE);
+        draws->countCapacity = countCapacity;
+    }
+    if(capacity <= draws->culledCapacity) {
+        return;
+    }
+    if(draws->culledBuffer != VK_NULL_HANDLE) {
+        bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, draws->culledHandle);
+        vkDestroyBuffer(device, draws->culledBuffer, NULL);
+        vkFreeMemory(device, draws->culledMemory, NULL);
+    }
+    uint32_t culledCapacity = draws->culledCapacity ? draws->culledCapacity : 64;
+    while(culledCapacity < capacity) {
+        culledCapacity *= 2;
+    }
+    createBuffer((VkDeviceSize)culledCapacity * sizeof(VkDrawIndexedIndirectCommand),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &draws->culledBuffer, &draws->culledMemory);
+    draws->culledHandle = bindlessAddStorageBuffer(draws->culledBuffer, 0, VK_WHOLE_SIZE);
+    draws->culledCapacity = culledCapacity;
+}
+
+void cleanupFrameDraws() {
+    for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        struct FrameDraws* draws = &frameDraws[i];
+        mappedBufferDestroy(&draws->instances);
+        mappedBufferDestroy(&draws->draws);
+        mappedBufferDestroy(&draws->drawStarts);
+        if(draws->culledBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, draws->culledBuffer, NULL);
+            vkFreeMemory(device, draws->culledMemory, NULL);
+        }
+        if(draws->countBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, draws->countBuffer, NULL);
+            vkFreeMemory(device, draws->countMemory, NULL);
+        }
+        if(draws->visibilityBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(device, draws->visibilityBuffer, NULL);
+            vkFreeMemory(device, draws->visibilityMemory, NULL);
+        }
+        free(draws->groups);
+    }
+    memset(frameDraws, 0, sizeof(frameDraws));
+    free(meshInstances);
+    meshInstances = NULL;
+    meshInstanceCount = 0;
+    meshInstanceCapacity = 0;
+    free(meshDraws);
+    meshDraws = NULL;
+    meshDrawCount = 0;
+    meshDrawCapacity = 0;
+    free(drawOrder);
+    drawOrder = NULL;
+    free(drawKeys);
+    drawKeys = NULL;
+    for(uint32_t i = 0; i < JOB_MAX_WORKERS; i++) {
+        free(sortScratch[i].keys);
+        free(sortScratch[i].scratchKeys);
+        free(sortScratch[i].scratchValues);
+    }
+    memset(sortScratch, 0, sizeof(sortScratch));
+    cullBoundsFree(&instanceBounds);
+    free(visibleInstances);
+    visibleInstances = NULL;
+    visibleInstanceCapacity = 0;
+    free(packContext.pieces);
+    free(packContext.jobEnds);
+    memset(&packContext, 0, sizeof(packContext));
+}
+
+void createMaterials() {
+    const float white[3] = {1.0f, 1.0f, 1.0f};
+    materialCount = 0;
+    createMaterial(DRAW_PIPELINE_OPAQUE, white, TEXTURE_INVALID);
+}
+
+uint32_t createMaterial(uint32_t pipeline, const float tint[3], uint32_t texture) {
+    if(materialCount == MAX_MATERIALS || pipeline >= DRAW_PIPELINE_COUNT) {
+        fprintf(stderr, "Failed to create material %u, aborting.", materialCount);
+        exit(EXIT_FAILURE);
+    }
+    struct Material* material = &materials[materialCount];
+    memset(material, 0, sizeof(*material));
+    material->pipeline = pipeline;
+    memcpy(&material->constants.parameters[MATERIAL_PARAMETER_TINT], tint, 3 * sizeof(float));
+    materialCount++;
+    setMaterialTexture(materialCount - 1, texture);
+    return materialCount - 1;
+}
+
+// The texture is sampled from the first frame recorded after its upload.
+void setMaterialTexture(uint32_t material, uint32_t texture) {
+    if(material >= materialCount) {
+        return;
+    }
+    materials[material].texture = texture;
+    bool live = texture < MAX_TEXTURES && textures[texture].state == TEXTURE_LIVE;
+    materials[material].constants.resourceHandles[MATERIAL_HANDLE_TEXTURE] = 
+        live ? textures[texture].handle : BINDLESS_INVALID_HANDLE;
+}
+
+// After textures were uploaded or removed. Only called between frames, as the recording threads
+// read the materials.
+void updateMaterialTextures() {
+    for(uint32_t material = 0; material < materialCount; material++) {
+        if(materials[material].texture != TEXTURE_INVALID) {
+            setMaterialTexture(material, materials[material].texture);
+        }
+    }
+}
+
+// Binds what the drawCount draws of material need that is not bound yet.
+void bindDrawState(VkCommandBuffer commandBuffer, struct DrawState* state, uint32_t material,
+                   uint32_t drawCount) {
+    uint32_t pipeline = materials[material].pipeline;
+    if(state->pipeline != pipeline) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *drawPipelines[pipeline]);
+        state->pipeline = pipeline;
+        state->pipelineBinds++;
+        state->pipelineBindsAvoided += drawCount - 1;
+    } else {
+        state->pipelineBindsAvoided += drawCount;
+    }
+    if(state->material != material) {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, 
+                           sizeof(struct PushConstants), &materials[material].constants);
+        state->material = material;
+        state->materialBinds++;
+        state->materialBindsAvoided += drawCount - 1;
+    } else {
+        state->materialBindsAvoided += drawCount;
+    }
+}
+
+void addBindCounts(struct DrawState* state) {
+    pipelineBinds += state->pipelineBinds;
+    pipelineBindsAvoided += state->pipelineBindsAvoided;
+    materialBinds += state->materialBinds;
+    materialBindsAvoided += state->materialBindsAvoided;
+    state->pipelineBinds = 0;
+    state->pipelineBindsAvoided = 0;
+    state->materialBinds = 0;
+    state->materialBindsAvoided = 0;
+}
+
+// Compute pipelines share the bindless pipeline layout with the graphics pipeline, so their
+// shaders take their resources and parameters from struct PushConstants.
+void createComputePipeline(uint32_t shader, VkPipeline* pipeline) {
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModuleCacheModule(shader);
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    pipelineInfo.basePipelineIndex = -1;
+    if(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, NULL, pipeline) 
+       != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateComputePipelines failed, aborting.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Binds the pipeline and the bindless descriptor set, for any number of dispatches after.
+void bindComputePipeline(VkCommandBuffer commandBuffer, VkPipeline pipeline) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1,
+                            &bindlessDescriptorSet, 0, NULL);
+}
+
+// Dispatches the bound compute pipeline with its own push constants. Recording into a command
+// buffer of computeCommandPool runs it on the async compute queue.
+void recordDispatch(VkCommandBuffer commandBuffer, const struct PushConstants* pushConstants, 
+                    uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL, 0, 
+                       sizeof(*pushConstants), pushConstants);
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
+bool checkComputePrimitivesSupport(VkPhysicalDevice device) {
+    VkPhysicalDeviceVulkan11Properties properties11 = {};
+    properties11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties11;
+    vkGetPhysicalDeviceProperties2(device, &properties);
+    VkSubgroupFeatureFlags operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+    return (properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+           (properties11.subgroupSupportedOperations & operations) == operations;
+}
+
+void createComputePrimitivePipelines() {
+    if(!computePrimitivesEnabled) {
+        return;
+    }
+    createComputePipeline(scanShader, &scanPipeline);
+    createComputePipeline(histogramShader, &sortHistogramPipeline);
+    createComputePipeline(onesweepShader, &sortPassPipeline);
+    createComputePipeline(reduceShader, &reducePipeline);
+}
+
+void cleanupComputePrimitives() {
+    if(!computePrimitivesEnabled) {
+        return;
+    }
+    vkDestroyPipeline(device, scanPipeline, NULL);
+    vkDestroyPipeline(device, sortHistogramPipeline, NULL);
+    vkDestroyPipeline(device, sortPassPipeline, NULL);
+    vkDestroyPipeline(device, reducePipeline, NULL);
+    releaseShaderModule(scanShader);
+    releaseShaderModule(histogramShader);
+    releaseShaderModule(onesweepShader);
+    releaseShaderModule(reduceShader);
+}
+
+// Usable by compute shaders, vkCmdFillBuffer() and copies in both directions.
+void storageBufferCreate(struct StorageBuffer* storageBuffer, VkDeviceSize size) {
+    createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | 
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+                 &storageBuffer->buffer, &storageBuffer->memory);
+    storageBuffer->size = size;
+    storageBuffer->handle = bindlessAddStorageBuffer(storageBuffer->buffer, 0, VK_WHOLE_SIZE);
+}
+
+void storageBufferDestroy(struct StorageBuffer* storageBuffer) {
+    if(storageBuffer->buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    bindlessReleaseHandle(BINDLESS_STORAGE_BUFFER_BINDING, storageBuffer->handle);
+    vkDestroyBuffer(device, storageBuffer->buffer, NULL);
+    vkFreeMemory(device, storageBuffer->memory, NULL);
+    memset(storageBuffer, 0, sizeof(*storageBuffer));
+}
+
+void recordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+                         VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// The partition counter and a descriptor per partition.
+VkDeviceSize prefixSumStateSize(uint32_t count) {
+    uint32_t partitionSize = scanLocalSizeX * SCAN_ITEMS_PER_INVOCATION;
+    return (1 + (VkDeviceSize)(count + partitionSize - 1) / partitionSize) * sizeof(uint32_t);
+}
+
+VkDeviceSize radixSortStateSize(uint32_t count) {
+    uint32_t tileSize = onesweepLocalSizeX * SORT_ITEMS_PER_INVOCATION;
+    VkDeviceSize tileCount = (count + tileSize - 1) / tileSize;
+    return (SORT_STATE_LOOKBACK + SORT_PASSES * tileCount * SORT_DIGITS) * sizeof(uint32_t);
+}
+
+// The primitives record the barriers between their own dispatches. The caller makes their
+// inputs visible to compute shaders before, orders earlier uses of the state and output
+// buffers, and waits for their compute shader writes before reading the results.
+
+// Writes the exclusive prefix sum of count uints of input to output, which may be input itself.
+// The sums have to stay below 2^30. state holds prefixSumStateSize(count) bytes.
+void recordPrefixSum(VkCommandBuffer commandBuffer, const struct StorageBuffer* input, 
+                     const struct StorageBuffer* output, const struct StorageBuffer* state, uint32_t count) {
+    if(count == 0) {
+        return;
+    }
+    if(count > PRIMITIVE_MAX_ELEMENTS) {
+        fprintf(stderr, "Cannot scan %u elements, aborting.", count);
+        exit(EXIT_FAILURE);
+    }
+    vkCmdFillBuffer(commandBuffer, state->buffer, 0, prefixSumStateSize(count), 0);
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    struct PushConstants pushConstants = {};
+    pushConstants.resourceHandles[SCAN_HANDLE_INPUT] = input->handle;
+    pushConstants.resourceHandles[SCAN_HANDLE_OUTPUT] = output->handle;
+    pushConstants.resourceHandles[SCAN_HANDLE_STATE] = state->handle;
+    pushConstants.parameters[SCAN_PARAMETER_COUNT] = count;
+    uint32_t partitionSize = scanLocalSizeX * SCAN_ITEMS_PER_INVOCATION;
+    bindComputePipeline(commandBuffer, scanPipeline);
+    recordDispatch(commandBuffer, &pushConstants, (count + partitionSize - 1) / partitionSize, 1, 1);
+}
+
+// Sorts count keys and their values by all 32 bits of the keys, keeping the order of equal
+// keys, 8 bits per pass like radixSortKeys() in drawkey.h. The result ends up back in keys and
+// values. The scratch buffers hold count uints each, state radixSortStateSize(count) bytes.
+void recordRadixSort(VkCommandBuffer commandBuffer, const struct StorageBuffer* keys, 
+                     const struct StorageBuffer* values, const struct StorageBuffer* scratchKeys,
+                     const struct StorageBuffer* scratchValues, const struct StorageBuffer* state, uint32_t count) {
+    if(count == 0) {
+        return;
+    }
+    if(count > PRIMITIVE_MAX_ELEMENTS) {
+        fprintf(stderr, "Cannot sort %u elements, aborting.", count);
+        exit(EXIT_FAILURE);
+    }
+    vkCmdFillBuffer(commandBuffer, state->buffer, 0, radixSortStateSize(count), 0);
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    uint32_t tileSize = onesweepLocalSizeX * SORT_ITEMS_PER_INVOCATION;
+    uint32_t tileCount = (count + tileSize - 1) / tileSize;
+    struct PushConstants pushConstants = {};
+    pushConstants.resourceHandles[SORT_HANDLE_KEYS] = keys->handle;
+    pushConstants.resourceHandles[SORT_HANDLE_STATE] = state->handle;
+    pushConstants.parameters[SORT_PARAMETER_COUNT] = count;
+    bindComputePipeline(commandBuffer, sortHistogramPipeline);
+    recordDispatch(commandBuffer, &pushConstants, tileCount, 1, 1);
+    bindComputePipeline(commandBuffer, sortPassPipeline);
+    // Back and forth between the buffers and the scratch buffers, an even number of times.
+    for(uint32_t pass = 0; pass < SORT_PASSES; pass++) {
+        recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        bool fromScratch = pass % 2 == 1;
+        pushConstants.resourceHandles[SORT_HANDLE_KEYS] = fromScratch ? scratchKeys->handle : keys->handle;
+        pushConstants.resourceHandles[SORT_HANDLE_VALUES] = fromScratch ? scratchValues->handle : values->handle;
+        pushConstants.resourceHandles[SORT_HANDLE_SORTED_KEYS] = fromScratch ? keys->handle : scratchKeys->handle;
+        pushConstants.resourceHandles[SORT_HANDLE_SORTED_VALUES] = 
+            fromScratch ? values->handle : scratchValues->handle;
+        pushConstants.parameters[SORT_PARAMETER_PASS] = pass;
+        recordDispatch(commandBuffer, &pushConstants, tileCount, 1, 1);
+    }
+}
+
+// Writes the sum of count uints of input, wrapping around, their minimum and their maximum to
+// REDUCE_RESULT_COUNT uints of results. Without elements the minimum is UINT32_MAX.
+void recordReduce(VkCommandBuffer commandBuffer, const struct StorageBuffer* input, 
+                  const struct StorageBuffer* results, uint32_t count) {
+    vkCmdFillBuffer(commandBuffer, results->buffer, REDUCE_RESULT_SUM * sizeof(uint32_t), sizeof(uint32_t), 0);
+    vkCmdFillBuffer(commandBuffer, results->buffer, REDUCE_RESULT_MIN * sizeof(uint32_t), sizeof(uint32_t),
+                    UINT32_MAX);
+    vkCmdFillBuffer(commandBuffer, results->buffer, REDUCE_RESULT_MAX * sizeof(uint32_t), sizeof(uint32_t), 0);
+    if(count == 0) {
+        return;
+    }
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    struct PushConstants pushConstants = {};
+    pushConstants.resourceHandles[REDUCE_HANDLE_INPUT] = input->handle;
+    pushConstants.resourceHandles[REDUCE_HANDLE_RESULTS] = results->handle;
+    pushConstants.parameters[REDUCE_PARAMETER_COUNT] = count;
+    // Enough invocations to keep the device busy, each folding a few elements at least, and
+    // few enough atomics on the results.
+    uint32_t workgroupElements = reduceLocalSizeX * REDUCE_ITEMS_PER_INVOCATION;
+    uint32_t workgroupCount = (count + workgroupElements - 1) / workgroupElements;
+    if(workgroupCount > REDUCE_MAX_WORKGROUPS) {
+        workgroupCount = REDUCE_MAX_WORKGROUPS;
+    }
+    bindComputePipeline(commandBuffer, reducePipeline);
+    recordDispatch(commandBuffer, &pushConstants, workgroupCount, 1, 1);
+}
+
+void createCullPipeline() {
+    if(gpuCullingEnabled) {
+        createComputePipeline(cullShader, &cullPipeline);
+    }
+}
+
+// Culls each group into its range of the culled draws, the render graph orders it after the
+// draw count clear and before the indirect draws. Host writes to the instances and draws are
+// visible through the queue submit.
+void recordCullPass(VkCommandBuffer commandBuffer, struct FrameDraws* draws, enum CullPhase phase) {
+    struct PushConstants pushConstants = {};
+    pushConstants.resourceHandles[CULL_HANDLE_INSTANCES] = draws->instances.handle;
+    pushConstants.resourceHandles[CULL_HANDLE_CULLED_DRAWS] = draws->culledHandle;
+    pushConstants.resourceHandles[CULL_HANDLE_DRAW_COUNT] = draws->countHandle;
+    pushConstants.resourceHandles[CULL_HANDLE_DRAWS] = draws->draws.handle;
+    pushConstants.resourceHandles[CULL_HANDLE_DRAW_STARTS] = draws->drawStarts.handle;
+    pushConstants.parameters[CULL_PARAMETER_PHASE] = phase;
+    if(occlusionCullingEnabled) {
+        pushConstants.resourceHandles[CULL_HANDLE_VISIBILITY] = draws->visibilityHandle;
+        pushConstants.resourceHandles[CULL_HANDLE_PYRAMID] = pyramidHandle;
+        pushConstants.parameters[CULL_PARAMETER_DEPTH_SIZE] = swapchainExtent.width | swapchainExtent.height << 16;
+        pushConstants.parameters[CULL_PARAMETER_PYRAMID_LEVELS] = pyramidLevelCount;
+    }
+    // The late phase's ranges follow all of the early phase's.
+    uint32_t firstCulled = phase == CULL_PHASE_LATE ? draws->totalDrawInstances : 0;
+    uint32_t firstCount = phase == CULL_PHASE_LATE ? draws->drawCount : 0;
+    bindComputePipeline(commandBuffer, cullPipeline);
+    for(uint32_t i = 0; i < draws->groupCount; i++) {
+        const struct DrawGroup* group = &draws->groups[i];
+        pushConstants.parameters[CULL_PARAMETER_CULLED_CAPACITY] = group->culledCount;
+        pushConstants.parameters[CULL_PARAMETER_FIRST_CULLED] = firstCulled + group->firstCulled;
+        pushConstants.parameters[CULL_PARAMETER_FIRST_DRAW] = group->firstDraw;
+        pushConstants.parameters[CULL_PARAMETER_COUNT_SLOT] = firstCount + group->firstDraw;
+        pushConstants.parameters[CULL_PARAMETER_DRAW_COUNT] = group->drawCount;
+        // One invocation per instance of the group, whatever the draws it is spread over. The
+        // workgroups wrap into rows of 65535, the smallest maxComputeWorkGroupCount.
+        uint32_t workgroupCount = (group->culledCount + cullLocalSizeX - 1) / cullLocalSizeX;
+        if(workgroupCount == 0) {
+            continue;
+        }
+        uint32_t rowSize = workgroupCount < 65535 ? workgroupCount : 65535;
+        recordDispatch(commandBuffer, &pushConstants, rowSize, (workgroupCount + rowSize - 1) / rowSize, 1);
+    }
+}
+
+// Draws the groups, with GPU culling from the phase's culled draws. Only the draws from
+// firstDraw to endDraw are recorded, groups drawn with a single command belong to the range
+// they start in.
+void recordDrawGroups(VkCommandBuffer commandBuffer, const struct FrameDraws* draws, 
+                      struct DrawState* state, enum CullPhase phase, uint32_t firstDraw, uint32_t endDraw) {
+    const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t firstCulled = phase == CULL_PHASE_LATE ? draws->totalDrawInstances : 0;
+    uint32_t firstCount = phase == CULL_PHASE_LATE ? draws->drawCount : 0;
+    for(uint32_t i = 0; i < draws->groupCount; i++) {
+        const struct DrawGroup* group = &draws->groups[i];
+        uint32_t groupEnd = group->firstDraw + group->drawCount;
+        if(group->firstDraw >= endDraw) {
+            break;
+        }
+        bool perDraw = drawRecordedPerDraw(group);
+        if(groupEnd <= firstDraw || (!perDraw && group->firstDraw < firstDraw)) {
+            continue;
+        }
+        if(perDraw) {
+            // The commands are still in host memory, read them back instead.
+            uint32_t first = group->firstDraw > firstDraw ? group->firstDraw : firstDraw;
+            uint32_t end = groupEnd < endDraw ? groupEnd : endDraw;
+            bindDrawState(commandBuffer, state, group->material, end - first);
+            const VkDrawIndexedIndirectCommand* commands = 
+                (const VkDrawIndexedIndirectCommand*)draws->draws.mapped;
+            for(uint32_t j = first; j < end; j++) {
+                vkCmdDrawIndexed(commandBuffer, commands[j].indexCount, commands[j].instanceCount,
+                                 commands[j].firstIndex, commands[j].vertexOffset, 
+                                 commands[j].firstInstance);
+            }
+            continue;
+        }
+        bindDrawState(commandBuffer, state, group->material, group->drawCount);
+        if(gpuCullingEnabled) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, draws->culledBuffer, 
+                                          (firstCulled + group->firstCulled) * stride, draws->countBuffer,
+                                          (firstCount + group->firstDraw) * sizeof(uint32_t),
+                                          group->culledCount < maxIndirectDrawCount ?
+                                          group->culledCount : maxIndirectDrawCount, (uint32_t)stride);
+        } else {
+            vkCmdDrawIndexedIndirect(commandBuffer, draws->draws.buffer, group->firstDraw * stride,
+                                     group->drawCount, (uint32_t)stride);
+        }
+    }
+}
+
+// Without GPU culling or multi-draw indirect for the group, every draw is its own command.
+bool drawRecordedPerDraw(const struct DrawGroup* group) {
+    return !gpuCullingEnabled && !(multiDrawIndirectEnabled && group->drawCount <= maxIndirectDrawCount);
+}
+
+uint32_t drawCommandCount(const struct FrameDraws* draws) {
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < draws->groupCount; i++) {
+        count += drawRecordedPerDraw(&draws->groups[i]) ? draws->groups[i].drawCount : 1;
+    }
+    return count;
+}
+
+// Ends rangeCount ranges of the draws at ends[], with about as many commands in each. Groups
+// drawn with a single command stay whole.
+void splitDrawRanges(const struct FrameDraws* draws, uint32_t rangeCount, uint32_t* ends) {
+    uint32_t total = drawCommandCount(draws);
+    uint32_t range = 0;
+    uint32_t commands = 0;
+    for(uint32_t i = 0; i < draws->groupCount && range + 1 < rangeCount; i++) {
+        const struct DrawGroup* group = &draws->groups[i];
+        bool perDraw = drawRecordedPerDraw(group);
+        uint32_t cost = perDraw ? group->drawCount : 1;
+        while(range + 1 < rangeCount) {
+            uint32_t target = (uint32_t)((uint64_t)total * (range + 1) / rangeCount);
+            if(target >= commands + cost) {
+                break;
+            }
+            ends[range++] = perDraw ? group->firstDraw + (target - commands) : group->firstDraw;
+        }
+        commands += cost;
+    }
+    while(range < rangeCount) {
+        ends[range++] = draws->drawCount;
+    }
+}
+
+// Begins scenePass on the frame's framebuffer, for contents recorded inline or in secondary
+// command buffers.
+void beginScenePass(VkCommandBuffer commandBuffer, struct FrameContext* context, VkRenderPass scenePass,
+                    bool clear, VkSubpassContents contents) {
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = scenePass;
+    renderPassInfo.framebuffer = context->framebuffer;
+    VkOffset2D offset = {0, 0};
+    renderPassInfo.renderArea.offset = offset;
+    renderPassInfo.renderArea.extent = swapchainExtent;
+    VkClearValue clearValues[2] = {};
+    VkClearColorValue color= {0.0, 0.0, 0.0, 1.0};
+    clearValues[0].color = color;
+    clearValues[1].depthStencil.depth = 1.0f;
+    if(clear) {
+        renderPassInfo.clearValueCount = depthEnabled ? 2 : 1;
+        renderPassInfo.pClearValues = clearValues;
+    }
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
+}
+
+// What every draw of a scene pass shares. Secondary command buffers inherit none of it.
+void bindSceneState(VkCommandBuffer commandBuffer, const struct FrameDraws* draws) {
+    // The bindless set is the only descriptor set, so it is the only one bound.
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+                            &bindlessDescriptorSet, 0, NULL);
+    // Every mesh lives in the geometry pool, so this is the only index buffer binding.
+    vkCmdBindIndexBuffer(commandBuffer, geometryPool.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    VkViewport viewport={};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)(swapchainExtent.width);
+    viewport.height = (float)(swapchainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor={};
+    scissor.extent = swapchainExtent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    // Draws only exist with instances, so there is always an instance buffer to bind.
+    if(draws->drawCount > 0) {
+        VkBuffer vertexBuffers[VERTEX_BINDING_COUNT];
+        vertexBuffers[VERTEX_BINDING] = geometryPool.vertexBuffer;
+        vertexBuffers[INSTANCE_BINDING] = draws->instances.buffer;
+        VkDeviceSize offsets[VERTEX_BINDING_COUNT] = {};
+        vkCmdBindVertexBuffers(commandBuffer, 0, VERTEX_BINDING_COUNT, vertexBuffers, offsets); 
+    }
+}
+
+// Clears the counts of both phases.
+void recordDrawCountClear(VkCommandBuffer commandBuffer, void* frameData) {
+    const struct FrameDraws* draws = ((struct FrameContext*)frameData)->draws;
+    if(draws->drawCount == 0) {
+        return;
+    }
+    uint32_t phaseCount = occlusionCullingEnabled ? 2 : 1;
+    vkCmdFillBuffer(commandBuffer, draws->countBuffer, 0, 
+                    (VkDeviceSize)phaseCount * draws->drawCount * sizeof(uint32_t), 0);
+}
+
+// Once per visibility buffer, before the early cull first reads it. The graph's barriers stay
+// in place in the frames it records nothing.
+void recordVisibilityClear(VkCommandBuffer commandBuffer, void* frameData) {
+    struct FrameDraws* draws = ((struct FrameContext*)frameData)->draws;
+    if(draws->drawCount == 0 || draws->visibilityCleared) {
+        return;
+    }
+    vkCmdFillBuffer(commandBuffer, draws->visibilityBuffer, 0, VK_WHOLE_SIZE, 0);
+    draws->visibilityCleared = true;
+}
+
+void recordEarlyCull(VkCommandBuffer commandBuffer, void* frameData) {
+    struct FrameDraws* draws = ((struct FrameContext*)frameData)->draws;
+    if(draws->drawCount == 0) {
+        return;
+    }
+    recordCullPass(commandBuffer, draws, occlusionCullingEnabled ? CULL_PHASE_EARLY : CULL_PHASE_VIEW);
+}
+
+// The render graph's draw count clear and cull passes, recorded for the compute queue with the
+// barrier the graph would have put between them.
+void recordAsyncCull(VkCommandBuffer commandBuffer) {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "vkBeginCommandBuffer failed for the compute queue, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    struct FrameContext context = {};
+    context.draws = &frameDraws[currentFrame];
+    recordDrawCountClear(commandBuffer, &context);
+    VkMemoryBarrier clearBarrier = {};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &clearBarrier, 0, NULL, 0, NULL);
+    recordEarlyCull(commandBuffer, &context);
+    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "vkEndCommandBuffer failed for the compute queue, aborting.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// The whole frame without occlusion culling, sprites included.
+void recordEarlyDraws(VkCommandBuffer commandBuffer, void* frameData) {
+    recordScenePass(commandBuffer, frameData, occlusionCullingEnabled ? CULL_PHASE_EARLY : CULL_PHASE_VIEW);
+}
+
+void recordLateCull(VkCommandBuffer commandBuffer, void* frameData) {
+    struct FrameDraws* draws = ((struct FrameContext*)frameData)->draws;
+    if(draws->drawCount > 0) {
+        recordCullPass(commandBuffer, draws, CULL_PHASE_LATE);
+    }
+}
+
+// The pipeline binding carries over from the early draws, the pushed constants do not.
+void recordLateDraws(VkCommandBuffer commandBuffer, void* frameData) {
+    struct FrameContext* context = frameData;
+    context->state.material = UINT32_MAX;
+    recordScenePass(commandBuffer, context, CULL_PHASE_LATE);
+}
+
+// The draws of phase and, in the last scene pass, the sprites. Recorded inline, or split over
+// the recording threads when there are enough commands.
+void recordScenePass(VkCommandBuffer commandBuffer, struct FrameContext* context, enum CullPhase phase) {
+    const struct FrameDraws* draws = context->draws;
+    VkRenderPass scenePass = phase == CULL_PHASE_LATE ? lateRenderPass : renderPass;
+    bool clear = phase != CULL_PHASE_LATE;
+    bool sprites = phase != CULL_PHASE_EARLY;
+    uint32_t rangeCount = recordThreadCount;
+    if(drawCommandCount(draws) < PARALLEL_RECORD_MIN_COMMANDS || 
+       (context->statisticsActive && !inheritedQueriesEnabled)) {
+        rangeCount = 1;
+    }
+    if(rangeCount <= 1) {
+        beginScenePass(commandBuffer, context, scenePass, clear, VK_SUBPASS_CONTENTS_INLINE);
+        bindSceneState(commandBuffer, draws);
+        if(draws->drawCount > 0) {
+            recordDrawGroups(commandBuffer, draws, &context->state, phase, 0, draws->drawCount);
+        }
+        if(sprites) {
+            recordSpriteBatches(commandBuffer, &context->state);
+        }
+        vkCmdEndRenderPass(commandBuffer);
+        return;
+    }
+
+    uint32_t ends[RECORD_MAX_THREADS];
+    splitDrawRanges(draws, rangeCount, ends);
+    struct RecordRange ranges[RECORD_MAX_THREADS] = {};
+    VkCommandBuffer secondaries[RECORD_MAX_THREADS];
+    uint32_t scenePassIndex = phase == CULL_PHASE_LATE ? 1 : 0;
+    for(uint32_t i = 0; i < rangeCount; i++) {
+        struct RecordRange* range = &ranges[i];
+        range->commandBuffer = recordBuffers[currentFrame][i][scenePassIndex];
+        range->context = context;
+        range->scenePass = scenePass;
+        range->phase = phase;
+        range->firstDraw = i == 0 ? 0 : ends[i - 1];
+        range->endDraw = ends[i];
+        range->sprites = sprites && i == rangeCount - 1;
+        range->state.pipeline = UINT32_MAX;
+        range->state.material = UINT32_MAX;
+        secondaries[i] = range->commandBuffer;
+    }
+    struct JobCounter recorded = {};
+    jobRun(&jobSystem, recordRangeTask, ranges, rangeCount, &recorded);
+    beginScenePass(commandBuffer, context, scenePass, clear, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    jobWait(&jobSystem, &recorded);
+    vkCmdExecuteCommands(commandBuffer, rangeCount, secondaries);
+    vkCmdEndRenderPass(commandBuffer);
+    for(uint32_t i = 0; i < rangeCount; i++) {
+        addBindCounts(&ranges[i].state);
+    }
+    // Nothing bound by the secondary command buffers is left bound after them.
+    context->state.pipeline = UINT32_MAX;
+    context->state.material = UINT32_MAX;
+}
+
+// Runs as a job, only touching the command buffer of the range's own pool.
+void recordRangeTask(void* context, uint32_t index) {
+    struct RecordRange* range = &((struct RecordRange*)context)[index];
+    const struct FrameContext* frame = range->context;
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = range->scenePass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = frame->framebuffer;
+    if(frame->statisticsActive) {
+        inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    }
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | 
+                      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    if(vkBeginCommandBuffer(range->commandBuffer, &beginInfo) != VK_SUCCESS) {
+        fprintf(stderr, "vkBeginCommandBuffer failed for a secondary command buffer, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    bindSceneState(range->commandBuffer, frame->draws);
+    if(range->endDraw > range->firstDraw) {
+        recordDrawGroups(range->commandBuffer, frame->draws, &range->state, range->phase, range->firstDraw,
+                         range->endDraw);
+    }
+    if(range->sprites) {
+        recordSpriteBatches(range->commandBuffer, &range->state);
+    }
+    if(vkEndCommandBuffer(range->commandBuffer) != VK_SUCCESS) {
+        fprintf(stderr, "vkEndCommandBuffer failed for a secondary command buffer, aborting.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// A transient pool per range and frame in flight, with a secondary command buffer per scene pass.
+void createRecordPools() {
+    if(recordThreadCount == 0) {
+        recordThreadCount = jobSystem.workerCount;
+    }
+    if(recordThreadCount > RECORD_MAX_THREADS) {
+        recordThreadCount = RECORD_MAX_THREADS;
+    }
+    if(recordThreadCount <= 1) {
+        return;
+    }
+    struct QueueFamilyIndices queueFamilyIndices;
+    findQueueFamilies(physicalDevice, &queueFamilyIndices);
+    for(uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        for(uint32_t thread = 0; thread < recordThreadCount; thread++) {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = queueFamilyIndices.graphics;
+            if(vkCreateCommandPool(device, &poolInfo, NULL, &recordPools[frame][thread]) != VK_SUCCESS) {
+                fprintf(stderr, "vkCreateCommandPool failed for a recording thread, aborting.");
+                exit(EXIT_FAILURE);
+            }
+            VkCommandBufferAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = recordPools[frame][thread];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = SCENE_PASS_COUNT;
+            if(vkAllocateCommandBuffers(device, &allocInfo, recordBuffers[frame][thread]) != VK_SUCCESS) {
+                fprintf(stderr, "vkAllocateCommandBuffers failed for a recording thread, aborting.");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    printf("Recording on up to %u threads.\n", recordThreadCount);
+}
+
+void cleanupRecordPools() {
+    if(recordThreadCount <= 1) {
+        return;
+    }
+    for(uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+        for(uint32_t thread = 0; thread < recordThreadCount; thread++) {
+            vkDestroyCommandPool(device, recordPools[frame][thread], NULL);
+        }
+    }
+}
+
+// The pyramid and its sampler outlive swapchain recreation, the buffer is sized with the
+// depth buffer in createRenderGraph().
+void createDepthPyramidPipeline() {
+    if(!occlusionCullingEnabled) {
+        return;
+    }
+    createComputePipeline(hizShader, &hizPipeline);
+    // hiz.comp only fetches texels, which the filter does not affect.
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    if(vkCreateSampler(device, &samplerInfo, NULL, &depthSampler) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateSampler failed for the depth buffer, aborting.");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// A pass of the render graph, between the early draws and the late cull. Each level reads the
+// one below, the graph orders the rest.
+void recordDepthPyramid(VkCommandBuffer commandBuffer, void* frameData) {
+    struct PushConstants pushConstants = {};
+    pushConstants.resourceHandles[HIZ_HANDLE_DEPTH] = depthHandle;
+    pushConstants.resourceHandles[HIZ_HANDLE_PYRAMID] = pyramidHandle;
+    bindComputePipeline(commandBuffer, hizPipeline);
+    VkMemoryBarrier levelBarrier = {};
+    levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    for(uint32_t level = 0; level < pyramidLevelCount; level++) {
+        if(level == 0) {
+            pushConstants.parameters[HIZ_PARAMETER_SOURCE_OFFSET] = HIZ_SOURCE_DEPTH;
+            pushConstants.parameters[HIZ_PARAMETER_SOURCE_SIZE] = 
+                swapchainExtent.width | swapchainExtent.height << 16;
+        } else {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                                 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, NULL, 0, NULL);
+            pushConstants.parameters[HIZ_PARAMETER_SOURCE_OFFSET] = pyramidOffsets[level - 1];
+            pushConstants.parameters[HIZ_PARAMETER_SOURCE_SIZE] = 
+                pyramidWidths[level - 1] | pyramidHeights[level - 1] << 16;
+        }
+        pushConstants.parameters[HIZ_PARAMETER_DESTINATION_OFFSET] = pyramidOffsets[level];
+        pushConstants.parameters[HIZ_PARAMETER_DESTINATION_SIZE] = 
+            pyramidWidths[level] | pyramidHeights[level] << 16;
+        recordDispatch(commandBuffer, &pushConstants, (pyramidWidths[level] + hizLocalSizeX - 1) / hizLocalSizeX,
+                       (pyramidHeights[level] + hizLocalSizeY - 1) / hizLocalSizeY, 1);
+    }
+}
+
+// Timestamps are optional, without them the instance benchmark only reports frame times.
+void createTimestampQueries() {
+    struct QueueFamilyIndices queueFamilyIndices = {};
+    findQueueFamilies(physicalDevice, &queueFamilyIndices);
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties queueFamilyProperties[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProperties);
+    uint32_t validBits = queueFamilyProperties[queueFamilyIndices.graphics].timestampValidBits;
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    if(validBits == 0 || deviceProperties.limits.timestampPeriod == 0) {
+        return;
+    }
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT * 2;
+    if(vkCreateQueryPool(device, &queryPoolInfo, NULL, &timestampQueryPool) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateQueryPool failed, GPU timings are disabled.\n");
+        return;
+    }
+    timestampsSupported = true;
+    timestampPeriod = deviceProperties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t)1 << validBits) - 1;
+}
+
+void createStatisticsQueries() {
+    if(!statisticsSupported) {
+        return;
+    }
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    queryPoolInfo.queryCount = MAX_FRAMES_IN_FLIGHT;
+    queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    if(vkCreateQueryPool(device, &queryPoolInfo, NULL, &statisticsQueryPool) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateQueryPool failed, overdraw statistics are disabled.\n");
+        statisticsSupported = false;
+    }
+}
+
+// Called once the frame's fence has been waited on, so its queries are available.
+void readFrameQueries(uint32_t frame) {
+    if(frameTimestampsWritten[frame]) {
+        frameTimestampsWritten[frame] = false;
+        uint64_t timestamps[2];
+        if(vkGetQueryPoolResults(device, timestampQueryPool, frame * 2, 2, sizeof(timestamps), 
+                                 timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+            gpuDrawMilliseconds += ticks * timestampPeriod / 1e6;
+            gpuDrawSamples++;
+        }
+    }
+    if(frameStatisticsWritten[frame]) {
+        frameStatisticsWritten[frame] = false;
+        uint64_t invocations;
+        if(vkGetQueryPoolResults(device, statisticsQueryPool, frame, 1, sizeof(invocations), 
+                                 &invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            fragmentInvocations += (double)invocations;
+            fragmentInvocationSamples++;
+        }
+    }
+}
+
+// Draws a grid of 1, 10, ... INSTANCE_BENCHMARK_MAX_INSTANCES quads and prints the frame time 
+// and the GPU time of culling and drawing them for each count. Frame times include presentation, 
+// so they bottom out at the refresh rate with FIFO presentation.
+void runInstanceBenchmark() {
+    struct MeshInstance* instances = malloc(INSTANCE_BENCHMARK_MAX_INSTANCES * sizeof(struct MeshInstance));
+    if(!instances) {
+        fprintf(stderr, "Failed to allocate benchmark instances, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    if(!timestampsSupported) {
+        printf("Timestamps are not supported, reporting frame times only.\n");
+    }
+    printf("%10s %12s %12s %14s\n", "Instances", "Frame ms", "GPU ms", "GPU Minst/s");
+    frameTimingEnabled = true;
+    for(uint32_t count = 1; count <= INSTANCE_BENCHMARK_MAX_INSTANCES && 
+        !glfwWindowShouldClose(window); count *= 10) {
+        // One grid cell per instance, filling the view.
+        uint32_t columns = (uint32_t)ceil(sqrt((double)count));
+        float cell = 2.0f * QUAD_VIEW_EXTENT / columns;
+        for(uint32_t i = 0; i < count; i++) {
+            struct MeshInstance* instance = &instances[i];
+            uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+            instance->offset[0] = -QUAD_VIEW_EXTENT + (i % columns + 0.5f) * cell;
+            instance->offset[1] = -QUAD_VIEW_EXTENT + (i / columns + 0.5f) * cell;
+            instance->scale[0] = cell * 0.8f;
+            instance->scale[1] = cell * 0.8f;
+            instance->color[0] = (hash & 0xff) / 255.0f;
+            instance->color[1] = ((hash >> 8) & 0xff) / 255.0f;
+            instance->color[2] = ((hash >> 16) & 0xff) / 255.0f;
+            instance->depth = ((hash >> 24) & 0xff) / 255.0f;
+        }
+        const struct MeshDraw draw = {quadMesh, 0, count, MATERIAL_DEFAULT};
+        setMeshInstances(instances, count);
+        setMeshDraws(&draw, 1);
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES; frame++) {
+            glfwPollEvents();
+            drawFrame();
+        }
+        // Throw away the samples of the warm up frames.
+        vkDeviceWaitIdle(device);
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readFrameQueries(i);
+        }
+        gpuDrawMilliseconds = 0;
+        gpuDrawSamples = 0;
+
+        double start = glfwGetTime();
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_FRAMES; frame++) {
+            glfwPollEvents();
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readFrameQueries(i);
+        }
+        if(gpuDrawSamples > 0) {
+            double drawMilliseconds = gpuDrawMilliseconds / gpuDrawSamples;
+            printf("%10u %12.3f %12.3f %14.1f\n", count, frameMilliseconds, drawMilliseconds,
+                   drawMilliseconds > 0 ? count / drawMilliseconds / 1000.0 : 0.0);
+        } else {
+            printf("%10u %12.3f %12s %14s\n", count, frameMilliseconds, "-", "-");
+        }
+    }
+    frameTimingEnabled = false;
+    free(instances);
+}
+
+// Draws OVERDRAW_BENCHMARK_QUADS large, overlapping quads at random depths in each depth sort
+// order and prints the GPU time and the fragment shader invocations per pixel. Front to back
+// lets early depth testing skip the hidden fragments, back to front shades all of them.
+void runOverdrawBenchmark() {
+    if(!depthEnabled) {
+        printf("Drawing without a depth buffer, every order shades every fragment.\n");
+    }
+    if(!statisticsSupported) {
+        printf("Pipeline statistics are not supported, overdraw is not reported.\n");
+    }
+    struct MeshInstance instances[OVERDRAW_BENCHMARK_QUADS];
+    for(uint32_t i = 0; i < OVERDRAW_BENCHMARK_QUADS; i++) {
+        struct MeshInstance* instance = &instances[i];
+        uint64_t hash = hashBytes64(&i, sizeof(i));
+        instance->offset[0] = QUAD_VIEW_EXTENT * (2.0f * (hash & 0xffff) / 65535.0f - 1.0f);
+        instance->offset[1] = QUAD_VIEW_EXTENT * (2.0f * ((hash >> 16) & 0xffff) / 65535.0f - 1.0f);
+        instance->scale[0] = QUAD_VIEW_EXTENT;
+        instance->scale[1] = QUAD_VIEW_EXTENT;
+        instance->color[0] = ((hash >> 32) & 0xff) / 255.0f;
+        instance->color[1] = ((hash >> 40) & 0xff) / 255.0f;
+        instance->color[2] = ((hash >> 48) & 0xff) / 255.0f;
+        instance->depth = (float)i / OVERDRAW_BENCHMARK_QUADS;
+    }
+    // Submitted back to front, so unsorted is the worst case too.
+    for(uint32_t i = 0; i < OVERDRAW_BENCHMARK_QUADS / 2; i++) {
+        struct MeshInstance swap = instances[i];
+        instances[i] = instances[OVERDRAW_BENCHMARK_QUADS - 1 - i];
+        instances[OVERDRAW_BENCHMARK_QUADS - 1 - i] = swap;
+    }
+    const struct MeshDraw draw = {quadMesh, 0, OVERDRAW_BENCHMARK_QUADS, MATERIAL_DEFAULT};
+    setMeshInstances(instances, OVERDRAW_BENCHMARK_QUADS);
+    setMeshDraws(&draw, 1);
+    enum DepthSortOrder previousOrder = depthSortOrder;
+    printf("%14s %12s %12s %12s\n", "Order", "Frame ms", "GPU ms", "Overdraw");
+    frameTimingEnabled = true;
+    for(uint32_t order = 0; order < DEPTH_SORT_ORDER_COUNT && !glfwWindowShouldClose(window); order++) {
+        setDepthSortOrder(order);
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES; frame++) {
+            glfwPollEvents();
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readFrameQueries(i);
+        }
+        gpuDrawMilliseconds = 0;
+        gpuDrawSamples = 0;
+        fragmentInvocations = 0;
+        fragmentInvocationSamples = 0;
+
+        double start = glfwGetTime();
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_FRAMES; frame++) {
+            glfwPollEvents();
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            readFrameQueries(i);
+        }
+        double pixels = (double)swapchainExtent.width * swapchainExtent.height;
+        printf("%14s %12.3f", depthSortOrderNames[order], frameMilliseconds);
+        if(gpuDrawSamples > 0) {
+            printf(" %12.3f", gpuDrawMilliseconds / gpuDrawSamples);
+        } else {
+            printf(" %12s", "-");
+        }
+        if(fragmentInvocationSamples > 0) {
+            printf(" %12.2f\n", fragmentInvocations / fragmentInvocationSamples / pixels);
+        } else {
+            printf(" %12s\n", "-");
+        }
+    }
+    frameTimingEnabled = false;
+    setDepthSortOrder(previousOrder);
+}
+// Draws DRAW_KEY_BENCHMARK_DRAWS single quads, their materials interleaved, with 1, 16 and 256
+// materials. The draws are set again every frame, so each frame sorts them, and the sort time,
+// the groups and the binds per frame are printed.
+void runDrawKeyBenchmark() {
+    struct MeshInstance* instances = malloc(DRAW_KEY_BENCHMARK_DRAWS * sizeof(struct MeshInstance));
+    struct MeshDraw* meshDrawList = malloc(DRAW_KEY_BENCHMARK_DRAWS * sizeof(struct MeshDraw));
+    if(!instances || !meshDrawList) {
+        fprintf(stderr, "Failed to allocate benchmark draws, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t columns = (uint32_t)ceil(sqrt((double)DRAW_KEY_BENCHMARK_DRAWS));
+    float cell = 2.0f * QUAD_VIEW_EXTENT / columns;
+    for(uint32_t i = 0; i < DRAW_KEY_BENCHMARK_DRAWS; i++) {
+        struct MeshInstance* instance = &instances[i];
+        uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+        instance->offset[0] = -QUAD_VIEW_EXTENT + (i % columns + 0.5f) * cell;
+        instance->offset[1] = -QUAD_VIEW_EXTENT + (i / columns + 0.5f) * cell;
+        instance->scale[0] = cell * 0.8f;
+        instance->scale[1] = cell * 0.8f;
+        instance->color[0] = 1.0f;
+        instance->color[1] = 1.0f;
+        instance->color[2] = 1.0f;
+        instance->depth = (hash & 0xffff) / 65535.0f;
+    }
+    setMeshInstances(instances, DRAW_KEY_BENCHMARK_DRAWS);
+    const uint32_t materialCounts[] = {1, 16, 256};
+    uint32_t firstMaterial = materialCount;
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+        const float tint[3] = {(hash & 0xff) / 255.0f, ((hash >> 8) & 0xff) / 255.0f, 
+                               ((hash >> 16) & 0xff) / 255.0f};
+        createMaterial(DRAW_PIPELINE_OPAQUE, tint, TEXTURE_INVALID);
+    }
+    printf("%10s %10s %10s %12s %12s %12s %10s %10s\n", "Materials", "Draws", "Groups", "Pipe binds", 
+           "Mat binds", "Avoided", "Sort ms", "Frame ms");
+    for(uint32_t run = 0; run < sizeof(materialCounts) / sizeof(materialCounts[0]) && 
+        !glfwWindowShouldClose(window); run++) {
+        for(uint32_t i = 0; i < DRAW_KEY_BENCHMARK_DRAWS; i++) {
+            meshDrawList[i].mesh = quadMesh;
+            meshDrawList[i].firstInstance = i;
+            meshDrawList[i].instanceCount = 1;
+            meshDrawList[i].material = firstMaterial + i % materialCounts[run];
+        }
+        double sortMilliseconds = 0.0;
+        double start = 0.0;
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES + INSTANCE_BENCHMARK_FRAMES; frame++) {
+            if(frame == INSTANCE_BENCHMARK_WARMUP_FRAMES) {
+                vkDeviceWaitIdle(device);
+                sortMilliseconds = 0.0;
+                pipelineBinds = 0;
+                pipelineBindsAvoided = 0;
+                materialBinds = 0;
+                materialBindsAvoided = 0;
+                start = glfwGetTime();
+            }
+            glfwPollEvents();
+            setMeshDraws(meshDrawList, DRAW_KEY_BENCHMARK_DRAWS);
+            // uploadFrameDraws() sorts the same draws again, this only times the sort.
+            double sortStart = glfwGetTime();
+            sortMeshDraws();
+            sortMilliseconds += (glfwGetTime() - sortStart) * 1000.0;
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        printf("%10u %10u %10u %12.1f %12.1f %12.1f %10.3f %10.3f\n", materialCounts[run], 
+               DRAW_KEY_BENCHMARK_DRAWS, frameDraws[0].groupCount,
+               (double)pipelineBinds / INSTANCE_BENCHMARK_FRAMES, (double)materialBinds / INSTANCE_BENCHMARK_FRAMES,
+               (double)(pipelineBindsAvoided + materialBindsAvoided) / INSTANCE_BENCHMARK_FRAMES,
+               sortMilliseconds / INSTANCE_BENCHMARK_FRAMES, frameMilliseconds);
+    }
+    free(instances);
+    free(meshDrawList);
+}
 
-    if(vkCreateBuffer(device, &bufferInfo, NULL, buffer) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to create vertex buffer, aborting.");
+// Draws RECORD_BENCHMARK_DRAWS single quads over RECORD_BENCHMARK_MATERIALS materials, so there
+// are thousands of groups to record even with multi-draw indirect, with 1, 2, 4 and up to as
+// many job workers as --threads asked for. The draws are set again every frame, so they are
+// sorted and packed again too. Prints the CPU time uploading and recording a frame take.
+void runRecordingBenchmark() {
+    struct MeshInstance* instances = malloc(RECORD_BENCHMARK_DRAWS * sizeof(struct MeshInstance));
+    struct MeshDraw* meshDrawList = malloc(RECORD_BENCHMARK_DRAWS * sizeof(struct MeshDraw));
+    if(!instances || !meshDrawList) {
+        fprintf(stderr, "Failed to allocate benchmark draws, aborting.");
         exit(EXIT_FAILURE);
     }
+    uint32_t columns = (uint32_t)ceil(sqrt((double)RECORD_BENCHMARK_DRAWS));
+    float cell = 2.0f * QUAD_VIEW_EXTENT / columns;
+    uint32_t firstMaterial = materialCount;
+    for(uint32_t i = 0; i < RECORD_BENCHMARK_MATERIALS; i++) {
+        uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+        const float tint[3] = {(hash & 0xff) / 255.0f, ((hash >> 8) & 0xff) / 255.0f, 
+                               ((hash >> 16) & 0xff) / 255.0f};
+        createMaterial(DRAW_PIPELINE_OPAQUE, tint, TEXTURE_INVALID);
+    }
+    for(uint32_t i = 0; i < RECORD_BENCHMARK_DRAWS; i++) {
+        struct MeshInstance* instance = &instances[i];
+        instance->offset[0] = -QUAD_VIEW_EXTENT + (i % columns + 0.5f) * cell;
+        instance->offset[1] = -QUAD_VIEW_EXTENT + (i / columns + 0.5f) * cell;
+        instance->scale[0] = cell * 0.8f;
+        instance->scale[1] = cell * 0.8f;
+        instance->color[0] = 1.0f;
+        instance->color[1] = 1.0f;
+        instance->color[2] = 1.0f;
+        instance->depth = 0.5f;
+        meshDrawList[i].mesh = quadMesh;
+        meshDrawList[i].firstInstance = i;
+        meshDrawList[i].instanceCount = 1;
+        meshDrawList[i].material = firstMaterial + i % RECORD_BENCHMARK_MATERIALS;
+    }
+    setMeshInstances(instances, RECORD_BENCHMARK_DRAWS);
+    uint32_t maxThreads = jobSystem.workerCount;
+    uint32_t poolCount = recordThreadCount;
+    printf("%10s %10s %10s %12s %12s %10s\n", "Threads", "Draws", "Commands", "Upload ms", "Record ms", 
+           "Frame ms");
+    for(uint32_t threads = 1; threads <= maxThreads && !glfwWindowShouldClose(window); threads *= 2) {
+        vkDeviceWaitIdle(device);
+        jobSystemDestroy(&jobSystem);
+        jobSystemCreate(&jobSystem, threads);
+        recordThreadCount = threads < poolCount ? threads : poolCount;
+        double start = 0.0;
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES + INSTANCE_BENCHMARK_FRAMES; frame++) {
+            if(frame == INSTANCE_BENCHMARK_WARMUP_FRAMES) {
+                vkDeviceWaitIdle(device);
+                uploadMilliseconds = 0.0;
+                recordMilliseconds = 0.0;
+                start = glfwGetTime();
+            }
+            glfwPollEvents();
+            setMeshDraws(meshDrawList, RECORD_BENCHMARK_DRAWS);
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        printf("%10u %10u %10u %12.3f %12.3f %10.3f\n", threads, RECORD_BENCHMARK_DRAWS, 
+               drawCommandCount(&frameDraws[0]), uploadMilliseconds / INSTANCE_BENCHMARK_FRAMES, 
+               recordMilliseconds / INSTANCE_BENCHMARK_FRAMES, frameMilliseconds);
+        // The largest count last, even if it is no power of two.
+        if(threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    recordThreadCount = poolCount;
+    free(instances);
+    free(meshDrawList);
+}
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if(vkAllocateMemory(device, &allocInfo, NULL, deviceMemory) != VK_SUCCESS) {
-        fprintf(stderr, "Failed to allocate vertex buffer memory, aborting.");
+// Culls ASYNC_COMPUTE_BENCHMARK_INSTANCES instances scattered over twice the view in
+// ASYNC_COMPUTE_BENCHMARK_DRAWS draws, first on the graphics queue and then on the compute
+// queue, and prints the frame times. main() turns occlusion culling off for it. Software
+// drivers often have a single queue, which leaves nothing to compare.
+void runAsyncComputeBenchmark() {
+    if(!gpuCullingEnabled) {
+        printf("GPU culling is not supported, there is no compute work to move.\n");
+        return;
+    }
+    if(!asyncComputeEnabled) {
+        printf("The device has no queue beside the graphics queue, async compute is unavailable.\n");
+        return;
+    }
+    struct MeshInstance* instances = malloc(ASYNC_COMPUTE_BENCHMARK_INSTANCES * sizeof(struct MeshInstance));
+    if(!instances) {
+        fprintf(stderr, "Failed to allocate benchmark instances, aborting.");
         exit(EXIT_FAILURE);
     }
-
-    vkBindBufferMemory(device, *buffer, *deviceMemory, 0);
-
+    for(uint32_t i = 0; i < ASYNC_COMPUTE_BENCHMARK_INSTANCES; i++) {
+        struct MeshInstance* instance = &instances[i];
+        uint64_t hash = hashBytes64(&i, sizeof(i));
+        instance->offset[0] = QUAD_VIEW_EXTENT * (4.0f * (hash & 0xffff) / 65535.0f - 2.0f);
+        instance->offset[1] = QUAD_VIEW_EXTENT * (4.0f * ((hash >> 16) & 0xffff) / 65535.0f - 2.0f);
+        instance->scale[0] = 0.01f;
+        instance->scale[1] = 0.01f;
+        instance->color[0] = ((hash >> 32) & 0xff) / 255.0f;
+        instance->color[1] = ((hash >> 40) & 0xff) / 255.0f;
+        instance->color[2] = ((hash >> 48) & 0xff) / 255.0f;
+        instance->depth = ((hash >> 56) & 0xff) / 255.0f;
+    }
+    struct MeshDraw draws[ASYNC_COMPUTE_BENCHMARK_DRAWS];
+    const uint32_t drawInstances = ASYNC_COMPUTE_BENCHMARK_INSTANCES / ASYNC_COMPUTE_BENCHMARK_DRAWS;
+    for(uint32_t i = 0; i < ASYNC_COMPUTE_BENCHMARK_DRAWS; i++) {
+        draws[i].mesh = quadMesh;
+        draws[i].firstInstance = i * drawInstances;
+        draws[i].instanceCount = drawInstances;
+        draws[i].material = MATERIAL_DEFAULT;
+    }
+    setMeshInstances(instances, ASYNC_COMPUTE_BENCHMARK_INSTANCES);
+    setMeshDraws(draws, ASYNC_COMPUTE_BENCHMARK_DRAWS);
+    printf("%10s %10s %12s %10s\n", "Queue", "Instances", "Frame ms", "Speedup");
+    double graphicsMilliseconds = 0.0;
+    for(uint32_t run = 0; run < 2 && !glfwWindowShouldClose(window); run++) {
+        // The graph leaves the cull passes out on the compute queue.
+        asyncCullingEnabled = run == 1;
+        recreateSwapchain();
+        double start = 0.0;
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES + INSTANCE_BENCHMARK_FRAMES; frame++) {
+            if(frame == INSTANCE_BENCHMARK_WARMUP_FRAMES) {
+                vkDeviceWaitIdle(device);
+                start = glfwGetTime();
+            }
+            glfwPollEvents();
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        if(run == 0) {
+            graphicsMilliseconds = frameMilliseconds;
+        }
+        printf("%10s %10u %12.3f %10.2f\n", run == 1 ? "compute" : "graphics", ASYNC_COMPUTE_BENCHMARK_INSTANCES,
+               frameMilliseconds, frameMilliseconds > 0 ? graphicsMilliseconds / frameMilliseconds : 0.0);
+    }
+    free(instances);
 }
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+void primitiveBenchmarkUpload(const struct StorageBuffer* storageBuffer, struct MappedBuffer* staging,
+                              const uint32_t* data, uint32_t count) {
+    memcpy(staging->mapped, data, (size_t)count * sizeof(uint32_t));
+    copyBuffer(staging->buffer, 0, storageBuffer->buffer, 0, (VkDeviceSize)count * sizeof(uint32_t));
+}
 
+// Waits for the compute shader writes to storageBuffer first.
+void primitiveBenchmarkDownload(const struct StorageBuffer* storageBuffer, struct MappedBuffer* staging,
+                                uint32_t* data, uint32_t count) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
     VkBufferCopy copyRegion = {};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-    vkEndCommandBuffer(commandBuffer);
-
+    copyRegion.size = (VkDeviceSize)count * sizeof(uint32_t);
+    vkCmdCopyBuffer(commandBuffer, storageBuffer->buffer, staging->buffer, 1, &copyRegion);
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    endSingleTimeCommands(commandBuffer);
+    memcpy(data, staging->mapped, (size_t)count * sizeof(uint32_t));
+}
 
-    VkSubmitInfo submitInfo  = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, NULL);
-    vkQueueWaitIdle(graphicsQueue);
-    
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+// The first count hashed uints as the primitive's input, with the indices as the sort's values.
+void primitiveBenchmarkUploadInput(struct PrimitiveBenchmark* benchmark, uint32_t primitive, uint32_t count) {
+    if(primitive == PRIMITIVE_SCAN) {
+        // Small enough for the 30 bits of the scan's descriptors.
+        for(uint32_t i = 0; i < count; i++) {
+            benchmark->result[i] = benchmark->data[i] & 0xff;
+        }
+        primitiveBenchmarkUpload(&benchmark->initialKeys, &benchmark->staging, benchmark->result, count);
+    } else {
+        primitiveBenchmarkUpload(&benchmark->initialKeys, &benchmark->staging, benchmark->data, count);
+    }
+    if(primitive == PRIMITIVE_SORT) {
+        primitiveBenchmarkUpload(&benchmark->initialValues, &benchmark->staging, benchmark->indices, count);
+    }
 }
-void createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(vertexData);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, 
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertexData, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+// Copies the uploaded input over whatever the previous run left in input and output, so every
+// run starts from the same unsorted keys.
+void recordPrimitiveInput(VkCommandBuffer commandBuffer, struct PrimitiveBenchmark* benchmark, uint32_t primitive,
+                          uint32_t count) {
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 
+                        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = (VkDeviceSize)count * sizeof(uint32_t);
+    vkCmdCopyBuffer(commandBuffer, benchmark->initialKeys.buffer, benchmark->input.buffer, 1, &copyRegion);
+    if(primitive == PRIMITIVE_SORT) {
+        vkCmdCopyBuffer(commandBuffer, benchmark->initialValues.buffer, benchmark->output.buffer, 1, &copyRegion);
+    }
+    recordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
+void recordPrimitive(VkCommandBuffer commandBuffer, struct PrimitiveBenchmark* benchmark, uint32_t primitive,
+                     uint32_t count) {
+    if(primitive == PRIMITIVE_SCAN) {
+        recordPrefixSum(commandBuffer, &benchmark->input, &benchmark->output, &benchmark->state, count);
+    } else if(primitive == PRIMITIVE_SORT) {
+        recordRadixSort(commandBuffer, &benchmark->input, &benchmark->output, &benchmark->scratchKeys, 
+                        &benchmark->scratchValues, &benchmark->state, count);
+    } else {
+        recordReduce(commandBuffer, &benchmark->input, &benchmark->results, count);
+    }
+}
 
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+// Whether the GPU's results for the first count hashed uints match the processor's, the sort's
+// those of radixSortKeys(), values included.
+bool primitiveAgrees(struct PrimitiveBenchmark* benchmark, uint32_t primitive, uint32_t count) {
+    const uint32_t* data = benchmark->data;
+    uint32_t* result = benchmark->result;
+    bool agrees = true;
+    if(primitive == PRIMITIVE_SCAN) {
+        primitiveBenchmarkDownload(&benchmark->output, &benchmark->staging, result, count);
+        uint32_t sum = 0;
+        for(uint32_t i = 0; i < count && agrees; i++) {
+            agrees = result[i] == sum;
+            sum += data[i] & 0xff;
+        }
+    } else if(primitive == PRIMITIVE_SORT) {
+        primitiveBenchmarkDownload(&benchmark->input, &benchmark->staging, result, count);
+        primitiveBenchmarkDownload(&benchmark->output, &benchmark->staging, benchmark->resultValues, count);
+        for(uint32_t i = 0; i < count; i++) {
+            benchmark->sortKeys[i] = data[i];
+            benchmark->sortValues[i] = i;
+        }
+        radixSortKeys(benchmark->sortKeys, benchmark->sortValues, count, benchmark->sortScratchKeys, 
+                      benchmark->sortScratchValues);
+        for(uint32_t i = 0; i < count && agrees; i++) {
+            agrees = result[i] == benchmark->sortKeys[i] && benchmark->resultValues[i] == benchmark->sortValues[i];
+        }
+    } else {
+        primitiveBenchmarkDownload(&benchmark->results, &benchmark->staging, result, REDUCE_RESULT_COUNT);
+        uint32_t sum = 0, minimum = UINT32_MAX, maximum = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            sum += data[i];
+            minimum = data[i] < minimum ? data[i] : minimum;
+            maximum = data[i] > maximum ? data[i] : maximum;
+        }
+        agrees = result[REDUCE_RESULT_SUM] == sum && result[REDUCE_RESULT_MIN] == minimum && 
+                 result[REDUCE_RESULT_MAX] == maximum;
+    }
+    return agrees;
 }
-void createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(indexData);
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, 
-                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indexData, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+// Runs every primitive once on sizes around its tile, where partial tiles and the look-back
+// between tiles go wrong first, and on many tiles up to an odd count at the benchmark's largest,
+// and checks the results against the processor's.
+void testComputePrimitives(struct PrimitiveBenchmark* benchmark) {
+    const uint32_t tileSizes[PRIMITIVE_COUNT] = {
+        scanLocalSizeX * SCAN_ITEMS_PER_INVOCATION,
+        onesweepLocalSizeX * SORT_ITEMS_PER_INVOCATION,
+        reduceLocalSizeX * REDUCE_ITEMS_PER_INVOCATION
+    };
+    uint32_t testCount = 0;
+    for(uint32_t primitive = 0; primitive < PRIMITIVE_COUNT; primitive++) {
+        // 999983 is prime, so it leaves a partial tile and partial subgroups at every tile size.
+        const uint32_t counts[] = {1, 1023, 1025, tileSizes[primitive] + 1, 100000, 999983, 
+                                   PRIMITIVE_BENCHMARK_MAX_ELEMENTS};
+        for(uint32_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+            primitiveBenchmarkUploadInput(benchmark, primitive, counts[i]);
+            VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+            recordPrimitiveInput(commandBuffer, benchmark, primitive, counts[i]);
+            recordPrimitive(commandBuffer, benchmark, primitive, counts[i]);
+            endSingleTimeCommands(commandBuffer);
+            if(!primitiveAgrees(benchmark, primitive, counts[i])) {
+                fprintf(stderr, "The GPU %s of %u elements disagrees with the processor, aborting.", 
+                        primitiveNames[primitive], counts[i]);
+                exit(EXIT_FAILURE);
+            }
+            testCount++;
+        }
+    }
+    printf("The GPU agrees with the processor on %u scans, sorts and reductions of 1 to %u elements.\n",
+           testCount, PRIMITIVE_BENCHMARK_MAX_ELEMENTS);
+}
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+// Checks the primitives with testComputePrimitives(), then scans, sorts and reduces 10k, 100k
+// and PRIMITIVE_BENCHMARK_MAX_ELEMENTS hashed uints on the GPU, PRIMITIVE_BENCHMARK_RUNS times
+// in one submission each, and prints the average GPU time per run. Each run is timed with a
+// pair of timestamps around the primitive alone, after its input has been copied in.
+void runComputePrimitiveBenchmark() {
+    if(!computePrimitivesEnabled) {
+        printf("The device has no subgroup arithmetic in compute shaders, the primitives are unavailable.\n");
+        return;
+    }
+    const uint32_t maxCount = PRIMITIVE_BENCHMARK_MAX_ELEMENTS;
+    struct PrimitiveBenchmark benchmark = {};
+    benchmark.data = malloc((size_t)maxCount * sizeof(uint32_t));
+    benchmark.indices = malloc((size_t)maxCount * sizeof(uint32_t));
+    benchmark.result = malloc((size_t)maxCount * sizeof(uint32_t));
+    benchmark.resultValues = malloc((size_t)maxCount * sizeof(uint32_t));
+    benchmark.sortKeys = malloc((size_t)maxCount * sizeof(uint64_t));
+    benchmark.sortScratchKeys = malloc((size_t)maxCount * sizeof(uint64_t));
+    benchmark.sortValues = malloc((size_t)maxCount * sizeof(uint32_t));
+    benchmark.sortScratchValues = malloc((size_t)maxCount * sizeof(uint32_t));
+    if(!benchmark.data || !benchmark.indices || !benchmark.result || !benchmark.resultValues || 
+       !benchmark.sortKeys || !benchmark.sortScratchKeys || !benchmark.sortValues || 
+       !benchmark.sortScratchValues) {
+        fprintf(stderr, "Failed to allocate benchmark elements, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t i = 0; i < maxCount; i++) {
+        benchmark.data[i] = (uint32_t)hashBytes64(&i, sizeof(i));
+        benchmark.indices[i] = i;
+    }
+    VkDeviceSize stateSize = prefixSumStateSize(maxCount);
+    if(radixSortStateSize(maxCount) > stateSize) {
+        stateSize = radixSortStateSize(maxCount);
+    }
+    storageBufferCreate(&benchmark.initialKeys, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.initialValues, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.input, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.output, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.scratchKeys, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.scratchValues, (VkDeviceSize)maxCount * sizeof(uint32_t));
+    storageBufferCreate(&benchmark.state, stateSize);
+    storageBufferCreate(&benchmark.results, REDUCE_RESULT_COUNT * sizeof(uint32_t));
+    mappedBufferReserve(&benchmark.staging, (VkDeviceSize)maxCount * sizeof(uint32_t), 
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    testComputePrimitives(&benchmark);
 
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    if(timestampsSupported) {
+        VkQueryPoolCreateInfo queryPoolInfo = {};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = PRIMITIVE_BENCHMARK_RUNS * 2;
+        if(vkCreateQueryPool(device, &queryPoolInfo, NULL, &queryPool) != VK_SUCCESS) {
+            queryPool = VK_NULL_HANDLE;
+        }
+    }
+    if(queryPool == VK_NULL_HANDLE) {
+        printf("Timestamps are not supported, the primitives are checked but not timed.\n");
+    } else {
+        printf("%10s %10s %10s %12s\n", "Elements", "Primitive", "GPU ms", "Melements/s");
+    }
+    for(uint32_t count = 10000; count <= maxCount && queryPool != VK_NULL_HANDLE; count *= 10) {
+        for(uint32_t primitive = 0; primitive < PRIMITIVE_COUNT; primitive++) {
+            primitiveBenchmarkUploadInput(&benchmark, primitive, count);
+            VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+            vkCmdResetQueryPool(commandBuffer, queryPool, 0, PRIMITIVE_BENCHMARK_RUNS * 2);
+            for(uint32_t run = 0; run < PRIMITIVE_BENCHMARK_RUNS; run++) {
+                recordPrimitiveInput(commandBuffer, &benchmark, primitive, count);
+                // At the bottom of the pipe, the first waits for the copies and the second for
+                // the primitive's last dispatch.
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, run * 2);
+                recordPrimitive(commandBuffer, &benchmark, primitive, count);
+                vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, run * 2 + 1);
+            }
+            endSingleTimeCommands(commandBuffer);
+            uint64_t timestamps[PRIMITIVE_BENCHMARK_RUNS * 2];
+            if(vkGetQueryPoolResults(device, queryPool, 0, PRIMITIVE_BENCHMARK_RUNS * 2, sizeof(timestamps), 
+                                     timestamps, sizeof(uint64_t), 
+                                     VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+                fprintf(stderr, "vkGetQueryPoolResults failed, aborting.");
+                exit(EXIT_FAILURE);
+            }
+            uint64_t ticks = 0;
+            for(uint32_t run = 0; run < PRIMITIVE_BENCHMARK_RUNS; run++) {
+                ticks += (timestamps[run * 2 + 1] - timestamps[run * 2]) & timestampMask;
+            }
+            double milliseconds = ticks * timestampPeriod / 1e6 / PRIMITIVE_BENCHMARK_RUNS;
+            printf("%10u %10s %10.3f %12.1f\n", count, primitiveNames[primitive], milliseconds, 
+                   milliseconds > 0 ? count / (milliseconds * 1000.0) : 0.0);
+        }
+    }
+    if(queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(device, queryPool, NULL);
+    }
+    mappedBufferDestroy(&benchmark.staging);
+    storageBufferDestroy(&benchmark.initialKeys);
+    storageBufferDestroy(&benchmark.initialValues);
+    storageBufferDestroy(&benchmark.input);
+    storageBufferDestroy(&benchmark.output);
+    storageBufferDestroy(&benchmark.scratchKeys);
+    storageBufferDestroy(&benchmark.scratchValues);
+    storageBufferDestroy(&benchmark.state);
+    storageBufferDestroy(&benchmark.results);
+    free(benchmark.data);
+    free(benchmark.indices);
+    free(benchmark.result);
+    free(benchmark.resultValues);
+    free(benchmark.sortKeys);
+    free(benchmark.sortScratchKeys);
+    free(benchmark.sortValues);
+    free(benchmark.sortScratchValues);
 }
-uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-    for(uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if(typeFilter & (1 << i) && 
-            (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+
+// Draws TEXTURE_BENCHMARK_MATERIALS quads with a TEXTURE_BENCHMARK_SIZE texture each, first
+// with all of them resident, then replacing TEXTURE_BENCHMARK_STREAMED_PER_FRAME of them every
+// frame, and prints the frame times, the texels uploaded per second and the texture memory.
+void runTextureBenchmark() {
+    const size_t textureSize = (size_t)TEXTURE_BENCHMARK_SIZE * TEXTURE_BENCHMARK_SIZE * TEXTURE_TEXEL_SIZE;
+    uint8_t* pixels = malloc(TEXTURE_BENCHMARK_MATERIALS * textureSize);
+    struct MeshInstance instances[TEXTURE_BENCHMARK_MATERIALS];
+    struct MeshDraw draws[TEXTURE_BENCHMARK_MATERIALS];
+    uint32_t benchmarkTextures[TEXTURE_BENCHMARK_MATERIALS];
+    if(!pixels) {
+        fprintf(stderr, "Failed to allocate benchmark texels, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    if(!textureMipsSupported) {
+        printf("Textures are blitted without linear filtering, they keep their first level only.\n");
+    }
+    uint32_t columns = (uint32_t)ceil(sqrt((double)TEXTURE_BENCHMARK_MATERIALS));
+    float cell = 2.0f * QUAD_VIEW_EXTENT / columns;
+    const float white[3] = {1.0f, 1.0f, 1.0f};
+    uint32_t firstMaterial = materialCount;
+    for(uint32_t i = 0; i < TEXTURE_BENCHMARK_MATERIALS; i++) {
+        // A checkerboard of white and a color of its own.
+        uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+        uint8_t* texels = pixels + i * textureSize;
+        for(uint32_t y = 0; y < TEXTURE_BENCHMARK_SIZE; y++) {
+            for(uint32_t x = 0; x < TEXTURE_BENCHMARK_SIZE; x++) {
+                uint8_t* texel = texels + ((size_t)y * TEXTURE_BENCHMARK_SIZE + x) * TEXTURE_TEXEL_SIZE;
+                bool colored = ((x / 16) + (y / 16)) % 2 == 1;
+                texel[0] = colored ? hash & 0xff : 0xff;
+                texel[1] = colored ? (hash >> 8) & 0xff : 0xff;
+                texel[2] = colored ? (hash >> 16) & 0xff : 0xff;
+                texel[3] = 0xff;
+            }
         }
+        benchmarkTextures[i] = textureCreate(texels, TEXTURE_BENCHMARK_SIZE, TEXTURE_BENCHMARK_SIZE);
+        if(benchmarkTextures[i] == TEXTURE_INVALID) {
+            fprintf(stderr, "Failed to create benchmark texture %u, aborting.", i);
+            exit(EXIT_FAILURE);
+        }
+        struct MeshInstance* instance = &instances[i];
+        instance->offset[0] = -QUAD_VIEW_EXTENT + (i % columns + 0.5f) * cell;
+        instance->offset[1] = -QUAD_VIEW_EXTENT + (i / columns + 0.5f) * cell;
+        instance->scale[0] = cell * 0.8f;
+        instance->scale[1] = cell * 0.8f;
+        instance->color[0] = 1.0f;
+        instance->color[1] = 1.0f;
+        instance->color[2] = 1.0f;
+        instance->depth = 0.5f;
+        draws[i].mesh = quadMesh;
+        draws[i].firstInstance = i;
+        draws[i].instanceCount = 1;
+        draws[i].material = createMaterial(DRAW_PIPELINE_OPAQUE, white, benchmarkTextures[i]);
     }
-    fprintf(stderr, "Failed to find suitable memory!");
-    return -1;
+    setMeshInstances(instances, TEXTURE_BENCHMARK_MATERIALS);
+    setMeshDraws(draws, TEXTURE_BENCHMARK_MATERIALS);
+    printf("%10s %10s %12s %12s %12s\n", "Textures", "Streamed", "Frame ms", "Upload MB/s", "Texture MB");
+    uint32_t next = 0;
+    for(uint32_t run = 0; run < 2 && !glfwWindowShouldClose(window); run++) {
+        uint32_t streamed = run == 1 ? TEXTURE_BENCHMARK_STREAMED_PER_FRAME : 0;
+        double start = 0.0;
+        uint64_t startUploadBytes = 0;
+        for(uint32_t frame = 0; frame < INSTANCE_BENCHMARK_WARMUP_FRAMES + INSTANCE_BENCHMARK_FRAMES; frame++) {
+            if(frame == INSTANCE_BENCHMARK_WARMUP_FRAMES) {
+                vkDeviceWaitIdle(device);
+                start = glfwGetTime();
+                startUploadBytes = textureUploadBytes;
+            }
+            for(uint32_t i = 0; i < streamed; i++) {
+                uint32_t slot = next++ % TEXTURE_BENCHMARK_MATERIALS;
+                textureDestroy(benchmarkTextures[slot]);
+                benchmarkTextures[slot] = textureCreate(pixels + slot * textureSize, TEXTURE_BENCHMARK_SIZE, 
+                                                        TEXTURE_BENCHMARK_SIZE);
+                if(benchmarkTextures[slot] == TEXTURE_INVALID) {
+                    fprintf(stderr, "Failed to stream benchmark texture %u, aborting.", slot);
+                    exit(EXIT_FAILURE);
+                }
+                setMaterialTexture(firstMaterial + slot, benchmarkTextures[slot]);
+            }
+            glfwPollEvents();
+            drawFrame();
+        }
+        vkDeviceWaitIdle(device);
+        double seconds = glfwGetTime() - start;
+        double frameMilliseconds = seconds * 1000.0 / INSTANCE_BENCHMARK_FRAMES;
+        printf("%10u %10u %12.3f %12.1f %12.1f\n", textureCount, streamed, frameMilliseconds, 
+               seconds > 0 ? (textureUploadBytes - startUploadBytes) / 1e6 / seconds : 0.0, 
+               textureMemoryBytes / 1e6);
+    }
+    for(uint32_t i = 0; i < TEXTURE_BENCHMARK_MATERIALS; i++) {
+        textureDestroy(benchmarkTextures[i]);
+    }
+    free(pixels);
 }
-void createCommandBuffers() {
 
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
-    if(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers) != VK_SUCCESS) {
-        fprintf(stderr, "vkAllocateCommandBuffers failed, aborting");
-        EXIT_FAILURE; 
+// Culls 10k, 100k and CULL_BENCHMARK_MAX_OBJECTS boxes scattered over twice the view with
+// every kernel the processor supports, best of CULL_BENCHMARK_RUNS each. All kernels must
+// agree with the scalar one.
+void runCullingBenchmark() {
+    struct CullBounds bounds = {};
+    uint32_t* scalarVisible = malloc(((size_t)CULL_BENCHMARK_MAX_OBJECTS + CULL_BATCH) * sizeof(uint32_t));
+    uint32_t* visible = malloc(((size_t)CULL_BENCHMARK_MAX_OBJECTS + CULL_BATCH) * sizeof(uint32_t));
+    if(!scalarVisible || !visible || !cullBoundsReserve(&bounds, CULL_BENCHMARK_MAX_OBJECTS)) {
+        fprintf(stderr, "Failed to allocate benchmark bounds, aborting.");
+        exit(EXIT_FAILURE);
     }
+    for(uint32_t i = 0; i < CULL_BENCHMARK_MAX_OBJECTS; i++) {
+        uint64_t hash = hashBytes64(&i, sizeof(i));
+        bounds.centerX[i] = QUAD_VIEW_EXTENT * (4.0f * (hash & 0xffff) / 65535.0f - 2.0f);
+        bounds.centerY[i] = QUAD_VIEW_EXTENT * (4.0f * ((hash >> 16) & 0xffff) / 65535.0f - 2.0f);
+        bounds.extentX[i] = 0.01f * ((hash >> 32) & 0xff) / 255.0f;
+        bounds.extentY[i] = 0.01f * ((hash >> 40) & 0xff) / 255.0f;
+    }
+    bounds.count = CULL_BENCHMARK_MAX_OBJECTS;
+    printf("%10s %8s %10s %10s %12s %10s\n", "Objects", "Kernel", "Visible", "Cull ms", 
+           "Mobjects/s", "Speedup");
+    for(uint32_t count = 10000; count <= CULL_BENCHMARK_MAX_OBJECTS; count *= 10) {
+        double scalarMilliseconds = 0.0;
+        uint32_t scalarVisibleCount = 0;
+        for(uint32_t kernel = 0; kernel < CULL_KERNEL_COUNT; kernel++) {
+            if(!cullKernelSupported(kernel)) {
+                continue;
+            }
+            uint32_t* output = kernel == CULL_KERNEL_SCALAR ? scalarVisible : visible;
+            uint32_t visibleCount = 0;
+            double bestMilliseconds = 0.0;
+            for(uint32_t run = 0; run < CULL_BENCHMARK_RUNS; run++) {
+                double start = glfwGetTime();
+                visibleCount = cullBoxes(kernel, &bounds, 0, count, viewPlanes, viewPlaneCount, output);
+                double milliseconds = (glfwGetTime() - start) * 1000.0;
+                if(run == 0 || milliseconds < bestMilliseconds) {
+                    bestMilliseconds = milliseconds;
+                }
+            }
+            if(kernel == CULL_KERNEL_SCALAR) {
+                scalarMilliseconds = bestMilliseconds;
+                scalarVisibleCount = visibleCount;
+            } else if(visibleCount != scalarVisibleCount || 
+                      memcmp(visible, scalarVisible, visibleCount * sizeof(uint32_t)) != 0) {
+                fprintf(stderr, "The %s kernel disagrees with the scalar one, aborting.", 
+                        cullKernelNames[kernel]);
+                exit(EXIT_FAILURE);
+            }
+            printf("%10u %8s %10u %10.3f %12.1f %10.2f\n", count, cullKernelNames[kernel], visibleCount,
+                   bestMilliseconds, bestMilliseconds > 0 ? count / bestMilliseconds / 1000.0 : 0.0,
+                   bestMilliseconds > 0 ? scalarMilliseconds / bestMilliseconds : 0.0);
+        }
+    }
+    cullBoundsFree(&bounds);
+    free(scalarVisible);
+    free(visible);
 }
 
-void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = 0;
-    beginInfo.pInheritanceInfo = NULL;
+struct JobBenchmark {
+    struct CullBounds bounds;
+    uint32_t* visible;
+    atomic_uint visibleCount;
+};
 
-    if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-        fprintf(stderr, "vkBeginComandBuffer failed, aborting");
-        EXIT_FAILURE;
-    }
+// PACK_JOB_INSTANCES boxes per index, culled into their own part of visible.
+void jobBenchmarkCullTask(void* context, uint32_t index) {
+    struct JobBenchmark* benchmark = context;
+    uint32_t first = index * PACK_JOB_INSTANCES;
+    uint32_t count = benchmark->bounds.count - first < PACK_JOB_INSTANCES ? 
+                     benchmark->bounds.count - first : PACK_JOB_INSTANCES;
+    uint32_t visibleCount = cullBoxes(cpuCullKernel, &benchmark->bounds, first, count, viewPlanes, viewPlaneCount,
+                                      benchmark->visible + (size_t)index * (PACK_JOB_INSTANCES + CULL_BATCH));
+    atomic_fetch_add(&benchmark->visibleCount, visibleCount);
+}
 
-         VkRenderPassBeginInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapchainFramebuffers[imageIndex];
-    VkOffset2D offset = {0, 0};
-    renderPassInfo.renderArea.offset = offset;
-    renderPassInfo.renderArea.extent = swapchainExtent;
+void jobBenchmarkEmptyTask(void* context, uint32_t index) {
+}
 
-    VkClearValue clearColor = {};
-    VkClearColorValue color= {0.0, 0.0, 0.0, 1.0};
-    clearColor.color = color;
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+// Culls CULL_BENCHMARK_MAX_OBJECTS boxes in jobs of PACK_JOB_INSTANCES with 1, 2, 4 and up to
+// as many workers as --threads asked for, best of JOB_BENCHMARK_RUNS each, and runs
+// JOB_BENCHMARK_EMPTY_JOBS empty jobs to show what scheduling one costs.
+void runJobBenchmark() {
+    struct JobBenchmark benchmark = {};
+    uint32_t jobCount = (CULL_BENCHMARK_MAX_OBJECTS + PACK_JOB_INSTANCES - 1) / PACK_JOB_INSTANCES;
+    benchmark.visible = malloc((size_t)jobCount * (PACK_JOB_INSTANCES + CULL_BATCH) * sizeof(uint32_t));
+    if(!benchmark.visible || !cullBoundsReserve(&benchmark.bounds, CULL_BENCHMARK_MAX_OBJECTS)) {
+        fprintf(stderr, "Failed to allocate benchmark bounds, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t i = 0; i < CULL_BENCHMARK_MAX_OBJECTS; i++) {
+        uint64_t hash = hashBytes64(&i, sizeof(i));
+        benchmark.bounds.centerX[i] = QUAD_VIEW_EXTENT * (4.0f * (hash & 0xffff) / 65535.0f - 2.0f);
+        benchmark.bounds.centerY[i] = QUAD_VIEW_EXTENT * (4.0f * ((hash >> 16) & 0xffff) / 65535.0f - 2.0f);
+        benchmark.bounds.extentX[i] = 0.01f * ((hash >> 32) & 0xff) / 255.0f;
+        benchmark.bounds.extentY[i] = 0.01f * ((hash >> 40) & 0xff) / 255.0f;
+    }
+    benchmark.bounds.count = CULL_BENCHMARK_MAX_OBJECTS;
+    for(uint32_t kernel = 0; kernel < CULL_KERNEL_COUNT; kernel++) {
+        if(cullKernelSupported(kernel)) {
+            cpuCullKernel = kernel;
+        }
+    }
+    printf("%8s %10s %10s %10s %12s %10s\n", "Threads", "Visible", "Cull ms", "Speedup", "Empty ns", 
+           "Steals");
+    uint32_t maxThreads = jobSystem.workerCount;
+    double singleMilliseconds = 0.0;
+    for(uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+        jobSystemDestroy(&jobSystem);
+        jobSystemCreate(&jobSystem, threads);
+        double bestMilliseconds = 0.0;
+        double bestEmpty = 0.0;
+        for(uint32_t run = 0; run < JOB_BENCHMARK_RUNS; run++) {
+            atomic_store(&benchmark.visibleCount, 0);
+            double start = glfwGetTime();
+            jobRunAndWait(&jobSystem, jobBenchmarkCullTask, &benchmark, jobCount);
+            double milliseconds = (glfwGetTime() - start) * 1000.0;
+            if(run == 0 || milliseconds < bestMilliseconds) {
+                bestMilliseconds = milliseconds;
+            }
+            start = glfwGetTime();
+            jobRunAndWait(&jobSystem, jobBenchmarkEmptyTask, NULL, JOB_BENCHMARK_EMPTY_JOBS);
+            double empty = (glfwGetTime() - start) * 1e9 / JOB_BENCHMARK_EMPTY_JOBS;
+            if(run == 0 || empty < bestEmpty) {
+                bestEmpty = empty;
+            }
+        }
+        if(threads == 1) {
+            singleMilliseconds = bestMilliseconds;
+        }
+        printf("%8u %10u %10.3f %10.2f %12.1f %10u\n", threads, atomic_load(&benchmark.visibleCount), 
+               bestMilliseconds, bestMilliseconds > 0 ? singleMilliseconds / bestMilliseconds : 0.0, bestEmpty,
+               atomic_load(&jobSystem.steals) / JOB_BENCHMARK_RUNS);
+        // The largest count last, even if it is no power of two.
+        if(threads < maxThreads && threads * 2 > maxThreads) {
+            threads = maxThreads / 2;
+        }
+    }
+    cullBoundsFree(&benchmark.bounds);
+    free(benchmark.visible);
+}
+// The index pattern is added to the geometry pool as a mesh of its own. Its first quad indexes
+// the quad's vertices, the rest index whatever vertices follow in the bound vertex buffer.
+void createSpriteBatcher() {
+    uint32_t* indices = malloc((size_t)SPRITE_MAX_QUADS * 6 * sizeof(uint32_t));
+    if(!indices) {
+        fprintf(stderr, "Failed to allocate the sprite index pattern, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    for(uint32_t quad = 0; quad < SPRITE_MAX_QUADS; quad++) {
+        for(uint32_t i = 0; i < 6; i++) {
+            indices[quad * 6 + i] = quad * 4 + indexData[i];
+        }
+    }
+    spriteBatcher.indexMesh = geometryPoolAddMesh(quadVertices, 4, indices, SPRITE_MAX_QUADS * 6);
+    free(indices);
+    if(spriteBatcher.indexMesh == MESH_INVALID) {
+        fprintf(stderr, "Failed to add the sprite index pattern to the geometry pool, aborting.");
+        exit(EXIT_FAILURE);
+    }
+    VkDeviceSize frameSize = (VkDeviceSize)SPRITE_MAX_QUADS * 4 * vertexFormat.stride;
+    mappedBufferReserve(&spriteBatcher.ring, SPRITE_RING_FRAMES_OFFSET + frameSize * MAX_FRAMES_IN_FLIGHT,
+                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    const struct MeshInstance identity = {{0.0f, 0.0f}, {1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, 0.0f};
+    memcpy(spriteBatcher.ring.mapped, &identity, sizeof(identity));
+}
 
+// Waits until the current frame's sprites are no longer read, pushQuad() calls it first.
+void beginSprites() {
+    if(spriteBatcher.begun) {
+        return;
+    }
+    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    spriteBatcher.begun = true;
+    spriteBatcher.vertices = (uint8_t*)spriteBatcher.ring.mapped + SPRITE_RING_FRAMES_OFFSET +
+                             (size_t)currentFrame * SPRITE_MAX_QUADS * 4 * vertexFormat.stride;
+    spriteBatcher.quadCount = 0;
+    spriteBatcher.droppedQuads = 0;
+    spriteBatcher.batchCount = 0;
+}
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-    VkBuffer vertexBuffers[] = {vertexBuffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets); 
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
-    VkViewport viewport={};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float)(swapchainExtent.width);
-    viewport.height = (float)(swapchainExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+// In framebuffer pixels, NULL for none. Lasts until changed, across frames.
+void setSpriteScissor(const VkRect2D* scissor) {
+    spriteBatcher.scissored = scissor != NULL;
+    if(scissor) {
+        spriteBatcher.scissor = *scissor;
+    }
+}
 
-    VkRect2D scissor={};
+// rect is x, y, width and height in the units of instance offsets, so [-QUAD_VIEW_EXTENT,
+// QUAD_VIEW_EXTENT] is on screen. Sprites are drawn in the order they were pushed.
+void pushQuad(const float rect[4], const float color[3]) {
+    beginSprites();
+    if(spriteBatcher.quadCount == SPRITE_MAX_QUADS) {
+        spriteBatcher.droppedQuads++;
+        return;
+    }
+    struct SpriteBatch* batch = spriteBatcher.batchCount > 0 ? 
+                                &spriteBatcher.batches[spriteBatcher.batchCount - 1] : NULL;
+    bool sameState = batch && batch->scissored == spriteBatcher.scissored &&
+                     (!batch->scissored || memcmp(&batch->scissor, &spriteBatcher.scissor, sizeof(VkRect2D)) == 0);
+    if(!sameState) {
+        if(spriteBatcher.batchCount == SPRITE_MAX_BATCHES) {
+            spriteBatcher.droppedQuads++;
+            return;
+        }
+        batch = &spriteBatcher.batches[spriteBatcher.batchCount++];
+        batch->firstQuad = spriteBatcher.quadCount;
+        batch->quadCount = 0;
+        batch->scissored = spriteBatcher.scissored;
+        batch->scissor = spriteBatcher.scissor;
+    }
+    // Same corners and winding as quadVertices.
+    struct MeshVertex vertices[4];
+    for(uint32_t i = 0; i < 4; i++) {
+        vertices[i].position[0] = rect[0] + (quadVertices[i].position[0] + 0.5f) * rect[2];
+        vertices[i].position[1] = rect[1] + (quadVertices[i].position[1] + 0.5f) * rect[3];
+        memcpy(vertices[i].color, color, sizeof(vertices[i].color));
+        memcpy(vertices[i].normal, quadVertices[i].normal, sizeof(vertices[i].normal));
+    }
+    vertexFormatPack(&vertexFormat, vertices, 4, 
+                     spriteBatcher.vertices + (size_t)spriteBatcher.quadCount * 4 * vertexFormat.stride);
+    spriteBatcher.quadCount++;
+    batch->quadCount++;
+}
 
-    scissor.offset = offset;
-    scissor.extent = swapchainExtent;
-    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-    vkCmdDrawIndexed(commandBuffer, sizeof(indexData)/(sizeof(uint16_t)), 1, 0, 0, 0);
-    
-    vkCmdEndRenderPass(commandBuffer);
-    if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        fprintf(stderr, "vkEndCommandBuffer() failed, aborting");
-        EXIT_FAILURE;
+// One draw per batch, all with the default material. Sprites pushed for a frame are drawn
+// only by that frame.
+void recordSpriteBatches(VkCommandBuffer commandBuffer, struct DrawState* state) {
+    if(!spriteBatcher.begun || spriteBatcher.quadCount == 0) {
+        return;
+    }
+    bindDrawState(commandBuffer, state, MATERIAL_DEFAULT, spriteBatcher.batchCount);
+    VkBuffer vertexBuffers[VERTEX_BINDING_COUNT];
+    vertexBuffers[VERTEX_BINDING] = spriteBatcher.ring.buffer;
+    vertexBuffers[INSTANCE_BINDING] = spriteBatcher.ring.buffer;
+    VkDeviceSize offsets[VERTEX_BINDING_COUNT];
+    offsets[VERTEX_BINDING] = spriteBatcher.vertices - (uint8_t*)spriteBatcher.ring.mapped;
+    offsets[INSTANCE_BINDING] = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, VERTEX_BINDING_COUNT, vertexBuffers, offsets);
+    const struct PoolMesh* indexMesh = &geometryPool.meshes[spriteBatcher.indexMesh];
+    for(uint32_t i = 0; i < spriteBatcher.batchCount; i++) {
+        const struct SpriteBatch* batch = &spriteBatcher.batches[i];
+        VkRect2D scissor = {{0, 0}, swapchainExtent};
+        if(batch->scissored) {
+            scissor = batch->scissor;
+        }
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdDrawIndexed(commandBuffer, batch->quadCount * 6, 1, indexMesh->firstIndex,
+                         (int32_t)(batch->firstQuad * 4), 0);
     }
 }
-void createSyncObjects() {
-    VkSemaphoreCreateInfo semaphoreInfo = {};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    for(int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
 
-        if(vkCreateSemaphore(device, &semaphoreInfo, NULL, &imageAvailableSemaphores[i]) 
-            != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinishedSemaphores[i]) 
-            != VK_SUCCESS ||
-            vkCreateFence(device, &fenceInfo, NULL, &inFlightFences[i]) != VK_SUCCESS) {
+void cleanupSpriteBatcher() {
+    mappedBufferDestroy(&spriteBatcher.ring);
+    memset(&spriteBatcher, 0, sizeof(spriteBatcher));
+}
 
-            fprintf(stderr, "vkCreateSempaphore or vkCreateFence failed, aborting.");
-            EXIT_FAILURE; 
+// Pushes 1000, 10000 and SPRITE_BENCHMARK_MAX_SPRITES moving sprites every frame, split across
+// the four quarters of the framebuffer by scissor, and prints how long pushing them takes.
+void runSpriteBenchmark() {
+    printf("%10s %10s %10s %12s %12s\n", "Sprites", "Batches", "Dropped", "Push ms", "Frame ms");
+    const uint32_t counts[] = {1000, 10000, SPRITE_BENCHMARK_MAX_SPRITES};
+    for(uint32_t run = 0; run < sizeof(counts) / sizeof(counts[0]) && !glfwWindowShouldClose(window); run++) {
+        uint32_t count = counts[run];
+        double pushMilliseconds = 0.0;
+        double start = 0.0;
+        for(uint32_t frame = 0; frame < SPRITE_BENCHMARK_WARMUP_FRAMES + SPRITE_BENCHMARK_FRAMES; frame++) {
+            if(frame == SPRITE_BENCHMARK_WARMUP_FRAMES) {
+                vkDeviceWaitIdle(device);
+                pushMilliseconds = 0.0;
+                start = glfwGetTime();
+            }
+            glfwPollEvents();
+            double pushStart = glfwGetTime();
+            beginSprites();
+            float time = (float)frame / SPRITE_BENCHMARK_FRAMES;
+            for(uint32_t quarter = 0; quarter < 4; quarter++) {
+                VkRect2D scissor;
+                scissor.offset.x = (int32_t)(quarter % 2 * swapchainExtent.width / 2);
+                scissor.offset.y = (int32_t)(quarter / 2 * swapchainExtent.height / 2);
+                scissor.extent.width = swapchainExtent.width / 2;
+                scissor.extent.height = swapchainExtent.height / 2;
+                setSpriteScissor(&scissor);
+                for(uint32_t i = quarter; i < count; i += 4) {
+                    uint32_t hash = (uint32_t)hashBytes64(&i, sizeof(i));
+                    float x = (hash & 0xffff) / 65535.0f + time;
+                    float y = ((hash >> 16) & 0xffff) / 65535.0f;
+                    const float rect[4] = {
+                        QUAD_VIEW_EXTENT * (2.0f * (x - floorf(x)) - 1.0f),
+                        QUAD_VIEW_EXTENT * (2.0f * y - 1.0f), 0.01f, 0.01f
+                    };
+                    const float color[3] = {x - floorf(x), y, 1.0f - y};
+                    pushQuad(rect, color);
+                }
+            }
+            setSpriteScissor(NULL);
+            pushMilliseconds += (glfwGetTime() - pushStart) * 1000.0;
+            drawFrame();
         }
+        vkDeviceWaitIdle(device);
+        double frameMilliseconds = (glfwGetTime() - start) * 1000.0 / SPRITE_BENCHMARK_FRAMES;
+        printf("%10u %10u %10u %12.3f %12.3f\n", count, spriteBatcher.batchCount, 
+               spriteBatcher.droppedQuads, pushMilliseconds / SPRITE_BENCHMARK_FRAMES, frameMilliseconds);
     }
 }
 void recreateSwapchain() {
@@ -1146,6 +6338,7 @@ void recreateSwapchain() {
     cleanupSwapchain();
     createSwapchain();
     createImageViews();
+    createRenderGraph();
     createFramebuffers();
 }
 
@@ -1159,6 +6352,7 @@ void cleanupSwapchain() {
     }
     free(swapchainImageViews);
     free(swapchainImages);
+    cleanupRenderGraph();
     vkDestroySwapchainKHR(device, swapchain, NULL);
 
 }
@@ -1181,6 +6375,9 @@ void mainLoop() {
         int iy = y * (float)height/2 + (float)height/2 - (float)winHeight/2;
         glfwSetWindowPos(window, ix, iy);
         glfwPollEvents();
+#ifdef SHADER_HOT_RELOAD
+        reloadChangedShaders();
+#endif
         drawFrame();
     }
     vkDeviceWaitIdle(device);
@@ -1202,14 +6399,50 @@ void drawFrame() {
         EXIT_FAILURE;
     }
     vkResetFences(device, 1, &inFlightFences[currentFrame]);
+    bindlessRecycleHandles();
+    geometryPoolRecycle();
+    textureRecycle();
+    readFrameQueries(currentFrame);
+    double uploadStart = glfwGetTime();
+    uploadFrameDraws(currentFrame);
+    uploadFrameTextures(currentFrame);
+    uploadMilliseconds += (glfwGetTime() - uploadStart) * 1000.0;
+#ifdef SHADER_HOT_RELOAD
+    destroyRetiredPipelines(false);
+#endif
 
     vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+    double recordStart = glfwGetTime();
+    if(asyncCullingEnabled) {
+        vkResetCommandBuffer(computeCommandBuffers[currentFrame], 0);
+        recordAsyncCull(computeCommandBuffers[currentFrame]);
+    }
     recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    recordMilliseconds += (glfwGetTime() - recordStart) * 1000.0;
+    spriteBatcher.begun = false;
+    // The instances the command buffer draws have to be in place before it is submitted.
+    jobWait(&jobSystem, &packCopies);
+    VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], computeFinishedSemaphores[currentFrame]};
+    VkPipelineStageFlags waitStages[] = {
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+    };
+    // Submitted first, the graphics submission waits on its signal.
+    if(asyncCullingEnabled) {
+        VkSubmitInfo computeSubmitInfo = {};
+        computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        computeSubmitInfo.commandBufferCount = 1;
+        computeSubmitInfo.pCommandBuffers = &computeCommandBuffers[currentFrame];
+        computeSubmitInfo.signalSemaphoreCount = 1;
+        computeSubmitInfo.pSignalSemaphores = &computeFinishedSemaphores[currentFrame];
+        if(vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            fprintf(stderr, "vkQueueSubmit failed for the compute queue, aborting.");
+            exit(EXIT_FAILURE);
+        }
+    }
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
+    submitInfo.waitSemaphoreCount = asyncCullingEnabled ? 2 : 1;
+    submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
@@ -1238,24 +6471,59 @@ void drawFrame() {
         EXIT_FAILURE;
     }
     currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    frameNumber++;
 
 }
 
 void cleanup() {
     cleanupSwapchain();
-    vkDestroyBuffer(device, vertexBuffer, NULL);
-    vkFreeMemory(device, vertexBufferMemory, NULL);
-    vkDestroyBuffer(device, indexBuffer, NULL);
-    vkFreeMemory(device, indexBufferMemory, NULL);
+    cleanupGeometryPool();
+    cleanupSpriteBatcher();
+    cleanupTextures();
+    cleanupFrameDraws();
+    if(timestampsSupported) {
+        vkDestroyQueryPool(device, timestampQueryPool, NULL);
+    }
+    if(statisticsSupported) {
+        vkDestroyQueryPool(device, statisticsQueryPool, NULL);
+    }
     for(int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(device, imageAvailableSemaphores[i], NULL);
         vkDestroySemaphore(device, renderFinishedSemaphores[i], NULL);
         vkDestroyFence(device, inFlightFences[i], NULL);
     }
+    cleanupRecordPools();
+    cleanupComputeCommands();
     vkDestroyCommandPool(device, commandPool, NULL);
+#ifdef SHADER_HOT_RELOAD
+    cleanupShaderHotReload();
+#endif
     vkDestroyPipeline(device, graphicsPipeline, NULL);
+    for(uint32_t i = 0; i < GRAPHICS_SHADER_COUNT; i++) {
+        releaseShaderModule(graphicsShaders[i]);
+    }
+    if(gpuCullingEnabled) {
+        vkDestroyPipeline(device, cullPipeline, NULL);
+        releaseShaderModule(cullShader);
+    }
+    if(occlusionCullingEnabled) {
+        vkDestroyPipeline(device, hizPipeline, NULL);
+        releaseShaderModule(hizShader);
+        vkDestroySampler(device, depthSampler, NULL);
+    }
+    cleanupComputePrimitives();
+    saveShaderModuleCache();
+    cleanupShaderModuleCache();
     vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+    cleanupBindlessDescriptors();
+#ifdef SHADER_BUNDLE
+    shaderBundleClose(&shaderBundle);
+    spirvArenaFree(&shaderDecodeArena);
+#endif
     vkDestroyRenderPass(device, renderPass, NULL);
+    if(occlusionCullingEnabled) {
+        vkDestroyRenderPass(device, lateRenderPass, NULL);
+    }
     if(validationLayersEnabled) {
         DestroyDebugUtilsMessengerEXT(instance, debugMessenger, NULL);
     }